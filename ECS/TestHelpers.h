@@ -4,6 +4,7 @@
 #include <concepts>
 #include <unordered_map>
 #include <queue>
+#include <deque>
 #include <memory>
 #include <vector>
 #include <cassert>
@@ -11,6 +12,14 @@
 #include "include/ecs.h"
 #include <chrono>
 #include <iostream>
+#include <thread>
+#include <numeric>
+#include <mutex>
+#include <execution>
+#include <ranges>
+#include <sstream>
+#include <fstream>
+#include <filesystem>
 
 struct vec3
 {
@@ -85,6 +94,100 @@ struct B
     }
 };
 
+// B owns heap memory, it is saved in snapshots through its serializer
+template<>
+struct ecs::ComponentSerializer<B>
+{
+    static void Write(ecs::SnapshotWriter& writer, const B& component) { writer.WriteString(component.s); }
+    static void Read(ecs::SnapshotReader& reader, B& component) { component.s = reader.ReadString(); }
+};
+
+// part of a Particle used every frame
+struct ParticleMotion
+{
+    vec3 Position = { 0, 0, 0 };
+    vec3 Velocity = { 0, 0, 0 };
+
+    bool operator==(const ParticleMotion& other) const
+    {
+        return Position == other.Position && Velocity == other.Velocity;
+    }
+};
+
+// part of a Particle that is rarely read
+struct ParticleLook
+{
+    vec3 Color = { 1, 1, 1 };
+    float Lifetime = 0;
+    uint32_t Emitter = 0;
+    char Texture[64] = {};
+
+    bool operator==(const ParticleLook& other) const
+    {
+        return Color == other.Color && Lifetime == other.Lifetime && Emitter == other.Emitter;
+    }
+};
+
+// stored as two columns, see the HotColdSplit specialization below
+struct Particle
+{
+    ParticleMotion Motion;
+    ParticleLook Look;
+};
+
+// same data as Particle, stored whole
+struct UnsplitParticle
+{
+    ParticleMotion Motion;
+    ParticleLook Look;
+};
+
+template<>
+struct ecs::HotColdSplit<Particle>
+{
+    using Hot = ParticleMotion;
+    using Cold = ParticleLook;
+    static Hot GetHot(const Particle& particle) { return particle.Motion; }
+    static Cold GetCold(const Particle& particle) { return particle.Look; }
+    static Particle Join(const Hot& hot, const Cold& cold) { return Particle{ hot, cold }; }
+};
+
+struct Position
+{
+    vec3 Value = { 0, 0, 0 };
+};
+
+struct Velocity
+{
+    vec3 Value = { 0, 0, 0 };
+};
+
+// stored in blocks of 8 lanes, see the LaneLayout specialization below
+struct Boid
+{
+    vec3 Position = { 0, 0, 0 };
+    vec3 Velocity = { 0, 0, 0 };
+
+    bool operator==(const Boid& other) const
+    {
+        return Position == other.Position && Velocity == other.Velocity;
+    }
+};
+
+// same data as Boid, stored whole
+struct UnlanedBoid
+{
+    vec3 Position = { 0, 0, 0 };
+    vec3 Velocity = { 0, 0, 0 };
+};
+
+template<>
+struct ecs::LaneLayout<Boid>
+{
+    using Scalar = float;
+    static constexpr uint32_t Lanes = 8;
+};
+
 struct ComplexStruct
 {
     int num = 0;
@@ -142,6 +245,92 @@ struct ComplexStruct
     }
 };
 
+// a family of distinct component types to build many signatures
+template<uint32_t N>
+struct Tag
+{
+    uint32_t Value = N;
+};
+
+template<uint32_t... Ns>
+void RegisterTags(std::integer_sequence<uint32_t, Ns...>)
+{
+    ecs::EntityRegistry::RegisterComponentTypes<Tag<Ns>...>();
+}
+
+// adds Tag<N> to the entity for every bit N set in the mask
+template<uint32_t... Ns>
+void AddTags(ecs::EntityRegistry& registry, ecs::EntityID entity, uint32_t mask, std::integer_sequence<uint32_t, Ns...>)
+{
+    ((mask & (1u << Ns) ? registry.TryAddComponent(entity, Tag<Ns>{}) : false), ...);
+}
+
+// keeps track of how many instances are alive to check containers construct and destroy them correctly
+struct CountedObject
+{
+    static inline int Alive = 0;
+    int Value = 0;
+
+    CountedObject(int value) : Value(value) { ++Alive; }
+    CountedObject(const CountedObject& other) : Value(other.Value) { ++Alive; }
+    CountedObject(CountedObject&& other) noexcept : Value(other.Value) { ++Alive; }
+    ~CountedObject() { --Alive; }
+    CountedObject& operator=(const CountedObject&) = default;
+    CountedObject& operator=(CountedObject&&) = default;
+
+    static void Reset() { Alive = 0; }
+};
+
+// copies throw once CopiesBeforeThrow reaches 0 and the move constructor isn't noexcept, to check the rollback of relocations
+struct ThrowingCopy
+{
+    static inline int Alive = 0;
+    static inline int CopiesBeforeThrow = -1;
+    int Value = 0;
+
+    ThrowingCopy(int value) : Value(value) { ++Alive; }
+    ThrowingCopy(const ThrowingCopy& other) : Value(other.Value)
+    {
+        if (CopiesBeforeThrow >= 0 && CopiesBeforeThrow-- == 0)
+            throw std::runtime_error("copy failed");
+        ++Alive;
+    }
+    ThrowingCopy(ThrowingCopy&& other) : Value(other.Value) { ++Alive; }
+    ~ThrowingCopy() { --Alive; }
+    ThrowingCopy& operator=(const ThrowingCopy&) = default;
+    ThrowingCopy& operator=(ThrowingCopy&&) = default;
+};
+
+// forwards to the default heap and keeps track of the outstanding allocations to check everything goes through a resource and comes back
+class CountingResource : public std::pmr::memory_resource
+{
+public:
+    size_t Outstanding = 0;
+    size_t AllocationCount = 0;
+    size_t AllocationLimit = SIZE_MAX; // allocations past this count throw std::bad_alloc
+
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        if (AllocationCount >= AllocationLimit)
+            throw std::bad_alloc();
+        Outstanding += bytes;
+        ++AllocationCount;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* memory, size_t bytes, size_t alignment) override
+    {
+        Outstanding -= bytes;
+        std::pmr::new_delete_resource()->deallocate(memory, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
 class ScopeTimer {
 public:
     ScopeTimer(const std::string& name)
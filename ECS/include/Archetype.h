@@ -1,5 +1,9 @@
 #pragma once
 #include "Types.h"
+#include "MemoryResource.h"
+#include "FlatHashMap.h"
+#include "ComponentColumn.h"
+#include "LaneColumn.h"
 #include <span>
 #include <tuple>
 
@@ -11,34 +15,145 @@ struct IComponentStorage
     virtual ~IComponentStorage() = default;
 };
 
+// column type of a component, blocked by lanes if the type has a LaneLayout
+template<typename Comp>
+struct ColumnTypeOf
+{
+    using Type = ComponentColumn<Comp>;
+};
+
+template<LaneComponentConstraint Comp>
+struct ColumnTypeOf<Comp>
+{
+    using Type = LaneColumn<Comp>;
+};
+
 template<ComponentConstraint Comp>
 struct ComponentStorage : public IComponentStorage
 {
-    std::vector<Comp> Components;
+    explicit ComponentStorage(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : Components(resource)
+    {}
+
+    typename ColumnTypeOf<Comp>::Type Components;
+};
+
+// storages are allocated from the archetype's memory resource, the deleter remembers the concrete type to give back the right size
+using DestroyStorageFunc = void(*)(IComponentStorage*, std::pmr::memory_resource*);
+struct ComponentStorageDeleter
+{
+    std::pmr::memory_resource* Resource = nullptr;
+    DestroyStorageFunc Destroy = nullptr;
+
+    void operator()(IComponentStorage* storage) const
+    {
+        Destroy(storage, Resource);
+    }
 };
+using ComponentStoragePtr = std::unique_ptr<IComponentStorage, ComponentStorageDeleter>;
 
 class Archetype
 {
 public:
-    Archetype() = default;
+    /// <summary>
+    /// The entity list, the index map and every component column are allocated from the given memory resource.
+    /// </summary>
+    explicit Archetype(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : m_Resource(resource)
+        , m_Entities(resource)
+        , m_EntityIndexMap(resource)
+        , m_DisabledRows(resource)
+        , m_ComponentStorages(resource)
+    {}
     ~Archetype() = default;
 
+    [[nodiscard]] std::pmr::memory_resource* GetMemoryResource() const { return m_Resource; }
+
+    // components this archetype has a storage for
+    [[nodiscard]] EntitySignature GetSignature() const { return m_Signature; }
+
     void AddEntity(EntityID entity)
     {
         m_Entities.push_back(entity);
         m_EntityIndexMap[entity] = (uint32_t)m_Entities.size() - 1;
+        if (m_DisabledRows.size() * 64 < m_Entities.size())
+            m_DisabledRows.push_back(0);
+    }
+
+    // Append entities in bulk, their components have to be appended to every column in the same order
+    void AddEntities(std::span<const EntityID> entities)
+    {
+        Reserve((uint32_t)(m_Entities.size() + entities.size()));
+        for (EntityID entity : entities)
+        {
+            m_EntityIndexMap[entity] = (uint32_t)m_Entities.size();
+            m_Entities.push_back(entity);
+        }
+        m_DisabledRows.resize((m_Entities.size() + 63) / 64);
+    }
+
+    // Replace the entity list and the index map by copies of another archetype's, its columns have to be copied or shared separately
+    void CopyEntities(const Archetype& other)
+    {
+        m_Entities = other.m_Entities;
+        m_EntityIndexMap.CopyFrom(other.m_EntityIndexMap);
+        m_DisabledRows = other.m_DisabledRows;
+        m_DisabledCount = other.m_DisabledCount;
+    }
+
+    // Move every entity of another archetype to the end of this one and leave it empty, their columns have to be spliced too.
+    // When this archetype is empty the entity list and the index map themselves change hands.
+    void SpliceEntities(Archetype& other)
+    {
+        if (this == &other || other.m_Entities.empty())
+            return;
+        if (m_Entities.empty())
+        {
+            m_Entities = std::move(other.m_Entities);
+            m_EntityIndexMap = std::move(other.m_EntityIndexMap);
+            m_DisabledRows = std::move(other.m_DisabledRows);
+            m_DisabledCount = other.m_DisabledCount;
+        }
+        else
+        {
+            const uint32_t first = GetEntityCount();
+            AddEntities(other.m_Entities);
+            for (uint32_t row = 0; other.m_DisabledCount && row < other.GetEntityCount(); ++row)
+            {
+                if (other.IsRowDisabled(row))
+                    SetRowEnabled(first + row, false);
+            }
+        }
+        other.ClearEntities();
+    }
+
+    // Remove every entity from this archetype but keep the memory, its columns have to be cleared too
+    void ClearEntities()
+    {
+        m_Entities.clear();
+        m_EntityIndexMap.Clear();
+        m_DisabledRows.clear();
+        m_DisabledCount = 0;
     }
 
     // Remove an entity from this archetype
     void RemoveEntity(EntityID entity)
     {
-        if (!m_EntityIndexMap.contains(entity))
+        const uint32_t* entityIndex = m_EntityIndexMap.TryGet(entity);
+        if (!entityIndex)
             return;
 
-        uint32_t index = m_EntityIndexMap[entity];
+        uint32_t index = *entityIndex;
         uint32_t lastIndex = (uint32_t)m_Entities.size() - 1;
 
-        // Swap and pop to maintain contiguous storage
+        // Swap and pop to maintain contiguous storage, the disabled bit of the last row moves along
+        if (m_DisabledCount)
+        {
+            if (IsRowDisabled(index))
+                --m_DisabledCount;
+            SetRowBit(index, IsRowDisabled(lastIndex));
+            SetRowBit(lastIndex, false);
+        }
         if (index != lastIndex)
         {
             std::swap(m_Entities[index], m_Entities[lastIndex]);
@@ -46,27 +161,72 @@ public:
         }
 
         m_Entities.pop_back();
-        m_EntityIndexMap.erase(entity);
+        m_EntityIndexMap.Erase(entity);
+        if (m_DisabledRows.size() * 64 >= m_Entities.size() + 64)
+            m_DisabledRows.pop_back();
     }
 
     // more for testing than anything else
     [[nodiscard]] bool HasEntity(EntityID entity) const
     {
-        return m_EntityIndexMap.contains(entity);
+        return m_EntityIndexMap.Contains(entity);
+    }
+
+    [[nodiscard]] ECS_FORCE_INLINE uint32_t GetEntityIndex(EntityID entity) const
+    {
+        const uint32_t* index = m_EntityIndexMap.TryGet(entity);
+        assert(index && "This archetype doesn't contain this entity");
+        return *index;
     }
 
-    [[nodiscard]] uint32_t GetEntityIndex(EntityID entity) const
+    // for a GetEntityIndex coming soon
+    ECS_FORCE_INLINE void PrefetchEntityIndex(EntityID entity) const
     {
-        assert(m_EntityIndexMap.contains(entity) && "This archetype doesn't contain this entity");
-        return m_EntityIndexMap.at(entity);
+        m_EntityIndexMap.Prefetch(entity);
     }
 
-    [[nodiscard]] ECS_FORCE_INLINE const std::vector<EntityID>& GetEntities() const
+    /// <summary>
+    /// Hides or shows the row of an entity in views, the entity keeps its row and its components.
+    /// Does nothing if the entity isn't listed in this archetype.
+    /// </summary>
+    void SetEntityEnabled(EntityID entity, bool enabled)
+    {
+        const uint32_t* index = m_EntityIndexMap.TryGet(entity);
+        if (index)
+            SetRowEnabled(*index, enabled);
+    }
+
+    void SetRowEnabled(uint32_t row, bool enabled)
+    {
+        assert(row < m_Entities.size() && "Row out of range");
+        if (IsRowDisabled(row) == !enabled)
+            return;
+        SetRowBit(row, !enabled);
+        if (enabled)
+            --m_DisabledCount;
+        else
+            ++m_DisabledCount;
+    }
+
+    [[nodiscard]] ECS_FORCE_INLINE bool IsRowDisabled(uint32_t row) const
+    {
+        return (m_DisabledRows[row / 64] >> (row % 64)) & 1;
+    }
+
+    [[nodiscard]] uint32_t GetDisabledCount() const { return m_DisabledCount; }
+
+    // one bit per row, set if the row is disabled, or null if no row is
+    [[nodiscard]] ECS_FORCE_INLINE const uint64_t* GetDisabledRows() const
+    {
+        return m_DisabledCount ? m_DisabledRows.data() : nullptr;
+    }
+
+    [[nodiscard]] ECS_FORCE_INLINE const std::pmr::vector<EntityID>& GetEntities() const
     {
         return m_Entities;
     }
 
-    [[nodiscard]] ECS_FORCE_INLINE std::vector<EntityID>* GetEntitiesPtr()
+    [[nodiscard]] ECS_FORCE_INLINE std::pmr::vector<EntityID>* GetEntitiesPtr()
     {
         return &m_Entities;
     }
@@ -76,10 +236,32 @@ public:
         return (uint32_t)m_Entities.size();
     }
 
+    [[nodiscard]] uint32_t GetCapacity() const
+    {
+        return (uint32_t)m_Entities.capacity();
+    }
+
+    // Make room for count entities in the entity list and the index map, columns are reserved one by one with ReserveComponentStorage
+    void Reserve(uint32_t count)
+    {
+        m_Entities.reserve(count);
+        m_EntityIndexMap.Reserve(count);
+        m_DisabledRows.reserve((count + 63) / 64);
+    }
+
+    // Release the spare capacity of the entity list and the index map
+    void ShrinkToFit()
+    {
+        m_Entities.shrink_to_fit();
+        m_EntityIndexMap.ShrinkToFit();
+        m_DisabledRows.shrink_to_fit();
+    }
+
+    // Comp&, or a LaneRef for components with a LaneLayout
     template<ComponentConstraint Comp, typename... Args>
-    Comp& EmplaceComponent(EntityID entity, Args&&... args)
+    decltype(auto) EmplaceComponent(EntityID entity, Args&&... args)
     {
-        assert(m_EntityIndexMap.contains(entity) && "This archetype doesn't contain this entity");
+        assert(m_EntityIndexMap.Contains(entity) && "This archetype doesn't contain this entity");
 
         auto& compStorage = GetComponentStorage<Comp>();
         compStorage.Components.emplace_back(std::forward<Args>(args)...);
@@ -89,7 +271,7 @@ public:
     template<ComponentConstraint Comp>
     void AddComponent(EntityID entity, const Comp& comp)
     {
-        assert(m_EntityIndexMap.contains(entity) && "This archetype doesn't contain this entity");
+        assert(m_EntityIndexMap.Contains(entity) && "This archetype doesn't contain this entity");
 
         auto& compStorage = GetComponentStorage<Comp>();
         compStorage.Components.emplace_back(comp);
@@ -105,18 +287,22 @@ public:
     bool RemoveComponent(EntityID entity)
     {
         auto type = GetComponentTypeIndex<Comp>();
-        if (!m_EntityIndexMap.contains(entity))
+        const uint32_t* entityIndex = m_EntityIndexMap.TryGet(entity);
+        if (!entityIndex)
             return false;
-        if (!m_ComponentStorages.contains(type))
+        if (!m_Signature.test(type))
             return false;
 
-        auto& compStorate = *static_cast<ComponentStorage<Comp>*>(m_ComponentStorages[type].get());
-        auto index = m_EntityIndexMap[entity];
+        auto& compStorate = GetComponentStorage<Comp>();
+        auto index = *entityIndex;
         auto lastIndex = m_Entities.size() - 1;
 
         if (index != lastIndex)
         {
-            std::swap(compStorate.Components[index], compStorate.Components[lastIndex]);
+            if constexpr (LaneComponentConstraint<Comp>)
+                compStorate.Components.MoveRow(lastIndex, index);
+            else
+                std::swap(compStorate.Components[index], compStorate.Components[lastIndex]);
         }
         compStorate.Components.pop_back();
         return true;
@@ -128,14 +314,18 @@ public:
         (RemoveComponent<Comps>(entity), ...);
     }
 
+    // Comp&, or a LaneRef for components with a LaneLayout
     template<ComponentConstraint Comp>
-    [[nodiscard]] Comp& GetComponent(EntityID entity)
+    [[nodiscard]] decltype(auto) GetComponent(EntityID entity)
     {
-        auto type = GetComponentTypeIndex<Comp>();
-        assert(m_ComponentStorages.contains(type) && "Component storage doesn't exist.");
-        auto& compStorage = *static_cast<ComponentStorage<Comp>*>(m_ComponentStorages[type].get());
-        auto index = m_EntityIndexMap[entity];
-        return compStorage.Components[index];
+        return GetComponentStorage<Comp>().Components[GetEntityIndex(entity)];
+    }
+
+    // const Comp&, or a copy for components with a LaneLayout
+    template<ComponentConstraint Comp>
+    [[nodiscard]] decltype(auto) GetComponent(EntityID entity) const
+    {
+        return GetComponentStorage<Comp>().Components[GetEntityIndex(entity)];
     }
 
     template<ComponentConstraint... Comps>
@@ -145,20 +335,29 @@ public:
     }
 
     template<ComponentConstraint Comp>
-    [[nodiscard]] Comp& GetComponentByIndex(uint32_t index)
+    [[nodiscard]] decltype(auto) GetComponentByIndex(uint32_t index)
     {
-        auto type = GetComponentTypeIndex<Comp>();
-        assert(m_ComponentStorages.contains(type) && "Component storage doesn't exist.");
-        auto& compStorage = *static_cast<ComponentStorage<Comp>*>(m_ComponentStorages[type].get());
-        return compStorage.Components[index];
+        return GetComponentStorage<Comp>().Components[index];
     }
 
+    // The components can be modified through the returned storage, so a column shared with a fork gets its own copy first
     template<ComponentConstraint Comp>
-    [[nodiscard]] ComponentStorage<Comp>& GetComponentStorage()
+    [[nodiscard]] ECS_FORCE_INLINE ComponentStorage<Comp>& GetComponentStorage()
     {
-        auto type = GetComponentTypeIndex<Comp>();
-        assert(m_ComponentStorages.contains(type) && "Component storage doesn't exist.");
-        return *static_cast<ComponentStorage<Comp>*>(m_ComponentStorages[type].get());
+        auto& storage = GetStorage<Comp>();
+        storage.Components.MakeUnique();
+        return storage;
+    }
+
+    template<ComponentConstraint Comp>
+    [[nodiscard]] ECS_FORCE_INLINE const ComponentStorage<Comp>& GetComponentStorage() const
+    {
+        return GetStorage<Comp>();
+    }
+
+    [[nodiscard]] bool HasComponentStorage(ComponentTypeIndex type) const
+    {
+        return m_Signature.test(type);
     }
 
     template<ComponentConstraint... Comps>
@@ -171,9 +370,13 @@ public:
     void CreateComponentStorage()
     {
         auto type = GetComponentTypeIndex<Comp>();
-        if (m_ComponentStorages.contains(type))
+        if (m_Signature.test(type))
             return;
-        m_ComponentStorages[type] = std::make_unique<ComponentStorage<Comp>>();
+        // owned before the emplace, which can throw while the vector grows
+        ComponentStoragePtr storage(std::pmr::polymorphic_allocator<>(m_Resource).new_object<ComponentStorage<Comp>>(m_Resource),
+            ComponentStorageDeleter{ m_Resource, &DestroyComponentStorage<Comp> });
+        m_ComponentStorages.emplace(m_ComponentStorages.begin() + GetStorageSlot(type), std::move(storage));
+        m_Signature.set(type);
     }
 
     template<ComponentConstraint ...Comps>
@@ -182,22 +385,131 @@ public:
         (CreateComponentStorage<Comps>(), ...);
     }
 
+    template<ComponentConstraint Comp>
+    void ReserveComponentStorage(uint32_t count)
+    {
+        GetComponentStorage<Comp>().Components.reserve(count);
+    }
+
+    template<ComponentConstraint Comp>
+    void ShrinkComponentStorage()
+    {
+        GetComponentStorage<Comp>().Components.shrink_to_fit();
+    }
+
+    // Move the whole column of another archetype to the end of this archetype's column, the entities have to be added in the same order
+    template<ComponentConstraint Comp>
+    void SpliceComponentStorage(Archetype& other)
+    {
+        GetComponentStorage<Comp>().Components.Splice(other.GetComponentStorage<Comp>().Components);
+    }
+
+    // Make sure SpliceComponentStorage(other) won't allocate
+    template<ComponentConstraint Comp>
+    void ReserveSpliceComponentStorage(Archetype& other)
+    {
+        GetStorage<Comp>().Components.ReserveSplice(other.GetStorage<Comp>().Components);
+    }
+
+    // Destroy every component of a column, a column shared with a fork just lets go of the shared components
+    template<ComponentConstraint Comp>
+    void ClearComponentStorage()
+    {
+        GetStorage<Comp>().Components.clear();
+    }
+
+    // Make the column of this archetype share the components of the same column of another one until either is modified
+    template<ComponentConstraint Comp>
+    void ShareComponentStorage(Archetype& other)
+    {
+        GetStorage<Comp>().Components.ShareFrom(other.GetStorage<Comp>().Components);
+    }
+
 private:
-    std::vector<EntityID> m_Entities;
-    std::unordered_map<EntityID, uint32_t> m_EntityIndexMap;
-    std::unordered_map<ComponentTypeIndex, std::unique_ptr<IComponentStorage>> m_ComponentStorages;
+    // no copy on write here, unlike GetComponentStorage
+    template<ComponentConstraint Comp>
+    [[nodiscard]] ECS_FORCE_INLINE ComponentStorage<Comp>& GetStorage() const
+    {
+        auto type = GetComponentTypeIndex<Comp>();
+        assert(m_Signature.test(type) && "Component storage doesn't exist.");
+        return *static_cast<ComponentStorage<Comp>*>(m_ComponentStorages[GetStorageSlot(type)].get());
+    }
+
+    ECS_FORCE_INLINE void SetRowBit(uint32_t row, bool value)
+    {
+        const uint64_t bit = uint64_t(1) << (row % 64);
+        m_DisabledRows[row / 64] = value ? m_DisabledRows[row / 64] | bit : m_DisabledRows[row / 64] & ~bit;
+    }
+
+    // storages are sorted by component index, so a storage sits at the number of components of the signature before its own
+    [[nodiscard]] ECS_FORCE_INLINE uint32_t GetStorageSlot(ComponentTypeIndex type) const
+    {
+        return (uint32_t)std::popcount(m_Signature.to_ullong() & ((uint64_t(1) << type) - 1));
+    }
+
+    template<ComponentConstraint Comp>
+    static void DestroyComponentStorage(IComponentStorage* storage, std::pmr::memory_resource* resource)
+    {
+        std::pmr::polymorphic_allocator<>(resource).delete_object(static_cast<ComponentStorage<Comp>*>(storage));
+    }
+
+private:
+    std::pmr::memory_resource* m_Resource;
+    EntitySignature m_Signature;
+    std::pmr::vector<EntityID> m_Entities;
+    FlatHashMap<EntityID, uint32_t> m_EntityIndexMap;
+    std::pmr::vector<uint64_t> m_DisabledRows; // a bit per row, set if the entity is disabled, bits past the last row are clear
+    uint32_t m_DisabledCount = 0;
+    std::pmr::vector<ComponentStoragePtr> m_ComponentStorages; // one per component of the signature, in component index order
+    uint32_t m_EmptyFlushCount = 0; // consecutive flushes this archetype has been empty for, used by the registry to collect it
 
     friend class EntityRegistry;
 };
 
+/// <summary>
+/// Width consecutive components of a column, handed out by ComponentView::EachBatch.
+/// The components past the last row of the last batch of an archetype aren't alive: they must not be written to,
+/// but the whole batch can be loaded (e.g. through GetScalars), the columns are padded for it, see MAX_BATCH_WIDTH.
+/// </summary>
+template<ComponentConstraint Comp, uint32_t Width>
+class Batch
+{
+public:
+    static constexpr uint32_t WIDTH = Width;
+
+    explicit Batch(Comp* data)
+        : m_Data(data)
+    {}
+
+    [[nodiscard]] ECS_FORCE_INLINE Comp& operator[](uint32_t lane) const { return m_Data[lane]; }
+    [[nodiscard]] ECS_FORCE_INLINE Comp* GetData() const { return m_Data; }
+
+    // the components of the batch seen as an array of GetScalarCount<Scalar>() scalars, e.g. to load them in SimdFloat
+    template<typename Scalar>
+        requires (sizeof(Comp) % sizeof(Scalar) == 0 && std::is_trivially_copyable_v<Comp>)
+    [[nodiscard]] ECS_FORCE_INLINE Scalar* GetScalars() const
+    {
+        return reinterpret_cast<Scalar*>(m_Data);
+    }
+
+    template<typename Scalar>
+    [[nodiscard]] static constexpr uint32_t GetScalarCount() { return Width * (uint32_t)(sizeof(Comp) / sizeof(Scalar)); }
+
+private:
+    Comp* m_Data;
+};
+
 template<ComponentConstraint... Comps>
 class ComponentView
 {
+public:
     struct Index
     {
-        EntityID Entity;
-        uint32_t ArchetypeIndex;
-        uint32_t ComponentIndex;
+        EntityID Entity = INVALID_ENTITY_ID;
+        uint32_t ArchetypeIndex = 0;
+        uint32_t ComponentIndex = 0;
+
+        Index() = default;
 
         Index(EntityID entity, uint32_t archetypeIndex, uint32_t componentIndex)
             : Entity(entity)
@@ -221,35 +533,27 @@ class ComponentView
         using iterator_category = std::forward_iterator_tag;
         using difference_type = std::ptrdiff_t;
         using value_type = Index;
-        using pointer = Index*;
-        using reference = Index&;
+        using pointer = const Index*;
+        using reference = const Index&;
 
-        Iterator(Index index, const std::vector<uint32_t>& archetypeSizes, const std::vector<std::vector<EntityID>*>& entityData)
+        Iterator() = default;
+
+        Iterator(Index index, const ComponentView* view)
             : m_Index(index)
-            , m_ArchetypeSizes(archetypeSizes)
-            , m_EntityData(entityData)
+            , m_View(view)
         {}
 
-        reference operator*() { return m_Index; }
-        pointer operator->() { return &m_Index; }
+        reference operator*() const { return m_Index; }
+        pointer operator->() const { return &m_Index; }
 
         Iterator& operator++()
         {
-            if (++m_Index.ComponentIndex >= m_ArchetypeSizes[m_Index.ArchetypeIndex])
-            {
-                m_Index.ComponentIndex = 0;
-                ++m_Index.ArchetypeIndex;
-                if (m_Index.ArchetypeIndex >= m_ArchetypeSizes.size())
-                {
-                    m_Index.Entity = m_EntityData.back()->back();
-                    return *this;
-                }
-            }
-            m_Index.Entity = (*m_EntityData[m_Index.ArchetypeIndex])[m_Index.ComponentIndex];
+            Advance();
+            SkipHidden();
             return *this;
         }
 
-        Iterator& operator++(int)
+        Iterator operator++(int)
         {
             Iterator tmp = *this;
             ++(*this);
@@ -259,14 +563,83 @@ class ComponentView
         friend bool operator==(const Iterator& a, const Iterator& b) { return a.m_Index == b.m_Index; }
         friend bool operator!=(const Iterator& a, const Iterator& b) { return a.m_Index != b.m_Index; }
 
+        [[nodiscard]] bool IsEnd() const { return m_Index.ArchetypeIndex >= m_View->m_ArchetypeSizes.size(); }
+
+        // moves forward to the first row that is neither disabled nor skipped, staying put if the current one is
+        void SkipHidden()
+        {
+            while (!IsEnd())
+            {
+                const uint64_t* disabled = m_View->m_Archetypes[m_Index.ArchetypeIndex]->GetDisabledRows();
+                if (disabled && ((disabled[m_Index.ComponentIndex / 64] >> (m_Index.ComponentIndex % 64)) & 1))
+                    SkipDisabledRows(disabled);
+                else if (m_View->IsSkipped(m_Index.Entity))
+                    Advance();
+                else
+                    return;
+            }
+        }
+
     private:
+        // jumps to the next enabled row of the archetype a word of rows at a time, or to the start of the next archetype
+        void SkipDisabledRows(const uint64_t* disabled)
+        {
+            const uint32_t size = m_View->m_ArchetypeSizes[m_Index.ArchetypeIndex];
+            uint32_t word = m_Index.ComponentIndex / 64;
+            uint64_t enabled = ~disabled[word] & (~uint64_t(0) << (m_Index.ComponentIndex % 64));
+            while (!enabled && ++word * 64 < size)
+                enabled = ~disabled[word];
+            const uint32_t row = word * 64 + (uint32_t)std::countr_zero(enabled);
+            if (enabled && row < size)
+            {
+                m_Index.ComponentIndex = row;
+                m_Index.Entity = (*m_View->m_EntityData[m_Index.ArchetypeIndex])[row];
+            }
+            else
+            {
+                m_Index.ComponentIndex = size - 1;
+                Advance();
+            }
+        }
+
+        void Advance()
+        {
+            if (++m_Index.ComponentIndex >= m_View->m_ArchetypeSizes[m_Index.ArchetypeIndex])
+            {
+                m_Index.ComponentIndex = 0;
+                ++m_Index.ArchetypeIndex;
+                if (m_Index.ArchetypeIndex >= m_View->m_ArchetypeSizes.size())
+                {
+                    m_Index.Entity = m_View->m_EntityData.back()->back();
+                    return;
+                }
+            }
+            m_Index.Entity = (*m_View->m_EntityData[m_Index.ArchetypeIndex])[m_Index.ComponentIndex];
+        }
+
         Index m_Index;
-        const std::vector<uint32_t>& m_ArchetypeSizes;
-        const std::vector<std::vector<EntityID>*>& m_EntityData;
+        const ComponentView* m_View = nullptr;
     };
+
+    // the rows of a view as an array of their Index (see ComponentView::Rows)
+    using RowRange = std::span<const Index>;
     
 public:
-    ComponentView(std::span<Archetype*> archetypeView)
+    /// <summary>
+    /// The entities flagged in skippedEntities are hidden while *skippedCount isn't 0. Both are read as the view is iterated,
+    /// so entities flagged after the view is created are hidden too, e.g. the ones queued for deletion, and the flags can
+    /// be reallocated (e.g. as the registry grows) without invalidating the view.
+    /// The lists of the view are allocated from resource.
+    /// </summary>
+    ComponentView(std::span<Archetype*> archetypeView, const std::pmr::vector<uint8_t>* skippedEntities = nullptr, const uint32_t* skippedCount = nullptr,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : m_EntityData(resource)
+        , m_Archetypes(resource)
+        , m_ComponentData(resource)
+        , m_ArchetypeSizes(resource)
+        , m_Rows(resource)
+        , m_SkippedEntities(skippedEntities)
+        , m_SkippedCount(skippedCount)
     {
         m_ArchetypeSizes.reserve(archetypeView.size());
         for (Archetype* archetype : archetypeView)
@@ -275,34 +648,130 @@ public:
             if (entityData->empty())
                 continue;
             m_EntityData.push_back(entityData);
+            m_Archetypes.push_back(archetype);
             m_ArchetypeSizes.push_back(archetype->GetEntityCount());
-            m_TotalSize += archetype->GetEntityCount();
+            m_RowCount += archetype->GetEntityCount();
             m_ComponentData.push_back(archetype->GetComponentStorages<Comps...>());
         }
     }
 
     ~ComponentView() = default;
 
+    // number of rows the view iterates, disabled and skipped entities excluded
+    [[nodiscard]] uint32_t GetSize() const
+    {
+        uint32_t size = m_RowCount;
+        for (const Archetype* archetype : m_Archetypes)
+            size -= archetype->GetDisabledCount();
+        if (HasSkippedEntities())
+        {
+            for (uint32_t a = 0; a < (uint32_t)m_Archetypes.size(); ++a)
+            {
+                for (uint32_t row = 0; row < m_ArchetypeSizes[a]; ++row)
+                    size -= !m_Archetypes[a]->IsRowDisabled(row) && (*m_SkippedEntities)[(*m_EntityData[a])[row]];
+            }
+        }
+        return size;
+    }
+
     ECS_FORCE_INLINE std::tuple<Comps&...> Get(const Index& index)
     {
         return { std::get<ComponentStorage<Comps>&>(m_ComponentData[index.ArchetypeIndex]).Components[index.ComponentIndex]... };
     }
 
+    /// <summary>
+    /// Calls func(Batch<Comps, Width>..., uint64_t mask) for every run of Width rows of every archetype of the view,
+    /// starting on a row multiple of Width. Bit i of mask is set if row i of the batch is one the view would iterate:
+    /// rows past the end of the archetype, disabled entities and skipped entities are cleared, and batches without any are skipped.
+    /// A full mask means every component of the batch can be processed as a whole, e.g. with SimdFloat, which is the common case;
+    /// the others have to go through the mask. See DispatchSimd to pick Width for the CPU.
+    /// </summary>
+    template<uint32_t Width, typename Func>
+    ECS_FORCE_INLINE void EachBatch(Func&& func)
+    {
+        static_assert(Width > 0 && Width <= MAX_BATCH_WIDTH && std::has_single_bit(Width), "The batch width must be a power of two up to MAX_BATCH_WIDTH.");
+        constexpr uint64_t fullMask = Width == 64 ? ~uint64_t(0) : (uint64_t(1) << Width) - 1;
+        for (uint32_t a = 0; a < (uint32_t)m_ArchetypeSizes.size(); ++a)
+        {
+            const uint32_t size = m_ArchetypeSizes[a];
+            const EntityID* entities = m_EntityData[a]->data();
+            const uint64_t* disabled = m_Archetypes[a]->GetDisabledRows();
+            UnshareColumns(a);
+            std::tuple<Comps*...> columns{ std::get<ComponentStorage<Comps>&>(m_ComponentData[a]).Components.data()... };
+            for (uint32_t first = 0; first < size; first += Width)
+            {
+                // Width is a power of two up to 64, so a batch never straddles two words of the disabled rows
+                uint64_t mask = size - first >= Width ? fullMask : (uint64_t(1) << (size - first)) - 1;
+                if (disabled)
+                    mask &= ~(disabled[first / 64] >> (first % 64));
+                if (HasSkippedEntities())
+                {
+                    for (uint64_t bits = mask; bits; bits &= bits - 1)
+                    {
+                        const uint32_t lane = (uint32_t)std::countr_zero(bits);
+                        if ((*m_SkippedEntities)[entities[first + lane]])
+                            mask &= ~(uint64_t(1) << lane);
+                    }
+                }
+                if (mask)
+                    func(Batch<Comps, Width>(std::get<Comps*>(columns) + first)..., mask);
+            }
+        }
+    }
+
+    /// <summary>
+    /// The rows the view iterates as a contiguous array, e.g. for std::for_each(std::execution::par, ...) or to split them
+    /// in chunks: each element is the Index to give to Get. The rows hidden when this is called (disabled or skipped entities)
+    /// are left out. The array is filled by each call, which invalidates the previous one, and like the iterators
+    /// it is invalidated by structural changes to the registry.
+    /// </summary>
+    [[nodiscard]] RowRange Rows()
+    {
+        for (uint32_t a = 0; a < (uint32_t)m_ComponentData.size(); ++a)
+            UnshareColumns(a);
+        m_Rows.clear();
+        m_Rows.reserve(m_RowCount);
+        for (Iterator it = begin(); !it.IsEnd(); ++it)
+            m_Rows.push_back(*it);
+        return m_Rows;
+    }
+
     ECS_FORCE_INLINE Iterator begin() const
     {
-        return Iterator{ Index{ m_EntityData.front()->front(), 0, 0 }, m_ArchetypeSizes, m_EntityData };
+        if (m_EntityData.empty())
+            return end();
+        for (uint32_t a = 0; a < (uint32_t)m_ComponentData.size(); ++a)
+            UnshareColumns(a);
+        Iterator it{ Index{ m_EntityData.front()->front(), 0, 0 }, this };
+        it.SkipHidden();
+        return it;
     }
 
     ECS_FORCE_INLINE Iterator end() const
     {
-        return Iterator{ Index{ m_EntityData.back()->back(), (uint32_t)m_ArchetypeSizes.size(), 0 }, m_ArchetypeSizes, m_EntityData };
+        EntityID lastEntity = m_EntityData.empty() ? INVALID_ENTITY_ID : m_EntityData.back()->back();
+        return Iterator{ Index{ lastEntity, (uint32_t)m_ArchetypeSizes.size(), 0 }, this };
+    }
+
+private:
+    [[nodiscard]] ECS_FORCE_INLINE bool HasSkippedEntities() const { return m_SkippedCount && *m_SkippedCount; }
+    [[nodiscard]] ECS_FORCE_INLINE bool IsSkipped(EntityID entity) const { return HasSkippedEntities() && (*m_SkippedEntities)[entity]; }
+
+    // the columns were made unique when the view was created, but a Fork since then shares them again
+    ECS_FORCE_INLINE void UnshareColumns(uint32_t archetypeIndex) const
+    {
+        std::apply([](auto&... storages) { (storages.Components.MakeUnique(), ...); }, m_ComponentData[archetypeIndex]);
     }
 
 private:
-    std::vector<std::vector<EntityID>*> m_EntityData;
-    std::vector<std::tuple<ComponentStorage<Comps>&...>> m_ComponentData;
-    std::vector<uint32_t> m_ArchetypeSizes;
-    uint32_t m_TotalSize{0};
+    std::pmr::vector<std::pmr::vector<EntityID>*> m_EntityData;
+    std::pmr::vector<const Archetype*> m_Archetypes;
+    std::pmr::vector<std::tuple<ComponentStorage<Comps>&...>> m_ComponentData;
+    std::pmr::vector<uint32_t> m_ArchetypeSizes;
+    std::pmr::vector<Index> m_Rows; // filled by Rows
+    uint32_t m_RowCount{0}; // rows of the archetypes, hidden ones included
+    const std::pmr::vector<uint8_t>* m_SkippedEntities{nullptr};
+    const uint32_t* m_SkippedCount{nullptr};
     friend class EntityRegistry;
 };
 }
@@ -1,5 +1,9 @@
 #pragma once
 #include "Types.h"
+#include <cstring>
+#include <new>
+#include <span>
+#include <memory_resource>
 
 
 namespace ecs
@@ -14,6 +18,13 @@ namespace ecs
         {}
     };
 
+    /// <summary>
+    /// Growable ring buffer.
+    /// The storage is left uninitialized and rounded up to a power of two so that indices wrap with a mask,
+    /// slots are only constructed when an item is pushed and destroyed when it is popped.
+    /// GetCapacity still reports the requested capacity, the buffer grows once that many items are stored.
+    /// The storage comes from a memory resource, which moves along with it when the buffer is moved.
+    /// </summary>
     template<typename T>
     class CircularBuffer
     {
@@ -23,13 +34,17 @@ namespace ecs
         /// Constructor for the CircularBuffer class.
         /// </summary>
         /// <param name="capacity"> is the size reserved for the buffer containing all the data. Default = 16</param>
-        explicit CircularBuffer(uint32_t capacity = 16) noexcept
-            : m_Head(0)
+        /// <param name="resource"> is where the storage is allocated from</param>
+        explicit CircularBuffer(uint32_t capacity = 16, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+            : m_Resource(resource)
+            , m_Head(0)
             , m_Tail(0)
             , m_Count(0)
             , m_Capacity(capacity)
         {
-            m_Buffer = new T[capacity];
+            uint64_t storageSize = GetStorageSizeFor(capacity);
+            m_Buffer = Allocate(storageSize);
+            m_Mask = uint32_t(storageSize - 1);
         }
 
         /// <summary>
@@ -37,40 +52,56 @@ namespace ecs
         /// </summary>
         /// <param name="other">: rvalue CircularBuffer that will be empty after the operation.</param>
         explicit CircularBuffer(CircularBuffer&& other) noexcept
-            : m_Buffer(other.m_Buffer)
+            : m_Resource(other.m_Resource)
+            , m_Buffer(other.m_Buffer)
             , m_Head(other.m_Head)
             , m_Tail(other.m_Tail)
             , m_Count(other.m_Count)
             , m_Capacity(other.m_Capacity)
+            , m_Mask(other.m_Mask)
         {
             other.m_Buffer = nullptr;
             other.m_Head = 0;
             other.m_Tail = 0;
             other.m_Count = 0;
             other.m_Capacity = 0;
+            other.m_Mask = 0;
         }
 
         /// <summary>
         /// Constructor for the CircularBuffer class.
         /// </summary>
         /// <param name="other">: CircularBuffer to be copied.</param>
-        CircularBuffer(const CircularBuffer& other) noexcept
-            : m_Buffer(new T[other.m_Capacity])
+        /// <param name="resource">: where the copy is allocated from, like the std::pmr containers it isn't the one of other.</param>
+        CircularBuffer(const CircularBuffer& other, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+            : m_Resource(resource)
+            , m_Buffer(nullptr)
             , m_Head(0)
-            , m_Tail(other.m_Count % other.m_Capacity)
-            , m_Count(other.m_Count)
+            , m_Tail(0)
+            , m_Count(0)
             , m_Capacity(other.m_Capacity)
+            , m_Mask(other.m_Mask)
         {
             static_assert(std::is_copy_constructible<T>::value, "T must be copy constructible.");
-            if (other.m_Head < other.m_Tail)
+            if (!other.m_Buffer)
+                return;
+
+            m_Buffer = Allocate(other.GetStorageSize());
+            try
             {
-                std::copy(other.m_Buffer + other.m_Head, other.m_Buffer + other.m_Tail, m_Buffer);
+                for (uint32_t i = 0; i < other.m_Count; ++i)
+                {
+                    std::construct_at(m_Buffer + i, other.m_Buffer[(other.m_Head + i) & other.m_Mask]);
+                    ++m_Count;
+                }
             }
-            else
+            catch (...)
             {
-                auto newBufferMid = std::copy(other.m_Buffer + other.m_Head, other.m_Buffer + other.m_Capacity, m_Buffer);
-                std::copy(other.m_Buffer, other.m_Buffer + (other.m_Count - (other.m_Capacity - other.m_Head)), newBufferMid);
+                Clear();
+                Deallocate(m_Buffer, GetStorageSize());
+                throw;
             }
+            m_Tail = m_Count & m_Mask;
         }
 
         /// <summary>
@@ -78,25 +109,27 @@ namespace ecs
         /// </summary>
         ~CircularBuffer()
         {
-            delete[] m_Buffer;
+            Clear();
+            Deallocate(m_Buffer, GetStorageSize());
         }
 
         /// <summary>
-        /// Add an item to the end of the buffer. 
+        /// Add an item to the end of the buffer.
         /// It will also automatically resize the buffer if it is full.
         /// It will throw an exception if the capacity is equal to the max of the uint32 type.
         /// </summary>
         void PushBack(const T& item)
         {
-            CheckForResize();
+            if (m_Count >= m_Capacity) [[unlikely]]
+                return GrowAndConstruct<false>(item);
 
-            m_Buffer[m_Tail] = item;
-            m_Tail = (m_Tail + 1) % m_Capacity;
+            std::construct_at(m_Buffer + m_Tail, item);
+            m_Tail = (m_Tail + 1) & m_Mask;
             m_Count++;
         }
 
         /// <summary>
-        /// Construct an item to the end of the buffer. 
+        /// Construct an item to the end of the buffer.
         /// It will also automatically resize the buffer if it is full.
         /// It will throw an exception if the capacity is equal to the max of the uint32 type.
         /// </summary>
@@ -104,29 +137,31 @@ namespace ecs
             requires IsConstructibleConstraint<T, Args...>
         void PushBack(Args&&... args)
         {
-            CheckForResize();
+            if (m_Count >= m_Capacity) [[unlikely]]
+                return GrowAndConstruct<false>(std::forward<Args>(args)...);
 
-            m_Buffer[m_Tail] = T(std::forward<Args>(args)...);
-            m_Tail = (m_Tail + 1) % m_Capacity;
+            std::construct_at(m_Buffer + m_Tail, std::forward<Args>(args)...);
+            m_Tail = (m_Tail + 1) & m_Mask;
             m_Count++;
         }
 
         /// <summary>
-        /// Add an item to the front of the buffer. 
+        /// Add an item to the front of the buffer.
         /// It will also automatically resize the buffer if it is full.
         /// It will throw an exception if the capacity is equal to the max of the uint32 type.
         /// </summary>
         void PushFront(const T& item)
         {
-            CheckForResize();
+            if (m_Count >= m_Capacity) [[unlikely]]
+                return GrowAndConstruct<true>(item);
 
-            m_Head = (m_Head - 1 + m_Capacity) % m_Capacity;
-            m_Buffer[m_Head] = item;
+            std::construct_at(m_Buffer + ((m_Head - 1) & m_Mask), item);
+            m_Head = (m_Head - 1) & m_Mask;
             m_Count++;
         }
 
         /// <summary>
-        /// Add an item to the front of the buffer. 
+        /// Add an item to the front of the buffer.
         /// It will also automatically resize the buffer if it is full.
         /// It will throw an exception if the capacity is equal to the max of the uint32 type.
         /// </summary>
@@ -134,35 +169,102 @@ namespace ecs
             requires IsConstructibleConstraint<T, Args...>
         void PushFront(Args&&... args)
         {
-            CheckForResize();
+            if (m_Count >= m_Capacity) [[unlikely]]
+                return GrowAndConstruct<true>(std::forward<Args>(args)...);
 
-            m_Head = (m_Head - 1 + m_Capacity) % m_Capacity;
-            m_Buffer[m_Head] = T(std::forward<Args>(args)...);
+            std::construct_at(m_Buffer + ((m_Head - 1) & m_Mask), std::forward<Args>(args)...);
+            m_Head = (m_Head - 1) & m_Mask;
             m_Count++;
         }
 
         /// <summary>
-        /// Remove and return the last element from the buffer
+        /// Add all the given items to the end of the buffer, in order.
+        /// The buffer grows at most once and the items are copied in at most two contiguous blocks
+        /// (memcpy for trivially copyable types). The items may be items of the buffer itself.
         /// </summary>
-        T PopBack()
+        void PushBackRange(std::span<const T> items)
         {
-            static_assert(std::is_move_assignable_v<T> || std::is_copy_assignable_v<T>, "T must be move or copy assignable.");
-            if (m_Count == 0)
-                throw CircularBufferException("CircularBuffer is empty");
+            if (items.empty())
+                return;
+            if (items.size() > std::numeric_limits<uint32_t>::max() - m_Count)
+                throw CircularBufferException("CircularBuffer is full and its capacity is at the limit");
 
-            m_Tail = (m_Tail - 1 + m_Capacity) % m_Capacity;
-            if constexpr (std::is_move_assignable_v<T>)
+            uint32_t count = (uint32_t)items.size();
+            if (m_Count + count > m_Capacity)
             {
-                T item = std::move(m_Buffer[m_Tail]);
-                m_Count--;
-                return item;
-            }
-            else
-            {
-                T item = m_Buffer[m_Tail];
-                m_Count--;
-                return item;
+                uint32_t doubled = m_Capacity > std::numeric_limits<uint32_t>::max() / 2 ? std::numeric_limits<uint32_t>::max() : m_Capacity * 2;
+                uint32_t newCapacity = std::max(m_Count + count, doubled);
+                if (!m_Buffer || GetStorageSizeFor(newCapacity) != GetStorageSize())
+                {
+                    // copy the items before the storage they may come from is freed
+                    ReallocateAround(newCapacity, m_Count, count, [&](T* dst) { CopyConstruct(items.data(), count, dst); });
+                    m_Tail = (m_Tail + count) & m_Mask;
+                    m_Count += count;
+                    return;
+                }
+                m_Capacity = newCapacity;
             }
+
+            uint32_t firstPart = (uint32_t)std::min<uint64_t>(count, GetStorageSize() - m_Tail);
+            CopyConstruct(items.data(), firstPart, m_Buffer + m_Tail);
+            m_Tail = (m_Tail + firstPart) & m_Mask;
+            m_Count += firstPart;
+            CopyConstruct(items.data() + firstPart, count - firstPart, m_Buffer);
+            m_Tail = (m_Tail + count - firstPart) & m_Mask;
+            m_Count += count - firstPart;
+        }
+
+        /// <summary>
+        /// Remove up to count items from the front of the buffer and write them, in order, to the start of the output span.
+        /// The items are moved in at most two contiguous blocks (memcpy for trivially copyable types).
+        /// </summary>
+        /// <returns>the number of items removed, limited by the size of the buffer and of the output span</returns>
+        uint32_t PopFrontInto(std::span<T> out, uint32_t count)
+        {
+            count = (uint32_t)std::min<uint64_t>({ count, m_Count, out.size() });
+            if (count == 0)
+                return 0;
+            uint32_t firstPart = (uint32_t)std::min<uint64_t>(count, GetStorageSize() - m_Head);
+            MoveOut(m_Buffer + m_Head, firstPart, out.data());
+            MoveOut(m_Buffer, count - firstPart, out.data() + firstPart);
+            m_Head = (m_Head + count) & m_Mask;
+            m_Count -= count;
+            return count;
+        }
+
+        /// <summary>
+        /// Return the content of the buffer as two contiguous arrays: the items from the head to the end of the storage,
+        /// then the items that wrapped around to its start. The second span is empty if nothing wrapped.
+        /// </summary>
+        [[nodiscard]] std::array<std::span<T>, 2> AsSpans() noexcept
+        {
+            uint32_t firstPart = m_Buffer ? (uint32_t)std::min<uint64_t>(m_Count, GetStorageSize() - m_Head) : 0;
+            return { std::span<T>(m_Buffer + m_Head, firstPart), std::span<T>(m_Buffer, m_Count - firstPart) };
+        }
+
+        /// <summary>
+        /// Return the content of the buffer as two contiguous arrays, see the non-const version.
+        /// </summary>
+        [[nodiscard]] std::array<std::span<const T>, 2> AsSpans() const noexcept
+        {
+            uint32_t firstPart = m_Buffer ? (uint32_t)std::min<uint64_t>(m_Count, GetStorageSize() - m_Head) : 0;
+            return { std::span<const T>(m_Buffer + m_Head, firstPart), std::span<const T>(m_Buffer, m_Count - firstPart) };
+        }
+
+        /// <summary>
+        /// Remove and return the last element from the buffer
+        /// </summary>
+        T PopBack()
+        {
+            static_assert(std::is_move_constructible_v<T> || std::is_copy_constructible_v<T>, "T must be move or copy constructible.");
+            if (m_Count == 0) [[unlikely]]
+                ThrowEmpty();
+
+            m_Tail = (m_Tail - 1) & m_Mask;
+            T item(std::move(m_Buffer[m_Tail]));
+            std::destroy_at(m_Buffer + m_Tail);
+            m_Count--;
+            return item;
         }
 
         /// <summary>
@@ -170,33 +272,24 @@ namespace ecs
         /// </summary>
         T PopFront()
         {
-            static_assert(std::is_move_assignable_v<T> || std::is_copy_assignable_v<T>, "T must be move or copy assignable.");
-            if (m_Count == 0)
-                throw CircularBufferException("CircularBuffer is empty");
-
-            if constexpr (std::is_move_assignable_v<T>)
-            {
-                T item = std::move(m_Buffer[m_Head]);
-                m_Head = (m_Head + 1) % m_Capacity;
-                m_Count--;
-                return item;
-            }
-            else
-            {
-                T item = m_Buffer[m_Head];
-                m_Head = (m_Head + 1) % m_Capacity;
-                m_Count--;
-                return item;
-            }
+            static_assert(std::is_move_constructible_v<T> || std::is_copy_constructible_v<T>, "T must be move or copy constructible.");
+            if (m_Count == 0) [[unlikely]]
+                ThrowEmpty();
+
+            T item(std::move(m_Buffer[m_Head]));
+            std::destroy_at(m_Buffer + m_Head);
+            m_Head = (m_Head + 1) & m_Mask;
+            m_Count--;
+            return item;
         }
 
         /// <summary>
         /// Return the first item in the buffer
         /// </summary>
-        constexpr T& GetFront() { 
+        constexpr T& GetFront() {
             if (m_Count == 0)
                 throw CircularBufferException("CircularBuffer is empty");
-            return m_Buffer[m_Head]; 
+            return m_Buffer[m_Head];
         }
 
         /// <summary>
@@ -206,7 +299,7 @@ namespace ecs
         {
             if (m_Count == 0)
                 throw CircularBufferException("CircularBuffer is empty");
-            return m_Buffer[(m_Tail - 1 + m_Capacity) % m_Capacity];
+            return m_Buffer[(m_Tail - 1) & m_Mask];
         }
 
         /// <summary>
@@ -226,15 +319,15 @@ namespace ecs
         {
             if (m_Count == 0)
                 throw CircularBufferException("CircularBuffer is empty");
-            return m_Buffer[(m_Tail - 1 + m_Capacity) % m_Capacity];
+            return m_Buffer[(m_Tail - 1) & m_Mask];
         }
 
         /// <summary>
         /// Change the capacity of the buffer, reallocating if necessary.
-        /// If the new capacity is less than or equal to the current count, 
+        /// If the new capacity is less than the current count,
         /// this function does nothing to the buffer.
-        /// If the new capacity is more than the current count but less than
-        /// the current capacity, the buffer will be truncated.
+        /// If the new capacity fits in the same power of two storage, no reallocation happens.
+        /// Trivially relocatable items are moved to the new storage with at most two memcpy.
         /// </summary>
         /// <param name="newCapacity"> the new capacity of the buffer</param>
         void Resize(uint32_t newCapacity)
@@ -242,49 +335,33 @@ namespace ecs
             if (newCapacity < m_Count)
                 return;
 
-            T* newBuffer = new T[newCapacity];
-            if constexpr (std::is_move_constructible<T>::value && noexcept(T(std::declval<T>())))
+            uint64_t newStorageSize = GetStorageSizeFor(newCapacity);
+            if (m_Buffer && newStorageSize == GetStorageSize())
             {
-                if (m_Head < m_Tail)
-                {
-                    std::move(m_Buffer + m_Head, m_Buffer + m_Tail, newBuffer);
-                }
-                else if (m_Head > m_Tail)
-                {
-                    auto newBufferMid = std::move(m_Buffer + m_Head, m_Buffer + m_Capacity, newBuffer);
-                    std::move(m_Buffer, m_Buffer + (m_Count - (m_Capacity - m_Head)), newBufferMid);
-                }
-                else if (m_Count == m_Capacity)
-                {
-                    auto newBufferMid = std::move(m_Buffer + m_Head, m_Buffer + m_Capacity, newBuffer);
-                    std::move(m_Buffer, m_Buffer + (m_Count - (m_Capacity - m_Head)), newBufferMid);
-                }
+                m_Capacity = newCapacity;
+                return;
             }
-            else
+
+            T* newBuffer = Allocate(newStorageSize);
+            if (m_Buffer)
             {
-                if (m_Head < m_Tail)
+                try
                 {
-                    std::copy(m_Buffer + m_Head, m_Buffer + m_Tail, newBuffer);
+                    Relocate(newBuffer);
                 }
-                else if (m_Head > m_Tail)
+                catch (...)
                 {
-                    auto newBufferMid = std::copy(m_Buffer + m_Head, m_Buffer + m_Capacity, newBuffer);
-                    std::copy(m_Buffer, m_Buffer + (m_Count - (m_Capacity - m_Head)), newBufferMid);
-                }
-                else if (m_Count == m_Capacity)
-                {
-                    auto newBufferMid = std::copy(m_Buffer + m_Head, m_Buffer + m_Capacity, newBuffer);
-                    std::copy(m_Buffer, m_Buffer + (m_Count - (m_Capacity - m_Head)), newBufferMid);
+                    Deallocate(newBuffer, newStorageSize);
+                    throw;
                 }
+                Deallocate(m_Buffer, GetStorageSize());
             }
 
-            m_Capacity = newCapacity; 
-            T* oldBuffer = m_Buffer;
             m_Buffer = newBuffer;
-            delete[] oldBuffer;
-
+            m_Capacity = newCapacity;
+            m_Mask = uint32_t(newStorageSize - 1);
             m_Head = 0;
-            m_Tail = m_Count % m_Capacity;
+            m_Tail = m_Count & m_Mask;
         }
 
         /// <summary>
@@ -305,13 +382,18 @@ namespace ecs
         /// </summary>
         [[nodiscard]] inline constexpr uint32_t GetCapacity() const noexcept { return m_Capacity; }
 
+        [[nodiscard]] std::pmr::memory_resource* GetMemoryResource() const noexcept { return m_Resource; }
+
+        /// <summary>
+        /// Destroy every item in the buffer, the storage is kept.
+        /// </summary>
         void Clear() noexcept
         {
-            if constexpr (std::is_destructible_v<T>)
+            if constexpr (!std::is_trivially_destructible_v<T>)
             {
                 for (uint32_t i = 0; i < m_Count; i++)
                 {
-                    m_Buffer[(m_Head + i) % m_Capacity].~T();
+                    std::destroy_at(m_Buffer + ((m_Head + i) & m_Mask));
                 }
             }
 
@@ -324,14 +406,14 @@ namespace ecs
         class Iterator
         {
         public:
-            Iterator(T* buffer, uint32_t index, uint32_t head, uint32_t capacity) noexcept
+            Iterator(T* buffer, uint32_t index, uint32_t head, uint32_t mask) noexcept
                 : m_Buffer(buffer)
                 , m_Index(index)
                 , m_Head(head)
-                , m_Capacity(capacity)
+                , m_Mask(mask)
             {}
 
-            T& operator*() { return m_Buffer[(m_Head + m_Index) % m_Capacity]; }
+            T& operator*() { return m_Buffer[(m_Head + m_Index) & m_Mask]; }
 
             const Iterator& operator++() noexcept
             {
@@ -345,23 +427,23 @@ namespace ecs
             T* m_Buffer;
             uint32_t m_Index;
             uint32_t m_Head;
-            uint32_t m_Capacity;
+            uint32_t m_Mask;
         };
 
-        Iterator begin() noexcept { return Iterator(m_Buffer, 0, m_Head, m_Capacity); }
-        Iterator end() noexcept { return Iterator(m_Buffer, m_Count, m_Head, m_Capacity); }
+        Iterator begin() noexcept { return Iterator(m_Buffer, 0, m_Head, m_Mask); }
+        Iterator end() noexcept { return Iterator(m_Buffer, m_Count, m_Head, m_Mask); }
 
         class ConstIterator
         {
         public:
-            ConstIterator(const T* buffer, uint32_t index, uint32_t head, uint32_t capacity) noexcept
+            ConstIterator(const T* buffer, uint32_t index, uint32_t head, uint32_t mask) noexcept
                 : m_Buffer(buffer)
                 , m_Index(index)
                 , m_Head(head)
-                , m_Capacity(capacity)
+                , m_Mask(mask)
             {}
 
-            const T& operator*() const { return m_Buffer[(m_Head + m_Index) % m_Capacity]; }
+            const T& operator*() const { return m_Buffer[(m_Head + m_Index) & m_Mask]; }
 
             const ConstIterator& operator++() noexcept
             {
@@ -375,47 +457,33 @@ namespace ecs
             const T* m_Buffer;
             uint32_t m_Index;
             uint32_t m_Head;
-            uint32_t m_Capacity;
+            uint32_t m_Mask;
         };
 
-        ConstIterator begin() const noexcept { return ConstIterator(m_Buffer, 0, m_Head, m_Capacity); }
-        ConstIterator end() const noexcept { return ConstIterator(m_Buffer, m_Count, m_Head, m_Capacity); }
+        ConstIterator begin() const noexcept { return ConstIterator(m_Buffer, 0, m_Head, m_Mask); }
+        ConstIterator end() const noexcept { return ConstIterator(m_Buffer, m_Count, m_Head, m_Mask); }
     #pragma endregion
 
     #pragma region OperatorLogic
         [[nodiscard]] constexpr T& operator[](uint32_t index) {
             if (index >= m_Count)
                 throw CircularBufferException("Index out of range");
-            return m_Buffer[(m_Head + index) % m_Capacity];
+            return m_Buffer[(m_Head + index) & m_Mask];
         }
         [[nodiscard]] constexpr const T& operator[](uint32_t index) const {
             if (index >= m_Count)
                 throw CircularBufferException("Index out of range");
-            return m_Buffer[(m_Head + index) % m_Capacity];
+            return m_Buffer[(m_Head + index) & m_Mask];
         }
 
-        CircularBuffer& operator=(const CircularBuffer& other) noexcept
+        CircularBuffer& operator=(const CircularBuffer& other)
         {
             static_assert(std::is_copy_constructible_v<T>, "T must be copy constructible");
-            if (this != other)
+            if (this != &other)
             {
-                delete[] m_Buffer;
-
-                m_Capacity = other.m_Capacity;
-                m_Count = other.m_Count;
-                m_Head = 0;
-                m_Tail = other.m_Tail % other.m_Capacity;
-
-                m_Buffer = new T[m_Capacity];
-                if (other.m_Head < other.m_Tail)
-                {
-                    std::copy(other.m_Buffer + other.m_Head, other.m_Buffer + other.m_Tail, m_Buffer);
-                }
-                else
-                {
-                    auto newBufferMid = std::copy(other.m_Buffer + other.m_Head, other.m_Buffer + other.m_Capacity, m_Buffer);
-                    std::copy(other.m_Buffer, other.m_Buffer + (other.m_Count - (other.m_Capacity - other.m_Head)), newBufferMid);
-                }
+                // the copy keeps the resource of this buffer
+                CircularBuffer copy(other, m_Resource);
+                *this = std::move(copy);
             }
             return *this;
         }
@@ -424,19 +492,23 @@ namespace ecs
         {
             if (this != &other)
             {
-                delete[] m_Buffer;
+                Clear();
+                Deallocate(m_Buffer, GetStorageSize());
 
+                m_Resource = other.m_Resource;
                 m_Buffer = other.m_Buffer;
                 m_Head = other.m_Head;
                 m_Tail = other.m_Tail;
                 m_Count = other.m_Count;
                 m_Capacity = other.m_Capacity;
+                m_Mask = other.m_Mask;
 
                 other.m_Buffer = nullptr;
                 other.m_Head = 0;
                 other.m_Tail = 0;
                 other.m_Count = 0;
                 other.m_Capacity = 0;
+                other.m_Mask = 0;
             }
 
             return *this;
@@ -444,35 +516,181 @@ namespace ecs
     #pragma endregion
 
     private:
+        std::pmr::memory_resource* m_Resource;
         T* m_Buffer;
         uint32_t m_Head;
         uint32_t m_Tail;
         uint32_t m_Count;
         uint32_t m_Capacity;
+        uint32_t m_Mask{ 0 }; // storage size - 1, the storage size is a power of two (up to 2^32)
 
     private:
-        
+
         /// <summary>
-        /// Resize helper method that checks if the buffer is full and needs to be resized
+        /// Smallest power of two that can hold the given capacity
         /// </summary>
-        void CheckForResize()
+        static constexpr uint64_t GetStorageSizeFor(uint32_t capacity) noexcept
         {
-            if (m_Count < m_Capacity)
-                return;
+            return std::bit_ceil(std::max<uint64_t>(capacity, 1));
+        }
+
+        [[nodiscard]] uint64_t GetStorageSize() const noexcept { return uint64_t(m_Mask) + 1; }
+
+        T* Allocate(uint64_t storageSize)
+        {
+            return static_cast<T*>(m_Resource->allocate(size_t(storageSize * sizeof(T)), alignof(T)));
+        }
+
+        void Deallocate(T* buffer, uint64_t storageSize) noexcept
+        {
+            if (buffer)
+                m_Resource->deallocate(buffer, size_t(storageSize * sizeof(T)), alignof(T));
+        }
+
+        /// <summary>
+        /// Copy construct count items into uninitialized slots
+        /// </summary>
+        static void CopyConstruct(const T* src, uint32_t count, T* dst)
+        {
+            if constexpr (std::is_trivially_copyable_v<T>)
+                std::memcpy(static_cast<void*>(dst), src, size_t(count) * sizeof(T));
+            else
+                std::uninitialized_copy_n(src, count, dst);
+        }
+
+        /// <summary>
+        /// Move count items out of the buffer into already constructed objects, the buffer slots are left destroyed
+        /// </summary>
+        static void MoveOut(T* src, uint32_t count, T* dst)
+        {
+            if constexpr (std::is_trivially_copyable_v<T>)
+            {
+                std::memcpy(static_cast<void*>(dst), src, size_t(count) * sizeof(T));
+            }
+            else
+            {
+                std::move(src, src + count, dst);
+                std::destroy_n(src, count);
+            }
+        }
+
+        /// <summary>
+        /// Move every item, in order, to the start of the given storage. The old slots are left destroyed.
+        /// </summary>
+        void Relocate(T* newBuffer)
+        {
+            uint32_t firstPart = (uint32_t)std::min<uint64_t>(m_Count, GetStorageSize() - m_Head);
+            if constexpr (IsTriviallyRelocatable<T>::value)
+            {
+                std::memcpy(static_cast<void*>(newBuffer), m_Buffer + m_Head, size_t(firstPart) * sizeof(T));
+                std::memcpy(static_cast<void*>(newBuffer + firstPart), m_Buffer, size_t(m_Count - firstPart) * sizeof(T));
+            }
+            else
+            {
+                uint32_t constructed = 0;
+                try
+                {
+                    for (; constructed < m_Count; ++constructed)
+                        std::construct_at(newBuffer + constructed, std::move_if_noexcept(m_Buffer[(m_Head + constructed) & m_Mask]));
+                }
+                catch (...)
+                {
+                    std::destroy(newBuffer, newBuffer + constructed);
+                    throw;
+                }
+                for (uint32_t i = 0; i < m_Count; ++i)
+                    std::destroy_at(m_Buffer + ((m_Head + i) & m_Mask));
+            }
+        }
 
-            uint32_t newCapacity;
+        [[noreturn]] ECS_NO_INLINE static void ThrowEmpty()
+        {
+            throw CircularBufferException("CircularBuffer is empty");
+        }
+
+        /// <summary>
+        /// Double the capacity
+        /// </summary>
+        [[nodiscard]] uint32_t GetGrownCapacity() const
+        {
             if (m_Capacity == std::numeric_limits<uint32_t>::max())
                 throw CircularBufferException("CircularBuffer is full and its capacity is at the limit");
 
             if (m_Capacity > std::numeric_limits<uint32_t>::max() / 2)
+                return std::numeric_limits<uint32_t>::max();
+            return std::max(uint32_t(m_Capacity * 2), 1u);
+        }
+
+        /// <summary>
+        /// Move the items to new storage for the given capacity, after constructing count new items at slot of the new storage
+        /// with construct(T* slotAddress). The old storage stays alive until the new items exist, so they can be copied from it.
+        /// The new items aren't counted, the caller updates the head or the tail and the count.
+        /// </summary>
+        template<typename Construct>
+        void ReallocateAround(uint32_t newCapacity, uint32_t slot, uint32_t count, Construct&& construct)
+        {
+            uint64_t newStorageSize = GetStorageSizeFor(newCapacity);
+            T* newBuffer = Allocate(newStorageSize);
+            try
+            {
+                construct(newBuffer + slot);
+            }
+            catch (...)
             {
-                newCapacity = std::numeric_limits<uint32_t>::max();
+                Deallocate(newBuffer, newStorageSize);
+                throw;
+            }
+            if (m_Buffer)
+            {
+                try
+                {
+                    Relocate(newBuffer);
+                }
+                catch (...)
+                {
+                    std::destroy_n(newBuffer + slot, count);
+                    Deallocate(newBuffer, newStorageSize);
+                    throw;
+                }
+                Deallocate(m_Buffer, GetStorageSize());
+            }
+
+            m_Buffer = newBuffer;
+            m_Capacity = newCapacity;
+            m_Mask = uint32_t(newStorageSize - 1);
+            m_Head = 0;
+            m_Tail = m_Count & m_Mask;
+        }
+
+        /// <summary>
+        /// Grow the full buffer and construct a new item at its front or back, kept out of line so that the push functions
+        /// stay small enough to be inlined.
+        /// Like vector::emplace_back, the item is constructed in the new storage before the old one is freed,
+        /// so the arguments may refer to items of the buffer.
+        /// </summary>
+        template<bool Front, typename... Args>
+        ECS_NO_INLINE void GrowAndConstruct(Args&&... args)
+        {
+            uint32_t newCapacity = GetGrownCapacity();
+            uint64_t newStorageSize = GetStorageSizeFor(newCapacity);
+            if (m_Buffer && newStorageSize == GetStorageSize())
+            {
+                // only the requested capacity grows, nothing moves
+                uint32_t slot = Front ? ((m_Head - 1) & m_Mask) : m_Tail;
+                std::construct_at(m_Buffer + slot, std::forward<Args>(args)...);
+                m_Capacity = newCapacity;
             }
             else
             {
-                newCapacity = uint32_t(m_Capacity * 2);
+                uint32_t slot = Front ? uint32_t(newStorageSize - 1) : m_Count;
+                ReallocateAround(newCapacity, slot, 1, [&](T* dst) { std::construct_at(dst, std::forward<Args>(args)...); });
             }
-            Resize(newCapacity);
+
+            if constexpr (Front)
+                m_Head = (m_Head - 1) & m_Mask;
+            else
+                m_Tail = (m_Tail + 1) & m_Mask;
+            m_Count++;
         }
     };
-}
\ No newline at end of file
+}
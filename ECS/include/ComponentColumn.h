@@ -0,0 +1,435 @@
+#pragma once
+#include "Types.h"
+#include <memory_resource>
+#include <cstring>
+#include <atomic>
+
+namespace ecs
+{
+    // columns start on a multiple of this offset and their memory is padded to a multiple of it,
+    // so vector loads of up to this many bytes never leave the column, see ComponentView::EachBatch
+    constexpr size_t COLUMN_ALIGNMENT = 64;
+    // widest batch of ComponentView::EachBatch: columns of trivially copyable components are padded to a multiple of this many rows,
+    // so loading the whole last batch of a column never leaves its memory whatever the size of the component
+    constexpr uint32_t MAX_BATCH_WIDTH = 64;
+
+    /// <summary>
+    /// Contiguous array of components allocated from a memory resource, with the interface of the std::pmr::vector it replaces.
+    /// On top of that, a column of trivially copyable components can adopt memory it doesn't own (e.g. a mapped snapshot file)
+    /// without copying it. Adopted memory is never freed by the column, and the first reallocation (growing or shrinking)
+    /// copies the components into memory of the column's resource.
+    /// Columns can also share their components copy on write (see ShareFrom): a shared column is read only until MakeUnique
+    /// gives it its own copy. Its mutating methods call MakeUnique, writing through operator[], data() or the iterators
+    /// requires calling it first.
+    /// The memory is aligned and padded to COLUMN_ALIGNMENT, and to MAX_BATCH_WIDTH rows for trivially copyable components;
+    /// adopted memory is expected to be as well.
+    /// </summary>
+    template<typename T>
+    class ComponentColumn
+    {
+    public:
+        using value_type = T;
+        using iterator = T*;
+        using const_iterator = const T*;
+
+        explicit ComponentColumn(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+            : m_Resource(resource)
+        {}
+
+        // columns live in heap allocated storages and are never copied or moved around
+        ComponentColumn(const ComponentColumn&) = delete;
+        ComponentColumn& operator=(const ComponentColumn&) = delete;
+
+        ~ComponentColumn()
+        {
+            clear();
+            Deallocate();
+        }
+
+        template<typename... Args>
+        T& emplace_back(Args&&... args)
+        {
+            MakeUnique();
+            if (m_Size == m_Capacity) [[unlikely]]
+                return GrowAndEmplace(std::forward<Args>(args)...);
+            T* component = Construct(m_Data + m_Size, std::forward<Args>(args)...);
+            ++m_Size;
+            return *component;
+        }
+
+        void push_back(const T& component) { emplace_back(component); }
+        void push_back(T&& component) { emplace_back(std::move(component)); }
+
+        void pop_back()
+        {
+            assert(m_Size > 0 && "pop_back on an empty column");
+            MakeUnique();
+            std::destroy_at(m_Data + --m_Size);
+        }
+
+        /// <summary>
+        /// Grows the column with value initialized components or destroys the last ones.
+        /// </summary>
+        void resize(size_t size)
+        {
+            MakeUnique();
+            if (size > m_Capacity)
+                Reallocate((uint32_t)size);
+            if (size < m_Size)
+                std::destroy(m_Data + size, m_Data + m_Size);
+            else
+            {
+                for (T* component = m_Data + m_Size; component != m_Data + size; ++component)
+                    Construct(component);
+            }
+            m_Size = (uint32_t)size;
+        }
+
+        void reserve(size_t capacity)
+        {
+            MakeUnique();
+            if (capacity > m_Capacity)
+                Reallocate((uint32_t)capacity);
+        }
+
+        void shrink_to_fit()
+        {
+            MakeUnique();
+            if (m_Size < m_Capacity)
+                Reallocate(m_Size);
+        }
+
+        void clear() noexcept
+        {
+            if (m_Share)
+            {
+                // the components stay with the other columns
+                ReleaseShare();
+                return;
+            }
+            std::destroy(m_Data, m_Data + m_Size);
+            m_Size = 0;
+        }
+
+        /// <summary>
+        /// Moves every component of another column to the end of this one and leaves the other column empty.
+        /// When this column is empty and both columns allocate from equal resources, the memory itself changes hands.
+        /// </summary>
+        void Splice(ComponentColumn& other)
+        {
+            if (this == &other || other.m_Size == 0)
+                return;
+            MakeUnique();
+            other.MakeUnique();
+            if (m_Size == 0 && !other.m_Borrowed && m_Resource->is_equal(*other.m_Resource))
+            {
+                Deallocate();
+                m_Data = std::exchange(other.m_Data, nullptr);
+                m_Size = std::exchange(other.m_Size, 0);
+                m_Capacity = std::exchange(other.m_Capacity, 0);
+                return;
+            }
+
+            const uint32_t size = m_Size + other.m_Size;
+            if (size > m_Capacity)
+                Reallocate(std::max(size, m_Capacity * 2));
+            if constexpr (IsTriviallyRelocatable<T>::value)
+                std::memcpy(static_cast<void*>(m_Data + m_Size), other.m_Data, sizeof(T) * other.m_Size);
+            else
+            {
+                // both columns are left untouched if a component throws, unless it can only be moved
+                MoveConstruct(other.m_Data, other.m_Size, m_Data + m_Size);
+                std::destroy(other.m_Data, other.m_Data + other.m_Size);
+            }
+            m_Size = size;
+            other.m_Size = 0;
+        }
+
+        /// <summary>
+        /// Allocates what Splice(other) needs, so that splicing can only throw from the components' constructors.
+        /// </summary>
+        void ReserveSplice(ComponentColumn& other)
+        {
+            if (this == &other || other.m_Size == 0)
+                return;
+            MakeUnique();
+            other.MakeUnique();
+            if (m_Size == 0 && !other.m_Borrowed && m_Resource->is_equal(*other.m_Resource))
+                return;
+            const uint32_t size = m_Size + other.m_Size;
+            if (size > m_Capacity)
+                Reallocate(std::max(size, m_Capacity * 2));
+        }
+
+        /// <summary>
+        /// Replaces the content of the column by count components already laid out at data.
+        /// The memory has to stay valid and writable as long as the column uses it, i.e. until it reallocates or is destroyed.
+        /// </summary>
+        void Adopt(T* data, uint32_t count) requires std::is_trivially_copyable_v<T>
+        {
+            assert(reinterpret_cast<uintptr_t>(data) % ALIGNMENT == 0 && "Adopted memory is misaligned");
+            clear();
+            Deallocate();
+            m_Data = data;
+            m_Size = count;
+            m_Capacity = count;
+            m_Borrowed = true;
+        }
+
+        // true while the column uses memory it doesn't own
+        [[nodiscard]] bool IsBorrowed() const noexcept { return m_Borrowed; }
+
+        // bytes of memory taken by a column of capacity components, padding included
+        [[nodiscard]] static size_t GetAllocationSize(uint32_t capacity)
+        {
+            // only trivially copyable components can be loaded as a whole batch (see Batch::GetScalars)
+            size_t rows = capacity;
+            if constexpr (std::is_trivially_copyable_v<T>)
+                rows = (rows + MAX_BATCH_WIDTH - 1) / MAX_BATCH_WIDTH * MAX_BATCH_WIDTH;
+            return (sizeof(T) * rows + COLUMN_ALIGNMENT - 1) / COLUMN_ALIGNMENT * COLUMN_ALIGNMENT;
+        }
+
+        /// <summary>
+        /// Makes this column share the components of another one, which is cheap whatever their number:
+        /// both become read only and the first one to be modified copies them (MakeUnique).
+        /// The other column's memory resource has to outlive this column.
+        /// </summary>
+        void ShareFrom(ComponentColumn& other) requires std::is_copy_constructible_v<T>
+        {
+            if (this == &other)
+                return;
+            clear();
+            Deallocate();
+            if (!other.m_Share)
+                other.m_Share = std::pmr::polymorphic_allocator<>(other.m_Resource).new_object<ColumnShare>(other.m_Resource, !other.m_Borrowed);
+            other.m_Share->RefCount.fetch_add(1, std::memory_order_relaxed);
+            m_Share = other.m_Share;
+            m_Data = other.m_Data;
+            m_Size = other.m_Size;
+            m_Capacity = other.m_Capacity;
+            m_Borrowed = other.m_Borrowed;
+        }
+
+        /// <summary>
+        /// Gives the column its own copy of the components if they are shared with other columns.
+        /// </summary>
+        ECS_FORCE_INLINE void MakeUnique()
+        {
+            if (m_Share) [[unlikely]]
+                Unshare();
+        }
+
+        // true while the components are shared with other columns and must not be written to
+        [[nodiscard]] bool IsShared() const noexcept { return m_Share != nullptr; }
+
+        [[nodiscard]] ECS_FORCE_INLINE T& operator[](size_t index) noexcept { return m_Data[index]; }
+        [[nodiscard]] ECS_FORCE_INLINE const T& operator[](size_t index) const noexcept { return m_Data[index]; }
+        [[nodiscard]] T& back() noexcept { return m_Data[m_Size - 1]; }
+        [[nodiscard]] const T& back() const noexcept { return m_Data[m_Size - 1]; }
+        [[nodiscard]] T& front() noexcept { return m_Data[0]; }
+        [[nodiscard]] const T& front() const noexcept { return m_Data[0]; }
+
+        [[nodiscard]] ECS_FORCE_INLINE T* data() noexcept { return m_Data; }
+        [[nodiscard]] ECS_FORCE_INLINE const T* data() const noexcept { return m_Data; }
+        [[nodiscard]] ECS_FORCE_INLINE size_t size() const noexcept { return m_Size; }
+        [[nodiscard]] size_t capacity() const noexcept { return m_Capacity; }
+        [[nodiscard]] bool empty() const noexcept { return m_Size == 0; }
+        [[nodiscard]] std::pmr::memory_resource* GetMemoryResource() const noexcept { return m_Resource; }
+
+        [[nodiscard]] iterator begin() noexcept { return m_Data; }
+        [[nodiscard]] iterator end() noexcept { return m_Data + m_Size; }
+        [[nodiscard]] const_iterator begin() const noexcept { return m_Data; }
+        [[nodiscard]] const_iterator end() const noexcept { return m_Data + m_Size; }
+
+    private:
+        // shared by the columns using the same components, the last one to let go of them destroys them
+        struct ColumnShare
+        {
+            ColumnShare(std::pmr::memory_resource* resource, bool ownsData)
+                : Resource(resource)
+                , OwnsData(ownsData)
+            {}
+
+            std::atomic<uint32_t> RefCount{ 1 };
+            std::pmr::memory_resource* Resource; // the components were allocated from it
+            bool OwnsData;                       // false for adopted memory
+        };
+
+        ECS_NO_INLINE void Unshare()
+        {
+            if (m_Share->RefCount.load(std::memory_order_acquire) == 1 && m_Share->Resource == m_Resource)
+            {
+                // the other columns are gone, the components are ours again
+                m_Borrowed = !m_Share->OwnsData;
+                std::pmr::polymorphic_allocator<>(m_Resource).delete_object(m_Share);
+                m_Share = nullptr;
+                return;
+            }
+
+            const uint32_t size = m_Size;
+            const uint32_t capacity = std::max(m_Capacity, MIN_CAPACITY);
+            T* data = Allocate(capacity);
+            if constexpr (std::is_trivially_copyable_v<T>)
+            {
+                if (size)
+                    std::memcpy(static_cast<void*>(data), m_Data, sizeof(T) * size);
+            }
+            else
+            {
+                uint32_t constructed = 0;
+                try
+                {
+                    for (; constructed < size; ++constructed)
+                        Construct(data + constructed, std::as_const(m_Data[constructed]));
+                }
+                catch (...)
+                {
+                    std::destroy(data, data + constructed);
+                    Free(m_Resource, data, capacity);
+                    throw;
+                }
+            }
+            ReleaseShare();
+            m_Data = data;
+            m_Size = size;
+            m_Capacity = capacity;
+        }
+
+        void ReleaseShare() noexcept
+        {
+            ColumnShare* share = std::exchange(m_Share, nullptr);
+            if (share->RefCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                std::destroy(m_Data, m_Data + m_Size);
+                if (share->OwnsData && m_Data)
+                    Free(share->Resource, m_Data, m_Capacity);
+                std::pmr::polymorphic_allocator<>(share->Resource).delete_object(share);
+            }
+            m_Data = nullptr;
+            m_Size = 0;
+            m_Capacity = 0;
+            m_Borrowed = false;
+        }
+
+        // components are built with uses-allocator construction like in a pmr vector, so pmr aware components share the resource
+        template<typename... Args>
+        T* Construct(T* component, Args&&... args)
+        {
+            return std::uninitialized_construct_using_allocator(component, std::pmr::polymorphic_allocator<T>(m_Resource), std::forward<Args>(args)...);
+        }
+
+        template<typename... Args>
+        ECS_NO_INLINE T& GrowAndEmplace(Args&&... args)
+        {
+            // the new component is built before the others are relocated, the arguments may refer to one of them
+            uint32_t capacity = std::max<uint32_t>(m_Capacity * 2, MIN_CAPACITY);
+            T* data = Allocate(capacity);
+            T* component;
+            try
+            {
+                component = Construct(data + m_Size, std::forward<Args>(args)...);
+            }
+            catch (...)
+            {
+                Free(m_Resource, data, capacity);
+                throw;
+            }
+            try
+            {
+                Relocate(data);
+            }
+            catch (...)
+            {
+                std::destroy_at(component);
+                Free(m_Resource, data, capacity);
+                throw;
+            }
+            Deallocate();
+            m_Data = data;
+            m_Capacity = capacity;
+            ++m_Size;
+            return *component;
+        }
+
+        ECS_NO_INLINE void Reallocate(uint32_t capacity)
+        {
+            T* data = capacity ? Allocate(capacity) : nullptr;
+            try
+            {
+                Relocate(data);
+            }
+            catch (...)
+            {
+                Free(m_Resource, data, capacity);
+                throw;
+            }
+            Deallocate();
+            m_Data = data;
+            m_Capacity = capacity;
+        }
+
+        // moves the components to the new memory, they are dead in the old one.
+        // If a component throws, the new memory is left empty and the column untouched (see MoveConstruct)
+        void Relocate(T* data)
+        {
+            if constexpr (IsTriviallyRelocatable<T>::value)
+            {
+                if (m_Size)
+                    std::memcpy(static_cast<void*>(data), m_Data, sizeof(T) * m_Size);
+            }
+            else
+            {
+                MoveConstruct(m_Data, m_Size, data);
+                std::destroy(m_Data, m_Data + m_Size);
+            }
+        }
+
+        // like std::vector, components whose move constructor can throw are copied so the source is still intact
+        // when one of them throws, the components constructed so far are destroyed before rethrowing.
+        // Only components that can't be copied are moved anyway, they get the basic guarantee
+        void MoveConstruct(T* source, uint32_t count, T* destination)
+        {
+            uint32_t constructed = 0;
+            try
+            {
+                for (; constructed < count; ++constructed)
+                    Construct(destination + constructed, std::move_if_noexcept(source[constructed]));
+            }
+            catch (...)
+            {
+                std::destroy(destination, destination + constructed);
+                throw;
+            }
+        }
+
+        void Deallocate() noexcept
+        {
+            if (m_Data && !m_Borrowed)
+                Free(m_Resource, m_Data, m_Capacity);
+            m_Data = nullptr;
+            m_Capacity = 0;
+            m_Borrowed = false;
+        }
+
+        [[nodiscard]] T* Allocate(uint32_t capacity)
+        {
+            return static_cast<T*>(m_Resource->allocate(GetAllocationSize(capacity), ALIGNMENT));
+        }
+
+        static void Free(std::pmr::memory_resource* resource, T* data, uint32_t capacity) noexcept
+        {
+            resource->deallocate(data, GetAllocationSize(capacity), ALIGNMENT);
+        }
+
+    private:
+        static constexpr uint32_t MIN_CAPACITY = 4;
+        static constexpr size_t ALIGNMENT = std::max(alignof(T), COLUMN_ALIGNMENT);
+
+        std::pmr::memory_resource* m_Resource;
+        T* m_Data = nullptr;
+        uint32_t m_Size = 0;
+        uint32_t m_Capacity = 0;
+        bool m_Borrowed = false;
+        ColumnShare* m_Share = nullptr; // set while the components are shared with other columns
+    };
+}
@@ -0,0 +1,555 @@
+#pragma once
+#include "Types.h"
+#include <vector>
+#include <span>
+#include <cstring>
+#include <new>
+#include <memory>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <utility>
+#include <mutex>
+#include <memory_resource>
+
+namespace ecs
+{
+
+    /// <summary>
+    /// Unbounded lock-free multi-producer single-consumer queue.
+    /// Items are stored in a linked list of fixed-size segments: producers claim a slot with a single fetch_add
+    /// and publish it with a ready flag, the consumer reads the slots in order.
+    /// A producer publishes the segment it works on in a hazard slot and the consumer only frees the drained segments
+    /// no hazard slot holds, so a late producer can never touch freed memory and at most HAZARD_SLOT_COUNT drained segments
+    /// wait to be freed however busy the producers are. More concurrent producers than hazard slots wait for one to be free.
+    /// Segments come from a memory resource, which doesn't have to be thread safe: the queue serializes its own calls to it,
+    /// one every SegmentSize pushes. The resource moves along with the segments when the queue is moved.
+    /// </summary>
+    template<typename T, uint32_t SegmentSize = 256>
+        requires std::is_trivially_copyable_v<T>
+    class MPSCQueue
+    {
+        struct Segment
+        {
+            std::atomic<uint32_t> WriteIndex{ 0 };
+            std::atomic<Segment*> Next{ nullptr };
+            std::array<std::atomic<uint8_t>, SegmentSize> Ready{};
+            std::array<T, SegmentSize> Items;
+        };
+
+    public:
+        static constexpr uint32_t HAZARD_SLOT_COUNT = 32;
+
+        explicit MPSCQueue(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+            : m_Resource(resource)
+        {
+            m_Head = NewSegment();
+            m_Tail.store(m_Head, std::memory_order_relaxed);
+        }
+
+        /// <summary>
+        /// Move constructor. Must not race with producers or the consumer of either queue.
+        /// The moved-from queue is left without segments, it can only be assigned to or destroyed.
+        /// </summary>
+        MPSCQueue(MPSCQueue&& other) noexcept
+            : m_Resource(other.m_Resource)
+            , m_Tail(other.m_Tail.exchange(nullptr, std::memory_order_relaxed))
+            , m_Head(std::exchange(other.m_Head, nullptr))
+            , m_ReadIndex(std::exchange(other.m_ReadIndex, 0))
+            , m_Retired(other.m_Retired)
+            , m_RetiredCount(std::exchange(other.m_RetiredCount, 0))
+        {}
+
+        MPSCQueue(const MPSCQueue&) = delete;
+        MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+        MPSCQueue& operator=(MPSCQueue&& other) noexcept
+        {
+            if (this != &other)
+                Swap(other);
+            return *this;
+        }
+
+        ~MPSCQueue()
+        {
+            for (uint32_t i = 0; i < m_RetiredCount; ++i)
+                DeleteSegment(m_Retired[i]);
+            Segment* segment = m_Head;
+            while (segment)
+            {
+                Segment* next = segment->Next.load(std::memory_order_relaxed);
+                DeleteSegment(segment);
+                segment = next;
+            }
+        }
+
+        /// <summary>
+        /// Add an item to the end of the queue. Safe to call from any number of threads at once.
+        /// </summary>
+        void PushBack(const T& item)
+        {
+            HazardScope hazard(*this);
+            Segment* segment = hazard.ProtectTail();
+            while (true)
+            {
+                uint32_t index = segment->WriteIndex.fetch_add(1, std::memory_order_relaxed);
+                if (index < SegmentSize)
+                {
+                    segment->Items[index] = item;
+                    segment->Ready[index].store(1, std::memory_order_release);
+                    return;
+                }
+
+                // the segment is full, link a new one (or use the one another producer linked) and retry there
+                Segment* next = segment->Next.load(std::memory_order_acquire);
+                if (!next)
+                {
+                    Segment* newSegment = NewSegment();
+                    if (segment->Next.compare_exchange_strong(next, newSegment, std::memory_order_acq_rel, std::memory_order_acquire))
+                        next = newSegment;
+                    else
+                        DeleteSegment(newSegment);
+                }
+                m_Tail.compare_exchange_strong(segment, next, std::memory_order_acq_rel, std::memory_order_acquire);
+                segment = hazard.ProtectTail();
+            }
+        }
+
+        /// <summary>
+        /// Remove the first item of the queue. Consumer thread only.
+        /// Returns false if the queue is empty or if the next item is still being written by a producer.
+        /// </summary>
+        bool PopFront(T& outItem)
+        {
+            if (m_ReadIndex == SegmentSize && !MoveToNextSegment())
+                return false;
+
+            if (!m_Head->Ready[m_ReadIndex].load(std::memory_order_acquire))
+                return false;
+            outItem = m_Head->Items[m_ReadIndex++];
+            return true;
+        }
+
+        /// <summary>
+        /// Remove up to out.size() items from the front of the queue and write them, in order, to the output span.
+        /// Runs of published items are copied with one memcpy per segment. Consumer thread only.
+        /// </summary>
+        /// <returns>the number of items removed, it stops early at an item that is still being written</returns>
+        uint32_t PopFrontInto(std::span<T> out)
+        {
+            uint32_t popped = 0;
+            while (popped < out.size())
+            {
+                if (m_ReadIndex == SegmentSize && !MoveToNextSegment())
+                    break;
+
+                uint32_t end = m_ReadIndex;
+                uint32_t last = (uint32_t)std::min<uint64_t>(SegmentSize, m_ReadIndex + (out.size() - popped));
+                while (end < last && m_Head->Ready[end].load(std::memory_order_acquire))
+                    ++end;
+                if (end == m_ReadIndex)
+                    break;
+
+                std::memcpy(out.data() + popped, m_Head->Items.data() + m_ReadIndex, (end - m_ReadIndex) * sizeof(T));
+                popped += end - m_ReadIndex;
+                m_ReadIndex = end;
+            }
+            return popped;
+        }
+
+        /// <summary>
+        /// Number of items pushed but not popped yet, including the ones still being written. Consumer thread only.
+        /// </summary>
+        [[nodiscard]] uint32_t GetSize() const
+        {
+            uint32_t size = 0;
+            uint32_t readIndex = m_ReadIndex;
+            for (const Segment* segment = m_Head; segment; segment = segment->Next.load(std::memory_order_acquire))
+            {
+                size += std::min(segment->WriteIndex.load(std::memory_order_relaxed), SegmentSize) - readIndex;
+                readIndex = 0;
+            }
+            return size;
+        }
+
+        /// <summary>
+        /// Check if queue is empty, without walking the segments like GetSize. Consumer thread only.
+        /// </summary>
+        [[nodiscard]] bool IsEmpty() const
+        {
+            if (m_ReadIndex < std::min(m_Head->WriteIndex.load(std::memory_order_relaxed), SegmentSize))
+                return false;
+            // a segment is only linked once the previous one is full, so the next one is the last and may not have items yet
+            const Segment* next = m_Head->Next.load(std::memory_order_acquire);
+            return !next || next->WriteIndex.load(std::memory_order_relaxed) == 0;
+        }
+
+        // drained segments not freed yet, at most HAZARD_SLOT_COUNT + 1 (the tail). Consumer thread only.
+        [[nodiscard]] uint32_t GetRetiredSegmentCount() const { return m_RetiredCount; }
+
+        [[nodiscard]] std::pmr::memory_resource* GetMemoryResource() const noexcept { return m_Resource; }
+
+    private:
+        struct alignas(ECS_CACHE_LINE_SIZE) HazardSlot
+        {
+            std::atomic<Segment*> Protected{ nullptr };
+        };
+
+        // marks a hazard slot as taken before the producer knows which segment it will publish, never a real segment
+        static Segment* ClaimedSlot() { return reinterpret_cast<Segment*>(uintptr_t(1)); }
+
+        /// <summary>
+        /// Hazard slot of a producer for the duration of a push: the segment published in it isn't freed by the consumer.
+        /// </summary>
+        class HazardScope
+        {
+        public:
+            explicit HazardScope(MPSCQueue& queue)
+                : m_Queue(queue)
+            {
+                // producers start looking at different slots so they rarely fight over one
+                static std::atomic<uint32_t> s_NextHint{ 0 };
+                thread_local const uint32_t hint = s_NextHint.fetch_add(1, std::memory_order_relaxed);
+                for (uint32_t i = hint;; ++i)
+                {
+                    std::atomic<Segment*>& slot = queue.m_HazardSlots[i % HAZARD_SLOT_COUNT].Protected;
+                    Segment* expected = nullptr;
+                    if (slot.load(std::memory_order_relaxed) == nullptr
+                        && slot.compare_exchange_strong(expected, ClaimedSlot(), std::memory_order_acquire, std::memory_order_relaxed))
+                    {
+                        m_Slot = &slot;
+                        return;
+                    }
+                }
+            }
+
+            HazardScope(const HazardScope&) = delete;
+            HazardScope& operator=(const HazardScope&) = delete;
+
+            ~HazardScope() { m_Slot->store(nullptr, std::memory_order_release); }
+
+            /// <summary>
+            /// Publishes the tail and returns it once it is known to still be the tail after publication:
+            /// the consumer then either sees it in the slot or sees that the tail has moved on and can't be handed out anymore.
+            /// </summary>
+            Segment* ProtectTail()
+            {
+                Segment* segment = m_Queue.m_Tail.load(std::memory_order_seq_cst);
+                while (true)
+                {
+                    m_Slot->store(segment, std::memory_order_seq_cst);
+                    Segment* current = m_Queue.m_Tail.load(std::memory_order_seq_cst);
+                    if (current == segment)
+                        return segment;
+                    segment = current;
+                }
+            }
+
+        private:
+            MPSCQueue& m_Queue;
+            std::atomic<Segment*>* m_Slot = nullptr;
+        };
+
+        /// <summary>
+        /// Retire the drained head segment and continue reading from the next one, if it has been linked already
+        /// </summary>
+        bool MoveToNextSegment()
+        {
+            Segment* next = m_Head->Next.load(std::memory_order_acquire);
+            if (!next)
+                return false;
+            m_Retired[m_RetiredCount++] = m_Head;
+            m_Head = next;
+            m_ReadIndex = 0;
+            ReclaimSegments();
+            return true;
+        }
+
+        void ReclaimSegments()
+        {
+            // the tail can lag one segment behind the consumer, it stays alive until the tail moves past it.
+            // The tail only moves forward, so a drained segment it has left can only be held by the producers that published it,
+            // which is why the tail is read before the hazard slots
+            Segment* tail = m_Tail.load(std::memory_order_seq_cst);
+            auto it = std::remove_if(m_Retired.begin(), m_Retired.begin() + m_RetiredCount, [this, tail](Segment* segment)
+            {
+                if (segment == tail || IsHazard(segment))
+                    return false;
+                DeleteSegment(segment);
+                return true;
+            });
+            m_RetiredCount = uint32_t(it - m_Retired.begin());
+        }
+
+        Segment* NewSegment()
+        {
+            std::lock_guard lock(m_ResourceMutex);
+            return std::pmr::polymorphic_allocator<>(m_Resource).new_object<Segment>();
+        }
+
+        void DeleteSegment(Segment* segment)
+        {
+            std::lock_guard lock(m_ResourceMutex);
+            std::pmr::polymorphic_allocator<>(m_Resource).delete_object(segment);
+        }
+
+        [[nodiscard]] bool IsHazard(const Segment* segment) const
+        {
+            for (const HazardSlot& slot : m_HazardSlots)
+            {
+                if (slot.Protected.load(std::memory_order_seq_cst) == segment)
+                    return true;
+            }
+            return false;
+        }
+
+        void Swap(MPSCQueue& other) noexcept
+        {
+            Segment* tail = m_Tail.load(std::memory_order_relaxed);
+            m_Tail.store(other.m_Tail.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            other.m_Tail.store(tail, std::memory_order_relaxed);
+            std::swap(m_Resource, other.m_Resource);
+            std::swap(m_Head, other.m_Head);
+            std::swap(m_ReadIndex, other.m_ReadIndex);
+            std::swap(m_Retired, other.m_Retired);
+            std::swap(m_RetiredCount, other.m_RetiredCount);
+        }
+
+    private:
+        std::pmr::memory_resource* m_Resource;
+        std::mutex m_ResourceMutex;
+
+        alignas(ECS_CACHE_LINE_SIZE) std::atomic<Segment*> m_Tail{ nullptr };
+        std::array<HazardSlot, HAZARD_SLOT_COUNT> m_HazardSlots;
+
+        // consumer side
+        alignas(ECS_CACHE_LINE_SIZE) Segment* m_Head;
+        uint32_t m_ReadIndex{ 0 };
+        // the retired segments kept are the tail or in a hazard slot, plus the one being retired
+        std::array<Segment*, HAZARD_SLOT_COUNT + 2> m_Retired{};
+        uint32_t m_RetiredCount{ 0 };
+    };
+
+    /// <summary>
+    /// Bounded wait-free single-producer single-consumer ring buffer.
+    /// The head and the tail live on their own cache lines and each side keeps a cached copy of the other side's index,
+    /// so the shared indices are only read again when the buffer looks full (producer) or empty (consumer).
+    /// The capacity is rounded up to a power of two.
+    /// </summary>
+    template<typename T>
+    class SPSCRingBuffer
+    {
+    public:
+        explicit SPSCRingBuffer(uint32_t capacity = 1024)
+            : m_Capacity((uint32_t)std::bit_ceil(std::clamp(capacity, 1u, 1u << 31)))
+            , m_Mask(m_Capacity - 1)
+        {
+            m_Buffer = static_cast<T*>(::operator new(size_t(m_Capacity) * sizeof(T), std::align_val_t{ alignof(T) }));
+        }
+
+        SPSCRingBuffer(const SPSCRingBuffer&) = delete;
+        SPSCRingBuffer& operator=(const SPSCRingBuffer&) = delete;
+
+        ~SPSCRingBuffer()
+        {
+            if constexpr (!std::is_trivially_destructible_v<T>)
+            {
+                uint32_t tail = m_Tail.load(std::memory_order_relaxed);
+                for (uint32_t head = m_Head.load(std::memory_order_relaxed); head != tail; ++head)
+                    std::destroy_at(m_Buffer + (head & m_Mask));
+            }
+            ::operator delete(m_Buffer, std::align_val_t{ alignof(T) });
+        }
+
+        /// <summary>
+        /// Construct an item at the end of the buffer. Producer thread only.
+        /// </summary>
+        /// <returns>false if the buffer is full</returns>
+        template<typename... Args>
+            requires IsConstructibleConstraint<T, Args...>
+        bool PushBack(Args&&... args)
+        {
+            const uint32_t tail = m_Tail.load(std::memory_order_relaxed);
+            if (tail - m_CachedHead == m_Capacity)
+            {
+                m_CachedHead = m_Head.load(std::memory_order_acquire);
+                if (tail - m_CachedHead == m_Capacity)
+                    return false;
+            }
+            std::construct_at(m_Buffer + (tail & m_Mask), std::forward<Args>(args)...);
+            m_Tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        /// <summary>
+        /// Remove the first item of the buffer. Consumer thread only.
+        /// </summary>
+        /// <returns>false if the buffer is empty</returns>
+        bool PopFront(T& outItem)
+        {
+            const uint32_t head = m_Head.load(std::memory_order_relaxed);
+            if (head == m_CachedTail)
+            {
+                m_CachedTail = m_Tail.load(std::memory_order_acquire);
+                if (head == m_CachedTail)
+                    return false;
+            }
+            T* slot = m_Buffer + (head & m_Mask);
+            outItem = std::move(*slot);
+            std::destroy_at(slot);
+            m_Head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        /// <summary>
+        /// Return the number of items in the buffer, only a snapshot when the other side is running.
+        /// </summary>
+        [[nodiscard]] uint32_t GetSize() const noexcept
+        {
+            return m_Tail.load(std::memory_order_acquire) - m_Head.load(std::memory_order_acquire);
+        }
+        [[nodiscard]] bool IsEmpty() const noexcept { return GetSize() == 0; }
+        [[nodiscard]] uint32_t GetCapacity() const noexcept { return m_Capacity; }
+
+    private:
+        // producer side
+        alignas(ECS_CACHE_LINE_SIZE) std::atomic<uint32_t> m_Tail{ 0 };
+        uint32_t m_CachedHead{ 0 };
+
+        // consumer side
+        alignas(ECS_CACHE_LINE_SIZE) std::atomic<uint32_t> m_Head{ 0 };
+        uint32_t m_CachedTail{ 0 };
+
+        // read-only after construction
+        alignas(ECS_CACHE_LINE_SIZE) T* m_Buffer;
+        const uint32_t m_Capacity;
+        const uint32_t m_Mask;
+    };
+
+    /// <summary>
+    /// Bounded lock-free multi-producer multi-consumer ring buffer.
+    /// Every cell stores a sequence number telling whether it is ready to be written or read for the current lap,
+    /// so producers and consumers only contend on the single index they move forward with a CAS.
+    /// The capacity is rounded up to a power of two.
+    /// </summary>
+    template<typename T>
+    class MPMCRingBuffer
+    {
+        struct Cell
+        {
+            std::atomic<uint64_t> Sequence;
+            alignas(T) std::byte Storage[sizeof(T)];
+        };
+
+    public:
+        explicit MPMCRingBuffer(uint32_t capacity = 1024)
+            : m_Capacity((uint32_t)std::bit_ceil(std::clamp(capacity, 2u, 1u << 31)))
+            , m_Mask(m_Capacity - 1)
+            , m_Cells(new Cell[m_Capacity])
+        {
+            for (uint32_t i = 0; i < m_Capacity; ++i)
+                m_Cells[i].Sequence.store(i, std::memory_order_relaxed);
+        }
+
+        MPMCRingBuffer(const MPMCRingBuffer&) = delete;
+        MPMCRingBuffer& operator=(const MPMCRingBuffer&) = delete;
+
+        ~MPMCRingBuffer()
+        {
+            if constexpr (!std::is_trivially_destructible_v<T>)
+            {
+                uint64_t tail = m_Tail.load(std::memory_order_relaxed);
+                for (uint64_t head = m_Head.load(std::memory_order_relaxed); head != tail; ++head)
+                    std::destroy_at(GetItem(m_Cells[head & m_Mask]));
+            }
+        }
+
+        /// <summary>
+        /// Construct an item at the end of the buffer. Safe to call from any number of threads at once.
+        /// </summary>
+        /// <returns>false if the buffer is full</returns>
+        template<typename... Args>
+            requires IsConstructibleConstraint<T, Args...>
+        bool PushBack(Args&&... args)
+        {
+            uint64_t tail = m_Tail.load(std::memory_order_relaxed);
+            Cell* cell;
+            while (true)
+            {
+                cell = &m_Cells[tail & m_Mask];
+                int64_t diff = int64_t(cell->Sequence.load(std::memory_order_acquire) - tail);
+                if (diff == 0)
+                {
+                    if (m_Tail.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (diff < 0)
+                {
+                    return false;
+                }
+                else
+                {
+                    tail = m_Tail.load(std::memory_order_relaxed);
+                }
+            }
+            std::construct_at(GetItem(*cell), std::forward<Args>(args)...);
+            cell->Sequence.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        /// <summary>
+        /// Remove the first item of the buffer. Safe to call from any number of threads at once.
+        /// </summary>
+        /// <returns>false if the buffer is empty</returns>
+        bool PopFront(T& outItem)
+        {
+            uint64_t head = m_Head.load(std::memory_order_relaxed);
+            Cell* cell;
+            while (true)
+            {
+                cell = &m_Cells[head & m_Mask];
+                int64_t diff = int64_t(cell->Sequence.load(std::memory_order_acquire) - (head + 1));
+                if (diff == 0)
+                {
+                    if (m_Head.compare_exchange_weak(head, head + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (diff < 0)
+                {
+                    return false;
+                }
+                else
+                {
+                    head = m_Head.load(std::memory_order_relaxed);
+                }
+            }
+            T* item = GetItem(*cell);
+            outItem = std::move(*item);
+            std::destroy_at(item);
+            cell->Sequence.store(head + m_Capacity, std::memory_order_release);
+            return true;
+        }
+
+        /// <summary>
+        /// Return the number of items in the buffer, only a snapshot when other threads are running.
+        /// </summary>
+        [[nodiscard]] uint32_t GetSize() const noexcept
+        {
+            uint64_t head = m_Head.load(std::memory_order_acquire);
+            uint64_t tail = m_Tail.load(std::memory_order_acquire);
+            return tail > head ? (uint32_t)std::min<uint64_t>(tail - head, m_Capacity) : 0;
+        }
+        [[nodiscard]] bool IsEmpty() const noexcept { return GetSize() == 0; }
+        [[nodiscard]] uint32_t GetCapacity() const noexcept { return m_Capacity; }
+
+    private:
+        static T* GetItem(Cell& cell) noexcept { return std::launder(reinterpret_cast<T*>(cell.Storage)); }
+
+    private:
+        alignas(ECS_CACHE_LINE_SIZE) std::atomic<uint64_t> m_Tail{ 0 };
+        alignas(ECS_CACHE_LINE_SIZE) std::atomic<uint64_t> m_Head{ 0 };
+        alignas(ECS_CACHE_LINE_SIZE) const uint32_t m_Capacity;
+        const uint32_t m_Mask;
+        std::unique_ptr<Cell[]> m_Cells;
+    };
+}
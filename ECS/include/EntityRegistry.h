@@ -2,8 +2,14 @@
 
 #include "Types.h"
 #include "CircularBuffer.h"
+#include "ConcurrentQueue.h"
 #include "Archetype.h"
+#include "FlatHashMap.h"
 #include "Exceptions.h"
+#include "Snapshot.h"
+#include <numeric>
+#include <future>
+#include <functional>
 
 namespace ecs
 {
@@ -11,18 +17,159 @@ namespace ecs
 using CreateStorageFunc = void(*)(Archetype*);
 using RemoveComponentFunc = bool(*)(Archetype*, EntityID);
 using MoveComponentFunc = void(*)(Archetype*, Archetype*, EntityID, EntityID);
+using ShrinkStorageFunc = void(*)(Archetype*);
+using SaveColumnFunc = void(*)(const Archetype*, SnapshotWriter&);
+using LoadColumnFunc = void(*)(Archetype*, SnapshotReader&, uint32_t);
+using SaveComponentFunc = void(*)(const Archetype*, EntityID, SnapshotWriter&);
+using LoadComponentFunc = void(*)(Archetype*, EntityID, SnapshotReader&);
+using ForkStorageFunc = void(*)(Archetype*, Archetype*);
+using SpliceStorageFunc = void(*)(Archetype*, Archetype*);
+using ClearStorageFunc = void(*)(Archetype*);
+using ReserveSpliceFunc = void(*)(Archetype*, Archetype*);
+using ReserveStorageFunc = void(*)(Archetype*, uint32_t);
 
-class EntityRegistry
+using ObserverID = uint32_t;
+
+enum class ComponentEvent : uint32_t
+{
+    Add,    // the component has been attached to the entity
+    Remove, // the component has been detached from the entity, or the entity has been destroyed
+    Set,    // the value of the component has been replaced or reported modified
+};
+constexpr uint32_t COMPONENT_EVENT_COUNT = 3;
+
+/// <summary>
+/// Entities an observer is notified about in one call. For OnAdd and OnSet they all belong to the same archetype
+/// and come in column order, their components are read straight from the column. For OnRemove the components are already gone.
+/// </summary>
+template<ComponentConstraint Comp>
+class ComponentBatch
 {
 public:
-    EntityRegistry()
-        : m_EntityCount(0)
-        , m_MaxEntityCount(4096)
-        , m_AvailableEntities(m_MaxEntityCount)
-        , m_EntitySignatures(m_MaxEntityCount)
+    using Column = typename ColumnTypeOf<Comp>::Type;
+
+    ComponentBatch(std::span<const EntityID> entities, std::span<const uint32_t> rows, Column* column)
+        : m_Entities(entities)
+        , m_Rows(rows)
+        , m_Column(column)
+    {}
+
+    [[nodiscard]] std::span<const EntityID> GetEntities() const { return m_Entities; }
+    [[nodiscard]] uint32_t GetSize() const { return (uint32_t)m_Entities.size(); }
+
+    // false for OnRemove
+    [[nodiscard]] bool HasComponents() const { return m_Column != nullptr; }
+
+    // component of the i-th entity of the batch, a LaneRef for components with a LaneLayout
+    [[nodiscard]] decltype(auto) GetComponent(uint32_t i) const
     {
-        Init();
+        assert(m_Column && "The components of removal events are gone!");
+        return (*m_Column)[m_Rows[i]];
+    }
+
+private:
+    std::span<const EntityID> m_Entities;
+    std::span<const uint32_t> m_Rows;
+    Column* m_Column;
+};
+
+/// <summary>
+/// Access to the two parts of a split component, see HotColdSplit.
+/// </summary>
+template<SplitComponentConstraint Comp>
+struct SplitComponentRef
+{
+    using Hot = typename HotColdSplit<Comp>::Hot;
+    using Cold = typename HotColdSplit<Comp>::Cold;
+
+    Hot& HotPart;
+    Cold& ColdPart;
+
+    [[nodiscard]] Comp Get() const { return HotColdSplit<Comp>::Join(HotPart, ColdPart); }
+    operator Comp() const { return Get(); }
+
+    const SplitComponentRef& operator=(const Comp& value) const
+    {
+        HotPart = HotColdSplit<Comp>::GetHot(value);
+        ColdPart = HotColdSplit<Comp>::GetCold(value);
+        return *this;
     }
+};
+
+// archetype and rows of the entities, null and empty for removal events
+using ObserverFunc = std::function<void(Archetype*, std::span<const EntityID>, std::span<const uint32_t>)>;
+
+class EntityRegistry
+{
+public:
+    /// <summary>
+    /// Snapshot being written by a background thread, see SnapshotAsync.
+    /// Waits for the snapshot to be written when destroyed.
+    /// </summary>
+    class AsyncSnapshot
+    {
+    public:
+        AsyncSnapshot() = default;
+        AsyncSnapshot(AsyncSnapshot&&) = default;
+
+        /// <summary>
+        /// Waits for the snapshot being overwritten, like Wait: if writing it failed, its SnapshotException is rethrown
+        /// and other is left untouched.
+        /// </summary>
+        AsyncSnapshot& operator=(AsyncSnapshot&& other)
+        {
+            if (this != &other)
+            {
+                Wait();
+                m_Task = std::move(other.m_Task);
+                m_Frozen = std::move(other.m_Frozen);
+            }
+            return *this;
+        }
+
+        ~AsyncSnapshot()
+        {
+            if (m_Task.valid())
+                m_Task.wait();
+        }
+
+        // true once the snapshot is written (or failed), Wait won't block anymore
+        [[nodiscard]] bool IsDone() const
+        {
+            return !m_Task.valid() || m_Task.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        }
+
+        /// <summary>
+        /// Blocks until the snapshot is written and releases the frozen copy of the registry.
+        /// Rethrows the SnapshotException raised by the background thread if writing failed.
+        /// </summary>
+        void Wait()
+        {
+            if (!m_Task.valid())
+                return;
+            // the frozen registry is released on this thread whatever happens, its memory resource may not be thread safe
+            std::unique_ptr<EntityRegistry> frozen = std::move(m_Frozen);
+            m_Task.get();
+        }
+
+    private:
+        std::unique_ptr<EntityRegistry> m_Frozen;
+        std::future<void> m_Task; // after m_Frozen so it is waited for before the registry is released
+
+        friend class EntityRegistry;
+    };
+
+    EntityRegistry()
+        : EntityRegistry(4096)
+    {}
+
+    /// <summary>
+    /// Creates a registry whose archetypes, component columns and internal maps are all allocated from the given memory resource.
+    /// The resource has to outlive the registry.
+    /// </summary>
+    explicit EntityRegistry(std::pmr::memory_resource* resource)
+        : EntityRegistry(4096, resource)
+    {}
 
     uint32_t GetEntityCount() const { return m_EntityCount; }
     uint32_t GetMaxEntityCount() const { return m_MaxEntityCount; }
@@ -33,22 +180,42 @@ public:
         (RegisterComponentType<Comps>(), ...);
     }
 
+    /// <summary>
+    /// Registers a component type. A split component (see HotColdSplit) registers its hot and cold parts instead.
+    /// </summary>
     template<ComponentConstraint Comp>
     static void RegisterComponentType()
     {
-        assert(GetComponentTypeIndex<Comp>() < 64 && "Too many components registered!");
-
-        s_CreateStorageFuncs[GetComponentTypeIndex<Comp>()] = &CreateStorage<Comp>;
-        s_RemoveComponentFuncs[GetComponentTypeIndex<Comp>()] = &RemoveComponent<Comp>;
-        s_MoveComponentFuncs[GetComponentTypeIndex<Comp>()] = &MoveComponent<Comp>;
+        if constexpr (SplitComponentConstraint<Comp>)
+            RegisterComponentTypes<typename HotColdSplit<Comp>::Hot, typename HotColdSplit<Comp>::Cold>();
+        else
+            RegisterStoredComponentType<Comp>();
     }
 
-    EntityRegistry(uint32_t MaxEntityCount)
+    EntityRegistry(uint32_t MaxEntityCount, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
         : m_MaxEntityCount(MaxEntityCount)
+        , m_Resource(resource)
+        , m_AvailableEntities(MaxEntityCount, resource)
+        , m_EntitySignatures(resource)
+        , m_PendingDeletions(resource)
+        , m_DisabledEntities(resource)
+        , m_Archetypes(resource)
+        , m_ArchetypeCache(resource)
+        , m_ComponentArchetypes(MAX_COMPONENTS, resource)
+        , m_CachesByComponent(MAX_COMPONENTS, resource)
+        , m_DeltaOperations(resource)
+        , m_ChangedEntities(resource)
+        , m_ChangedComponents(resource)
+        , m_IsEntityChanged(resource)
+        , m_DeletedEntities(resource)
+        , m_DeletedComponents(resource)
+        , m_Observers(resource)
     {
         Init();
     }
 
+    [[nodiscard]] std::pmr::memory_resource* GetMemoryResource() const { return m_Resource; }
+
     /// <summary>
     /// Creates an entity with no components attached to it.
     /// </summary>
@@ -57,26 +224,55 @@ public:
     {
         if (m_AvailableEntities.GetSize() == 0)
             Resize();
-        const EntityID entity = m_AvailableEntities.PopFront();
-        m_EntitySignatures[entity] = EntityMetadata{ EntitySignature(), GetArchetype(EntitySignature()) };
-        ++m_EntityCount;
-        return entity;
+        return AcquireEntity(EntitySignature());
     }
 
     /// <summary>
     /// Deletes an entity with its components.
+    /// The entity is considered dead right away (IsEntityValid, views) and components can't be added to it anymore,
+    /// but its storage is only released on Flush: until then its components can still be read with GetComponent.
+    /// Can be called from several threads at once as long as no structural change happens at the same time.
     /// </summary>
     /// <param name="entity">: ID of the entity to be deleted</param>
     void DeleteEntity(EntityID entity)
     {
         if (entity >= m_MaxEntityCount || m_EntitySignatures[entity].Archetype == nullptr)
             return;
+        if (std::atomic_ref<uint8_t>(m_PendingDeletions[entity]).exchange(1, std::memory_order_relaxed))
+            return;
+        std::atomic_ref<uint32_t>(m_PendingDeletionCount).fetch_add(1, std::memory_order_relaxed);
         m_DeletedEntities.PushBack(entity);
     }
 
     bool IsEntityValid(EntityID entity)
     {
-        return entity < m_MaxEntityCount && m_EntitySignatures[entity].Archetype != nullptr;
+        return entity < m_MaxEntityCount && m_EntitySignatures[entity].Archetype != nullptr
+            && !std::atomic_ref<uint8_t>(m_PendingDeletions[entity]).load(std::memory_order_relaxed);
+    }
+
+    /// <summary>
+    /// Disables or enables an entity in O(1), without moving it to another archetype. A disabled entity is skipped by views
+    /// but keeps its row and its components, which stay reachable through GetComponent. Entities are created enabled.
+    /// </summary>
+    /// <param name="entity">: ID of the entity that we want to modify</param>
+    /// <param name="enabled">: false to hide the entity from views</param>
+    void SetEnabled(EntityID entity, bool enabled)
+    {
+        if (entity >= m_MaxEntityCount || m_EntitySignatures[entity].Archetype == nullptr)
+            throw EntityIDOutOfRange();
+        if (m_DisabledEntities[entity] == !enabled)
+            return;
+        m_DisabledEntities[entity] = !enabled;
+        // entities without components may not be listed in their archetype, MigrateEntity applies the flag to their first row
+        m_EntitySignatures[entity].Archetype->SetEntityEnabled(entity, enabled);
+        if (m_ChangeTracking)
+            m_DeltaOperations.push_back(DeltaOperation{ enabled ? DeltaOperationType::EnableEntity : DeltaOperationType::DisableEntity, entity });
+    }
+
+    // false for disabled and dead entities
+    [[nodiscard]] bool IsEnabled(EntityID entity) const
+    {
+        return entity < m_MaxEntityCount && m_EntitySignatures[entity].Archetype != nullptr && !m_DisabledEntities[entity];
     }
 
     ///////////////////////////////////////////////////////////////////
@@ -85,13 +281,20 @@ public:
 
     /// <summary>
     /// Deletes a component of the specified component type that has been added to the specified entity.
+    /// Can be called from several threads at once, the deletion is applied on Flush.
     /// </summary>
     /// <typeparam name="Comp">: Type of the component to be deleted.</typeparam>
     /// <param name="entity">: ID of the targeted entity</param>
     template<ComponentConstraint Comp>
     void DeleteComponent(EntityID entity)
     {
-        m_DeletedComponents.PushBack({ entity, GetComponentTypeIndex<Comp>() });
+        if constexpr (SplitComponentConstraint<Comp>)
+        {
+            DeleteComponent<typename HotColdSplit<Comp>::Hot>(entity);
+            DeleteComponent<typename HotColdSplit<Comp>::Cold>(entity);
+        }
+        else
+            m_DeletedComponents.PushBack(DeletedComponent{ entity, GetComponentTypeIndex<Comp>() });
     }
 
     /// <summary>
@@ -102,18 +305,25 @@ public:
     template<ComponentConstraint Comp>
     bool TryAddComponent(EntityID entity, const Comp& component) noexcept
     {
-        if (entity >= m_MaxEntityCount || m_EntitySignatures[entity].Archetype == nullptr)
+        if (entity >= m_MaxEntityCount || m_EntitySignatures[entity].Archetype == nullptr || m_PendingDeletions[entity])
             return false;
-        ComponentTypeID compType = ComponentType<Comp>();
+        ComponentTypeID compType = StorageSignature<Comp>();
         if ((m_EntitySignatures[entity].Signature & compType).any())
             return false;
+        if constexpr (SplitComponentConstraint<Comp>)
+            AddSplitComponent(entity, component);
+        else
+        {
+            EntitySignature newSig = m_EntitySignatures[entity].Signature | compType;
+            m_EntitySignatures[entity].Signature = newSig;
 
-        EntitySignature newSig = m_EntitySignatures[entity].Signature | compType;
-        m_EntitySignatures[entity].Signature = newSig;
-
-        Archetype* newArchetype = GetOrCreateArchetype(newSig);
-        MigrateEntity(entity, m_EntitySignatures[entity].Archetype, newArchetype);
-        newArchetype->AddComponent<Comp>(entity, component);
+            Archetype* newArchetype = GetOrCreateArchetype(newSig);
+            MigrateEntity(entity, m_EntitySignatures[entity].Archetype, newArchetype);
+            newArchetype->AddComponent<Comp>(entity, component);
+            if (m_ChangeTracking)
+                MarkComponentChanged(entity, GetComponentTypeIndex<Comp>());
+            RecordEvent(ComponentEvent::Add, GetComponentTypeIndex<Comp>(), entity);
+        }
         return true;
     }
 
@@ -122,11 +332,12 @@ public:
     /// </summary>
     /// <param name="entity">: ID of the entity that we want to modify</param>
     /// <param name="...args">arguments used to construct the component</param>
-    /// <returns>the newly created component</returns>
+    /// <returns>the newly created component, a LaneRef for components with a LaneLayout</returns>
     template<ComponentConstraint Comp, IsConstructibleConstraint... Args>
-    Comp& EmplaceComponent(EntityID entity, Args&&... args)
+        requires (!SplitComponentConstraint<Comp>)
+    decltype(auto) EmplaceComponent(EntityID entity, Args&&... args)
     {
-        if (entity >= m_MaxEntityCount || m_EntitySignatures[entity].Archetype == nullptr)
+        if (entity >= m_MaxEntityCount || m_EntitySignatures[entity].Archetype == nullptr || m_PendingDeletions[entity])
             throw EntityIDOutOfRange();
 
         ComponentTypeID compType = ComponentType<Comp>();
@@ -138,7 +349,25 @@ public:
 
         Archetype* newArchetype = GetOrCreateArchetype(newSig);
         MigrateEntity(entity, m_EntitySignatures[entity].Archetype, newArchetype);
-        return newArchetype->EmplaceComponent<Comp>(entity, std::forward<args>()...);
+        decltype(auto) comp = newArchetype->EmplaceComponent<Comp>(entity, std::forward<Args>(args)...);
+        if (m_ChangeTracking)
+            MarkComponentChanged(entity, GetComponentTypeIndex<Comp>());
+        RecordEvent(ComponentEvent::Add, GetComponentTypeIndex<Comp>(), entity);
+        return comp;
+    }
+
+    /// <summary>
+    /// Attaches a split component (see HotColdSplit) constructed with the given arguments, its two parts are added with a single migration.
+    /// </summary>
+    /// <returns>the hot and cold parts of the new component</returns>
+    template<SplitComponentConstraint Comp, typename... Args>
+    SplitComponentRef<Comp> EmplaceComponent(EntityID entity, Args&&... args)
+    {
+        if (entity >= m_MaxEntityCount || m_EntitySignatures[entity].Archetype == nullptr || m_PendingDeletions[entity])
+            throw EntityIDOutOfRange();
+        if ((m_EntitySignatures[entity].Signature & StorageSignature<Comp>()).any())
+            throw ComponentAlreadyExistsException();
+        return AddSplitComponent(entity, Comp(std::forward<Args>(args)...));
     }
 
     /// <summary>
@@ -152,16 +381,32 @@ public:
         if (entity >= m_MaxEntityCount || m_EntitySignatures[entity].Archetype == nullptr)
             return false;
 
-        if (!m_EntitySignatures[entity].Signature.test(GetComponentTypeIndex<Comp>()))
-            return false;
+        if constexpr (SplitComponentConstraint<Comp>)
+        {
+            // neither part is written unless the entity has both
+            const EntitySignature parts = StorageSignature<Comp>();
+            if ((m_EntitySignatures[entity].Signature & parts) != parts)
+                return false;
+            TryReplaceComponent(entity, typename HotColdSplit<Comp>::Hot(HotColdSplit<Comp>::GetHot(component)));
+            TryReplaceComponent(entity, typename HotColdSplit<Comp>::Cold(HotColdSplit<Comp>::GetCold(component)));
+            return true;
+        }
+        else
+        {
+            if (!m_EntitySignatures[entity].Signature.test(GetComponentTypeIndex<Comp>()))
+                return false;
 
-        Comp& comp = GetComponent<Comp>(entity);
-        comp = component;
-        return true;
+            GetComponent<Comp>(entity) = component;
+            if (m_ChangeTracking)
+                MarkComponentChanged(entity, GetComponentTypeIndex<Comp>());
+            RecordEvent(ComponentEvent::Set, GetComponentTypeIndex<Comp>(), entity);
+            return true;
+        }
     }
 
     /// <summary>
     /// Checks if the given entity has a component of the specified type.
+    /// A split component (see HotColdSplit) is only there if the entity has both its parts.
     /// </summary>
     /// <typeparam name="Comp">: Type of the component that we want to check</typeparam>
     /// <param name="entity">: ID of the entity that we want to modify</param>
@@ -172,7 +417,13 @@ public:
         if (entity >= m_MaxEntityCount)
             throw EntityIDOutOfRange();
 
-        return m_EntitySignatures[entity].Signature.test(GetComponentTypeIndex<Comp>());
+        if constexpr (SplitComponentConstraint<Comp>)
+        {
+            const EntitySignature parts = StorageSignature<Comp>();
+            return (m_EntitySignatures[entity].Signature & parts) == parts;
+        }
+        else
+            return m_EntitySignatures[entity].Signature.test(GetComponentTypeIndex<Comp>());
     }
 
     /// <summary>
@@ -204,8 +455,10 @@ public:
         return m_EntitySignatures[entity].Archetype->GetComponent<Comp>(entity);
     }
 
+    // Comp&, or a LaneRef for components with a LaneLayout. The components of an entity queued for deletion stay readable until the Flush
     template<ComponentConstraint Comp>
-    [[nodiscard]] ECS_FORCE_INLINE Comp& GetComponent(EntityID entity)
+        requires (!SplitComponentConstraint<Comp>)
+    [[nodiscard]] ECS_FORCE_INLINE decltype(auto) GetComponent(EntityID entity)
     {
         if (entity >= m_MaxEntityCount || m_EntitySignatures[entity].Archetype == nullptr)
             throw EntityIDOutOfRange();
@@ -215,180 +468,2005 @@ public:
         return m_EntitySignatures[entity].Archetype->GetComponent<Comp>(entity);
     }
 
+    // the parts of a split component, read them separately with GetComponent<Hot> and GetComponent<Cold> when only one is needed
+    template<SplitComponentConstraint Comp>
+    [[nodiscard]] SplitComponentRef<Comp> GetComponent(EntityID entity)
+    {
+        return { GetComponent<typename HotColdSplit<Comp>::Hot>(entity), GetComponent<typename HotColdSplit<Comp>::Cold>(entity) };
+    }
+
     template<ComponentConstraint... Comps>
     [[nodiscard]] ECS_FORCE_INLINE std::tuple<Comps&...> GetComponents(EntityID entity)
     {
         return { GetComponent<Comps>(entity)... };
     }
     
-    template<ComponentConstraint... Comps>
-    [[nodiscard]] ComponentView<Comps...> GetView()
+    /// <summary>
+    /// Calls callback(EntityID, Comps&...) for each of the given entities, like GetComponents would, but in the order
+    /// the components are in memory rather than the order of the entities: the requests are grouped by archetype
+    /// and sorted by row, and the components a few requests ahead are prefetched.
+    /// Meant for systems following entity references (targets, owners, collision pairs) in random order.
+    /// Entities that aren't alive, queued for deletion included, or lack one of the components are skipped, an entity listed several times is visited as many times.
+    /// The callback can modify the components, but must not make structural changes.
+    /// </summary>
+    /// <returns>the number of calls made</returns>
+    template<ComponentConstraint... Comps, typename Func>
+    size_t Gather(std::span<const EntityID> entities, Func&& callback)
     {
+        static_assert(sizeof...(Comps) > 0, "Gather needs at least one component.");
+        static_assert(!(SplitComponentConstraint<Comps> || ...), "Gather takes the Hot and Cold parts of a split component.");
+        static_assert(!(LaneComponentConstraint<Comps> || ...), "Components with a LaneLayout are iterated with EachBlock.");
+        constexpr size_t prefetchDistance = 8;
+
         EntitySignature sig;
         sig |= (ComponentType<Comps>() | ...);
-        if (!m_ArchetypeCache.contains(sig))
-             CreateArchetypeCache(sig);
-        auto it = m_Archetypes.find(sig);
-        if (it == m_Archetypes.end())
-            return ComponentView<Comps...>(std::span<Archetype*>());
-        return ComponentView<Comps...>(m_ArchetypeCache[sig]);
-    }
-
-    void Flush()
-    {
-        for (int i = m_DeletedComponents.GetSize() - 1; i >= 0; --i)
+        std::pmr::vector<GatherLocation> locations(m_Resource);
+        locations.reserve(entities.size());
+        std::pmr::vector<Archetype*> archetypes(m_Resource);
+        FlatHashMap<Archetype*, uint32_t> archetypeIndices(m_Resource);
+        Archetype* lastArchetype = nullptr;
+        uint32_t lastArchetypeIndex = 0;
+        uint32_t maxRow = 0;
+        for (size_t i = 0; i < entities.size(); ++i)
         {
-            auto entityComp = m_DeletedComponents.PopFront();
-            DeleteComponent_Internal(entityComp.first, entityComp.second);
+            // pipelined: the metadata of an entity is prefetched, then its slot in the row index of its archetype
+            if (i + 2 * prefetchDistance < entities.size() && entities[i + 2 * prefetchDistance] < m_MaxEntityCount)
+                ECS_PREFETCH(&m_EntitySignatures[entities[i + 2 * prefetchDistance]]);
+            if (i + prefetchDistance < entities.size() && entities[i + prefetchDistance] < m_MaxEntityCount)
+            {
+                if (const Archetype* archetype = m_EntitySignatures[entities[i + prefetchDistance]].Archetype)
+                    archetype->PrefetchEntityIndex(entities[i + prefetchDistance]);
+            }
+
+            const EntityID entity = entities[i];
+            if (entity >= m_MaxEntityCount)
+                continue;
+            const EntityMetadata& metadata = m_EntitySignatures[entity];
+            if (!metadata.Archetype || (metadata.Signature & sig) != sig || (m_PendingDeletionCount && m_PendingDeletions[entity]))
+                continue;
+            if (metadata.Archetype != lastArchetype)
+            {
+                auto [entry, inserted] = archetypeIndices.TryEmplace(metadata.Archetype, (uint32_t)archetypes.size());
+                if (inserted)
+                    archetypes.push_back(metadata.Archetype);
+                lastArchetype = metadata.Archetype;
+                lastArchetypeIndex = entry.second;
+            }
+            const uint32_t row = metadata.Archetype->GetEntityIndex(entity);
+            maxRow = std::max(maxRow, row);
+            locations.push_back(GatherLocation{ lastArchetypeIndex, row, entity });
         }
-        for (int i = m_DeletedEntities.GetSize() - 1; i >= 0; --i)
+        SortGatherLocations(locations, (uint32_t)archetypes.size(), maxRow);
+
+        for (size_t first = 0; first < locations.size();)
         {
-            EntityID entity = m_DeletedEntities.PopFront();
-            DeleteEntity_Internal(entity);
+            const uint32_t archetypeIndex = locations[first].Archetype;
+            std::tuple<Comps*...> columns{ archetypes[archetypeIndex]->GetComponentStorage<Comps>().Components.data()... };
+            size_t last = first;
+            for (; last < locations.size() && locations[last].Archetype == archetypeIndex; ++last)
+            {
+                if (last + prefetchDistance < locations.size() && locations[last + prefetchDistance].Archetype == archetypeIndex)
+                {
+                    const uint32_t row = locations[last + prefetchDistance].Row;
+                    (ECS_PREFETCH(std::get<Comps*>(columns) + row), ...);
+                }
+                const GatherLocation& location = locations[last];
+                callback(location.Entity, std::get<Comps*>(columns)[location.Row]...);
+            }
+            first = last;
         }
+        return locations.size();
     }
 
-private:
-    uint32_t m_EntityCount = 0;
-    uint32_t m_MaxEntityCount = 4096;
-
-    CircularBuffer<EntityID> m_AvailableEntities;
-    struct EntityMetadata
+    template<ComponentConstraint... Comps>
+    [[nodiscard]] ComponentView<Comps...> GetView()
     {
-        EntitySignature Signature{};
-        Archetype*      Archetype{};
-    };
-    std::vector<EntityMetadata> m_EntitySignatures;
-
-    std::unordered_map<EntitySignature, std::unique_ptr<Archetype>> m_Archetypes;
-    std::unordered_map<EntitySignature, std::vector<Archetype*>>    m_ArchetypeCache; // list of archetypes that has AT LEAST these components for looping through entities faster
-
-    CircularBuffer<EntityID> m_DeletedEntities;
-    CircularBuffer<std::pair<EntityID, ComponentTypeIndex>> m_DeletedComponents;
-
-private:
-    static inline std::array<CreateStorageFunc, MAX_COMPONENTS>    s_CreateStorageFuncs = {};
-    static inline std::array<MoveComponentFunc, MAX_COMPONENTS>    s_MoveComponentFuncs = {};
-    static inline std::array<RemoveComponentFunc, MAX_COMPONENTS>  s_RemoveComponentFuncs = {};
-
-private:
+        static_assert(!(SplitComponentConstraint<Comps> || ...), "Views take the Hot and Cold parts of a split component.");
+        static_assert(!(LaneComponentConstraint<Comps> || ...), "Components with a LaneLayout are iterated with EachBlock.");
+        EntitySignature sig;
+        sig |= (ComponentType<Comps>() | ...);
+        std::pmr::vector<Archetype*>* archetypes = m_ArchetypeCache.TryGet(sig);
+        if (!archetypes)
+            archetypes = &CreateArchetypeCache(sig);
+        return ComponentView<Comps...>(*archetypes, &m_PendingDeletions, &m_PendingDeletionCount, m_Resource);
+    }
 
     /// <summary>
-    /// Initialization helper
+    /// Iterates the components with a LaneLayout a block at a time, calling func(uint64_t laneMask, LaneBlock<Comps>&...)
+    /// for every block of every archetype that has all of them. Bit i of laneMask is set if lane i holds a live entity:
+    /// the tail lanes of the last block, disabled entities and entities queued for deletion are cleared,
+    /// and blocks without any live entity are skipped. The rows of an archetype line up, so do the blocks.
+    /// Components without a LaneLayout can be listed too, they are handed out as a Comp* to the row of lane 0:
+    /// lane i of the block is at [i], and only the lanes set in laneMask can be accessed.
+    /// Same rules as a view: no structural changes while iterating.
     /// </summary>
-    void Init()
+    template<ComponentConstraint... Comps, typename Func>
+    void EachBlock(Func&& func)
     {
-        m_EntitySignatures.resize(m_MaxEntityCount);
-        for (EntityID i = 0; i < m_MaxEntityCount; ++i)
+        static_assert(!(SplitComponentConstraint<Comps> || ...), "EachBlock takes the Hot and Cold parts of a split component.");
+        constexpr uint32_t lanes = std::max({ 0u, GetLaneCount<Comps>()... });
+        static_assert(lanes > 0, "EachBlock needs at least one component with a LaneLayout.");
+        static_assert(((GetLaneCount<Comps>() == 0 || GetLaneCount<Comps>() == lanes) && ...), "The components of EachBlock with a LaneLayout need the same number of lanes.");
+
+        EntitySignature sig;
+        sig |= (ComponentType<Comps>() | ...);
+        std::pmr::vector<Archetype*>* archetypes = m_ArchetypeCache.TryGet(sig);
+        if (!archetypes)
+            archetypes = &CreateArchetypeCache(sig);
+
+        constexpr uint64_t fullMask = lanes == 64 ? ~uint64_t(0) : (uint64_t(1) << lanes) - 1;
+        const uint8_t* pendingDeletions = m_PendingDeletionCount ? m_PendingDeletions.data() : nullptr;
+        for (Archetype* archetype : *archetypes)
         {
-            m_AvailableEntities.PushBack(i);
+            const uint32_t size = archetype->GetEntityCount();
+            if (size == 0)
+                continue;
+            const EntityID* entities = archetype->GetEntities().data();
+            const uint64_t* disabled = archetype->GetDisabledRows();
+            std::tuple<BlockColumn<Comps>...> columns{ GetBlockColumn<Comps>(archetype)... };
+            const uint32_t blockCount = (size + lanes - 1) / lanes;
+            for (uint32_t block = 0; block < blockCount; ++block)
+            {
+                // lanes is a power of two up to 64, so a block never straddles two words of the disabled rows
+                const uint32_t first = block * lanes;
+                uint64_t mask = size - first >= lanes ? fullMask : (uint64_t(1) << (size - first)) - 1;
+                if (disabled)
+                    mask &= ~(disabled[first / 64] >> (first % 64));
+                if (pendingDeletions)
+                {
+                    for (uint64_t bits = mask; bits; bits &= bits - 1)
+                    {
+                        const uint32_t lane = (uint32_t)std::countr_zero(bits);
+                        if (pendingDeletions[entities[first + lane]])
+                            mask &= ~(uint64_t(1) << lane);
+                    }
+                }
+                if (mask)
+                    func(mask, GetBlockArgument<Comps, lanes>(std::get<BlockColumn<Comps>>(columns), block)...);
+            }
         }
-
-        EntitySignature emptySig;
-        m_Archetypes[emptySig].reset(new Archetype());
     }
 
-    Archetype* GetArchetype(EntitySignature signature)
+    /// <summary>
+    /// Processes every deferred component and entity deletion, then dispatches the component events.
+    /// </summary>
+    void Flush()
     {
-        if (m_Archetypes.contains(signature))
-            return m_Archetypes[signature].get();
-        return nullptr;
+        while (FlushDeletedComponents()) {}
+        while (FlushDeletedEntities()) {}
+        CollectEmptyArchetypes();
+        DispatchEvents();
     }
 
-    Archetype* GetOrCreateArchetype(EntitySignature signature)
+    /// <summary>
+    /// Processes deferred component and entity deletions until the time budget runs out.
+    /// At least one batch is processed whatever the budget, so repeated calls always get through the queues.
+    /// Whatever is left stays queued and will be processed by the next call to Flush.
+    /// Component events are only dispatched once everything has been processed.
+    /// </summary>
+    /// <param name="budget">: time the flush is allowed to take</param>
+    /// <returns>true if every deferred operation has been processed, false if some are carried over</returns>
+    bool Flush(std::chrono::microseconds budget)
     {
-        if (m_Archetypes.contains(signature))
-            return m_Archetypes[signature].get();
-        Archetype* archetype = new Archetype();
+        // the clock is read once per batch of deferred operations, after the first one.
+        // A queue is done when a batch comes back empty, it can still hold an item a producer is writing
+        const auto deadline = std::chrono::steady_clock::now() + budget;
+        bool processed = false;
+        while ((!processed || std::chrono::steady_clock::now() < deadline) && FlushDeletedComponents())
+            processed = true;
+        if (!m_DeletedComponents.IsEmpty())
+            return false;
+        while ((!processed || std::chrono::steady_clock::now() < deadline) && FlushDeletedEntities())
+            processed = true;
+        if (!m_DeletedEntities.IsEmpty())
+            return false;
+        CollectEmptyArchetypes();
+        DispatchEvents();
+        return true;
+    }
+
+    ///////////////////////////////////////////////////////////////////
+    //// Bulk operations //////////////////////////////////////////////
+    ///////////////////////////////////////////////////////////////////
+
+    // The entities these operations apply to are those a view of Comps visits: having all of Comps, enabled and not queued for deletion.
+    // They are applied right away, like MoveEntity, so they must not run while iterating.
+    // An archetype whose entities all match moves or drops its columns whole, the others are handled one entity at a time.
 
-        for (uint32_t i = 0; i < MAX_COMPONENTS; ++i)
+    /// <summary>
+    /// Destroys every entity having all of Comps. The component deletions queued for them are dropped, so they don't reach
+    /// the entities that get their IDs before the next Flush.
+    /// </summary>
+    /// <returns>the number of destroyed entities</returns>
+    template<ComponentConstraint... Comps>
+    uint32_t DestroyAll()
+    {
+        uint32_t count = 0;
+        for (Archetype* archetype : GetBulkArchetypes(BulkSignature<Comps...>()))
         {
-            if (signature.test(i))
+            if (!IsArchetypeFullyMatched(archetype))
             {
-                assert(s_CreateStorageFuncs[i] && "Component type not registered!");
-                s_CreateStorageFuncs[i](archetype);
+                for (EntityID entity : GetMatchedEntities(archetype))
+                {
+                    DeleteEntity_Internal(entity);
+                    ++count;
+                }
+                continue;
             }
-        }
-        m_Archetypes[signature].reset(archetype);
 
-        for (auto& [sig, archetypes] : m_ArchetypeCache)
-        {
-            if ((signature & sig) == sig)
-                archetypes.push_back(archetype);
+            const EntitySignature signature = archetype->GetSignature();
+            for (EntityID entity : archetype->GetEntities())
+            {
+                RecordEvents(ComponentEvent::Remove, signature, entity);
+                ReleaseEntity(entity);
+            }
+            count += archetype->GetEntityCount();
+            ForEachComponentIndex(signature, [archetype](ComponentTypeIndex i)
+            {
+                assert(s_ClearStorageFuncs[i] && "Component type not registered!");
+                s_ClearStorageFuncs[i](archetype);
+            });
+            archetype->ClearEntities();
         }
-
-        return archetype;
+        if (count)
+            PurgeDeletedComponents();
+        return count;
     }
 
-    void MigrateCommonComponents(
-        Archetype* srcArchetype, Archetype* dstArchetype, 
-        EntityID oldEntity, EntityID newEntity
-    )
+    /// <summary>
+    /// Attaches a copy of value to every entity having all of Comps, entities that already have a Comp keep theirs.
+    /// </summary>
+    /// <returns>the number of entities that received the component</returns>
+    template<ComponentConstraint Comp, ComponentConstraint... Comps>
+    uint32_t AddToAll(const Comp& value)
     {
-        for (auto& [compType, _] : srcArchetype->m_ComponentStorages)
+        const EntitySignature added = StorageSignature<Comp>();
+        uint32_t count = 0;
+        for (Archetype* archetype : GetBulkArchetypes(BulkSignature<Comps...>()))
         {
-            if (!dstArchetype->m_ComponentStorages.contains(compType))
+            if ((archetype->GetSignature() & added).any())
                 continue;
-            assert(s_MoveComponentFuncs[compType] && "Component type not registered!");
-            s_MoveComponentFuncs[compType](srcArchetype, dstArchetype, oldEntity, newEntity);
+            if (!IsArchetypeFullyMatched(archetype))
+            {
+                for (EntityID entity : GetMatchedEntities(archetype))
+                    count += TryAddComponent(entity, value);
+                continue;
+            }
+
+            Archetype* target = GetOrCreateArchetype(archetype->GetSignature() | added);
+            const uint32_t size = archetype->GetEntityCount();
+            const uint32_t first = SpliceArchetype(archetype, target);
+            if constexpr (SplitComponentConstraint<Comp>)
+            {
+                FillComponentStorage(target, typename HotColdSplit<Comp>::Hot(HotColdSplit<Comp>::GetHot(value)), size);
+                FillComponentStorage(target, typename HotColdSplit<Comp>::Cold(HotColdSplit<Comp>::GetCold(value)), size);
+            }
+            else
+                FillComponentStorage(target, value, size);
+            for (EntityID entity : std::span<const EntityID>(target->GetEntities()).subspan(first))
+            {
+                ForEachComponentIndex(added, [this, entity](ComponentTypeIndex type)
+                {
+                    if (m_ChangeTracking)
+                        MarkComponentChanged(entity, type);
+                    RecordEvent(ComponentEvent::Add, type, entity);
+                });
+            }
+            count += size;
         }
+        return count;
     }
 
-    void MigrateEntity(EntityID entity, Archetype* srcArchetype, Archetype* dstArchetype)
+    /// <summary>
+    /// Detaches the Comp of every entity having it and all of Comps.
+    /// </summary>
+    /// <returns>the number of entities that lost the component</returns>
+    template<ComponentConstraint Comp, ComponentConstraint... Comps>
+    uint32_t RemoveFromAll()
     {
-        dstArchetype->AddEntity(entity);
-
-        MigrateCommonComponents(srcArchetype, dstArchetype, entity, entity);
+        const EntitySignature removed = StorageSignature<Comp>();
+        uint32_t count = 0;
+        for (Archetype* archetype : GetBulkArchetypes(BulkSignature<Comp, Comps...>()))
+        {
+            if (!IsArchetypeFullyMatched(archetype))
+            {
+                for (EntityID entity : GetMatchedEntities(archetype))
+                {
+                    ForEachComponentIndex(removed, [this, entity](ComponentTypeIndex type) { DeleteComponent_Internal(entity, type); });
+                    ++count;
+                }
+                continue;
+            }
 
-        srcArchetype->RemoveEntity(entity);
-        m_EntitySignatures[entity].Archetype = dstArchetype;
+            Archetype* target = GetOrCreateArchetype(archetype->GetSignature() & ~removed);
+            const uint32_t first = SpliceArchetype(archetype, target);
+            for (EntityID entity : std::span<const EntityID>(target->GetEntities()).subspan(first))
+            {
+                RecordEvents(ComponentEvent::Remove, removed, entity);
+                if (m_ChangeTracking)
+                    MarkEntityChanged(entity);
+            }
+            count += target->GetEntityCount() - first;
+        }
+        return count;
     }
 
-    void DeleteComponent_Internal(EntityID entity, ComponentTypeIndex compType)
-    {
-        if (entity >= m_MaxEntityCount || m_EntitySignatures[entity].Archetype == nullptr)
-            return;
-        assert(s_RemoveComponentFuncs[compType] && "Component type not registered!");
-        if (!s_RemoveComponentFuncs[compType](m_EntitySignatures[entity].Archetype, entity))
-            return;
-
-        ComponentTypeID compId = ComponentTypeID((uint64_t)1 << (uint32_t)compType);
+    ///////////////////////////////////////////////////////////////////
+    //// Observers ////////////////////////////////////////////////////
+    ///////////////////////////////////////////////////////////////////
 
-        EntitySignature newSig = m_EntitySignatures[entity].Signature & compId.flip();
-        m_EntitySignatures[entity].Signature = newSig;
+    /// <summary>
+    /// Calls callback(ComponentBatch<Comp>&) with the entities that received a Comp since the last dispatch.
+    /// Events are queued as they happen and dispatched by Flush (or DispatchEvents), one call per archetype, so spawning
+    /// thousands of entities costs a handful of calls. Entities that lost the component or died before the dispatch are left out.
+    /// Callbacks can modify components and queue deferred deletions, but must not make structural changes right away
+    /// (add components, create entities) nor add or remove observers.
+    /// Observers belong to the registry object: a Fork has none, and both RestoreFrom (e.g. RollbackRing::Restore)
+    /// and move assignment keep the observers of the target.
+    /// </summary>
+    /// <returns>the ID to give to RemoveObserver</returns>
+    template<ComponentConstraint Comp, typename Func>
+    ObserverID OnAdd(Func&& callback)
+    {
+        return AddObserver<Comp>(ComponentEvent::Add, std::forward<Func>(callback));
+    }
 
-        Archetype* newArchetype = GetOrCreateArchetype(newSig);
-        MigrateEntity(entity, m_EntitySignatures[entity].Archetype, newArchetype);
+    /// <summary>
+    /// Calls callback(ComponentBatch<Comp>&) with the entities that lost their Comp since the last dispatch, by removal or destruction.
+    /// The components are already destroyed, the batch only has the entity IDs, in the order the removals happened.
+    /// Same rules as OnAdd.
+    /// </summary>
+    template<ComponentConstraint Comp, typename Func>
+    ObserverID OnRemove(Func&& callback)
+    {
+        return AddObserver<Comp>(ComponentEvent::Remove, std::forward<Func>(callback));
     }
 
-    void DeleteEntity_Internal(EntityID entity)
+    /// <summary>
+    /// Calls callback(ComponentBatch<Comp>&) with the entities whose Comp has been replaced (TryReplaceComponent)
+    /// or reported modified (MarkComponentChanged) since the last dispatch, batched like OnAdd. Same rules as OnAdd.
+    /// </summary>
+    template<ComponentConstraint Comp, typename Func>
+    ObserverID OnSet(Func&& callback)
     {
-        if (entity >= m_MaxEntityCount || m_EntitySignatures[entity].Archetype == nullptr)
-            return;
+        return AddObserver<Comp>(ComponentEvent::Set, std::forward<Func>(callback));
+    }
 
-        Archetype* archetype = m_EntitySignatures[entity].Archetype;
-        for (auto& [compType, _] : archetype->m_ComponentStorages)
+    /// <summary>
+    /// Unregisters an observer. Events queued for a component nobody observes anymore are dropped.
+    /// </summary>
+    /// <returns>false if there is no observer with this ID</returns>
+    bool RemoveObserver(ObserverID id)
+    {
+        auto found = std::find_if(m_Observers.Callbacks.begin(), m_Observers.Callbacks.end(), [id](const Observer& observer) { return observer.ID == id; });
+        if (found == m_Observers.Callbacks.end())
+            return false;
+        const ComponentEvent event = found->Event;
+        const ComponentTypeIndex type = found->Type;
+        m_Observers.Callbacks.erase(found);
+        if (std::none_of(m_Observers.Callbacks.begin(), m_Observers.Callbacks.end(), [=](const Observer& observer) { return observer.Event == event && observer.Type == type; }))
         {
-            assert(s_RemoveComponentFuncs[compType] && "Component type not registered!");
-            s_RemoveComponentFuncs[compType](archetype, entity);
+            m_Observers.Observed[(uint32_t)event].reset(type);
+            m_Observers.Events[(uint32_t)event * MAX_COMPONENTS + type].clear();
         }
-        archetype->RemoveEntity(entity);
+        return true;
+    }
+
+    /// <summary>
+    /// Calls the observers with the events queued so far, removals first. Flush already does it.
+    /// </summary>
+    void DispatchEvents()
+    {
+        // a component removed then added again before the dispatch ends up reported as added
+        static constexpr ComponentEvent order[] = { ComponentEvent::Remove, ComponentEvent::Add, ComponentEvent::Set };
+        std::pmr::vector<EntityID> entities(m_Resource);
+        for (ComponentEvent event : order)
+        {
+            ForEachComponentIndex(m_Observers.Observed[(uint32_t)event], [&](ComponentTypeIndex type)
+            {
+                // copied out so that callbacks can queue new events
+                std::pmr::vector<EntityID>& queued = m_Observers.Events[(uint32_t)event * MAX_COMPONENTS + type];
+                if (queued.empty())
+                    return;
+                entities.assign(queued.begin(), queued.end());
+                queued.clear();
+                if (event == ComponentEvent::Remove)
+                    NotifyObservers(event, type, nullptr, entities, {});
+                else
+                    DispatchByArchetype(event, type, entities);
+            });
+        }
+    }
+
+    /// <summary>
+    /// Sets how many flushes in a row an archetype can stay empty before it is destroyed and removed from the view caches.
+    /// Only complete flushes count. Archetypes made with Reserve are collected too, the archetype without components never is.
+    /// 0 keeps empty archetypes forever, which is the default.
+    /// </summary>
+    /// <param name="flushCount">: number of consecutive flushes</param>
+    void SetEmptyArchetypeLifetime(uint32_t flushCount) { m_EmptyArchetypeLifetime = flushCount; }
+    [[nodiscard]] uint32_t GetEmptyArchetypeLifetime() const { return m_EmptyArchetypeLifetime; }
+
+    /// <summary>
+    /// Creates the archetype holding exactly these components if it doesn't exist yet and makes room for count entities in it,
+    /// so the first wave of spawns doesn't go through archetype creation and repeated column growth.
+    /// Also makes sure enough entity IDs are available to create that many entities.
+    /// </summary>
+    /// <typeparam name="...Comps">: Components of the archetype</typeparam>
+    /// <param name="count">: Number of entities the archetype can hold without reallocating</param>
+    template<ComponentConstraint... Comps>
+    void Reserve(uint32_t count)
+    {
+        EntitySignature sig = (EntitySignature() | ... | StorageSignature<Comps>());
+        Archetype* archetype = GetOrCreateArchetype(sig);
+        archetype->Reserve(count);
+        (ReserveStorage<Comps>(archetype, count), ...);
+
+        while (m_AvailableEntities.GetSize() < count)
+            Resize();
+    }
+
+    /// <summary>
+    /// Releases the spare capacity of every archetype (entity lists, index maps and component columns) after a load peak.
+    /// With a MonotonicArena the old blocks are only given back when the arena is released.
+    /// </summary>
+    void ShrinkToFit()
+    {
+        for (auto& [sig, archetype] : m_Archetypes)
+        {
+            archetype->ShrinkToFit();
+            ForEachComponentIndex(sig, [&archetype](ComponentTypeIndex compType)
+            {
+                assert(s_ShrinkStorageFuncs[compType] && "Component type not registered!");
+                s_ShrinkStorageFuncs[compType](archetype.get());
+            });
+        }
+    }
+
+    [[nodiscard]] uint32_t GetArchetypeCount() const { return m_Archetypes.GetSize(); }
+
+    /// <summary>
+    /// Number of deferred operations waiting for a Flush.
+    /// </summary>
+    [[nodiscard]] uint32_t GetPendingFlushCount() const
+    {
+        return m_DeletedComponents.GetSize() + m_DeletedEntities.GetSize();
+    }
+
+    /// <summary>
+    /// Writes every entity and component of the registry to a binary stream, archetype by archetype:
+    /// the entity IDs then one blob per component column. Trivially copyable columns are written with a single write,
+    /// other components go through their ComponentSerializer specialization.
+    /// Entity IDs are kept, as well as the order in which free IDs will be handed out.
+    /// Throws a SnapshotException if deferred operations are waiting for a Flush or if a component can't be serialized.
+    /// </summary>
+    /// <param name="stream">: binary output stream</param>
+    void SaveSnapshot(std::ostream& stream) const
+    {
+        if (GetPendingFlushCount() != 0)
+            throw SnapshotException("The registry has to be flushed before taking a snapshot.");
+
+        EntitySignature usedComponents;
+        uint32_t archetypeCount = 0;
+        // entities without components are the IDs that are neither used nor available, they aren't saved
+        for (const auto& [signature, archetype] : m_Archetypes)
+        {
+            if (archetype->GetEntityCount() == 0 || signature.none())
+                continue;
+            usedComponents |= signature;
+            ++archetypeCount;
+        }
+
+        SnapshotWriter writer(stream);
+        SnapshotHeader header;
+        header.EntityCount = m_EntityCount;
+        header.MaxEntityCount = m_MaxEntityCount;
+        header.AvailableEntityCount = m_AvailableEntities.GetSize();
+        header.DisabledEntityCount = (uint32_t)std::count(m_DisabledEntities.begin(), m_DisabledEntities.end(), 1);
+        header.ComponentCount = (uint32_t)usedComponents.count();
+        header.ArchetypeCount = archetypeCount;
+        writer.Write(header);
+
+        WriteComponentTable(writer, usedComponents);
+
+        for (std::span<const EntityID> ids : m_AvailableEntities.AsSpans())
+            writer.WriteSpan(ids);
+        for (EntityID entity = 0; header.DisabledEntityCount && entity < m_MaxEntityCount; ++entity)
+        {
+            if (m_DisabledEntities[entity])
+                writer.Write(entity);
+        }
+
+        for (const auto& [signature, archetype] : m_Archetypes)
+        {
+            if (archetype->GetEntityCount() == 0 || signature.none())
+                continue;
+            writer.Write((uint64_t)signature.to_ullong());
+            writer.Write(archetype->GetEntityCount());
+            writer.WriteSpan(std::span<const EntityID>(archetype->GetEntities()));
+            ForEachComponentIndex(signature, [&writer, &archetype](ComponentTypeIndex i)
+            {
+                writer.Align(SNAPSHOT_COLUMN_ALIGNMENT);
+                s_SaveColumnFuncs[i](archetype.get(), writer);
+            });
+        }
+        // pads the last column like the others, so it can be used in place too
+        writer.Align(SNAPSHOT_COLUMN_ALIGNMENT);
+    }
+
+    /// <summary>
+    /// Replaces the content of the registry with a snapshot written by SaveSnapshot.
+    /// Components are matched by type, so they don't have to be registered in the same order as when the snapshot was taken,
+    /// but every component of the snapshot has to be registered. Each archetype is created once and its columns are sized
+    /// before being filled. Views obtained before the load are invalidated.
+    /// Throws a SnapshotException if the snapshot can't be read, the registry is left empty in that case.
+    /// </summary>
+    /// <param name="stream">: binary input stream</param>
+    void LoadSnapshot(std::istream& stream)
+    {
+        SnapshotReader reader(stream);
+        LoadSnapshot_Internal(reader);
+    }
+
+    /// <summary>
+    /// Loads a snapshot from memory without copying the columns of trivially copyable components:
+    /// they point straight into the snapshot, which is typically a MappedFile so pages are only read when something touches them.
+    /// The memory is written to when those components are modified and has to outlive the registry,
+    /// unless the columns get reallocated (an entity joins or leaves the archetype, ShrinkToFit...) which copies them out.
+    /// The snapshot has to start on a 64 bytes boundary, columns that end up misaligned are copied.
+    /// </summary>
+    /// <param name="memory">: snapshot written by SaveSnapshot, copy on write if it must stay untouched</param>
+    void LoadSnapshot(std::span<std::byte> memory)
+    {
+        SnapshotReader reader(memory);
+        LoadSnapshot_Internal(reader);
+    }
+
+    /// <summary>
+    /// Moves every entity of another registry into this one, e.g. a world section built in a staging registry on a loader thread.
+    /// The entities get new IDs, taken from the available IDs of this registry, and the other registry is left empty.
+    /// Component columns are moved whole into the columns of the matching archetypes: an archetype this registry doesn't have yet
+    /// takes over the other registry's memory if both registries use equal memory resources, otherwise components are relocated in bulk.
+    /// Entity IDs stored inside components aren't updated, onRemap is called with each old and new ID once every entity is moved
+    /// so it can fix them, or they can be fixed with the returned table.
+    /// Throws a MergeException if deferred operations are waiting for a Flush in either registry.
+    /// Everything that allocates is done before the first entity moves, so running out of memory leaves both registries unchanged.
+    /// After that only components whose move constructor isn't noexcept can throw, which leaves both registries only fit to be destroyed.
+    /// The observers of the other registry get OnRemove events for the moved components at its next dispatch.
+    /// </summary>
+    /// <param name="other">: registry whose entities are moved, left empty</param>
+    /// <param name="onRemap">: called as onRemap(oldEntity, newEntity) for every moved entity</param>
+    /// <returns>the new ID of every entity, indexed by its old ID, INVALID_ENTITY_ID for the IDs that weren't used</returns>
+    template<typename RemapFunc>
+    std::vector<EntityID> Merge(EntityRegistry&& other, RemapFunc&& onRemap)
+    {
+        if (this == &other)
+            throw MergeException("A registry can't be merged into itself.");
+        if (GetPendingFlushCount() != 0 || other.GetPendingFlushCount() != 0)
+            throw MergeException("Both registries have to be flushed before being merged.");
+
+        while (m_AvailableEntities.GetSize() < other.m_EntityCount)
+            Resize();
+
+        std::vector<EntityID> remap(other.m_MaxEntityCount, INVALID_ENTITY_ID);
+        std::pmr::vector<EntityID> ids(m_Resource);
+        ReserveMerge(other, ids);
+        for (auto& [signature, archetype] : other.m_Archetypes)
+        {
+            // entities without components are moved below, whether their archetype lists them or not
+            if (archetype->GetEntityCount() == 0 || signature.none())
+                continue;
+            ids.clear();
+            for (EntityID entity : archetype->GetEntities())
+            {
+                const EntityID newEntity = AcquireEntity(signature);
+                remap[entity] = newEntity;
+                ids.push_back(newEntity);
+                other.RecordEvents(ComponentEvent::Remove, signature, entity);
+            }
+
+            Archetype* target = GetOrCreateArchetype(signature);
+            const uint32_t firstRow = target->GetEntityCount();
+            target->AddEntities(ids);
+            for (uint32_t i = 0; i < (uint32_t)ids.size(); ++i)
+            {
+                m_EntitySignatures[ids[i]].Archetype = target;
+                RecordEvents(ComponentEvent::Add, signature, ids[i]);
+                if (archetype->GetDisabledCount() && archetype->IsRowDisabled(i))
+                {
+                    m_DisabledEntities[ids[i]] = 1;
+                    target->SetRowEnabled(firstRow + i, false);
+                }
+            }
+            ForEachComponentIndex(signature, [&archetype, target](ComponentTypeIndex i)
+            {
+                assert(s_SpliceStorageFuncs[i] && "Component type not registered!");
+                s_SpliceStorageFuncs[i](archetype.get(), target);
+            });
+        }
+        for (EntityID entity = 0; entity < other.m_MaxEntityCount; ++entity)
+        {
+            const EntityMetadata& metadata = other.m_EntitySignatures[entity];
+            if (metadata.Archetype && metadata.Signature.none())
+            {
+                remap[entity] = AcquireEntity(EntitySignature());
+                m_DisabledEntities[remap[entity]] = other.m_DisabledEntities[entity];
+            }
+        }
+
+        other.ForgetEntities();
+
+        for (EntityID entity = 0; entity < (EntityID)remap.size(); ++entity)
+        {
+            if (remap[entity] != INVALID_ENTITY_ID)
+                onRemap(entity, remap[entity]);
+        }
+        return remap;
+    }
+
+    std::vector<EntityID> Merge(EntityRegistry&& other)
+    {
+        return Merge(std::move(other), [](EntityID, EntityID) {});
+    }
+
+    /// <summary>
+    /// Moves one entity and its components from another registry into this one, where it gets a new ID.
+    /// The entity is destroyed in the other registry right away, without going through a Flush.
+    /// Its observers get the OnRemove events at their next dispatch, as for a destruction.
+    /// Throws a MergeException if deferred operations are waiting for a Flush in the other registry, they could name the entity.
+    /// </summary>
+    /// <param name="other">: registry the entity is taken from</param>
+    /// <param name="entity">: ID of the entity in the other registry</param>
+    /// <returns>the ID of the entity in this registry</returns>
+    EntityID MoveEntity(EntityRegistry& other, EntityID entity)
+    {
+        if (this == &other || !other.IsEntityValid(entity))
+            throw EntityIDOutOfRange();
+        if (other.GetPendingFlushCount() != 0)
+            throw MergeException("The registry the entity is taken from has to be flushed first.");
+        if (m_AvailableEntities.IsEmpty())
+            Resize();
+
+        const EntitySignature signature = other.m_EntitySignatures[entity].Signature;
+        Archetype* source = other.m_EntitySignatures[entity].Archetype;
+        // the target archetype, its row and its columns are allocated before the ID is taken, so running out of memory doesn't lose it
+        Archetype* target = signature.any() ? GetOrCreateArchetype(signature) : nullptr;
+        if (target)
+        {
+            uint32_t capacity = target->GetCapacity();
+            if (target->GetEntityCount() == capacity)
+                capacity = std::max(capacity * 2, 16u);
+            target->Reserve(capacity);
+            ForEachComponentIndex(signature, [target, capacity](ComponentTypeIndex i)
+            {
+                assert(s_ReserveStorageFuncs[i] && "Component type not registered!");
+                s_ReserveStorageFuncs[i](target, capacity);
+            });
+        }
+
+        const EntityID newEntity = AcquireEntity(signature);
+        m_DisabledEntities[newEntity] = other.m_DisabledEntities[entity];
+        if (target)
+        {
+            target->AddEntity(newEntity);
+            if (m_DisabledEntities[newEntity])
+                target->SetRowEnabled(target->GetEntityCount() - 1, false);
+            MigrateCommonComponents(source, target, entity, newEntity);
+            m_EntitySignatures[newEntity].Archetype = target;
+        }
+        source->RemoveEntity(entity);
+        other.RecordEvents(ComponentEvent::Remove, signature, entity);
+        other.ReleaseEntity(entity);
+        RecordEvents(ComponentEvent::Add, signature, newEntity);
+        return newEntity;
+    }
+
+    /// <summary>
+    /// Writes a snapshot like SaveSnapshot, from a background thread, so the registry can keep being modified meanwhile.
+    /// The state of the registry at the time of the call is frozen with a Fork: components aren't copied up front,
+    /// a column is only copied when the registry writes to it before the snapshot is done with it.
+    /// The stream is written by the background thread only and has to stay alive until the snapshot is done.
+    /// Throws a SnapshotException if deferred operations are waiting for a Flush or if a component can't be serialized,
+    /// and a ForkException if a component can't be copied. Errors while writing are reported by AsyncSnapshot::Wait.
+    /// </summary>
+    /// <param name="stream">: binary output stream</param>
+    /// <returns>the snapshot in progress, to be waited for on this thread</returns>
+    [[nodiscard]] AsyncSnapshot SnapshotAsync(std::ostream& stream)
+    {
+        if (GetPendingFlushCount() != 0)
+            throw SnapshotException("The registry has to be flushed before taking a snapshot.");
+        for (const auto& [signature, archetype] : m_Archetypes)
+        {
+            ForEachComponentIndex(signature, [](ComponentTypeIndex i)
+            {
+                if (!s_SaveColumnFuncs[i])
+                    throw SnapshotException("A component type has no ComponentSerializer.");
+            });
+        }
+
+        AsyncSnapshot snapshot;
+        snapshot.m_Frozen = std::make_unique<EntityRegistry>(Fork());
+        const EntityRegistry* frozen = snapshot.m_Frozen.get();
+        snapshot.m_Task = std::async(std::launch::async, [frozen, &stream]() { frozen->SaveSnapshot(stream); });
+        return snapshot;
+    }
+
+    /// <summary>
+    /// Starts or stops recording the changes made to the registry for SaveDelta. Enabling it makes the current state the baseline.
+    /// Entity creations and destructions, component additions and removals are recorded by the registry,
+    /// component values modified in place (through GetComponent or a view) have to be reported with MarkComponentChanged.
+    /// Loading a snapshot starts a new baseline.
+    /// </summary>
+    void SetChangeTracking(bool enabled)
+    {
+        m_ChangeTracking = enabled;
+        ClearChanges();
+        if (enabled)
+        {
+            m_ChangedComponents.resize(m_MaxEntityCount);
+            m_IsEntityChanged.resize(m_MaxEntityCount);
+        }
+        else
+        {
+            m_ChangedComponents.clear();
+            m_ChangedComponents.shrink_to_fit();
+            m_IsEntityChanged.clear();
+            m_IsEntityChanged.shrink_to_fit();
+        }
+    }
+
+    [[nodiscard]] bool IsChangeTracking() const { return m_ChangeTracking; }
+
+    /// <summary>
+    /// Reports that the component of the entity has been modified in place, so the next delta carries its new value
+    /// and OnSet observers are notified.
+    /// Does nothing if the entity doesn't have the component.
+    /// </summary>
+    template<ComponentConstraint Comp>
+    void MarkComponentChanged(EntityID entity)
+    {
+        if constexpr (SplitComponentConstraint<Comp>)
+        {
+            MarkComponentChanged<typename HotColdSplit<Comp>::Hot>(entity);
+            MarkComponentChanged<typename HotColdSplit<Comp>::Cold>(entity);
+        }
+        else if (entity < m_MaxEntityCount && m_EntitySignatures[entity].Signature.test(GetComponentTypeIndex<Comp>()))
+        {
+            if (m_ChangeTracking)
+                MarkComponentChanged(entity, GetComponentTypeIndex<Comp>());
+            RecordEvent(ComponentEvent::Set, GetComponentTypeIndex<Comp>(), entity);
+        }
+    }
+
+    /// <summary>
+    /// Writes what changed since the baseline (the previous delta or the moment change tracking was enabled) and starts a new baseline:
+    /// entity creations and destructions in the order they happened, then the signature and the changed components of every entity
+    /// that has been touched. Applied with ApplyDelta to a registry that was identical at the baseline, it brings it to the same state,
+    /// entity IDs and the order in which free IDs are handed out included.
+    /// Throws a SnapshotException if change tracking is disabled, if deferred operations are waiting for a Flush
+    /// or if a component can't be serialized.
+    /// </summary>
+    /// <param name="stream">: binary output stream</param>
+    void SaveDelta(std::ostream& stream)
+    {
+        if (!m_ChangeTracking)
+            throw SnapshotException("Change tracking has to be enabled to save a delta.");
+        if (GetPendingFlushCount() != 0)
+            throw SnapshotException("The registry has to be flushed before saving a delta.");
+
+        // entities destroyed since the baseline are left out, their destruction is in the operations
+        EntitySignature usedComponents;
+        uint32_t entityCount = 0;
+        for (EntityID entity : m_ChangedEntities)
+        {
+            if (m_EntitySignatures[entity].Archetype == nullptr)
+                continue;
+            usedComponents |= m_EntitySignatures[entity].Signature;
+            ++entityCount;
+        }
+
+        SnapshotWriter writer(stream);
+        DeltaHeader header;
+        header.ComponentCount = (uint32_t)usedComponents.count();
+        header.OperationCount = (uint32_t)m_DeltaOperations.size();
+        header.EntityCount = entityCount;
+        writer.Write(header);
+        WriteComponentTable(writer, usedComponents);
+        writer.WriteSpan(std::span<const DeltaOperation>(m_DeltaOperations));
+
+        for (EntityID entity : m_ChangedEntities)
+        {
+            const EntityMetadata& metadata = m_EntitySignatures[entity];
+            if (metadata.Archetype == nullptr)
+                continue;
+            const EntitySignature changed = m_ChangedComponents[entity] & metadata.Signature;
+            writer.Write(entity);
+            writer.Write((uint64_t)metadata.Signature.to_ullong());
+            writer.Write((uint64_t)changed.to_ullong());
+            ForEachComponentIndex(changed, [&writer, &metadata, entity](ComponentTypeIndex i)
+            {
+                s_SaveComponentFuncs[i](metadata.Archetype, entity, writer);
+            });
+        }
+        ClearChanges();
+    }
+
+    /// <summary>
+    /// Replays a delta written by SaveDelta. The registry has to be in the state the delta's baseline was in,
+    /// typically a replica loaded from a snapshot of the source and fed every delta since, in order.
+    /// If change tracking is enabled, the applied changes are recorded like any other so replicas can be chained.
+    /// Throws a SnapshotException if the delta can't be read or doesn't match the state of the registry,
+    /// which is then left partially updated.
+    /// </summary>
+    /// <param name="stream">: binary input stream</param>
+    void ApplyDelta(std::istream& stream)
+    {
+        if (GetPendingFlushCount() != 0)
+            throw SnapshotException("The registry has to be flushed before applying a delta.");
+
+        SnapshotReader reader(stream);
+        const DeltaHeader header = reader.Read<DeltaHeader>();
+        if (header.Magic != DeltaHeader::MAGIC || header.Version != DeltaHeader::VERSION)
+            throw SnapshotException("Not a delta or unsupported delta version.");
+        if (header.ComponentCount > MAX_COMPONENTS)
+            throw SnapshotException("Corrupt delta header.");
+
+        std::array<ComponentTypeIndex, MAX_COMPONENTS> localIndices;
+        const EntitySignature deltaComponents = ReadComponentTable(reader, header.ComponentCount, localIndices);
+
+        for (uint32_t i = 0; i < header.OperationCount; ++i)
+        {
+            const auto operation = reader.Read<DeltaOperation>();
+            switch (operation.Type)
+            {
+            case DeltaOperationType::CreateEntity:
+                if (m_AvailableEntities.IsEmpty() || m_AvailableEntities.GetFront() != operation.Value)
+                    throw SnapshotException("The delta doesn't match the registry.");
+                CreateEntity();
+                break;
+            case DeltaOperationType::DestroyEntity:
+                if (operation.Value >= m_MaxEntityCount || m_EntitySignatures[operation.Value].Archetype == nullptr)
+                    throw SnapshotException("The delta doesn't match the registry.");
+                DeleteEntity_Internal(operation.Value);
+                break;
+            case DeltaOperationType::EnableEntity:
+            case DeltaOperationType::DisableEntity:
+                if (operation.Value >= m_MaxEntityCount || m_EntitySignatures[operation.Value].Archetype == nullptr)
+                    throw SnapshotException("The delta doesn't match the registry.");
+                SetEnabled(operation.Value, operation.Type == DeltaOperationType::EnableEntity);
+                break;
+            case DeltaOperationType::Grow:
+                while (m_MaxEntityCount < operation.Value)
+                    Resize();
+                if (m_MaxEntityCount != operation.Value)
+                    throw SnapshotException("The delta doesn't match the registry.");
+                break;
+            default:
+                throw SnapshotException("Corrupt delta operation.");
+            }
+        }
+
+        for (uint32_t i = 0; i < header.EntityCount; ++i)
+        {
+            const EntityID entity = reader.Read<EntityID>();
+            const EntitySignature deltaSig(reader.Read<uint64_t>());
+            const EntitySignature deltaChanged(reader.Read<uint64_t>());
+            if (entity >= m_MaxEntityCount || m_EntitySignatures[entity].Archetype == nullptr)
+                throw SnapshotException("The delta doesn't match the registry.");
+            if ((deltaSig & deltaComponents) != deltaSig || (deltaChanged & deltaSig) != deltaChanged)
+                throw SnapshotException("Corrupt delta entity.");
+            ApplyEntityDelta(entity, deltaSig, deltaChanged, localIndices, reader);
+        }
+    }
+
+    /// <summary>
+    /// Makes an independent copy of the registry, typically to simulate ahead speculatively and throw the result away (see RollbackRing).
+    /// The component columns aren't copied: both registries share them and a column is only copied the first time either registry
+    /// modifies it, so a fork costs about as much as the entity bookkeeping and only the columns that are written afterwards are paid for.
+    /// A column is considered modified as soon as its storage is handed out for writing (GetComponent, views, structural changes),
+    /// which means references obtained before the fork must not be written through afterwards. Views check their columns again
+    /// each time they start an iteration (begin, Rows, EachBatch), so a view can be kept across a fork but not written through
+    /// while one is made in the middle of an iteration.
+    /// Both registries use the memory resource of this one. Change tracking starts a new baseline in the fork.
+    /// Throws a ForkException if deferred operations are waiting for a Flush or if a component type can't be copied.
+    /// </summary>
+    /// <returns>a registry with the same entities, components and free entity IDs</returns>
+    [[nodiscard]] EntityRegistry Fork()
+    {
+        CheckForkable();
+        EntityRegistry fork(m_MaxEntityCount, m_Resource);
+        fork.ShareStateOf(*this);
+        fork.SetChangeTracking(m_ChangeTracking);
+        return fork;
+    }
+
+    /// <summary>
+    /// Brings the registry to the state of another one, typically a Fork kept aside (see RollbackRing::Restore).
+    /// The result is the same as assigning source.Fork() but it is done in place: the columns of source are shared the same way,
+    /// the archetypes and the memory of this registry are reused, and what belongs to the registry object is kept,
+    /// its observers and whether it tracks changes. Change tracking starts a new baseline and queued observer events are dropped,
+    /// the restore itself raises no event. Like any structural change, it invalidates views and references to components.
+    /// Throws a ForkException if either registry has deferred operations waiting for a Flush or if a component type of source can't be copied.
+    /// </summary>
+    void RestoreFrom(EntityRegistry& source)
+    {
+        if (GetPendingFlushCount() != 0)
+            throw ForkException("The registry has to be flushed before being restored.");
+        source.CheckForkable();
+        if (&source == this)
+            return;
+
+        ShareStateOf(source);
+        for (auto& events : m_Observers.Events)
+            events.clear();
+        SetChangeTracking(m_ChangeTracking);
+    }
+
+private:
+    uint32_t m_EntityCount = 0;
+    uint32_t m_MaxEntityCount = 4096;
+    std::pmr::memory_resource* m_Resource = std::pmr::get_default_resource();
+
+    CircularBuffer<EntityID> m_AvailableEntities;
+    struct EntityMetadata
+    {
+        EntitySignature Signature{};
+        Archetype*      Archetype{};
+    };
+    std::pmr::vector<EntityMetadata> m_EntitySignatures;
+    std::pmr::vector<uint8_t> m_PendingDeletions; // 1 if the entity is queued for deletion, indexed by EntityID
+    uint32_t m_PendingDeletionCount = 0;
+    std::pmr::vector<uint8_t> m_DisabledEntities; // 1 if the entity is disabled, indexed by EntityID, archetypes keep the same flag per row for views
+
+    using ArchetypePtr = std::unique_ptr<Archetype, ResourceDeleter<Archetype>>;
+    FlatHashMap<EntitySignature, ArchetypePtr>                 m_Archetypes;
+    FlatHashMap<EntitySignature, std::pmr::vector<Archetype*>> m_ArchetypeCache; // list of archetypes that has AT LEAST these components for looping through entities faster
+    uint32_t m_EmptyArchetypeLifetime = 0; // in flushes, 0 means empty archetypes are kept
+
+    // Matching index: answers "which archetypes have at least these components" without going through every archetype.
+    // Every archetype is listed under each of its components and every view cache is listed under one of its components,
+    // the one that had the fewest archetypes when the cache was made.
+    std::pmr::vector<std::pmr::vector<Archetype*>>      m_ComponentArchetypes; // indexed by ComponentTypeIndex
+    std::pmr::vector<std::pmr::vector<EntitySignature>> m_CachesByComponent;   // indexed by ComponentTypeIndex
+
+    // Change tracking for deltas, everything is relative to the baseline
+    bool m_ChangeTracking = false;
+    std::pmr::vector<DeltaOperation>  m_DeltaOperations;   // entity creations, destructions and growths in order
+    std::pmr::vector<EntityID>        m_ChangedEntities;   // entities whose signature or components changed
+    std::pmr::vector<EntitySignature> m_ChangedComponents; // components whose value changed, indexed by EntityID
+    std::pmr::vector<uint8_t>         m_IsEntityChanged;   // 1 if the entity is in m_ChangedEntities, indexed by EntityID
+
+    struct DeletedComponent
+    {
+        EntityID Entity;
+        ComponentTypeIndex Type;
+    };
+    // filled concurrently by DeleteEntity/DeleteComponent, drained by Flush
+    MPSCQueue<EntityID> m_DeletedEntities;
+    MPSCQueue<DeletedComponent> m_DeletedComponents;
+
+    struct Observer
+    {
+        ObserverID ID;
+        ComponentTypeIndex Type;
+        ComponentEvent Event;
+        ObserverFunc Callback;
+    };
+    // Observers belong to the registry object, not to its content: moving a registry into another one (operator=)
+    // keeps the observers of the target and drops the events queued for the entities it had
+    struct ObserverSet
+    {
+        explicit ObserverSet(std::pmr::memory_resource* resource)
+            : Callbacks(resource)
+            , Events(COMPONENT_EVENT_COUNT * MAX_COMPONENTS, resource)
+        {}
+
+        ObserverSet(ObserverSet&&) = default;
+
+        ObserverSet& operator=(ObserverSet&&) noexcept
+        {
+            for (auto& events : Events)
+                events.clear();
+            return *this;
+        }
+
+        std::pmr::vector<Observer> Callbacks;
+        ObserverID LastID = 0;
+        std::array<EntitySignature, COMPONENT_EVENT_COUNT> Observed{}; // components with at least one observer, per event
+        std::pmr::vector<std::pmr::vector<EntityID>> Events;             // queued entities, indexed by event * MAX_COMPONENTS + type
+    };
+    ObserverSet m_Observers;
+
+private:
+    static inline std::array<CreateStorageFunc, MAX_COMPONENTS>    s_CreateStorageFuncs = {};
+    static inline std::array<MoveComponentFunc, MAX_COMPONENTS>    s_MoveComponentFuncs = {};
+    static inline std::array<RemoveComponentFunc, MAX_COMPONENTS>  s_RemoveComponentFuncs = {};
+    static inline std::array<ShrinkStorageFunc, MAX_COMPONENTS>    s_ShrinkStorageFuncs = {};
+    static inline std::array<SpliceStorageFunc, MAX_COMPONENTS>    s_SpliceStorageFuncs = {};
+    static inline std::array<ClearStorageFunc, MAX_COMPONENTS>     s_ClearStorageFuncs = {};
+    static inline std::array<ReserveSpliceFunc, MAX_COMPONENTS>    s_ReserveSpliceFuncs = {};
+    static inline std::array<ReserveStorageFunc, MAX_COMPONENTS>   s_ReserveStorageFuncs = {};
+    static inline std::array<SaveColumnFunc, MAX_COMPONENTS>       s_SaveColumnFuncs = {};     // null if the component can't be serialized
+    static inline std::array<LoadColumnFunc, MAX_COMPONENTS>       s_LoadColumnFuncs = {};
+    static inline std::array<SaveComponentFunc, MAX_COMPONENTS>    s_SaveComponentFuncs = {};
+    static inline std::array<LoadComponentFunc, MAX_COMPONENTS>    s_LoadComponentFuncs = {};
+    static inline std::array<ForkStorageFunc, MAX_COMPONENTS>      s_ForkStorageFuncs = {};    // null if the component can't be copied
+    static inline std::array<uint64_t, MAX_COMPONENTS>             s_ComponentTypeHashes = {}; // matches snapshot columns with registered types
+    static inline std::array<uint32_t, MAX_COMPONENTS>             s_ComponentSizes = {};
+
+    // deferred operations are drained in batches of this size
+    static constexpr uint32_t FLUSH_BATCH_SIZE = 32;
+
+private:
+
+    /// <summary>
+    /// Initialization helper
+    /// </summary>
+    void Init()
+    {
+        m_EntitySignatures.resize(m_MaxEntityCount);
+        m_PendingDeletions.resize(m_MaxEntityCount);
+        m_DisabledEntities.resize(m_MaxEntityCount);
+        AddAvailableEntities(0, m_MaxEntityCount);
+
+        EntitySignature emptySig;
+        m_Archetypes[emptySig] = AllocateArchetype();
+    }
+
+    /// <summary>
+    /// Destroys every entity and archetype and sizes the registry for maxEntityCount entities, without any available ID.
+    /// </summary>
+    void Reset(uint32_t maxEntityCount)
+    {
+        m_ArchetypeCache.Clear();
+        for (auto& archetypes : m_ComponentArchetypes)
+            archetypes.clear();
+        for (auto& caches : m_CachesByComponent)
+            caches.clear();
+        m_Archetypes.Clear();
+
+        m_EntityCount = 0;
+        m_MaxEntityCount = maxEntityCount;
+        m_AvailableEntities.Clear();
+        m_AvailableEntities.Resize(maxEntityCount);
+        m_EntitySignatures.assign(maxEntityCount, EntityMetadata{});
+        m_PendingDeletions.assign(maxEntityCount, 0);
+        m_PendingDeletionCount = 0;
+        m_DisabledEntities.assign(maxEntityCount, 0);
+        m_Archetypes[EntitySignature()] = AllocateArchetype();
+        SetChangeTracking(m_ChangeTracking);
+        for (auto& events : m_Observers.Events)
+            events.clear();
+    }
+
+    /// <summary>
+    /// Makes room for the entities of other everywhere Merge adds them (archetypes, columns, events, changes),
+    /// so that moving them doesn't allocate. ids gets room for the largest archetype of other.
+    /// </summary>
+    void ReserveMerge(EntityRegistry& other, std::pmr::vector<EntityID>& ids)
+    {
+        std::array<uint32_t, MAX_COMPONENTS> addedCounts{};
+        uint32_t largest = 0;
+        for (auto& [signature, archetype] : other.m_Archetypes)
+        {
+            const uint32_t count = archetype->GetEntityCount();
+            if (count == 0 || signature.none())
+                continue;
+            largest = std::max(largest, count);
+            Archetype* target = GetOrCreateArchetype(signature);
+            target->Reserve(target->GetEntityCount() + count);
+            ForEachComponentIndex(signature, [&](ComponentTypeIndex i)
+            {
+                assert(s_ReserveSpliceFuncs[i] && "Component type not registered!");
+                s_ReserveSpliceFuncs[i](archetype.get(), target);
+                addedCounts[i] += count;
+            });
+        }
+        ids.reserve(largest);
+
+        ForEachComponentIndex(m_Observers.Observed[(uint32_t)ComponentEvent::Add], [&](ComponentTypeIndex i)
+        {
+            auto& events = m_Observers.Events[(uint32_t)ComponentEvent::Add * MAX_COMPONENTS + i];
+            events.reserve(events.size() + addedCounts[i]);
+        });
+        ForEachComponentIndex(other.m_Observers.Observed[(uint32_t)ComponentEvent::Remove], [&](ComponentTypeIndex i)
+        {
+            auto& events = other.m_Observers.Events[(uint32_t)ComponentEvent::Remove * MAX_COMPONENTS + i];
+            events.reserve(events.size() + addedCounts[i]);
+        });
+        if (m_ChangeTracking)
+        {
+            m_DeltaOperations.reserve(m_DeltaOperations.size() + other.m_EntityCount);
+            m_ChangedEntities.reserve(m_ChangedEntities.size() + other.m_EntityCount);
+        }
+    }
+
+    /// <summary>
+    /// Lets go of every entity once Merge has moved them out, without allocating: the archetypes are kept but emptied,
+    /// every ID is available again and change tracking starts a new baseline. Only the queued removals are kept.
+    /// </summary>
+    void ForgetEntities()
+    {
+        for (auto& [signature, archetype] : m_Archetypes)
+        {
+            ForEachComponentIndex(signature, [&archetype](ComponentTypeIndex i)
+            {
+                s_ClearStorageFuncs[i](archetype.get());
+            });
+            archetype->ClearEntities();
+        }
+        m_EntityCount = 0;
+        std::fill(m_EntitySignatures.begin(), m_EntitySignatures.end(), EntityMetadata{});
+        std::fill(m_DisabledEntities.begin(), m_DisabledEntities.end(), uint8_t(0));
+        m_AvailableEntities.Clear();
+        AddAvailableEntities(0, m_MaxEntityCount);
+        ClearChanges();
+        // the removals stay queued, the observers of this registry are told the entities left
+        for (ComponentEvent event : { ComponentEvent::Add, ComponentEvent::Set })
+        {
+            for (ComponentTypeIndex i = 0; i < MAX_COMPONENTS; ++i)
+                m_Observers.Events[(uint32_t)event * MAX_COMPONENTS + i].clear();
+        }
+    }
+
+    // throws a ForkException if the registry can't be forked
+    void CheckForkable()
+    {
+        if (GetPendingFlushCount() != 0)
+            throw ForkException("The registry has to be flushed before being forked.");
+        for (auto& [signature, archetype] : m_Archetypes)
+        {
+            ForEachComponentIndex(signature, [](ComponentTypeIndex i)
+            {
+                if (!s_ForkStorageFuncs[i])
+                    throw ForkException("Only registries of copy constructible components can be forked.");
+            });
+        }
+    }
+
+    /// <summary>
+    /// Replaces the entities of this registry with the ones of source, sharing its columns (see Fork). The archetypes of this registry
+    /// are kept, the ones source doesn't have are left empty. Change tracking and observer events are left to the caller.
+    /// </summary>
+    void ShareStateOf(EntityRegistry& source)
+    {
+        m_EntityCount = source.m_EntityCount;
+        m_MaxEntityCount = source.m_MaxEntityCount;
+        m_AvailableEntities = source.m_AvailableEntities;
+        m_EmptyArchetypeLifetime = source.m_EmptyArchetypeLifetime;
+        m_PendingDeletions.assign(m_MaxEntityCount, 0);
+        m_PendingDeletionCount = 0;
+
+        // entities without components aren't necessarily listed in the empty archetype, they are pointed at it first
+        Archetype* emptyArchetype = GetArchetype(EntitySignature());
+        m_EntitySignatures = source.m_EntitySignatures;
+        m_DisabledEntities = source.m_DisabledEntities;
+        for (EntityMetadata& metadata : m_EntitySignatures)
+        {
+            if (metadata.Archetype)
+                metadata.Archetype = emptyArchetype;
+        }
+
+        for (auto& [signature, archetype] : m_Archetypes)
+        {
+            if (source.m_Archetypes.TryGet(signature))
+                continue;
+            ForEachComponentIndex(signature, [&archetype](ComponentTypeIndex i)
+            {
+                s_ClearStorageFuncs[i](archetype.get());
+            });
+            archetype->ClearEntities();
+        }
+
+        for (auto& [signature, archetype] : source.m_Archetypes)
+        {
+            Archetype* shared = GetOrCreateArchetype(signature);
+            shared->CopyEntities(*archetype);
+            shared->m_EmptyFlushCount = archetype->m_EmptyFlushCount;
+            ForEachComponentIndex(signature, [&archetype, shared](ComponentTypeIndex i)
+            {
+                s_ForkStorageFuncs[i](archetype.get(), shared);
+            });
+            for (EntityID entity : shared->GetEntities())
+                m_EntitySignatures[entity].Archetype = shared;
+        }
+    }
+
+    /// <summary>
+    /// Writes the type of every component of the signature, to match them with the registered types when reading.
+    /// </summary>
+    static void WriteComponentTable(SnapshotWriter& writer, EntitySignature components)
+    {
+        ForEachComponentIndex(components, [&writer](ComponentTypeIndex i)
+        {
+            if (!s_SaveColumnFuncs[i])
+                throw SnapshotException("A component type has no ComponentSerializer.");
+            writer.Write(SnapshotComponentInfo{ s_ComponentTypeHashes[i], i, s_ComponentSizes[i] });
+        });
+    }
+
+    /// <summary>
+    /// Reads the component types written by WriteComponentTable and maps their indices to the ones of this process.
+    /// </summary>
+    /// <returns>the component indices found in the table</returns>
+    static EntitySignature ReadComponentTable(SnapshotReader& reader, uint32_t count, std::array<ComponentTypeIndex, MAX_COMPONENTS>& localIndices)
+    {
+        EntitySignature components;
+        EntitySignature localComponents;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const auto info = reader.Read<SnapshotComponentInfo>();
+            auto found = std::find(s_ComponentTypeHashes.begin(), s_ComponentTypeHashes.end(), info.TypeHash);
+            if (info.Index >= MAX_COMPONENTS || components.test(info.Index) || found == s_ComponentTypeHashes.end())
+                throw SnapshotException("The snapshot contains a component type that isn't registered.");
+            ComponentTypeIndex local = (ComponentTypeIndex)(found - s_ComponentTypeHashes.begin());
+            if (s_ComponentSizes[local] != info.Size || !s_LoadColumnFuncs[local] || localComponents.test(local))
+                throw SnapshotException("A component type of the snapshot doesn't match the registered one.");
+            localIndices[info.Index] = local;
+            components.set(info.Index);
+            localComponents.set(local);
+        }
+        return components;
+    }
+
+    static EntitySignature ToLocalSignature(EntitySignature signature, const std::array<ComponentTypeIndex, MAX_COMPONENTS>& localIndices)
+    {
+        EntitySignature local;
+        ForEachComponentIndex(signature, [&local, &localIndices](ComponentTypeIndex i) { local.set(localIndices[i]); });
+        return local;
+    }
+
+    /// <summary>
+    /// Moves the entity to the archetype of its new signature and reads the values of its changed components.
+    /// </summary>
+    void ApplyEntityDelta(EntityID entity, EntitySignature deltaSig, EntitySignature deltaChanged,
+        const std::array<ComponentTypeIndex, MAX_COMPONENTS>& localIndices, SnapshotReader& reader)
+    {
+        const EntitySignature signature = ToLocalSignature(deltaSig, localIndices);
+        const EntitySignature current = m_EntitySignatures[entity].Signature;
+        const EntitySignature added = signature & ~current;
+        if ((added & ToLocalSignature(deltaChanged, localIndices)) != added)
+            throw SnapshotException("Corrupt delta, the value of an added component is missing.");
+
+        if (signature != current)
+        {
+            Archetype* src = m_EntitySignatures[entity].Archetype;
+            ForEachComponentIndex(current & ~signature, [src, entity](ComponentTypeIndex compType)
+            {
+                assert(s_RemoveComponentFuncs[compType] && "Component type not registered!");
+                s_RemoveComponentFuncs[compType](src, entity);
+            });
+            RecordEvents(ComponentEvent::Remove, current & ~signature, entity);
+            m_EntitySignatures[entity].Signature = signature;
+            MigrateEntity(entity, src, GetOrCreateArchetype(signature));
+            if (m_ChangeTracking)
+                MarkEntityChanged(entity);
+        }
+
+        // added components are appended to the columns, the entity is the last one of its new archetype
+        Archetype* archetype = m_EntitySignatures[entity].Archetype;
+        ForEachComponentIndex(deltaChanged, [&](ComponentTypeIndex i)
+        {
+            const ComponentTypeIndex local = localIndices[i];
+            if (added.test(local))
+                s_LoadColumnFuncs[local](archetype, reader, 1);
+            else
+                s_LoadComponentFuncs[local](archetype, entity, reader);
+            if (m_ChangeTracking)
+                MarkComponentChanged(entity, local);
+            RecordEvent(added.test(local) ? ComponentEvent::Add : ComponentEvent::Set, local, entity);
+        });
+    }
+
+    /// <summary>
+    /// Hands out the next available ID for an entity coming with the given components, its archetype has to be set by the caller
+    /// unless it has none. There has to be an available ID.
+    /// </summary>
+    EntityID AcquireEntity(EntitySignature signature)
+    {
+        const EntityID entity = m_AvailableEntities.PopFront();
+        m_EntitySignatures[entity] = EntityMetadata{ signature, GetArchetype(EntitySignature()) };
+        ++m_EntityCount;
+        if (m_ChangeTracking)
+        {
+            m_DeltaOperations.push_back(DeltaOperation{ DeltaOperationType::CreateEntity, entity });
+            MarkEntityChanged(entity);
+            m_ChangedComponents[entity] = signature;
+        }
+        return entity;
+    }
+
+    void MarkEntityChanged(EntityID entity)
+    {
+        if (!std::exchange(m_IsEntityChanged[entity], 1))
+            m_ChangedEntities.push_back(entity);
+    }
+
+    void MarkComponentChanged(EntityID entity, ComponentTypeIndex compType)
+    {
+        MarkEntityChanged(entity);
+        m_ChangedComponents[entity].set(compType);
+    }
+
+    // starts a new baseline
+    void ClearChanges()
+    {
+        for (EntityID entity : m_ChangedEntities)
+        {
+            m_IsEntityChanged[entity] = 0;
+            m_ChangedComponents[entity].reset();
+        }
+        m_ChangedEntities.clear();
+        m_DeltaOperations.clear();
+    }
+
+    void LoadSnapshot_Internal(SnapshotReader& reader)
+    {
+        if (GetPendingFlushCount() != 0)
+            throw SnapshotException("The registry has to be flushed before loading a snapshot.");
+
+        const SnapshotHeader header = reader.Read<SnapshotHeader>();
+        if (header.Magic != SnapshotHeader::MAGIC || header.Version != SnapshotHeader::VERSION)
+            throw SnapshotException("Not a snapshot or unsupported snapshot version.");
+        if (header.MaxEntityCount == 0 || header.ComponentCount > MAX_COMPONENTS
+            || (uint64_t)header.EntityCount + header.AvailableEntityCount != header.MaxEntityCount
+            || header.DisabledEntityCount > header.EntityCount)
+            throw SnapshotException("Corrupt snapshot header.");
+
+        std::array<ComponentTypeIndex, MAX_COMPONENTS> localIndices;
+        const EntitySignature snapshotComponents = ReadComponentTable(reader, header.ComponentCount, localIndices);
+
+        Reset(header.MaxEntityCount);
+        try
+        {
+            std::pmr::vector<EntityID> ids(header.AvailableEntityCount, m_Resource);
+            reader.ReadSpan(std::span<EntityID>(ids));
+            m_AvailableEntities.PushBackRange(ids);
+            std::pmr::vector<uint8_t> isAvailable(m_MaxEntityCount, m_Resource);
+            for (EntityID entity : ids)
+            {
+                if (entity >= m_MaxEntityCount || std::exchange(isAvailable[entity], 1))
+                    throw SnapshotException("Corrupt snapshot entity.");
+            }
+            std::pmr::vector<EntityID> disabled(header.DisabledEntityCount, m_Resource);
+            reader.ReadSpan(std::span<EntityID>(disabled));
+            for (EntityID entity : disabled)
+            {
+                if (entity >= m_MaxEntityCount || isAvailable[entity] || std::exchange(m_DisabledEntities[entity], 1))
+                    throw SnapshotException("Corrupt snapshot entity.");
+            }
+
+            for (uint32_t a = 0; a < header.ArchetypeCount; ++a)
+            {
+                EntitySignature snapshotSig(reader.Read<uint64_t>());
+                if (snapshotSig.none() || (snapshotSig & snapshotComponents) != snapshotSig)
+                    throw SnapshotException("Corrupt snapshot archetype.");
+                const EntitySignature signature = ToLocalSignature(snapshotSig, localIndices);
+
+                const uint32_t count = reader.Read<uint32_t>();
+                if (count > header.EntityCount - m_EntityCount)
+                    throw SnapshotException("Corrupt snapshot archetype.");
+                ids.resize(count);
+                reader.ReadSpan(std::span<EntityID>(ids));
+
+                Archetype* archetype = GetOrCreateArchetype(signature);
+                for (EntityID entity : ids)
+                {
+                    if (entity >= m_MaxEntityCount || isAvailable[entity] || m_EntitySignatures[entity].Archetype != nullptr)
+                        throw SnapshotException("Corrupt snapshot entity.");
+                    m_EntitySignatures[entity] = EntityMetadata{ signature, archetype };
+                }
+                m_EntityCount += count;
+                archetype->AddEntities(ids);
+                for (uint32_t row = archetype->GetEntityCount() - count; row < archetype->GetEntityCount(); ++row)
+                {
+                    if (m_DisabledEntities[archetype->GetEntities()[row]])
+                        archetype->SetRowEnabled(row, false);
+                }
+                ForEachComponentIndex(snapshotSig, [&](ComponentTypeIndex i)
+                {
+                    reader.Align(SNAPSHOT_COLUMN_ALIGNMENT);
+                    s_LoadColumnFuncs[localIndices[i]](archetype, reader, count);
+                });
+            }
+            reader.Align(SNAPSHOT_COLUMN_ALIGNMENT);
+
+            // entities without components weren't saved, they are the IDs that are neither used nor available
+            Archetype* emptyArchetype = GetArchetype(EntitySignature());
+            for (EntityID entity = 0; entity < m_MaxEntityCount; ++entity)
+            {
+                if (!isAvailable[entity] && m_EntitySignatures[entity].Archetype == nullptr)
+                {
+                    m_EntitySignatures[entity] = EntityMetadata{ EntitySignature(), emptyArchetype };
+                    ++m_EntityCount;
+                }
+            }
+        }
+        catch (...)
+        {
+            Reset(header.MaxEntityCount);
+            AddAvailableEntities(0, m_MaxEntityCount);
+            throw;
+        }
+    }
+
+    ArchetypePtr AllocateArchetype()
+    {
+        Archetype* archetype = std::pmr::polymorphic_allocator<>(m_Resource).new_object<Archetype>(m_Resource);
+        return ArchetypePtr(archetype, ResourceDeleter<Archetype>{ m_Resource });
+    }
+
+    Archetype* GetArchetype(EntitySignature signature)
+    {
+        ArchetypePtr* archetype = m_Archetypes.TryGet(signature);
+        return archetype ? archetype->get() : nullptr;
+    }
+
+    Archetype* GetOrCreateArchetype(EntitySignature signature)
+    {
+        if (ArchetypePtr* existing = m_Archetypes.TryGet(signature))
+            return existing->get();
+        ArchetypePtr newArchetype = AllocateArchetype();
+        Archetype* archetype = newArchetype.get();
+
+        ForEachComponentIndex(signature, [archetype](ComponentTypeIndex i)
+        {
+            assert(s_CreateStorageFuncs[i] && "Component type not registered!");
+            s_CreateStorageFuncs[i](archetype);
+        });
+        m_Archetypes[signature] = std::move(newArchetype);
+
+        // a cache matching this archetype is listed under one of the cache's components, which the archetype has too
+        try
+        {
+            ForEachComponentIndex(signature, [this, archetype, signature](ComponentTypeIndex i)
+            {
+                m_ComponentArchetypes[i].push_back(archetype);
+                for (EntitySignature cacheSig : m_CachesByComponent[i])
+                {
+                    if ((signature & cacheSig) == cacheSig)
+                        m_ArchetypeCache[cacheSig].push_back(archetype);
+                }
+            });
+        }
+        catch (...)
+        {
+            // out of memory, the archetype is taken out of the lists it made it into
+            ForEachComponentIndex(signature, [this, archetype, signature](ComponentTypeIndex i)
+            {
+                std::erase(m_ComponentArchetypes[i], archetype);
+                for (EntitySignature cacheSig : m_CachesByComponent[i])
+                {
+                    if ((signature & cacheSig) == cacheSig)
+                        std::erase(m_ArchetypeCache[cacheSig], archetype);
+                }
+            });
+            m_Archetypes.Erase(signature);
+            throw;
+        }
+
+        return archetype;
+    }
+
+    void MigrateCommonComponents(
+        Archetype* srcArchetype, Archetype* dstArchetype, 
+        EntityID oldEntity, EntityID newEntity
+    )
+    {
+        EntitySignature common = srcArchetype->GetSignature() & dstArchetype->GetSignature();
+        ForEachComponentIndex(common, [=](ComponentTypeIndex compType)
+        {
+            assert(s_MoveComponentFuncs[compType] && "Component type not registered!");
+            s_MoveComponentFuncs[compType](srcArchetype, dstArchetype, oldEntity, newEntity);
+        });
+    }
+
+    void MigrateEntity(EntityID entity, Archetype* srcArchetype, Archetype* dstArchetype)
+    {
+        dstArchetype->AddEntity(entity);
+        if (m_DisabledEntities[entity]) [[unlikely]]
+            dstArchetype->SetRowEnabled(dstArchetype->GetEntityCount() - 1, false);
+
+        MigrateCommonComponents(srcArchetype, dstArchetype, entity, entity);
+
+        srcArchetype->RemoveEntity(entity);
+        m_EntitySignatures[entity].Archetype = dstArchetype;
+    }
+
+    void DeleteComponent_Internal(EntityID entity, ComponentTypeIndex compType)
+    {
+        if (entity >= m_MaxEntityCount || m_EntitySignatures[entity].Archetype == nullptr)
+            return;
+        assert(s_RemoveComponentFuncs[compType] && "Component type not registered!");
+        if (!s_RemoveComponentFuncs[compType](m_EntitySignatures[entity].Archetype, entity))
+            return;
+
+        ComponentTypeID compId = ComponentTypeID((uint64_t)1 << (uint32_t)compType);
+
+        EntitySignature newSig = m_EntitySignatures[entity].Signature & compId.flip();
+        m_EntitySignatures[entity].Signature = newSig;
+
+        Archetype* newArchetype = GetOrCreateArchetype(newSig);
+        MigrateEntity(entity, m_EntitySignatures[entity].Archetype, newArchetype);
+        if (m_ChangeTracking)
+            MarkEntityChanged(entity);
+        RecordEvent(ComponentEvent::Remove, compType, entity);
+    }
+
+    // drops the queued component deletions of destroyed entities, their IDs can be handed out again before the Flush
+    void PurgeDeletedComponents()
+    {
+        if (m_DeletedComponents.IsEmpty())
+            return;
+        std::pmr::vector<DeletedComponent> kept(m_Resource);
+        DeletedComponent deleted;
+        while (m_DeletedComponents.PopFront(deleted))
+        {
+            if (deleted.Entity < m_MaxEntityCount && m_EntitySignatures[deleted.Entity].Archetype)
+                kept.push_back(deleted);
+        }
+        for (const DeletedComponent& component : kept)
+            m_DeletedComponents.PushBack(component);
+    }
+
+    template<ComponentConstraint... Comps>
+    static EntitySignature BulkSignature()
+    {
+        static_assert(sizeof...(Comps) > 0, "Bulk operations need at least one component to match.");
+        return (StorageSignature<Comps>() | ...);
+    }
+
+    // copy of the non empty archetypes having every component of the signature, the bulk operations create archetypes as they go
+    std::pmr::vector<Archetype*> GetBulkArchetypes(EntitySignature signature)
+    {
+        std::pmr::vector<Archetype*>* archetypes = m_ArchetypeCache.TryGet(signature);
+        if (!archetypes)
+            archetypes = &CreateArchetypeCache(signature);
+        std::pmr::vector<Archetype*> result(m_Resource);
+        for (Archetype* archetype : *archetypes)
+        {
+            if (archetype->GetEntityCount())
+                result.push_back(archetype);
+        }
+        return result;
+    }
+
+    // true if no entity of the archetype is disabled or queued for deletion
+    bool IsArchetypeFullyMatched(const Archetype* archetype) const
+    {
+        if (archetype->GetDisabledCount())
+            return false;
+        if (m_PendingDeletionCount == 0)
+            return true;
+        return std::none_of(archetype->GetEntities().begin(), archetype->GetEntities().end(),
+            [this](EntityID entity) { return m_PendingDeletions[entity] != 0; });
+    }
+
+    // entities of the archetype a view would visit, copied since handling them one by one reorders the rows
+    std::pmr::vector<EntityID> GetMatchedEntities(const Archetype* archetype) const
+    {
+        std::pmr::vector<EntityID> entities(m_Resource);
+        for (uint32_t row = 0; row < archetype->GetEntityCount(); ++row)
+        {
+            const EntityID entity = archetype->GetEntities()[row];
+            if (!archetype->IsRowDisabled(row) && !m_PendingDeletions[entity])
+                entities.push_back(entity);
+        }
+        return entities;
+    }
+
+    /// <summary>
+    /// Moves every entity of src to the end of dst with the columns both archetypes have, the other columns of src are dropped.
+    /// Columns and entity lists change hands when dst is empty.
+    /// </summary>
+    /// <returns>the row of the first moved entity in dst</returns>
+    uint32_t SpliceArchetype(Archetype* src, Archetype* dst)
+    {
+        const EntitySignature common = src->GetSignature() & dst->GetSignature();
+        ForEachComponentIndex(src->GetSignature(), [src, dst, common](ComponentTypeIndex i)
+        {
+            assert(s_SpliceStorageFuncs[i] && "Component type not registered!");
+            if (common.test(i))
+                s_SpliceStorageFuncs[i](src, dst);
+            else
+                s_ClearStorageFuncs[i](src);
+        });
+        const uint32_t first = dst->GetEntityCount();
+        dst->SpliceEntities(*src);
+        for (EntityID entity : std::span<const EntityID>(dst->GetEntities()).subspan(first))
+        {
+            m_EntitySignatures[entity].Signature = dst->GetSignature();
+            m_EntitySignatures[entity].Archetype = dst;
+        }
+        return first;
+    }
+
+    // appends count copies of value to the column, for the entities just spliced into the archetype
+    template<ComponentConstraint Comp>
+    static void FillComponentStorage(Archetype* archetype, const Comp& value, uint32_t count)
+    {
+        auto& components = archetype->GetComponentStorage<Comp>().Components;
+        components.reserve(components.size() + count);
+        for (uint32_t i = 0; i < count; ++i)
+            components.emplace_back(value);
+    }
+
+    void DeleteEntity_Internal(EntityID entity)
+    {
+        if (entity >= m_MaxEntityCount || m_EntitySignatures[entity].Archetype == nullptr)
+            return;
+
+        Archetype* archetype = m_EntitySignatures[entity].Archetype;
+        RecordEvents(ComponentEvent::Remove, archetype->GetSignature(), entity);
+        ForEachComponentIndex(archetype->GetSignature(), [archetype, entity](ComponentTypeIndex compType)
+        {
+            assert(s_RemoveComponentFuncs[compType] && "Component type not registered!");
+            s_RemoveComponentFuncs[compType](archetype, entity);
+        });
+        archetype->RemoveEntity(entity);
+        ReleaseEntity(entity);
+    }
+
+    // gives the ID of an entity whose components are gone back to the available entities
+    void ReleaseEntity(EntityID entity)
+    {
         m_EntitySignatures[entity].Archetype = nullptr;
         m_EntitySignatures[entity].Signature = EntitySignature();
+        m_DisabledEntities[entity] = 0;
+        if (std::atomic_ref<uint8_t>(m_PendingDeletions[entity]).exchange(0, std::memory_order_relaxed))
+            std::atomic_ref<uint32_t>(m_PendingDeletionCount).fetch_sub(1, std::memory_order_relaxed);
         m_AvailableEntities.PushBack(entity);
         --m_EntityCount;
+        if (m_ChangeTracking)
+        {
+            m_DeltaOperations.push_back(DeltaOperation{ DeltaOperationType::DestroyEntity, entity });
+            m_ChangedComponents[entity].reset();
+        }
+    }
+
+    // the columns a component is stored in: its own, or the hot and cold ones of a split component
+    template<ComponentConstraint Comp>
+    static EntitySignature StorageSignature()
+    {
+        if constexpr (SplitComponentConstraint<Comp>)
+            return ComponentType<typename HotColdSplit<Comp>::Hot>() | ComponentType<typename HotColdSplit<Comp>::Cold>();
+        else
+            return ComponentType<Comp>();
+    }
+
+    /// <summary>
+    /// Attaches both parts of a split component with a single migration, the entity must have neither.
+    /// </summary>
+    template<SplitComponentConstraint Comp>
+    SplitComponentRef<Comp> AddSplitComponent(EntityID entity, const Comp& component)
+    {
+        using Hot = typename HotColdSplit<Comp>::Hot;
+        using Cold = typename HotColdSplit<Comp>::Cold;
+        EntitySignature newSig = m_EntitySignatures[entity].Signature | StorageSignature<Comp>();
+        m_EntitySignatures[entity].Signature = newSig;
+
+        Archetype* newArchetype = GetOrCreateArchetype(newSig);
+        MigrateEntity(entity, m_EntitySignatures[entity].Archetype, newArchetype);
+        Hot& hot = newArchetype->EmplaceComponent<Hot>(entity, HotColdSplit<Comp>::GetHot(component));
+        Cold& cold = newArchetype->EmplaceComponent<Cold>(entity, HotColdSplit<Comp>::GetCold(component));
+        for (ComponentTypeIndex type : { GetComponentTypeIndex<Hot>(), GetComponentTypeIndex<Cold>() })
+        {
+            if (m_ChangeTracking)
+                MarkComponentChanged(entity, type);
+            RecordEvent(ComponentEvent::Add, type, entity);
+        }
+        return { hot, cold };
+    }
+
+    template<ComponentConstraint Comp>
+    static constexpr uint32_t GetLaneCount()
+    {
+        if constexpr (LaneComponentConstraint<Comp>)
+            return LaneLayout<Comp>::Lanes;
+        else
+            return 0;
+    }
+
+    // the column EachBlock walks for a component: its blocks for a component with a LaneLayout, its rows otherwise
+    template<ComponentConstraint Comp>
+    static auto GetBlockColumn(Archetype* archetype)
+    {
+        if constexpr (LaneComponentConstraint<Comp>)
+            return archetype->GetComponentStorage<Comp>().Components.GetBlocks();
+        else
+            return archetype->GetComponentStorage<Comp>().Components.data();
+    }
+
+    template<ComponentConstraint Comp>
+    using BlockColumn = decltype(GetBlockColumn<Comp>(nullptr));
+
+    template<ComponentConstraint Comp, uint32_t Lanes>
+    static decltype(auto) GetBlockArgument(BlockColumn<Comp> column, uint32_t block)
+    {
+        if constexpr (LaneComponentConstraint<Comp>)
+            return column[block];
+        else
+            return column + block * Lanes;
+    }
+
+    template<ComponentConstraint Comp>
+    static void ReserveStorage(Archetype* archetype, uint32_t count)
+    {
+        if constexpr (SplitComponentConstraint<Comp>)
+        {
+            archetype->ReserveComponentStorage<typename HotColdSplit<Comp>::Hot>(count);
+            archetype->ReserveComponentStorage<typename HotColdSplit<Comp>::Cold>(count);
+        }
+        else
+            archetype->ReserveComponentStorage<Comp>(count);
+    }
+
+    template<ComponentConstraint Comp, typename Func>
+    ObserverID AddObserver(ComponentEvent event, Func&& callback)
+    {
+        static_assert(!SplitComponentConstraint<Comp>, "Observers take the Hot and Cold parts of a split component.");
+        const ComponentTypeIndex type = GetComponentTypeIndex<Comp>();
+        ObserverFunc func = [callback = std::forward<Func>(callback)](Archetype* archetype, std::span<const EntityID> entities, std::span<const uint32_t> rows) mutable
+        {
+            auto* column = archetype ? &archetype->GetComponentStorage<Comp>().Components : nullptr;
+            ComponentBatch<Comp> batch(entities, rows, column);
+            callback(batch);
+        };
+        m_Observers.Callbacks.push_back(Observer{ ++m_Observers.LastID, type, event, std::move(func) });
+        m_Observers.Observed[(uint32_t)event].set(type);
+        return m_Observers.LastID;
+    }
+
+    ECS_FORCE_INLINE void RecordEvent(ComponentEvent event, ComponentTypeIndex type, EntityID entity)
+    {
+        if (m_Observers.Observed[(uint32_t)event].test(type)) [[unlikely]]
+            m_Observers.Events[(uint32_t)event * MAX_COMPONENTS + type].push_back(entity);
+    }
+
+    ECS_FORCE_INLINE void RecordEvents(ComponentEvent event, EntitySignature components, EntityID entity)
+    {
+        ForEachComponentIndex(components & m_Observers.Observed[(uint32_t)event], [this, event, entity](ComponentTypeIndex type)
+        {
+            m_Observers.Events[(uint32_t)event * MAX_COMPONENTS + type].push_back(entity);
+        });
+    }
+
+    // where the components requested from Gather are, Archetype indexes the archetypes met by the call
+    struct GatherLocation
+    {
+        uint32_t Archetype;
+        uint32_t Row;
+        EntityID Entity;
+    };
+
+    /// <summary>
+    /// Sorts the locations by archetype then row, i.e. in the order of the components in memory.
+    /// Radix sort on the bits the keys need, 11 at a time, small batches are left to std::sort.
+    /// </summary>
+    static void SortGatherLocations(std::pmr::vector<GatherLocation>& locations, uint32_t archetypeCount, uint32_t maxRow)
+    {
+        auto less = [](const GatherLocation& a, const GatherLocation& b)
+        {
+            return a.Archetype < b.Archetype || (a.Archetype == b.Archetype && a.Row < b.Row);
+        };
+        if (locations.size() < 1024)
+        {
+            std::sort(locations.begin(), locations.end(), less);
+            return;
+        }
+
+        constexpr uint32_t digitBits = 11;
+        constexpr uint32_t bucketCount = 1u << digitBits;
+        const uint32_t rowBits = (uint32_t)std::bit_width(maxRow);
+        const uint32_t keyBits = rowBits + (uint32_t)std::bit_width(archetypeCount - 1);
+        std::pmr::vector<GatherLocation> sorted(locations.size(), locations.get_allocator());
+        std::pmr::vector<uint32_t> offsets(bucketCount, locations.get_allocator());
+        for (uint32_t shift = 0; shift < keyBits; shift += digitBits)
+        {
+            auto digit = [rowBits, shift](const GatherLocation& location)
+            {
+                return (uint32_t)((((uint64_t)location.Archetype << rowBits) | location.Row) >> shift) & (bucketCount - 1);
+            };
+            std::fill(offsets.begin(), offsets.end(), 0);
+            for (const GatherLocation& location : locations)
+                ++offsets[digit(location)];
+            uint32_t offset = 0;
+            for (uint32_t& bucket : offsets)
+                offset += std::exchange(bucket, offset);
+            for (const GatherLocation& location : locations)
+                sorted[offsets[digit(location)]++] = location;
+            locations.swap(sorted);
+        }
+    }
+
+    /// <summary>
+    /// Drops the events of entities that don't have the component anymore, sorts the others by archetype and row
+    /// and notifies the observers once per archetype.
+    /// </summary>
+    void DispatchByArchetype(ComponentEvent event, ComponentTypeIndex type, std::span<const EntityID> entities)
+    {
+        struct Location
+        {
+            Archetype* Owner;
+            uint32_t Row;
+            EntityID Entity;
+        };
+        std::pmr::vector<Location> locations(m_Resource);
+        locations.reserve(entities.size());
+        for (EntityID entity : entities)
+        {
+            const EntityMetadata& metadata = m_EntitySignatures[entity];
+            if (metadata.Archetype && metadata.Signature.test(type))
+                locations.push_back(Location{ metadata.Archetype, metadata.Archetype->GetEntityIndex(entity), entity });
+        }
+        std::sort(locations.begin(), locations.end(), [](const Location& a, const Location& b)
+        {
+            return std::less<Archetype*>()(a.Owner, b.Owner) || (a.Owner == b.Owner && a.Row < b.Row);
+        });
+        // an entity changed several times is reported once
+        locations.erase(std::unique(locations.begin(), locations.end(), [](const Location& a, const Location& b)
+        {
+            return a.Owner == b.Owner && a.Row == b.Row;
+        }), locations.end());
+
+        std::pmr::vector<EntityID> ids(m_Resource);
+        std::pmr::vector<uint32_t> rows(m_Resource);
+        for (size_t first = 0; first < locations.size();)
+        {
+            size_t last = first;
+            ids.clear();
+            rows.clear();
+            for (; last < locations.size() && locations[last].Owner == locations[first].Owner; ++last)
+            {
+                ids.push_back(locations[last].Entity);
+                rows.push_back(locations[last].Row);
+            }
+            NotifyObservers(event, type, locations[first].Owner, ids, rows);
+            first = last;
+        }
+    }
+
+    void NotifyObservers(ComponentEvent event, ComponentTypeIndex type, Archetype* archetype, std::span<const EntityID> entities, std::span<const uint32_t> rows)
+    {
+        for (Observer& observer : m_Observers.Callbacks)
+        {
+            if (observer.Type == type && observer.Event == event)
+                observer.Callback(archetype, entities, rows);
+        }
+    }
+
+    /// <summary>
+    /// Applies one batch of deferred component deletions.
+    /// </summary>
+    /// <returns>the number of deletions applied</returns>
+    uint32_t FlushDeletedComponents()
+    {
+        std::array<DeletedComponent, FLUSH_BATCH_SIZE> batch;
+        uint32_t count = m_DeletedComponents.PopFrontInto(batch);
+        for (uint32_t i = 0; i < count; ++i)
+            DeleteComponent_Internal(batch[i].Entity, batch[i].Type);
+        return count;
+    }
+
+    /// <summary>
+    /// Applies one batch of deferred entity deletions.
+    /// </summary>
+    /// <returns>the number of deletions applied</returns>
+    uint32_t FlushDeletedEntities()
+    {
+        std::array<EntityID, FLUSH_BATCH_SIZE> batch;
+        uint32_t count = m_DeletedEntities.PopFrontInto(batch);
+        for (uint32_t i = 0; i < count; ++i)
+            DeleteEntity_Internal(batch[i]);
+        return count;
+    }
+
+    /// <summary>
+    /// Adds the IDs in [first, last) to the available entities, in order.
+    /// </summary>
+    void AddAvailableEntities(EntityID first, EntityID last)
+    {
+        std::array<EntityID, 1024> ids;
+        while (first < last)
+        {
+            uint32_t count = std::min<uint32_t>((uint32_t)ids.size(), last - first);
+            std::iota(ids.begin(), ids.begin() + count, first);
+            m_AvailableEntities.PushBackRange(std::span<const EntityID>(ids.data(), count));
+            first += count;
+        }
+    }
+
+    /// <summary>
+    /// Ages the empty archetypes by one flush and destroys the ones that have been empty for too long.
+    /// </summary>
+    void CollectEmptyArchetypes()
+    {
+        if (m_EmptyArchetypeLifetime == 0)
+            return;
+
+        std::pmr::vector<EntitySignature> collected(m_Resource);
+        for (auto& [signature, archetype] : m_Archetypes)
+        {
+            if (archetype->GetEntityCount() != 0 || signature.none())
+                archetype->m_EmptyFlushCount = 0;
+            else if (++archetype->m_EmptyFlushCount >= m_EmptyArchetypeLifetime)
+                collected.push_back(signature);
+        }
+
+        for (EntitySignature signature : collected)
+        {
+            Archetype* archetype = m_Archetypes[signature].get();
+            ForEachComponentIndex(signature, [this, archetype, signature](ComponentTypeIndex i)
+            {
+                auto& archetypes = m_ComponentArchetypes[i];
+                auto found = std::find(archetypes.begin(), archetypes.end(), archetype);
+                *found = archetypes.back();
+                archetypes.pop_back();
+
+                for (EntitySignature cacheSig : m_CachesByComponent[i])
+                {
+                    if ((signature & cacheSig) == cacheSig)
+                        std::erase(m_ArchetypeCache[cacheSig], archetype);
+                }
+            });
+            m_Archetypes.Erase(signature);
+        }
     }
 
-    void CreateArchetypeCache(EntitySignature cacheSig)
+    std::pmr::vector<Archetype*>& CreateArchetypeCache(EntitySignature cacheSig)
     {
-        for (const auto&[sig, archetype] : m_Archetypes)
+        assert(cacheSig.any() && "A view needs at least one component");
+
+        // only the archetypes having the rarest component of the query can match
+        ComponentTypeIndex rarest = 0;
+        size_t rarestCount = std::numeric_limits<size_t>::max();
+        ForEachComponentIndex(cacheSig, [this, &rarest, &rarestCount](ComponentTypeIndex i)
+        {
+            if (m_ComponentArchetypes[i].size() < rarestCount)
+            {
+                rarest = i;
+                rarestCount = m_ComponentArchetypes[i].size();
+            }
+        });
+
+        auto& archetypes = m_ArchetypeCache[cacheSig];
+        for (Archetype* archetype : m_ComponentArchetypes[rarest])
         {
-            if ((cacheSig & sig) == cacheSig)
-                m_ArchetypeCache[cacheSig].push_back(archetype.get());
+            if ((archetype->GetSignature() & cacheSig) == cacheSig)
+                archetypes.push_back(archetype);
         }
+        m_CachesByComponent[rarest].push_back(cacheSig);
+        return archetypes;
     }
 
 private:
+    // fills the function tables of a type that has its own column
+    template<ComponentConstraint Comp>
+    static void RegisterStoredComponentType()
+    {
+        assert(GetComponentTypeIndex<Comp>() < 64 && "Too many components registered!");
+
+        s_CreateStorageFuncs[GetComponentTypeIndex<Comp>()] = &CreateStorage<Comp>;
+        s_RemoveComponentFuncs[GetComponentTypeIndex<Comp>()] = &RemoveComponent<Comp>;
+        s_MoveComponentFuncs[GetComponentTypeIndex<Comp>()] = &MoveComponent<Comp>;
+        s_ShrinkStorageFuncs[GetComponentTypeIndex<Comp>()] = &ShrinkStorage<Comp>;
+        s_SpliceStorageFuncs[GetComponentTypeIndex<Comp>()] = &SpliceStorage<Comp>;
+        s_ClearStorageFuncs[GetComponentTypeIndex<Comp>()] = &ClearStorage<Comp>;
+        s_ReserveSpliceFuncs[GetComponentTypeIndex<Comp>()] = &ReserveSplice<Comp>;
+        s_ReserveStorageFuncs[GetComponentTypeIndex<Comp>()] = &ReserveStorage<Comp>;
+        s_ComponentTypeHashes[GetComponentTypeIndex<Comp>()] = GetComponentTypeHash<Comp>();
+        s_ComponentSizes[GetComponentTypeIndex<Comp>()] = (uint32_t)sizeof(Comp);
+        if constexpr (SerializableComponent<Comp>)
+        {
+            s_SaveColumnFuncs[GetComponentTypeIndex<Comp>()] = &SaveColumn<Comp>;
+            s_LoadColumnFuncs[GetComponentTypeIndex<Comp>()] = &LoadColumn<Comp>;
+            s_SaveComponentFuncs[GetComponentTypeIndex<Comp>()] = &SaveComponent<Comp>;
+            s_LoadComponentFuncs[GetComponentTypeIndex<Comp>()] = &LoadComponent<Comp>;
+        }
+        if constexpr (std::is_copy_constructible_v<Comp>)
+            s_ForkStorageFuncs[GetComponentTypeIndex<Comp>()] = &ForkStorage<Comp>;
+    }
+
     template<ComponentConstraint Comp>
     static void CreateStorage(Archetype* archetype)
     {
@@ -408,15 +2486,134 @@ private:
         return archetype->RemoveComponent<Comp>(entity);
     }
 
+    template<ComponentConstraint Comp>
+    static void ShrinkStorage(Archetype* archetype)
+    {
+        archetype->ShrinkComponentStorage<Comp>();
+    }
+
+    template<ComponentConstraint Comp>
+    static void SaveColumn(const Archetype* archetype, SnapshotWriter& writer)
+    {
+        const auto& components = archetype->GetComponentStorage<Comp>().Components;
+        if constexpr (LaneComponentConstraint<Comp>)
+        {
+            // saved whole like the other columns, so that snapshots don't depend on the layout
+            for (size_t i = 0; i < components.size(); ++i)
+                writer.Write(components.Get(i));
+        }
+        else if constexpr (std::is_trivially_copyable_v<Comp>)
+            writer.WriteSpan(std::span<const Comp>(components));
+        else
+        {
+            for (const Comp& component : components)
+                ComponentSerializer<Comp>::Write(writer, component);
+        }
+    }
+
+    template<ComponentConstraint Comp>
+    static void LoadColumn(Archetype* archetype, SnapshotReader& reader, uint32_t count)
+    {
+        auto& components = archetype->GetComponentStorage<Comp>().Components;
+        if constexpr (LaneComponentConstraint<Comp>)
+        {
+            const size_t first = components.size();
+            components.resize(first + count);
+            for (size_t i = first; i < components.size(); ++i)
+                components.Set(i, reader.Read<Comp>());
+        }
+        else
+        {
+            if constexpr (std::is_trivially_copyable_v<Comp>)
+            {
+                if (components.empty())
+                {
+                    // the column is used in place only if it is aligned and padded like its own memory, see MAX_BATCH_WIDTH
+                    const size_t size = sizeof(Comp) * count;
+                    const size_t paddedSize = ComponentColumn<Comp>::GetAllocationSize(count);
+                    std::byte* memory = reader.GetRemaining() >= paddedSize ? reader.Borrow(size, std::max(alignof(Comp), COLUMN_ALIGNMENT)) : nullptr;
+                    if (memory)
+                    {
+                        components.Adopt(reinterpret_cast<Comp*>(memory), count);
+                        return;
+                    }
+                }
+            }
+            const size_t first = components.size();
+            components.resize(first + count);
+            if constexpr (std::is_trivially_copyable_v<Comp>)
+                reader.ReadSpan(std::span<Comp>(components.data() + first, count));
+            else
+            {
+                for (size_t i = first; i < components.size(); ++i)
+                    ComponentSerializer<Comp>::Read(reader, components[i]);
+            }
+        }
+    }
+
+    template<ComponentConstraint Comp>
+    static void SaveComponent(const Archetype* archetype, EntityID entity, SnapshotWriter& writer)
+    {
+        decltype(auto) component = archetype->GetComponent<Comp>(entity);
+        if constexpr (std::is_trivially_copyable_v<Comp>)
+            writer.Write(component);
+        else
+            ComponentSerializer<Comp>::Write(writer, component);
+    }
+
+    template<ComponentConstraint Comp>
+    static void LoadComponent(Archetype* archetype, EntityID entity, SnapshotReader& reader)
+    {
+        if constexpr (LaneComponentConstraint<Comp>)
+            archetype->GetComponent<Comp>(entity) = reader.Read<Comp>();
+        else
+        {
+            Comp& component = archetype->GetComponent<Comp>(entity);
+            if constexpr (std::is_trivially_copyable_v<Comp>)
+                reader.ReadBytes(&component, sizeof(Comp));
+            else
+                ComponentSerializer<Comp>::Read(reader, component);
+        }
+    }
+
+    template<ComponentConstraint Comp>
+    static void SpliceStorage(Archetype* src, Archetype* dst)
+    {
+        dst->SpliceComponentStorage<Comp>(*src);
+    }
+
+    template<ComponentConstraint Comp>
+    static void ClearStorage(Archetype* archetype)
+    {
+        archetype->ClearComponentStorage<Comp>();
+    }
+
+    template<ComponentConstraint Comp>
+    static void ReserveSplice(Archetype* src, Archetype* dst)
+    {
+        dst->ReserveSpliceComponentStorage<Comp>(*src);
+    }
+
+    template<ComponentConstraint Comp>
+    static void ForkStorage(Archetype* src, Archetype* dst)
+    {
+        dst->ShareComponentStorage<Comp>(*src);
+    }
+
     void Resize()
     {
         m_MaxEntityCount *= 2;
         m_AvailableEntities.Resize(m_MaxEntityCount);
         m_EntitySignatures.resize(m_MaxEntityCount);
-        for (EntityID i = m_MaxEntityCount / 2; i < m_MaxEntityCount; ++i)
+        m_PendingDeletions.resize(m_MaxEntityCount);
+        m_DisabledEntities.resize(m_MaxEntityCount);
+        AddAvailableEntities(m_MaxEntityCount / 2, m_MaxEntityCount);
+        if (m_ChangeTracking)
         {
-            m_AvailableEntities.PushBack(i);
-        }        
+            m_ChangedComponents.resize(m_MaxEntityCount);
+            m_IsEntityChanged.resize(m_MaxEntityCount);
+            m_DeltaOperations.push_back(DeltaOperation{ DeltaOperationType::Grow, m_MaxEntityCount });
+        }
     }
 };
 }
\ No newline at end of file
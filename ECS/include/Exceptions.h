@@ -45,4 +45,28 @@ public:
     {}
 };
 
+class SnapshotException : public std::exception
+{
+public:
+    explicit SnapshotException(const char* message)
+        : exception(message)
+    {}
+};
+
+class ForkException : public std::exception
+{
+public:
+    explicit ForkException(const char* message)
+        : exception(message)
+    {}
+};
+
+class MergeException : public std::exception
+{
+public:
+    explicit MergeException(const char* message)
+        : exception(message)
+    {}
+};
+
 }
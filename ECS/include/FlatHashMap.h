@@ -0,0 +1,443 @@
+#pragma once
+#include "Types.h"
+#include <memory_resource>
+#include <cstring>
+#include <tuple>
+
+namespace ecs
+{
+    // finalizer of MurmurHash3, spreads every bit of the key over the low bits used to pick a slot
+    inline uint64_t MixHashBits(uint64_t key) noexcept
+    {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdull;
+        key ^= key >> 33;
+        key *= 0xc4ceb9fe1a85ec53ull;
+        key ^= key >> 33;
+        return key;
+    }
+
+    template<typename Key>
+    struct FlatHash;
+
+    template<std::integral Key>
+    struct FlatHash<Key>
+    {
+        uint64_t operator()(Key key) const noexcept { return MixHashBits((uint64_t)key); }
+    };
+
+    template<typename T>
+    struct FlatHash<T*>
+    {
+        uint64_t operator()(T* key) const noexcept { return MixHashBits((uint64_t)reinterpret_cast<uintptr_t>(key)); }
+    };
+
+    template<>
+    struct FlatHash<EntitySignature>
+    {
+        uint64_t operator()(const EntitySignature& key) const noexcept { return MixHashBits(key.to_ullong()); }
+    };
+
+    /// <summary>
+    /// Open addressing hash map with linear probing, meant for small keys like signatures and entity IDs.
+    /// Entries live in one flat array (no node allocation, no pointer chasing), the capacity is a power of two
+    /// and the map grows when it gets 3/4 full. Erasing shifts the following entries back instead of leaving tombstones.
+    /// Memory comes from a std::pmr::memory_resource and values are constructed with it (uses-allocator construction).
+    /// Inserting or erasing invalidates iterators and references to the entries.
+    /// </summary>
+    template<typename Key, typename Value, typename Hash = FlatHash<Key>>
+    class FlatHashMap
+    {
+    public:
+        using Entry = std::pair<Key, Value>;
+
+        template<bool IsConst>
+        class IteratorBase
+        {
+            using MapType = std::conditional_t<IsConst, const FlatHashMap, FlatHashMap>;
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using difference_type = std::ptrdiff_t;
+            using value_type = Entry;
+            using pointer = std::conditional_t<IsConst, const Entry*, Entry*>;
+            using reference = std::conditional_t<IsConst, const Entry&, Entry&>;
+
+            IteratorBase(MapType* map, uint32_t index)
+                : m_Map(map)
+                , m_Index(index)
+            {
+                SkipUnused();
+            }
+
+            reference operator*() const { return m_Map->m_Entries[m_Index]; }
+            pointer operator->() const { return &m_Map->m_Entries[m_Index]; }
+
+            IteratorBase& operator++()
+            {
+                ++m_Index;
+                SkipUnused();
+                return *this;
+            }
+
+            IteratorBase operator++(int)
+            {
+                IteratorBase tmp = *this;
+                ++(*this);
+                return tmp;
+            }
+
+            friend bool operator==(const IteratorBase& a, const IteratorBase& b) { return a.m_Index == b.m_Index; }
+            friend bool operator!=(const IteratorBase& a, const IteratorBase& b) { return a.m_Index != b.m_Index; }
+
+        private:
+            void SkipUnused()
+            {
+                while (m_Index < m_Map->m_Capacity && !m_Map->m_Used[m_Index])
+                    ++m_Index;
+            }
+
+            MapType* m_Map;
+            uint32_t m_Index;
+        };
+
+        using Iterator = IteratorBase<false>;
+        using ConstIterator = IteratorBase<true>;
+
+    public:
+        explicit FlatHashMap(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+            : m_Allocator(resource)
+        {}
+
+        FlatHashMap(const FlatHashMap&) = delete;
+        FlatHashMap& operator=(const FlatHashMap&) = delete;
+
+        FlatHashMap(FlatHashMap&& other) noexcept
+            : m_Allocator(other.m_Allocator)
+        {
+            Steal(other);
+        }
+
+        FlatHashMap& operator=(FlatHashMap&& other)
+        {
+            if (this == &other)
+                return *this;
+            Clear();
+            Deallocate();
+            if (m_Allocator == other.m_Allocator)
+            {
+                Steal(other);
+                return *this;
+            }
+
+            // different resources, the entries have to be moved one by one into memory of ours
+            Reserve(other.m_Size);
+            for (Entry& entry : other)
+                EmplaceNew(entry.first, std::move(entry.second));
+            other.Clear();
+            return *this;
+        }
+
+        ~FlatHashMap()
+        {
+            Clear();
+            Deallocate();
+        }
+
+        /// <summary>
+        /// Returns the value of the key, default constructs it first if the key isn't in the map.
+        /// </summary>
+        Value& operator[](const Key& key)
+        {
+            uint32_t index = FindIndex(key);
+            if (index != NOT_FOUND)
+                return m_Entries[index].second;
+            return EmplaceNew(key).second;
+        }
+
+        /// <summary>
+        /// Inserts the value if the key isn't in the map yet.
+        /// </summary>
+        /// <returns>the entry of the key and whether it has been inserted</returns>
+        template<typename... Args>
+        std::pair<Entry&, bool> TryEmplace(const Key& key, Args&&... args)
+        {
+            uint32_t index = FindIndex(key);
+            if (index != NOT_FOUND)
+                return { m_Entries[index], false };
+            return { EmplaceNew(key, std::forward<Args>(args)...), true };
+        }
+
+        [[nodiscard]] Iterator Find(const Key& key)
+        {
+            uint32_t index = FindIndex(key);
+            return index == NOT_FOUND ? end() : Iterator(this, index);
+        }
+
+        [[nodiscard]] ConstIterator Find(const Key& key) const
+        {
+            uint32_t index = FindIndex(key);
+            return index == NOT_FOUND ? end() : ConstIterator(this, index);
+        }
+
+        /// <returns>a pointer to the value of the key or nullptr if it isn't in the map</returns>
+        [[nodiscard]] ECS_FORCE_INLINE Value* TryGet(const Key& key)
+        {
+            uint32_t index = FindIndex(key);
+            return index == NOT_FOUND ? nullptr : &m_Entries[index].second;
+        }
+
+        [[nodiscard]] ECS_FORCE_INLINE const Value* TryGet(const Key& key) const
+        {
+            uint32_t index = FindIndex(key);
+            return index == NOT_FOUND ? nullptr : &m_Entries[index].second;
+        }
+
+        [[nodiscard]] bool Contains(const Key& key) const
+        {
+            return FindIndex(key) != NOT_FOUND;
+        }
+
+        /// <summary>
+        /// Removes the key from the map. The entries that were probed past it are shifted back so lookups never need tombstones.
+        /// </summary>
+        /// <returns>true if the key was in the map</returns>
+        bool Erase(const Key& key)
+        {
+            uint32_t hole = FindIndex(key);
+            if (hole == NOT_FOUND)
+                return false;
+
+            std::destroy_at(m_Entries + hole);
+            for (uint32_t index = (hole + 1) & m_Mask; m_Used[index]; index = (index + 1) & m_Mask)
+            {
+                // the entry can fill the hole if the hole sits between its home slot and its current slot
+                uint32_t home = GetHomeIndex(m_Entries[index].first);
+                if (((index - home) & m_Mask) < ((index - hole) & m_Mask))
+                    continue;
+                std::construct_at(m_Entries + hole, std::move(m_Entries[index]));
+                std::destroy_at(m_Entries + index);
+                hole = index;
+            }
+            m_Used[hole] = 0;
+            --m_Size;
+            return true;
+        }
+
+        /// <summary>
+        /// Destroys every entry but keeps the memory.
+        /// </summary>
+        void Clear()
+        {
+            if (m_Size == 0)
+                return;
+            for (uint32_t i = 0; i < m_Capacity; ++i)
+            {
+                if (m_Used[i])
+                    std::destroy_at(m_Entries + i);
+            }
+            std::memset(m_Used, 0, m_Capacity);
+            m_Size = 0;
+        }
+
+        /// <summary>
+        /// Replaces the content of the map by a copy of another one, with the same capacity and layout so nothing is rehashed.
+        /// Copies have to be explicit, the copy constructor is deleted to keep them from happening by accident.
+        /// </summary>
+        void CopyFrom(const FlatHashMap& other)
+        {
+            if (this == &other)
+                return;
+            Clear();
+            if (m_Capacity != other.m_Capacity)
+            {
+                Deallocate();
+                if (other.m_Capacity)
+                {
+                    m_Entries = m_Allocator.allocate_object<Entry>(other.m_Capacity);
+                    m_Used = m_Allocator.allocate_object<uint8_t>(other.m_Capacity);
+                }
+                m_Capacity = other.m_Capacity;
+                m_Mask = other.m_Mask;
+            }
+            if (m_Capacity == 0)
+                return;
+
+            std::memcpy(m_Used, other.m_Used, m_Capacity);
+            // a pair of trivially copyable members can be copied bitwise even though std::pair itself isn't trivially copyable
+            if constexpr (std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<Value>)
+                std::memcpy(static_cast<void*>(m_Entries), other.m_Entries, sizeof(Entry) * m_Capacity);
+            else
+            {
+                for (uint32_t i = 0; i < m_Capacity; ++i)
+                {
+                    if (m_Used[i])
+                        m_Allocator.construct(m_Entries + i, other.m_Entries[i]);
+                }
+            }
+            m_Size = other.m_Size;
+        }
+
+        /// <summary>
+        /// Starts loading the slot where the lookup of key begins, for a lookup coming soon.
+        /// </summary>
+        ECS_FORCE_INLINE void Prefetch(const Key& key) const noexcept
+        {
+            if (m_Size == 0)
+                return;
+            const uint32_t index = GetHomeIndex(key);
+            ECS_PREFETCH(m_Used + index);
+            ECS_PREFETCH(m_Entries + index);
+        }
+
+        /// <summary>
+        /// Makes room for count entries without growing.
+        /// </summary>
+        void Reserve(uint32_t count)
+        {
+            uint32_t capacity = GetCapacityFor(count);
+            if (capacity > m_Capacity)
+                Rehash(capacity);
+        }
+
+        /// <summary>
+        /// Shrinks the table to the smallest capacity holding the current entries.
+        /// </summary>
+        void ShrinkToFit()
+        {
+            uint32_t capacity = m_Size ? GetCapacityFor(m_Size) : 0;
+            if (capacity < m_Capacity)
+                Rehash(capacity);
+        }
+
+        [[nodiscard]] uint32_t GetSize() const noexcept { return m_Size; }
+        [[nodiscard]] bool IsEmpty() const noexcept { return m_Size == 0; }
+        [[nodiscard]] uint32_t GetCapacity() const noexcept { return m_Capacity; }
+        [[nodiscard]] std::pmr::memory_resource* GetMemoryResource() const noexcept { return m_Allocator.resource(); }
+
+        Iterator begin() { return Iterator(this, 0); }
+        Iterator end() { return Iterator(this, m_Capacity); }
+        ConstIterator begin() const { return ConstIterator(this, 0); }
+        ConstIterator end() const { return ConstIterator(this, m_Capacity); }
+
+    private:
+        static constexpr uint32_t NOT_FOUND = std::numeric_limits<uint32_t>::max();
+        static constexpr uint32_t MIN_CAPACITY = 8;
+
+        // smallest power of two keeping the map at most 3/4 full
+        static uint32_t GetCapacityFor(uint32_t count) noexcept
+        {
+            return std::max(MIN_CAPACITY, (uint32_t)std::bit_ceil(uint64_t(count) * 4 / 3 + 1));
+        }
+
+        ECS_FORCE_INLINE uint32_t GetHomeIndex(const Key& key) const noexcept
+        {
+            return (uint32_t)Hash{}(key) & m_Mask;
+        }
+
+        ECS_FORCE_INLINE uint32_t FindIndex(const Key& key) const noexcept
+        {
+            if (m_Size == 0)
+                return NOT_FOUND;
+            for (uint32_t index = GetHomeIndex(key); m_Used[index]; index = (index + 1) & m_Mask)
+            {
+                if (m_Entries[index].first == key)
+                    return index;
+            }
+            return NOT_FOUND;
+        }
+
+        // inserts a key that isn't in the map
+        template<typename... Args>
+        Entry& EmplaceNew(const Key& key, Args&&... args)
+        {
+            if ((uint64_t(m_Size) + 1) * 4 > uint64_t(m_Capacity) * 3) [[unlikely]]
+                Rehash(GetCapacityFor(m_Size + 1));
+
+            uint32_t index = GetHomeIndex(key);
+            while (m_Used[index])
+                index = (index + 1) & m_Mask;
+            m_Allocator.construct(m_Entries + index, std::piecewise_construct,
+                std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+            m_Used[index] = 1;
+            ++m_Size;
+            return m_Entries[index];
+        }
+
+        ECS_NO_INLINE void Rehash(uint32_t capacity)
+        {
+            Entry* oldEntries = m_Entries;
+            uint8_t* oldUsed = m_Used;
+            uint32_t oldCapacity = m_Capacity;
+
+            // both arrays are allocated before the map changes, it is left untouched if either allocation fails
+            Entry* entries = nullptr;
+            uint8_t* used = nullptr;
+            if (capacity)
+            {
+                entries = m_Allocator.allocate_object<Entry>(capacity);
+                try
+                {
+                    used = m_Allocator.allocate_object<uint8_t>(capacity);
+                }
+                catch (...)
+                {
+                    m_Allocator.deallocate_object(entries, capacity);
+                    throw;
+                }
+                std::memset(used, 0, capacity);
+            }
+            m_Entries = entries;
+            m_Used = used;
+            m_Capacity = capacity;
+            m_Mask = capacity ? capacity - 1 : 0;
+
+            for (uint32_t i = 0; i < oldCapacity; ++i)
+            {
+                if (!oldUsed[i])
+                    continue;
+                uint32_t index = GetHomeIndex(oldEntries[i].first);
+                while (m_Used[index])
+                    index = (index + 1) & m_Mask;
+                std::construct_at(m_Entries + index, std::move(oldEntries[i]));
+                std::destroy_at(oldEntries + i);
+                m_Used[index] = 1;
+            }
+
+            if (oldCapacity)
+            {
+                m_Allocator.deallocate_object(oldEntries, oldCapacity);
+                m_Allocator.deallocate_object(oldUsed, oldCapacity);
+            }
+        }
+
+        void Deallocate()
+        {
+            if (m_Capacity)
+            {
+                m_Allocator.deallocate_object(m_Entries, m_Capacity);
+                m_Allocator.deallocate_object(m_Used, m_Capacity);
+            }
+            m_Entries = nullptr;
+            m_Used = nullptr;
+            m_Capacity = 0;
+            m_Mask = 0;
+        }
+
+        void Steal(FlatHashMap& other) noexcept
+        {
+            m_Entries = std::exchange(other.m_Entries, nullptr);
+            m_Used = std::exchange(other.m_Used, nullptr);
+            m_Size = std::exchange(other.m_Size, 0);
+            m_Capacity = std::exchange(other.m_Capacity, 0);
+            m_Mask = std::exchange(other.m_Mask, 0);
+        }
+
+    private:
+        std::pmr::polymorphic_allocator<std::byte> m_Allocator;
+        Entry* m_Entries{ nullptr };
+        uint8_t* m_Used{ nullptr };
+        uint32_t m_Size{ 0 };
+        uint32_t m_Capacity{ 0 };
+        uint32_t m_Mask{ 0 };
+    };
+}
@@ -0,0 +1,261 @@
+#pragma once
+#include "Types.h"
+#include <memory_resource>
+#include <cstring>
+
+namespace ecs
+{
+    /// <summary>
+    /// Lanes consecutive components of a LaneLayout type, stored field by field: the first scalar of every lane, then the second...
+    /// A field of every lane fills an aligned vector register.
+    /// </summary>
+    template<LaneComponentConstraint T>
+    struct alignas(LaneLayout<T>::Lanes * sizeof(typename LaneLayout<T>::Scalar)) LaneBlock
+    {
+        using Scalar = typename LaneLayout<T>::Scalar;
+        static constexpr uint32_t Lanes = LaneLayout<T>::Lanes;
+        static constexpr uint32_t FieldCount = (uint32_t)(sizeof(T) / sizeof(Scalar));
+
+        Scalar Fields[FieldCount][Lanes];
+
+        // every lane of the scalar at the given byte offset in T, e.g. Field(offsetof(Boid, Position.y))
+        [[nodiscard]] ECS_FORCE_INLINE Scalar* Field(size_t offset) { return Fields[offset / sizeof(Scalar)]; }
+        [[nodiscard]] ECS_FORCE_INLINE const Scalar* Field(size_t offset) const { return Fields[offset / sizeof(Scalar)]; }
+    };
+
+    template<LaneComponentConstraint T>
+    class LaneColumn;
+
+    /// <summary>
+    /// Stands for a component of a LaneColumn, which doesn't exist as such in memory: reading it gathers its fields
+    /// and assigning it scatters them.
+    /// </summary>
+    template<LaneComponentConstraint T>
+    class LaneRef
+    {
+    public:
+        LaneRef(LaneColumn<T>& column, size_t row)
+            : m_Column(&column)
+            , m_Row(row)
+        {}
+
+        [[nodiscard]] T Get() const { return m_Column->Get(m_Row); }
+        operator T() const { return Get(); }
+
+        LaneRef& operator=(const T& value)
+        {
+            m_Column->Set(m_Row, value);
+            return *this;
+        }
+
+        LaneRef& operator=(const LaneRef& other)
+        {
+            return *this = other.Get();
+        }
+
+    private:
+        LaneColumn<T>* m_Column;
+        size_t m_Row;
+    };
+
+    /// <summary>
+    /// Column of a LaneLayout component type, in blocks of Lanes components (AoSoA), allocated from a memory resource.
+    /// Has the parts of the ComponentColumn interface the archetypes use, components are accessed through LaneRef.
+    /// The lanes past the last component of the last block hold stale values.
+    /// Unlike ComponentColumn, ShareFrom copies the components right away.
+    /// </summary>
+    template<LaneComponentConstraint T>
+    class LaneColumn
+    {
+    public:
+        using value_type = T;
+        using Block = LaneBlock<T>;
+        using Scalar = typename Block::Scalar;
+        static constexpr uint32_t Lanes = Block::Lanes;
+        static constexpr uint32_t FieldCount = Block::FieldCount;
+
+        explicit LaneColumn(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+            : m_Resource(resource)
+        {}
+
+        LaneColumn(const LaneColumn&) = delete;
+        LaneColumn& operator=(const LaneColumn&) = delete;
+
+        ~LaneColumn()
+        {
+            Deallocate();
+        }
+
+        template<typename... Args>
+        LaneRef<T> emplace_back(Args&&... args)
+        {
+            // built first, the arguments may refer to a component of this column
+            const T value(std::forward<Args>(args)...);
+            if (m_Size == m_BlockCapacity * Lanes) [[unlikely]]
+                Reallocate(std::max<uint32_t>(m_BlockCapacity * 2, 1));
+            Set(m_Size, value);
+            return LaneRef<T>(*this, m_Size++);
+        }
+
+        void push_back(const T& component) { emplace_back(component); }
+
+        void pop_back()
+        {
+            assert(m_Size > 0 && "pop_back on an empty column");
+            --m_Size;
+        }
+
+        /// <summary>
+        /// Grows the column with value initialized components or drops the last ones.
+        /// </summary>
+        void resize(size_t size)
+        {
+            reserve(size);
+            for (size_t row = m_Size; row < size; ++row)
+                Set(row, T{});
+            m_Size = (uint32_t)size;
+        }
+
+        void reserve(size_t capacity)
+        {
+            const uint32_t blocks = GetBlockCount(capacity);
+            if (blocks > m_BlockCapacity)
+                Reallocate(blocks);
+        }
+
+        void shrink_to_fit()
+        {
+            if (GetBlockCount(m_Size) < m_BlockCapacity)
+                Reallocate(GetBlockCount(m_Size));
+        }
+
+        void clear() noexcept { m_Size = 0; }
+
+        // overwrites the component at row to with the one at row from, used to fill the hole left by a removal
+        void MoveRow(size_t from, size_t to)
+        {
+            const Block& source = m_Blocks[from / Lanes];
+            Block& target = m_Blocks[to / Lanes];
+            for (uint32_t field = 0; field < FieldCount; ++field)
+                target.Fields[field][to % Lanes] = source.Fields[field][from % Lanes];
+        }
+
+        [[nodiscard]] T Get(size_t row) const
+        {
+            Scalar values[FieldCount];
+            const Block& block = m_Blocks[row / Lanes];
+            for (uint32_t field = 0; field < FieldCount; ++field)
+                values[field] = block.Fields[field][row % Lanes];
+            T value;
+            std::memcpy(static_cast<void*>(&value), values, sizeof(T));
+            return value;
+        }
+
+        void Set(size_t row, const T& value)
+        {
+            Scalar values[FieldCount];
+            std::memcpy(values, static_cast<const void*>(&value), sizeof(T));
+            Block& block = m_Blocks[row / Lanes];
+            for (uint32_t field = 0; field < FieldCount; ++field)
+                block.Fields[field][row % Lanes] = values[field];
+        }
+
+        /// <summary>
+        /// Moves every component of another column to the end of this one and leaves the other column empty.
+        /// When this column is empty and both columns allocate from equal resources, the memory itself changes hands.
+        /// </summary>
+        void Splice(LaneColumn& other)
+        {
+            if (this == &other || other.m_Size == 0)
+                return;
+            if (m_Size == 0 && m_Resource->is_equal(*other.m_Resource))
+            {
+                Deallocate();
+                m_Blocks = std::exchange(other.m_Blocks, nullptr);
+                m_Size = std::exchange(other.m_Size, 0);
+                m_BlockCapacity = std::exchange(other.m_BlockCapacity, 0);
+                return;
+            }
+            const uint32_t size = m_Size + other.m_Size;
+            if (GetBlockCount(size) > m_BlockCapacity)
+                Reallocate(std::max(GetBlockCount(size), m_BlockCapacity * 2));
+            if (m_Size % Lanes == 0)
+                std::memcpy(static_cast<void*>(m_Blocks + m_Size / Lanes), other.m_Blocks, sizeof(Block) * GetBlockCount(other.m_Size));
+            else
+            {
+                for (uint32_t row = 0; row < other.m_Size; ++row)
+                    Set(m_Size + row, other.Get(row));
+            }
+            m_Size = size;
+            other.m_Size = 0;
+        }
+
+        // allocates what Splice(other) needs
+        void ReserveSplice(LaneColumn& other)
+        {
+            if (this == &other || other.m_Size == 0 || (m_Size == 0 && m_Resource->is_equal(*other.m_Resource)))
+                return;
+            const uint32_t size = m_Size + other.m_Size;
+            if (GetBlockCount(size) > m_BlockCapacity)
+                Reallocate(std::max(GetBlockCount(size), m_BlockCapacity * 2));
+        }
+
+        // copies the components of another column, forks can't share lane columns
+        void ShareFrom(LaneColumn& other)
+        {
+            if (this == &other)
+                return;
+            clear();
+            reserve(other.m_Size);
+            if (other.m_Size)
+                std::memcpy(static_cast<void*>(m_Blocks), other.m_Blocks, sizeof(Block) * GetBlockCount(other.m_Size));
+            m_Size = other.m_Size;
+        }
+
+        // lane columns are never shared
+        ECS_FORCE_INLINE void MakeUnique() {}
+        [[nodiscard]] bool IsShared() const noexcept { return false; }
+
+        [[nodiscard]] ECS_FORCE_INLINE LaneRef<T> operator[](size_t index) noexcept { return LaneRef<T>(*this, index); }
+        [[nodiscard]] ECS_FORCE_INLINE T operator[](size_t index) const noexcept { return Get(index); }
+        [[nodiscard]] LaneRef<T> back() noexcept { return LaneRef<T>(*this, m_Size - 1); }
+        [[nodiscard]] T back() const noexcept { return Get(m_Size - 1); }
+
+        [[nodiscard]] ECS_FORCE_INLINE Block* GetBlocks() noexcept { return m_Blocks; }
+        [[nodiscard]] ECS_FORCE_INLINE const Block* GetBlocks() const noexcept { return m_Blocks; }
+        // number of blocks holding components, the last one may be partly used
+        [[nodiscard]] uint32_t GetBlockCount() const noexcept { return GetBlockCount(m_Size); }
+
+        [[nodiscard]] ECS_FORCE_INLINE size_t size() const noexcept { return m_Size; }
+        [[nodiscard]] size_t capacity() const noexcept { return (size_t)m_BlockCapacity * Lanes; }
+        [[nodiscard]] bool empty() const noexcept { return m_Size == 0; }
+        [[nodiscard]] std::pmr::memory_resource* GetMemoryResource() const noexcept { return m_Resource; }
+
+    private:
+        static constexpr uint32_t GetBlockCount(size_t size) { return (uint32_t)((size + Lanes - 1) / Lanes); }
+
+        ECS_NO_INLINE void Reallocate(uint32_t blockCapacity)
+        {
+            Block* blocks = blockCapacity ? static_cast<Block*>(m_Resource->allocate(sizeof(Block) * blockCapacity, alignof(Block))) : nullptr;
+            if (m_Size)
+                std::memcpy(static_cast<void*>(blocks), m_Blocks, sizeof(Block) * GetBlockCount(m_Size));
+            Deallocate();
+            m_Blocks = blocks;
+            m_BlockCapacity = blockCapacity;
+        }
+
+        void Deallocate() noexcept
+        {
+            if (m_Blocks)
+                m_Resource->deallocate(m_Blocks, sizeof(Block) * m_BlockCapacity, alignof(Block));
+            m_Blocks = nullptr;
+            m_BlockCapacity = 0;
+        }
+
+    private:
+        std::pmr::memory_resource* m_Resource;
+        Block* m_Blocks = nullptr;
+        uint32_t m_Size = 0;
+        uint32_t m_BlockCapacity = 0;
+    };
+}
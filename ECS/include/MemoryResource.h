@@ -0,0 +1,259 @@
+#pragma once
+#include "Types.h"
+#include <memory_resource>
+#include <vector>
+
+namespace ecs
+{
+    /// <summary>
+    /// Deleter for objects created with std::pmr::polymorphic_allocator::new_object, gives the memory back to the resource it came from.
+    /// </summary>
+    template<typename T>
+    struct ResourceDeleter
+    {
+        std::pmr::memory_resource* Resource = std::pmr::get_default_resource();
+
+        void operator()(T* object) const
+        {
+            std::pmr::polymorphic_allocator<T>(Resource).delete_object(object);
+        }
+    };
+
+    /// <summary>
+    /// Bump allocator that hands out memory from chunks taken from an upstream resource.
+    /// Deallocations are no-ops, everything is given back at once by Release or when the arena is destroyed,
+    /// which makes tearing down a whole registry a matter of freeing a few chunks.
+    /// Memory of grown containers is only reclaimed on Release, so size the first chunk after the expected peak.
+    /// A registry also takes the temporaries of its views, flushes and queries from its resource, so an arena behind a registry
+    /// that lives for many frames keeps growing until Release: prefer a PoolResource there.
+    /// Not thread safe.
+    /// </summary>
+    class MonotonicArena : public std::pmr::memory_resource
+    {
+        struct Chunk
+        {
+            Chunk* Next;
+            size_t Size;
+        };
+
+    public:
+        explicit MonotonicArena(size_t chunkSize = 64 * 1024, std::pmr::memory_resource* upstream = std::pmr::new_delete_resource())
+            : m_Upstream(upstream)
+            , m_NextChunkSize(std::max<size_t>(chunkSize, sizeof(Chunk) * 2))
+        {}
+
+        MonotonicArena(const MonotonicArena&) = delete;
+        MonotonicArena& operator=(const MonotonicArena&) = delete;
+
+        ~MonotonicArena() override
+        {
+            Release();
+        }
+
+        /// <summary>
+        /// Gives every chunk back to the upstream resource. Everything allocated from the arena becomes invalid.
+        /// </summary>
+        void Release()
+        {
+            while (m_Chunks)
+            {
+                Chunk* next = m_Chunks->Next;
+                m_Upstream->deallocate(m_Chunks, m_Chunks->Size, CHUNK_ALIGNMENT);
+                m_Chunks = next;
+            }
+            m_Current = nullptr;
+            m_Remaining = 0;
+            m_BytesAllocated = 0;
+            m_BytesReserved = 0;
+        }
+
+        /// <summary>
+        /// Number of bytes handed out since the last Release, padding included.
+        /// </summary>
+        [[nodiscard]] size_t GetBytesAllocated() const noexcept { return m_BytesAllocated; }
+
+        /// <summary>
+        /// Number of bytes taken from the upstream resource.
+        /// </summary>
+        [[nodiscard]] size_t GetBytesReserved() const noexcept { return m_BytesReserved; }
+
+        [[nodiscard]] std::pmr::memory_resource* GetUpstream() const noexcept { return m_Upstream; }
+
+    protected:
+        void* do_allocate(size_t bytes, size_t alignment) override
+        {
+            size_t padding = (alignment - (reinterpret_cast<uintptr_t>(m_Current) & (alignment - 1))) & (alignment - 1);
+            if (padding + bytes > m_Remaining || !m_Current) [[unlikely]]
+            {
+                AddChunk(bytes, alignment);
+                padding = (alignment - (reinterpret_cast<uintptr_t>(m_Current) & (alignment - 1))) & (alignment - 1);
+            }
+            std::byte* memory = m_Current + padding;
+            m_Current = memory + bytes;
+            m_Remaining -= padding + bytes;
+            m_BytesAllocated += padding + bytes;
+            return memory;
+        }
+
+        void do_deallocate(void*, size_t, size_t) override {}
+
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+        {
+            return this == &other;
+        }
+
+    private:
+        ECS_NO_INLINE void AddChunk(size_t bytes, size_t alignment)
+        {
+            // chunks grow geometrically so the chunk count stays logarithmic in the total size
+            size_t size = std::max(m_NextChunkSize, sizeof(Chunk) + bytes + alignment);
+            Chunk* chunk = static_cast<Chunk*>(m_Upstream->allocate(size, CHUNK_ALIGNMENT));
+            chunk->Next = m_Chunks;
+            chunk->Size = size;
+            m_Chunks = chunk;
+            m_Current = reinterpret_cast<std::byte*>(chunk) + sizeof(Chunk);
+            m_Remaining = size - sizeof(Chunk);
+            m_BytesReserved += size;
+            m_NextChunkSize = std::min(size * 2, MAX_CHUNK_SIZE);
+        }
+
+    private:
+        static constexpr size_t CHUNK_ALIGNMENT = ECS_CACHE_LINE_SIZE;
+        static constexpr size_t MAX_CHUNK_SIZE = 64 * 1024 * 1024;
+
+        std::pmr::memory_resource* m_Upstream;
+        Chunk* m_Chunks{ nullptr };
+        std::byte* m_Current{ nullptr };
+        size_t m_Remaining{ 0 };
+        size_t m_NextChunkSize;
+        size_t m_BytesAllocated{ 0 };
+        size_t m_BytesReserved{ 0 };
+    };
+
+    /// <summary>
+    /// Pool allocator with power of two size classes from 16 bytes to MAX_BLOCK_SIZE.
+    /// Freed blocks go to the free list of their size class and are reused by the next allocation of that class,
+    /// so archetypes, storages and columns that come and go stop fragmenting the upstream heap.
+    /// Bigger blocks go straight to the upstream resource. Not thread safe.
+    /// </summary>
+    class PoolResource : public std::pmr::memory_resource
+    {
+        struct FreeBlock
+        {
+            FreeBlock* Next;
+        };
+
+        struct Slab
+        {
+            void* Memory;
+            size_t Size;
+            size_t Alignment;
+        };
+
+    public:
+        static constexpr size_t MIN_BLOCK_SIZE = 16;
+        static constexpr size_t MAX_BLOCK_SIZE = 4096;
+
+        explicit PoolResource(size_t slabSize = 64 * 1024, std::pmr::memory_resource* upstream = std::pmr::new_delete_resource())
+            : m_Upstream(upstream)
+            , m_SlabSize(std::max(slabSize, MAX_BLOCK_SIZE))
+        {}
+
+        PoolResource(const PoolResource&) = delete;
+        PoolResource& operator=(const PoolResource&) = delete;
+
+        ~PoolResource() override
+        {
+            Release();
+        }
+
+        /// <summary>
+        /// Gives every slab back to the upstream resource. Blocks that are still in use become invalid.
+        /// Large blocks are owned by their users and must have been deallocated before.
+        /// </summary>
+        void Release()
+        {
+            for (const Slab& slab : m_Slabs)
+                m_Upstream->deallocate(slab.Memory, slab.Size, slab.Alignment);
+            m_Slabs.clear();
+            m_FreeLists.fill(nullptr);
+        }
+
+        /// <summary>
+        /// Number of slabs taken from the upstream resource.
+        /// </summary>
+        [[nodiscard]] size_t GetSlabCount() const noexcept { return m_Slabs.size(); }
+
+        [[nodiscard]] std::pmr::memory_resource* GetUpstream() const noexcept { return m_Upstream; }
+
+    protected:
+        void* do_allocate(size_t bytes, size_t alignment) override
+        {
+            size_t blockSize = GetBlockSize(bytes, alignment);
+            if (blockSize > MAX_BLOCK_SIZE)
+                return m_Upstream->allocate(bytes, alignment);
+
+            FreeBlock*& freeList = m_FreeLists[GetSizeClass(blockSize)];
+            if (!freeList) [[unlikely]]
+                AddSlab(blockSize);
+            FreeBlock* block = freeList;
+            freeList = block->Next;
+            return block;
+        }
+
+        void do_deallocate(void* memory, size_t bytes, size_t alignment) override
+        {
+            size_t blockSize = GetBlockSize(bytes, alignment);
+            if (blockSize > MAX_BLOCK_SIZE)
+            {
+                m_Upstream->deallocate(memory, bytes, alignment);
+                return;
+            }
+
+            FreeBlock*& freeList = m_FreeLists[GetSizeClass(blockSize)];
+            FreeBlock* block = static_cast<FreeBlock*>(memory);
+            block->Next = freeList;
+            freeList = block;
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+        {
+            return this == &other;
+        }
+
+    private:
+        // blocks of a class are aligned on their size, so any alignment up to the block size is honored
+        static size_t GetBlockSize(size_t bytes, size_t alignment) noexcept
+        {
+            return std::bit_ceil(std::max({ bytes, alignment, MIN_BLOCK_SIZE }));
+        }
+
+        static uint32_t GetSizeClass(size_t blockSize) noexcept
+        {
+            return (uint32_t)(std::countr_zero(blockSize) - std::countr_zero(MIN_BLOCK_SIZE));
+        }
+
+        ECS_NO_INLINE void AddSlab(size_t blockSize)
+        {
+            std::byte* memory = static_cast<std::byte*>(m_Upstream->allocate(m_SlabSize, blockSize));
+            m_Slabs.push_back(Slab{ memory, m_SlabSize, blockSize });
+
+            // thread the free list through the new slab, lowest address first
+            FreeBlock*& freeList = m_FreeLists[GetSizeClass(blockSize)];
+            for (size_t offset = m_SlabSize - m_SlabSize % blockSize; offset != 0; offset -= blockSize)
+            {
+                FreeBlock* block = reinterpret_cast<FreeBlock*>(memory + offset - blockSize);
+                block->Next = freeList;
+                freeList = block;
+            }
+        }
+
+    private:
+        static constexpr uint32_t SIZE_CLASS_COUNT = std::countr_zero(MAX_BLOCK_SIZE) - std::countr_zero(MIN_BLOCK_SIZE) + 1;
+
+        std::pmr::memory_resource* m_Upstream;
+        size_t m_SlabSize;
+        std::array<FreeBlock*, SIZE_CLASS_COUNT> m_FreeLists{};
+        std::vector<Slab> m_Slabs;
+    };
+}
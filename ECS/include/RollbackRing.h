@@ -0,0 +1,104 @@
+#pragma once
+#include "EntityRegistry.h"
+#include "CircularBuffer.h"
+
+namespace ecs
+{
+    /// <summary>
+    /// Keeps the state of a registry for the last few ticks so a simulation can rewind and replay,
+    /// e.g. when a late input arrives for a tick that has already been simulated.
+    /// States are saved as forks (see EntityRegistry::Fork): they share their component columns with the registry and with each other,
+    /// so a save costs the entity bookkeeping and only the columns written between two saves end up copied.
+    /// References to components must not be written through after a Save, views can be kept (see EntityRegistry::Fork).
+    /// </summary>
+    class RollbackRing
+    {
+        struct SavedState
+        {
+            SavedState(uint64_t tick, EntityRegistry&& registry)
+                : Tick(tick)
+                , Registry(std::move(registry))
+            {}
+
+            uint64_t Tick;
+            EntityRegistry Registry;
+        };
+
+    public:
+        /// <summary>
+        /// Creates a ring that keeps the states of the last capacity saved ticks.
+        /// </summary>
+        explicit RollbackRing(uint32_t capacity)
+            : m_States(capacity)
+            , m_Capacity(capacity)
+        {
+            assert(capacity > 0 && "A rollback ring needs room for at least one state");
+        }
+
+        /// <summary>
+        /// Saves the state of the registry for a tick. Saving a tick again, or one older than the newest saved tick,
+        /// discards the states saved for that tick and the ones after it since they belong to a timeline that is being replaced.
+        /// The oldest state is dropped when the ring is full. Throws a ForkException if the registry can't be forked.
+        /// </summary>
+        /// <param name="tick">: tick the state belongs to</param>
+        /// <param name="registry">: registry to save, not modified</param>
+        void Save(uint64_t tick, EntityRegistry& registry)
+        {
+            EntityRegistry state = registry.Fork();
+            while (!m_States.IsEmpty() && m_States.GetBack().Tick >= tick)
+                m_States.PopBack();
+            if (m_States.GetSize() == m_Capacity)
+                m_States.PopFront();
+            m_States.PushBack(tick, std::move(state));
+        }
+
+        /// <summary>
+        /// Brings the registry back to the state saved for a tick. The saved state is kept, so it can be restored again.
+        /// The registry is restored in place (see EntityRegistry::RestoreFrom): it keeps its observers and its change tracking setting.
+        /// Throws a ForkException if the registry has deferred operations waiting for a Flush.
+        /// </summary>
+        /// <param name="tick">: tick to go back to</param>
+        /// <param name="registry">: registry to overwrite, it has to use the memory resource of the saved registry</param>
+        /// <returns>false if no state is saved for this tick, the registry is then left untouched</returns>
+        bool Restore(uint64_t tick, EntityRegistry& registry)
+        {
+            SavedState* state = Find(tick);
+            if (!state)
+                return false;
+            registry.RestoreFrom(state->Registry);
+            return true;
+        }
+
+        [[nodiscard]] bool Contains(uint64_t tick) { return Find(tick) != nullptr; }
+
+        // number of saved states
+        [[nodiscard]] uint32_t GetSize() const { return m_States.GetSize(); }
+        [[nodiscard]] uint32_t GetCapacity() const { return m_Capacity; }
+        [[nodiscard]] bool IsEmpty() const { return m_States.IsEmpty(); }
+
+        // throw a CircularBufferException if nothing is saved
+        [[nodiscard]] uint64_t GetOldestTick() const { return m_States.GetFront().Tick; }
+        [[nodiscard]] uint64_t GetNewestTick() const { return m_States.GetBack().Tick; }
+
+        void Clear() { m_States.Clear(); }
+
+    private:
+        // ticks are increasing from the oldest to the newest state
+        SavedState* Find(uint64_t tick)
+        {
+            for (uint32_t i = m_States.GetSize(); i > 0; --i)
+            {
+                SavedState& state = m_States[i - 1];
+                if (state.Tick == tick)
+                    return &state;
+                if (state.Tick < tick)
+                    break;
+            }
+            return nullptr;
+        }
+
+    private:
+        CircularBuffer<SavedState> m_States;
+        uint32_t m_Capacity;
+    };
+}
@@ -0,0 +1,393 @@
+#pragma once
+#include "Types.h"
+#include <cstring>
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+// SimdFloat is built on the vector extensions, which compile to the widest registers the enclosing function allows
+#define ECS_SIMD_VECTOR_EXTENSIONS
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+// SimdFloat<4/8/16> are built on the SSE/AVX/AVX-512 intrinsics, which MSVC emits whatever /arch allows,
+// so SimdFloat<8> needs AVX2 and SimdFloat<16> AVX-512 at run time, see DispatchSimd
+#define ECS_SIMD_INTRINSICS
+#endif
+
+// Compiles a function for an instruction set whatever the compiler flags, SimdFloat operations inlined in it use that set.
+// Such a function may only run once GetSimdLevel has confirmed the CPU supports it, see DispatchSimd.
+// MSVC has no per function targets, there the width of SimdFloat picks the instruction set (see ECS_SIMD_INTRINSICS).
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define ECS_SIMD_TARGET_SSE2 __attribute__((target("sse2")))
+#define ECS_SIMD_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define ECS_SIMD_TARGET_AVX512 __attribute__((target("avx512f,avx512vl,avx2,fma")))
+#else
+#define ECS_SIMD_TARGET_SSE2
+#define ECS_SIMD_TARGET_AVX2
+#define ECS_SIMD_TARGET_AVX512
+#endif
+
+namespace ecs
+{
+    enum class SimdLevel : uint8_t
+    {
+        Scalar,
+        SSE2,
+        AVX2,
+        AVX512,
+    };
+
+    /// <summary>
+    /// Widest instruction set of the CPU running the program, including the OS support for its registers.
+    /// Detected once, use GetSimdLevel.
+    /// </summary>
+    inline SimdLevel DetectSimdLevel()
+    {
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl"))
+            return SimdLevel::AVX512;
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            return SimdLevel::AVX2;
+        if (__builtin_cpu_supports("sse2"))
+            return SimdLevel::SSE2;
+        return SimdLevel::Scalar;
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+        int info[4];
+        __cpuid(info, 0);
+        const int maxLeaf = info[0];
+        __cpuid(info, 1);
+        const bool sse2 = (info[3] & (1 << 26)) != 0;
+        const bool fma = (info[2] & (1 << 12)) != 0;
+        // the OS saves the YMM (and ZMM) registers on context switches
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+        const uint64_t xcr0 = osxsave ? _xgetbv(0) : 0;
+        const bool avxState = (xcr0 & 0x6) == 0x6;
+        const bool avx512State = (xcr0 & 0xe6) == 0xe6;
+        int extended[4] = {};
+        if (maxLeaf >= 7)
+            __cpuidex(extended, 7, 0);
+        const bool avx2 = (extended[1] & (1 << 5)) != 0;
+        const bool avx512 = (extended[1] & (1 << 16)) != 0 && (extended[1] & (1 << 31)) != 0; // F and VL
+        if (avx512 && avx2 && fma && avx512State)
+            return SimdLevel::AVX512;
+        if (avx2 && fma && avxState)
+            return SimdLevel::AVX2;
+        return sse2 ? SimdLevel::SSE2 : SimdLevel::Scalar;
+#else
+        return SimdLevel::Scalar;
+#endif
+    }
+
+    [[nodiscard]] inline SimdLevel GetSimdLevel()
+    {
+        static const SimdLevel level = DetectSimdLevel();
+        return level;
+    }
+
+    // number of floats in a register of the instruction set, the natural batch width of kernels written for it
+    [[nodiscard]] constexpr uint32_t GetSimdFloatCount(SimdLevel level)
+    {
+        switch (level)
+        {
+        case SimdLevel::AVX512: return 16;
+        case SimdLevel::AVX2: return 8;
+        default: return 4;
+        }
+    }
+
+#ifdef ECS_SIMD_VECTOR_EXTENSIONS
+    // spelled out per width, the vector_size attribute can't depend on a template parameter
+    template<uint32_t Width>
+    struct SimdVectorOf;
+    template<> struct SimdVectorOf<1> { typedef float Type __attribute__((vector_size(4))); };
+    template<> struct SimdVectorOf<2> { typedef float Type __attribute__((vector_size(8))); };
+    template<> struct SimdVectorOf<4> { typedef float Type __attribute__((vector_size(16))); };
+    template<> struct SimdVectorOf<8> { typedef float Type __attribute__((vector_size(32))); };
+    template<> struct SimdVectorOf<16> { typedef float Type __attribute__((vector_size(64))); };
+#endif
+
+#ifdef ECS_SIMD_INTRINSICS
+    // the register and the operations of SimdFloat<Width> when it maps to one, spelled out per width like the intrinsics
+    template<uint32_t Width>
+    struct SimdIntrinsicsOf
+    {
+        static constexpr bool NATIVE = false;
+        using Type = std::array<float, Width>;
+    };
+
+    template<>
+    struct SimdIntrinsicsOf<4>
+    {
+        static constexpr bool NATIVE = true;
+        using Type = __m128;
+        static ECS_FORCE_INLINE Type Set(float value) { return _mm_set1_ps(value); }
+        static ECS_FORCE_INLINE Type Load(const float* data) { return _mm_loadu_ps(data); }
+        static ECS_FORCE_INLINE void Store(float* data, Type value) { _mm_storeu_ps(data, value); }
+        static ECS_FORCE_INLINE Type Add(Type a, Type b) { return _mm_add_ps(a, b); }
+        static ECS_FORCE_INLINE Type Sub(Type a, Type b) { return _mm_sub_ps(a, b); }
+        static ECS_FORCE_INLINE Type Mul(Type a, Type b) { return _mm_mul_ps(a, b); }
+        static ECS_FORCE_INLINE Type Div(Type a, Type b) { return _mm_div_ps(a, b); }
+        // SSE2 has no fused multiply-add
+        static ECS_FORCE_INLINE Type MulAdd(Type a, Type b, Type c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+        static ECS_FORCE_INLINE Type Min(Type a, Type b) { return _mm_min_ps(a, b); }
+        static ECS_FORCE_INLINE Type Max(Type a, Type b) { return _mm_max_ps(a, b); }
+    };
+
+    template<>
+    struct SimdIntrinsicsOf<8>
+    {
+        static constexpr bool NATIVE = true;
+        using Type = __m256;
+        static ECS_FORCE_INLINE Type Set(float value) { return _mm256_set1_ps(value); }
+        static ECS_FORCE_INLINE Type Load(const float* data) { return _mm256_loadu_ps(data); }
+        static ECS_FORCE_INLINE void Store(float* data, Type value) { _mm256_storeu_ps(data, value); }
+        static ECS_FORCE_INLINE Type Add(Type a, Type b) { return _mm256_add_ps(a, b); }
+        static ECS_FORCE_INLINE Type Sub(Type a, Type b) { return _mm256_sub_ps(a, b); }
+        static ECS_FORCE_INLINE Type Mul(Type a, Type b) { return _mm256_mul_ps(a, b); }
+        static ECS_FORCE_INLINE Type Div(Type a, Type b) { return _mm256_div_ps(a, b); }
+        static ECS_FORCE_INLINE Type MulAdd(Type a, Type b, Type c) { return _mm256_fmadd_ps(a, b, c); }
+        static ECS_FORCE_INLINE Type Min(Type a, Type b) { return _mm256_min_ps(a, b); }
+        static ECS_FORCE_INLINE Type Max(Type a, Type b) { return _mm256_max_ps(a, b); }
+    };
+
+    template<>
+    struct SimdIntrinsicsOf<16>
+    {
+        static constexpr bool NATIVE = true;
+        using Type = __m512;
+        static ECS_FORCE_INLINE Type Set(float value) { return _mm512_set1_ps(value); }
+        static ECS_FORCE_INLINE Type Load(const float* data) { return _mm512_loadu_ps(data); }
+        static ECS_FORCE_INLINE void Store(float* data, Type value) { _mm512_storeu_ps(data, value); }
+        static ECS_FORCE_INLINE Type Add(Type a, Type b) { return _mm512_add_ps(a, b); }
+        static ECS_FORCE_INLINE Type Sub(Type a, Type b) { return _mm512_sub_ps(a, b); }
+        static ECS_FORCE_INLINE Type Mul(Type a, Type b) { return _mm512_mul_ps(a, b); }
+        static ECS_FORCE_INLINE Type Div(Type a, Type b) { return _mm512_div_ps(a, b); }
+        static ECS_FORCE_INLINE Type MulAdd(Type a, Type b, Type c) { return _mm512_fmadd_ps(a, b, c); }
+        static ECS_FORCE_INLINE Type Min(Type a, Type b) { return _mm512_min_ps(a, b); }
+        static ECS_FORCE_INLINE Type Max(Type a, Type b) { return _mm512_max_ps(a, b); }
+    };
+#endif
+
+    /// <summary>
+    /// Fixed width pack of floats, with the element-wise operations of data parallel kernels.
+    /// Written once, it compiles to SSE, AVX2 or AVX-512 depending on the function it is inlined in (see ECS_SIMD_TARGET_*),
+    /// wider packs than the registers are split. On MSVC the widths 4, 8 and 16 are SSE, AVX2 and AVX-512 registers instead
+    /// (see ECS_SIMD_INTRINSICS). Loads and stores don't need aligned addresses.
+    /// </summary>
+    template<uint32_t Width>
+    struct SimdFloat
+    {
+        static_assert(Width > 0 && Width <= 16 && std::has_single_bit(Width), "SimdFloat width must be a power of two up to 16.");
+        static constexpr uint32_t WIDTH = Width;
+
+#if defined(ECS_SIMD_VECTOR_EXTENSIONS)
+        using Vector = typename SimdVectorOf<Width>::Type;
+#elif defined(ECS_SIMD_INTRINSICS)
+        using Intrinsics = SimdIntrinsicsOf<Width>;
+        static constexpr bool NATIVE = Intrinsics::NATIVE;
+        using Vector = typename Intrinsics::Type;
+#else
+        using Vector = std::array<float, Width>;
+#endif
+
+        Vector Value;
+
+        SimdFloat() = default;
+
+        // every lane set to value
+        ECS_FORCE_INLINE SimdFloat(float value)
+        {
+#ifdef ECS_SIMD_INTRINSICS
+            if constexpr (NATIVE)
+                Value = Intrinsics::Set(value);
+            else
+#endif
+            {
+                for (uint32_t i = 0; i < Width; ++i)
+                    Value[i] = value;
+            }
+        }
+
+        [[nodiscard]] ECS_FORCE_INLINE static SimdFloat Load(const float* data)
+        {
+            SimdFloat result;
+#ifdef ECS_SIMD_INTRINSICS
+            if constexpr (NATIVE)
+                result.Value = Intrinsics::Load(data);
+            else
+#endif
+                std::memcpy(&result.Value, data, sizeof(Vector));
+            return result;
+        }
+
+        ECS_FORCE_INLINE void Store(float* data) const
+        {
+#ifdef ECS_SIMD_INTRINSICS
+            if constexpr (NATIVE)
+                Intrinsics::Store(data, Value);
+            else
+#endif
+                std::memcpy(data, &Value, sizeof(Vector));
+        }
+
+        // only writes the lanes whose bit is set in mask
+        ECS_FORCE_INLINE void StoreMasked(float* data, uint64_t mask) const
+        {
+#ifdef ECS_SIMD_INTRINSICS
+            if constexpr (Width == 16)
+            {
+                _mm512_mask_storeu_ps(data, (__mmask16)mask, Value);
+                return;
+            }
+#endif
+            for (uint32_t i = 0; i < Width; ++i)
+            {
+                if (mask & (uint64_t(1) << i))
+                    data[i] = (*this)[i];
+            }
+        }
+
+        [[nodiscard]] ECS_FORCE_INLINE float operator[](uint32_t lane) const
+        {
+#ifdef ECS_SIMD_INTRINSICS
+            // the registers can't be indexed, the optimizer turns this into a lane extraction
+            if constexpr (NATIVE)
+            {
+                float lanes[Width];
+                Intrinsics::Store(lanes, Value);
+                return lanes[lane];
+            }
+            else
+#endif
+                return Value[lane];
+        }
+
+#if defined(ECS_SIMD_VECTOR_EXTENSIONS)
+        [[nodiscard]] ECS_FORCE_INLINE friend SimdFloat operator+(const SimdFloat& a, const SimdFloat& b) { return FromVector(a.Value + b.Value); }
+        [[nodiscard]] ECS_FORCE_INLINE friend SimdFloat operator-(const SimdFloat& a, const SimdFloat& b) { return FromVector(a.Value - b.Value); }
+        [[nodiscard]] ECS_FORCE_INLINE friend SimdFloat operator*(const SimdFloat& a, const SimdFloat& b) { return FromVector(a.Value * b.Value); }
+        [[nodiscard]] ECS_FORCE_INLINE friend SimdFloat operator/(const SimdFloat& a, const SimdFloat& b) { return FromVector(a.Value / b.Value); }
+#elif defined(ECS_SIMD_INTRINSICS)
+        [[nodiscard]] ECS_FORCE_INLINE friend SimdFloat operator+(const SimdFloat& a, const SimdFloat& b)
+        {
+            if constexpr (NATIVE) return FromVector(Intrinsics::Add(a.Value, b.Value));
+            else return Map(a, b, [](float x, float y) { return x + y; });
+        }
+        [[nodiscard]] ECS_FORCE_INLINE friend SimdFloat operator-(const SimdFloat& a, const SimdFloat& b)
+        {
+            if constexpr (NATIVE) return FromVector(Intrinsics::Sub(a.Value, b.Value));
+            else return Map(a, b, [](float x, float y) { return x - y; });
+        }
+        [[nodiscard]] ECS_FORCE_INLINE friend SimdFloat operator*(const SimdFloat& a, const SimdFloat& b)
+        {
+            if constexpr (NATIVE) return FromVector(Intrinsics::Mul(a.Value, b.Value));
+            else return Map(a, b, [](float x, float y) { return x * y; });
+        }
+        [[nodiscard]] ECS_FORCE_INLINE friend SimdFloat operator/(const SimdFloat& a, const SimdFloat& b)
+        {
+            if constexpr (NATIVE) return FromVector(Intrinsics::Div(a.Value, b.Value));
+            else return Map(a, b, [](float x, float y) { return x / y; });
+        }
+#else
+        [[nodiscard]] ECS_FORCE_INLINE friend SimdFloat operator+(const SimdFloat& a, const SimdFloat& b) { return Map(a, b, [](float x, float y) { return x + y; }); }
+        [[nodiscard]] ECS_FORCE_INLINE friend SimdFloat operator-(const SimdFloat& a, const SimdFloat& b) { return Map(a, b, [](float x, float y) { return x - y; }); }
+        [[nodiscard]] ECS_FORCE_INLINE friend SimdFloat operator*(const SimdFloat& a, const SimdFloat& b) { return Map(a, b, [](float x, float y) { return x * y; }); }
+        [[nodiscard]] ECS_FORCE_INLINE friend SimdFloat operator/(const SimdFloat& a, const SimdFloat& b) { return Map(a, b, [](float x, float y) { return x / y; }); }
+#endif
+
+        ECS_FORCE_INLINE SimdFloat& operator+=(const SimdFloat& other) { return *this = *this + other; }
+        ECS_FORCE_INLINE SimdFloat& operator-=(const SimdFloat& other) { return *this = *this - other; }
+        ECS_FORCE_INLINE SimdFloat& operator*=(const SimdFloat& other) { return *this = *this * other; }
+        ECS_FORCE_INLINE SimdFloat& operator/=(const SimdFloat& other) { return *this = *this / other; }
+
+        // a * b + c, contracted to a fused multiply-add when the compiler is allowed to
+        [[nodiscard]] ECS_FORCE_INLINE friend SimdFloat MulAdd(const SimdFloat& a, const SimdFloat& b, const SimdFloat& c)
+        {
+#ifdef ECS_SIMD_INTRINSICS
+            if constexpr (NATIVE)
+                return FromVector(Intrinsics::MulAdd(a.Value, b.Value, c.Value));
+            else
+#endif
+                return a * b + c;
+        }
+
+        [[nodiscard]] ECS_FORCE_INLINE friend SimdFloat Min(const SimdFloat& a, const SimdFloat& b)
+        {
+#ifdef ECS_SIMD_INTRINSICS
+            if constexpr (NATIVE)
+                return FromVector(Intrinsics::Min(a.Value, b.Value));
+            else
+#endif
+            {
+                SimdFloat result;
+                for (uint32_t i = 0; i < Width; ++i)
+                    result.Value[i] = a.Value[i] < b.Value[i] ? a.Value[i] : b.Value[i];
+                return result;
+            }
+        }
+
+        [[nodiscard]] ECS_FORCE_INLINE friend SimdFloat Max(const SimdFloat& a, const SimdFloat& b)
+        {
+#ifdef ECS_SIMD_INTRINSICS
+            if constexpr (NATIVE)
+                return FromVector(Intrinsics::Max(a.Value, b.Value));
+            else
+#endif
+            {
+                SimdFloat result;
+                for (uint32_t i = 0; i < Width; ++i)
+                    result.Value[i] = a.Value[i] > b.Value[i] ? a.Value[i] : b.Value[i];
+                return result;
+            }
+        }
+
+    private:
+#if defined(ECS_SIMD_VECTOR_EXTENSIONS) || defined(ECS_SIMD_INTRINSICS)
+        [[nodiscard]] ECS_FORCE_INLINE static SimdFloat FromVector(const Vector& value)
+        {
+            SimdFloat result;
+            result.Value = value;
+            return result;
+        }
+#endif
+#ifndef ECS_SIMD_VECTOR_EXTENSIONS
+        template<typename Op>
+        [[nodiscard]] ECS_FORCE_INLINE static SimdFloat Map(const SimdFloat& a, const SimdFloat& b, Op op)
+        {
+            SimdFloat result;
+            for (uint32_t i = 0; i < Width; ++i)
+                result.Value[i] = op(a.Value[i], b.Value[i]);
+            return result;
+        }
+#endif
+    };
+
+    // the kernel is inlined in these, so it is compiled for their instruction set
+    template<typename Func>
+    ECS_SIMD_TARGET_AVX512 decltype(auto) DispatchSimd_AVX512(Func& func) { return func(std::integral_constant<SimdLevel, SimdLevel::AVX512>{}); }
+    template<typename Func>
+    ECS_SIMD_TARGET_AVX2 decltype(auto) DispatchSimd_AVX2(Func& func) { return func(std::integral_constant<SimdLevel, SimdLevel::AVX2>{}); }
+    template<typename Func>
+    ECS_SIMD_TARGET_SSE2 decltype(auto) DispatchSimd_SSE2(Func& func) { return func(std::integral_constant<SimdLevel, SimdLevel::SSE2>{}); }
+
+    /// <summary>
+    /// Runs a kernel for the widest instruction set of the CPU: func(std::integral_constant<SimdLevel, level>) is instantiated
+    /// for each level and compiled for it, so a kernel written with SimdFloat<GetSimdFloatCount(level)> and
+    /// ComponentView::EachBatch<GetSimdFloatCount(level)> uses the full width of the registers.
+    /// This relies on the kernel being inlined, which optimized builds do for a lambda called from a single place.
+    /// On MSVC the kernel is compiled once for all levels, its SimdFloat width picks the instructions (see ECS_SIMD_INTRINSICS).
+    /// </summary>
+    template<typename Func>
+    decltype(auto) DispatchSimd(Func&& func)
+    {
+        switch (GetSimdLevel())
+        {
+        case SimdLevel::AVX512: return DispatchSimd_AVX512(func);
+        case SimdLevel::AVX2: return DispatchSimd_AVX2(func);
+        case SimdLevel::SSE2: return DispatchSimd_SSE2(func);
+        default: return func(std::integral_constant<SimdLevel, SimdLevel::Scalar>{});
+        }
+    }
+}
@@ -0,0 +1,364 @@
+#pragma once
+#include "Types.h"
+#include "Exceptions.h"
+#include <istream>
+#include <ostream>
+#include <span>
+#include <cstring>
+#include <typeinfo>
+#include <string>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ecs
+{
+    class SnapshotWriter;
+    class SnapshotReader;
+
+    /// <summary>
+    /// Specialize this for component types that aren't trivially copyable so they can be saved in snapshots:
+    ///     static void Write(SnapshotWriter& writer, const T& component);
+    ///     static void Read(SnapshotReader& reader, T& component);
+    /// Trivially copyable components are saved as raw column blobs and don't need it.
+    /// The specialization has to be visible where the component type is registered.
+    /// </summary>
+    template<typename T>
+    struct ComponentSerializer;
+
+    template<typename T>
+    concept SerializableComponent = std::is_trivially_copyable_v<T> || requires(SnapshotWriter& writer, SnapshotReader& reader, const T& in, T& out)
+    {
+        ComponentSerializer<T>::Write(writer, in);
+        ComponentSerializer<T>::Read(reader, out);
+    };
+
+    /// <summary>
+    /// Stable identifier of a component type within a build, used to match the columns of a snapshot with the registered types
+    /// even if they were registered in a different order.
+    /// </summary>
+    template<typename T>
+    uint64_t GetComponentTypeHash()
+    {
+        // FNV-1a of the type name
+        static const uint64_t hash = []()
+        {
+            uint64_t value = 0xcbf29ce484222325ull;
+            for (const char* c = typeid(T).name(); *c; ++c)
+                value = (value ^ (uint8_t)*c) * 0x100000001b3ull;
+            return value;
+        }();
+        return hash;
+    }
+
+    // column blobs start on a multiple of this offset, so a mapped snapshot can be used in place
+    constexpr size_t SNAPSHOT_COLUMN_ALIGNMENT = 64;
+
+    /// <summary>
+    /// Binary output for snapshots. Values are written with the native byte order.
+    /// </summary>
+    class SnapshotWriter
+    {
+    public:
+        explicit SnapshotWriter(std::ostream& stream)
+            : m_Stream(stream)
+        {}
+
+        void WriteBytes(const void* data, size_t size)
+        {
+            if (size && !m_Stream.write(static_cast<const char*>(data), (std::streamsize)size))
+                throw SnapshotException("Failed to write the snapshot.");
+            m_Offset += size;
+        }
+
+        /// <summary>
+        /// Pads with zeros up to the next multiple of alignment, counted from the start of the snapshot.
+        /// </summary>
+        void Align(size_t alignment)
+        {
+            static constexpr std::byte zeros[SNAPSHOT_COLUMN_ALIGNMENT] = {};
+            assert(alignment <= SNAPSHOT_COLUMN_ALIGNMENT && "Alignment is too big");
+            WriteBytes(zeros, (alignment - m_Offset % alignment) % alignment);
+        }
+
+        // number of bytes written so far
+        [[nodiscard]] size_t GetOffset() const noexcept { return m_Offset; }
+
+        template<typename T>
+            requires std::is_trivially_copyable_v<T>
+        void Write(const T& value)
+        {
+            WriteBytes(&value, sizeof(T));
+        }
+
+        template<typename T>
+            requires std::is_trivially_copyable_v<T>
+        void WriteSpan(std::span<const T> values)
+        {
+            WriteBytes(values.data(), values.size_bytes());
+        }
+
+        void WriteString(const std::string& value)
+        {
+            Write((uint32_t)value.size());
+            WriteBytes(value.data(), value.size());
+        }
+
+    private:
+        std::ostream& m_Stream;
+        size_t m_Offset = 0;
+    };
+
+    /// <summary>
+    /// Binary input for snapshots, from a stream or from memory. Throws a SnapshotException when the data runs out.
+    /// Reading from writable memory also lets trivially copyable columns point straight into it, see Borrow.
+    /// </summary>
+    class SnapshotReader
+    {
+    public:
+        explicit SnapshotReader(std::istream& stream)
+            : m_Stream(&stream)
+        {}
+
+        explicit SnapshotReader(std::span<std::byte> memory)
+            : m_Memory(memory)
+        {}
+
+        void ReadBytes(void* data, size_t size)
+        {
+            if (size == 0)
+                return;
+            if (m_Stream)
+            {
+                if (!m_Stream->read(static_cast<char*>(data), (std::streamsize)size))
+                    throw SnapshotException("Unexpected end of snapshot.");
+            }
+            else
+            {
+                CheckRemaining(size);
+                std::memcpy(data, m_Memory.data() + m_Offset, size);
+            }
+            m_Offset += size;
+        }
+
+        /// <summary>
+        /// Returns the next size bytes in place and skips them, if the snapshot is read from memory and they are aligned.
+        /// Otherwise returns nullptr and the bytes have to be read with ReadBytes.
+        /// </summary>
+        [[nodiscard]] std::byte* Borrow(size_t size, size_t alignment)
+        {
+            if (m_Stream)
+                return nullptr;
+            std::byte* data = m_Memory.data() + m_Offset;
+            if (reinterpret_cast<uintptr_t>(data) % alignment != 0)
+                return nullptr;
+            CheckRemaining(size);
+            m_Offset += size;
+            return data;
+        }
+
+        // number of bytes left when reading from memory, 0 when reading from a stream
+        [[nodiscard]] size_t GetRemaining() const noexcept
+        {
+            return m_Stream ? 0 : m_Memory.size() - m_Offset;
+        }
+
+        /// <summary>
+        /// Skips the padding written by SnapshotWriter::Align.
+        /// </summary>
+        void Align(size_t alignment)
+        {
+            std::byte padding[SNAPSHOT_COLUMN_ALIGNMENT];
+            assert(alignment <= SNAPSHOT_COLUMN_ALIGNMENT && "Alignment is too big");
+            ReadBytes(padding, (alignment - m_Offset % alignment) % alignment);
+        }
+
+        template<typename T>
+            requires std::is_trivially_copyable_v<T>
+        T Read()
+        {
+            T value;
+            ReadBytes(&value, sizeof(T));
+            return value;
+        }
+
+        template<typename T>
+            requires std::is_trivially_copyable_v<T>
+        void ReadSpan(std::span<T> values)
+        {
+            ReadBytes(values.data(), values.size_bytes());
+        }
+
+        std::string ReadString()
+        {
+            std::string value(Read<uint32_t>(), '\0');
+            ReadBytes(value.data(), value.size());
+            return value;
+        }
+
+    private:
+        void CheckRemaining(size_t size) const
+        {
+            if (size > m_Memory.size() - m_Offset)
+                throw SnapshotException("Unexpected end of snapshot.");
+        }
+
+    private:
+        std::istream* m_Stream = nullptr;
+        std::span<std::byte> m_Memory;
+        size_t m_Offset = 0;
+    };
+
+    /// <summary>
+    /// Maps a file in memory, copy on write: pages are read from the file the first time they are touched
+    /// and get a private copy the first time they are written, the file itself is never modified.
+    /// Meant to load a snapshot without reading it, see EntityRegistry::LoadSnapshot(std::span<std::byte>).
+    /// </summary>
+    class MappedFile
+    {
+    public:
+        explicit MappedFile(const std::string& path)
+        {
+#if defined(_WIN32)
+            HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE)
+                throw SnapshotException("Failed to open the file to map.");
+            LARGE_INTEGER size;
+            if (!GetFileSizeEx(file, &size))
+            {
+                CloseHandle(file);
+                throw SnapshotException("Failed to open the file to map.");
+            }
+            m_Size = (size_t)size.QuadPart;
+            if (m_Size)
+            {
+                HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+                if (mapping)
+                {
+                    m_Data = static_cast<std::byte*>(MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0));
+                    CloseHandle(mapping);
+                }
+            }
+            CloseHandle(file);
+#else
+            int file = open(path.c_str(), O_RDONLY);
+            if (file < 0)
+                throw SnapshotException("Failed to open the file to map.");
+            struct stat info;
+            if (fstat(file, &info) != 0)
+            {
+                close(file);
+                throw SnapshotException("Failed to open the file to map.");
+            }
+            m_Size = (size_t)info.st_size;
+            if (m_Size)
+            {
+                void* data = mmap(nullptr, m_Size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+                m_Data = data == MAP_FAILED ? nullptr : static_cast<std::byte*>(data);
+            }
+            close(file);
+#endif
+            if (m_Size && !m_Data)
+                throw SnapshotException("Failed to map the file.");
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        ~MappedFile()
+        {
+            if (!m_Data)
+                return;
+#if defined(_WIN32)
+            UnmapViewOfFile(m_Data);
+#else
+            munmap(m_Data, m_Size);
+#endif
+        }
+
+        [[nodiscard]] std::span<std::byte> GetData() const noexcept { return { m_Data, m_Size }; }
+        [[nodiscard]] size_t GetSize() const noexcept { return m_Size; }
+
+    private:
+        std::byte* m_Data = nullptr;
+        size_t m_Size = 0;
+    };
+
+    // Layout of a snapshot, everything in native byte order:
+    //   SnapshotHeader
+    //   ComponentCount x SnapshotComponentInfo
+    //   AvailableEntityCount x EntityID          free entity IDs, in the order they will be handed out
+    //   DisabledEntityCount x EntityID           disabled entities, see EntityRegistry::SetEnabled
+    //   ArchetypeCount x
+    //       uint64 signature (snapshot component indices), uint32 entity count, entity IDs,
+    //       one column per component of the signature, in component index order,
+    //       each starting on a multiple of SNAPSHOT_COLUMN_ALIGNMENT
+    //   padding up to a multiple of SNAPSHOT_COLUMN_ALIGNMENT
+    struct SnapshotHeader
+    {
+        static constexpr uint32_t MAGIC = 0x53534345; // "ECSS"
+        static constexpr uint32_t VERSION = 4;
+
+        uint32_t Magic = MAGIC;
+        uint32_t Version = VERSION;
+        uint32_t EntityCount = 0;
+        uint32_t MaxEntityCount = 0;
+        uint32_t AvailableEntityCount = 0;
+        uint32_t DisabledEntityCount = 0;
+        uint32_t ComponentCount = 0;
+        uint32_t ArchetypeCount = 0;
+    };
+
+    struct SnapshotComponentInfo
+    {
+        uint64_t TypeHash;
+        uint32_t Index;
+        uint32_t Size;
+    };
+
+    // Layout of a delta, the changes made to a registry since the previous delta (or since change tracking was enabled):
+    //   DeltaHeader
+    //   ComponentCount x SnapshotComponentInfo
+    //   OperationCount x DeltaOperation        entity creations, destructions, growths and toggles, in the order they happened
+    //   EntityCount x
+    //       EntityID, uint64 signature, uint64 changed components (snapshot component indices),
+    //       the value of each changed component, in component index order
+    struct DeltaHeader
+    {
+        static constexpr uint32_t MAGIC = 0x44534345; // "ECSD"
+        static constexpr uint32_t VERSION = 2;
+
+        uint32_t Magic = MAGIC;
+        uint32_t Version = VERSION;
+        uint32_t ComponentCount = 0;
+        uint32_t OperationCount = 0;
+        uint32_t EntityCount = 0;
+    };
+
+    enum class DeltaOperationType : uint32_t
+    {
+        CreateEntity,  // Value: ID of the entity, the one at the front of the available entities
+        DestroyEntity, // Value: ID of the entity
+        Grow,          // Value: new maximum entity count
+        EnableEntity,  // Value: ID of the entity
+        DisableEntity, // Value: ID of the entity
+    };
+
+    struct DeltaOperation
+    {
+        DeltaOperationType Type;
+        uint32_t Value;
+    };
+}
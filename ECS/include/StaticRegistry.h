@@ -0,0 +1,367 @@
+#pragma once
+#include "Types.h"
+#include "MemoryResource.h"
+#include "FlatHashMap.h"
+#include "ComponentColumn.h"
+#include "CircularBuffer.h"
+#include "Exceptions.h"
+#include <numeric>
+#include <tuple>
+#include <utility>
+
+namespace ecs
+{
+    // Position of T in Ts..., sizeof...(Ts) if it isn't there
+    template<typename T, typename... Ts>
+    constexpr ComponentTypeIndex IndexOfType()
+    {
+        constexpr bool matches[] = { std::is_same_v<T, Ts>..., false };
+        ComponentTypeIndex index = 0;
+        while (index < sizeof...(Ts) && !matches[index])
+            ++index;
+        return index;
+    }
+
+    template<typename... Ts>
+    constexpr bool AreDistinctTypes()
+    {
+        constexpr ComponentTypeIndex firstIndices[] = { IndexOfType<Ts, Ts...>()..., 0 };
+        for (ComponentTypeIndex i = 0; i < sizeof...(Ts); ++i)
+        {
+            if (firstIndices[i] != i)
+                return false;
+        }
+        return true;
+    }
+
+    /// <summary>
+    /// Entity registry for a set of component types known at compile time.
+    /// A component's index is its position in Components..., so indices and signatures are constants that don't depend on
+    /// the order types are first used in and are the same in every process built with the same list.
+    /// Archetypes keep one column per component of the list (the ones outside their signature stay empty and don't allocate),
+    /// which are reached with std::get instead of a lookup, and moving an entity between archetypes is a fold over the component
+    /// list instead of calls through function pointer tables.
+    /// Unlike EntityRegistry, deletions are applied right away and there are no view caches, snapshots or change tracking.
+    /// </summary>
+    template<ComponentConstraint... Components>
+    class StaticRegistry
+    {
+        static_assert(sizeof...(Components) <= MAX_COMPONENTS, "Too many components!");
+        static_assert(AreDistinctTypes<Components...>(), "A component type is listed twice!");
+
+        template<typename Comp>
+        static constexpr bool Contains = IndexOfType<Comp, Components...>() < sizeof...(Components);
+
+        using IndexSequence = std::index_sequence_for<Components...>;
+
+    public:
+        template<typename Comp>
+            requires Contains<Comp>
+        static constexpr ComponentTypeIndex ComponentIndex = IndexOfType<Comp, Components...>();
+
+        template<typename... Comps>
+        static constexpr uint64_t SignatureMask = (uint64_t(0) | ... | (uint64_t(1) << ComponentIndex<Comps>));
+
+        template<typename... Comps>
+        static constexpr EntitySignature Signature = EntitySignature(SignatureMask<Comps...>);
+
+        explicit StaticRegistry(uint32_t maxEntityCount = 4096, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+            : m_MaxEntityCount(maxEntityCount)
+            , m_Resource(resource)
+            , m_AvailableEntities(maxEntityCount, resource)
+            , m_Entities(maxEntityCount, resource)
+            , m_Archetypes(resource)
+            , m_ArchetypeList(resource)
+        {
+            AddAvailableEntities(0, m_MaxEntityCount);
+            m_EmptyArchetype = GetOrCreateArchetype(0);
+        }
+
+        StaticRegistry(const StaticRegistry&) = delete;
+        StaticRegistry& operator=(const StaticRegistry&) = delete;
+
+        [[nodiscard]] uint32_t GetEntityCount() const { return m_EntityCount; }
+        [[nodiscard]] uint32_t GetMaxEntityCount() const { return m_MaxEntityCount; }
+        [[nodiscard]] uint32_t GetArchetypeCount() const { return (uint32_t)m_ArchetypeList.size(); }
+        [[nodiscard]] std::pmr::memory_resource* GetMemoryResource() const { return m_Resource; }
+
+        /// <summary>
+        /// Creates an entity with no components attached to it.
+        /// </summary>
+        /// <returns>the ID of an entity</returns>
+        EntityID CreateEntity()
+        {
+            if (m_AvailableEntities.IsEmpty())
+                Resize();
+            const EntityID entity = m_AvailableEntities.PopFront();
+            m_Entities[entity] = EntityMetadata{ 0, m_EmptyArchetype, (uint32_t)m_EmptyArchetype->Entities.size() };
+            m_EmptyArchetype->Entities.push_back(entity);
+            ++m_EntityCount;
+            return entity;
+        }
+
+        /// <summary>
+        /// Deletes an entity with its components, right away.
+        /// </summary>
+        /// <param name="entity">: ID of the entity to be deleted</param>
+        void DeleteEntity(EntityID entity)
+        {
+            if (!IsEntityValid(entity))
+                return;
+            EntityMetadata& metadata = m_Entities[entity];
+            RemoveRow(*metadata.Archetype, metadata.Row, IndexSequence());
+            metadata = EntityMetadata{};
+            m_AvailableEntities.PushBack(entity);
+            --m_EntityCount;
+        }
+
+        [[nodiscard]] bool IsEntityValid(EntityID entity) const
+        {
+            return entity < m_MaxEntityCount && m_Entities[entity].Archetype != nullptr;
+        }
+
+        /// <summary>
+        /// Attaches a component of the specified type and constructed with the given arguments to an entity.
+        /// The arguments may refer to the other components of the entity.
+        /// Throws EntityIDOutOfRange if the entity doesn't exist and ComponentAlreadyExistsException if it already has one.
+        /// </summary>
+        /// <returns>the newly created component</returns>
+        template<ComponentConstraint Comp, typename... Args>
+            requires Contains<Comp>
+        Comp& EmplaceComponent(EntityID entity, Args&&... args)
+        {
+            if (!IsEntityValid(entity))
+                throw EntityIDOutOfRange();
+            if (m_Entities[entity].Mask & SignatureMask<Comp>)
+                throw ComponentAlreadyExistsException();
+
+            EntityMetadata& metadata = m_Entities[entity];
+            StaticArchetype* source = metadata.Archetype;
+            const uint32_t row = metadata.Row;
+            StaticArchetype* target = GetOrCreateArchetype(metadata.Mask | SignatureMask<Comp>);
+            const uint32_t targetRow = (uint32_t)target->Entities.size();
+
+            // the new component is built before the row moves, the arguments may refer to the entity's other components
+            auto& column = std::get<ComponentIndex<Comp>>(target->Columns);
+            Comp& component = column.emplace_back(std::forward<Args>(args)...);
+            try
+            {
+                target->Entities.push_back(entity);
+            }
+            catch (...)
+            {
+                column.pop_back();
+                throw;
+            }
+            MoveRow(*source, row, *target, metadata.Mask, IndexSequence());
+            RemoveRow(*source, row, IndexSequence());
+            metadata = EntityMetadata{ target->Mask, target, targetRow };
+            return component;
+        }
+
+        template<ComponentConstraint Comp>
+            requires Contains<Comp>
+        bool TryAddComponent(EntityID entity, const Comp& component)
+        {
+            if (!IsEntityValid(entity) || (m_Entities[entity].Mask & SignatureMask<Comp>))
+                return false;
+            EmplaceComponent<Comp>(entity, component);
+            return true;
+        }
+
+        /// <summary>
+        /// Detaches the component of the specified type from an entity, right away.
+        /// </summary>
+        /// <returns>false if the entity doesn't exist or doesn't have the component</returns>
+        template<ComponentConstraint Comp>
+            requires Contains<Comp>
+        bool RemoveComponent(EntityID entity)
+        {
+            if (!IsEntityValid(entity) || !(m_Entities[entity].Mask & SignatureMask<Comp>))
+                return false;
+
+            EntityMetadata& metadata = m_Entities[entity];
+            StaticArchetype* source = metadata.Archetype;
+            const uint32_t row = metadata.Row;
+            StaticArchetype* target = GetOrCreateArchetype(metadata.Mask & ~SignatureMask<Comp>);
+            const uint32_t targetRow = (uint32_t)target->Entities.size();
+
+            target->Entities.push_back(entity);
+            MoveRow(*source, row, *target, target->Mask, IndexSequence());
+            RemoveRow(*source, row, IndexSequence());
+            metadata = EntityMetadata{ target->Mask, target, targetRow };
+            return true;
+        }
+
+        template<ComponentConstraint Comp>
+            requires Contains<Comp>
+        [[nodiscard]] ECS_FORCE_INLINE bool HasComponent(EntityID entity) const
+        {
+            if (entity >= m_MaxEntityCount)
+                throw EntityIDOutOfRange();
+            return m_Entities[entity].Mask & SignatureMask<Comp>;
+        }
+
+        template<ComponentConstraint... Comps>
+        [[nodiscard]] ECS_FORCE_INLINE bool HasComponents(EntityID entity) const
+        {
+            if (entity >= m_MaxEntityCount)
+                throw EntityIDOutOfRange();
+            return (m_Entities[entity].Mask & SignatureMask<Comps...>) == SignatureMask<Comps...>;
+        }
+
+        template<ComponentConstraint Comp>
+            requires Contains<Comp>
+        [[nodiscard]] ECS_FORCE_INLINE Comp& GetComponent(EntityID entity)
+        {
+            if (!IsEntityValid(entity))
+                throw EntityIDOutOfRange();
+            const EntityMetadata& metadata = m_Entities[entity];
+            if (!(metadata.Mask & SignatureMask<Comp>))
+                throw NoComponentException();
+            return std::get<ComponentIndex<Comp>>(metadata.Archetype->Columns)[metadata.Row];
+        }
+
+        template<ComponentConstraint... Comps>
+        [[nodiscard]] ECS_FORCE_INLINE std::tuple<Comps&...> GetComponents(EntityID entity)
+        {
+            return { GetComponent<Comps>(entity)... };
+        }
+
+        /// <summary>
+        /// Calls func for every entity having at least the given components, archetype by archetype,
+        /// as func(Comps&...) or func(EntityID, Comps&...). Entities and components must not be added or removed meanwhile.
+        /// </summary>
+        template<ComponentConstraint... Comps, typename Func>
+        void Each(Func&& func)
+        {
+            constexpr uint64_t query = SignatureMask<Comps...>;
+            for (StaticArchetype* archetype : m_ArchetypeList)
+            {
+                if ((archetype->Mask & query) != query || archetype->Entities.empty())
+                    continue;
+                const EntityID* entities = archetype->Entities.data();
+                const uint32_t count = (uint32_t)archetype->Entities.size();
+                std::tuple<Comps*...> columns{ std::get<ComponentIndex<Comps>>(archetype->Columns).data()... };
+                for (uint32_t i = 0; i < count; ++i)
+                {
+                    if constexpr (std::is_invocable_v<Func, EntityID, Comps&...>)
+                        func(entities[i], std::get<Comps*>(columns)[i]...);
+                    else
+                        func(std::get<Comps*>(columns)[i]...);
+                }
+            }
+        }
+
+        /// <summary>
+        /// Creates the archetype holding exactly these components if it doesn't exist yet and makes room for count entities in it.
+        /// Also makes sure enough entity IDs are available to create that many entities.
+        /// </summary>
+        template<ComponentConstraint... Comps>
+        void Reserve(uint32_t count)
+        {
+            StaticArchetype* archetype = GetOrCreateArchetype(SignatureMask<Comps...>);
+            archetype->Entities.reserve(count);
+            (std::get<ComponentIndex<Comps>>(archetype->Columns).reserve(count), ...);
+            while (m_AvailableEntities.GetSize() < count)
+                Resize();
+        }
+
+    private:
+        struct StaticArchetype
+        {
+            StaticArchetype(uint64_t mask, std::pmr::memory_resource* resource)
+                : Mask(mask)
+                , Entities(resource)
+                , Columns(ResourceFor<Components>(resource)...)
+            {}
+
+            uint64_t Mask;
+            std::pmr::vector<EntityID> Entities;
+            std::tuple<ComponentColumn<Components>...> Columns; // only the columns of the components in Mask are used
+        };
+
+        struct EntityMetadata
+        {
+            uint64_t Mask = 0;
+            StaticArchetype* Archetype = nullptr;
+            uint32_t Row = 0; // index of the entity in the archetype's entity list and columns
+        };
+
+        template<typename>
+        static std::pmr::memory_resource* ResourceFor(std::pmr::memory_resource* resource) { return resource; }
+
+        // appends the components of the row in mask to the target's columns
+        template<size_t... Is>
+        static ECS_FORCE_INLINE void MoveRow(StaticArchetype& source, uint32_t row, StaticArchetype& target, uint64_t mask, std::index_sequence<Is...>)
+        {
+            ((mask & (uint64_t(1) << Is) ? (void)std::get<Is>(target.Columns).emplace_back(std::move(std::get<Is>(source.Columns)[row])) : (void)0), ...);
+        }
+
+        // removes the row from the archetype by moving the last one in its place
+        template<size_t... Is>
+        ECS_FORCE_INLINE void RemoveRow(StaticArchetype& archetype, uint32_t row, std::index_sequence<Is...>)
+        {
+            const uint32_t last = (uint32_t)archetype.Entities.size() - 1;
+            ((archetype.Mask & (uint64_t(1) << Is) ? SwapAndPop(std::get<Is>(archetype.Columns), row, last) : (void)0), ...);
+            if (row != last)
+            {
+                const EntityID moved = archetype.Entities[last];
+                archetype.Entities[row] = moved;
+                m_Entities[moved].Row = row;
+            }
+            archetype.Entities.pop_back();
+        }
+
+        template<typename Comp>
+        static ECS_FORCE_INLINE void SwapAndPop(ComponentColumn<Comp>& column, uint32_t row, uint32_t last)
+        {
+            if (row != last)
+                column[row] = std::move(column[last]);
+            column.pop_back();
+        }
+
+        StaticArchetype* GetOrCreateArchetype(uint64_t mask)
+        {
+            if (ArchetypePtr* existing = m_Archetypes.TryGet(mask))
+                return existing->get();
+            StaticArchetype* archetype = std::pmr::polymorphic_allocator<>(m_Resource).new_object<StaticArchetype>(mask, m_Resource);
+            m_Archetypes[mask] = ArchetypePtr(archetype, ResourceDeleter<StaticArchetype>{ m_Resource });
+            m_ArchetypeList.push_back(archetype);
+            return archetype;
+        }
+
+        void Resize()
+        {
+            m_MaxEntityCount *= 2;
+            m_AvailableEntities.Resize(m_MaxEntityCount);
+            m_Entities.resize(m_MaxEntityCount);
+            AddAvailableEntities(m_MaxEntityCount / 2, m_MaxEntityCount);
+        }
+
+        void AddAvailableEntities(EntityID first, EntityID last)
+        {
+            std::array<EntityID, 1024> ids;
+            while (first < last)
+            {
+                uint32_t count = std::min<uint32_t>((uint32_t)ids.size(), last - first);
+                std::iota(ids.begin(), ids.begin() + count, first);
+                m_AvailableEntities.PushBackRange(std::span<const EntityID>(ids.data(), count));
+                first += count;
+            }
+        }
+
+    private:
+        uint32_t m_EntityCount = 0;
+        uint32_t m_MaxEntityCount;
+        std::pmr::memory_resource* m_Resource;
+
+        CircularBuffer<EntityID> m_AvailableEntities;
+        std::pmr::vector<EntityMetadata> m_Entities; // indexed by EntityID
+
+        using ArchetypePtr = std::unique_ptr<StaticArchetype, ResourceDeleter<StaticArchetype>>;
+        FlatHashMap<uint64_t, ArchetypePtr> m_Archetypes;
+        std::pmr::vector<StaticArchetype*> m_ArchetypeList; // in creation order, for Each
+        StaticArchetype* m_EmptyArchetype = nullptr;
+    };
+}
@@ -20,6 +20,8 @@
 #include <stdexcept>
 #include <limits>
 #include <atomic>
+#include <chrono>
+#include <bit>
 
 
 #if defined(__clang__)
@@ -32,6 +34,27 @@
 #define ECS_FORCE_INLINE inline
 #endif
 
+#if defined(_MSC_VER)
+#define ECS_NO_INLINE __declspec(noinline)
+#elif defined(__clang__) || defined(__GNUC__) || defined(__GNUG__)
+#define ECS_NO_INLINE __attribute__((noinline))
+#else
+#define ECS_NO_INLINE
+#endif
+
+// used to keep data written by different threads on separate cache lines
+#define ECS_CACHE_LINE_SIZE 64
+
+// hints the CPU to start loading the cache line of an address that will be read soon
+#if defined(__clang__) || defined(__GNUC__) || defined(__GNUG__)
+#define ECS_PREFETCH(address) __builtin_prefetch(address)
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#define ECS_PREFETCH(address) _mm_prefetch(reinterpret_cast<const char*>(address), _MM_HINT_T0)
+#else
+#define ECS_PREFETCH(address) ((void)(address))
+#endif
+
 namespace ecs
 {
 using EntityID = uint32_t;
@@ -54,6 +77,44 @@ concept ComponentConstraint = std::is_default_constructible_v<T> && !std::is_emp
 template<typename T, typename... Args>
 concept IsConstructibleConstraint = std::is_constructible_v<T, Args...>;
 
+// Types whose objects can be moved to another address with a plain memcpy (the source is then considered dead).
+// Specialize it for types that are not trivially copyable but still safe to relocate bitwise.
+template<typename T>
+struct IsTriviallyRelocatable : std::is_trivially_copyable<T> {};
+
+// Specialize it to store a component as two columns, the fields used every frame and the rarely used ones,
+// so that going through the hot part never loads the cold bytes:
+//     using Hot = ...; using Cold = ...;
+//     static Hot GetHot(const T& value); static Cold GetCold(const T& value); static T Join(const Hot& hot, const Cold& cold);
+// Hot and Cold are components of their own, views and observers take them instead of T.
+template<typename T>
+struct HotColdSplit;
+
+template<typename T>
+concept SplitComponentConstraint = requires(const T& value, const typename HotColdSplit<T>::Hot& hot, const typename HotColdSplit<T>::Cold& cold)
+{
+    { HotColdSplit<T>::GetHot(value) } -> std::convertible_to<typename HotColdSplit<T>::Hot>;
+    { HotColdSplit<T>::GetCold(value) } -> std::convertible_to<typename HotColdSplit<T>::Cold>;
+    { HotColdSplit<T>::Join(hot, cold) } -> std::convertible_to<T>;
+};
+
+// Specialize it to store a component made only of Scalar fields in blocks of Lanes components, field by field
+// (Lanes x, then Lanes y...), for kernels that read a few fields or work on several entities per instruction:
+//     using Scalar = float; static constexpr uint32_t Lanes = 8;
+// Lanes is a power of two up to 64. See LaneColumn and EntityRegistry::EachBlock.
+template<typename T>
+struct LaneLayout;
+
+template<typename T>
+concept LaneComponentConstraint = requires
+{
+    typename LaneLayout<T>::Scalar;
+    { LaneLayout<T>::Lanes } -> std::convertible_to<uint32_t>;
+}
+    && std::is_trivially_copyable_v<T> && std::is_arithmetic_v<typename LaneLayout<T>::Scalar>
+    && sizeof(T) % sizeof(typename LaneLayout<T>::Scalar) == 0
+    && std::has_single_bit(LaneLayout<T>::Lanes) && LaneLayout<T>::Lanes <= 64;
+
 template<typename T>
 concept SystemConstraint = DerivedFromConstraint<BaseSystem, T>&& std::is_default_constructible_v<T>;
 
@@ -70,6 +131,18 @@ inline ComponentTypeIndex GetComponentTypeIndex()
     return typeIndex;
 }
 
+// Calls func with the index of every component of the signature, in increasing order
+template<typename Func>
+inline ECS_FORCE_INLINE void ForEachComponentIndex(EntitySignature signature, Func&& func)
+{
+    uint64_t bits = signature.to_ullong();
+    while (bits)
+    {
+        func((ComponentTypeIndex)std::countr_zero(bits));
+        bits &= bits - 1;
+    }
+}
+
 template<ComponentConstraint T>
 inline const ComponentTypeID ComponentType()
 {
@@ -1,6 +1,15 @@
 #pragma once
 
 #include "Types.h"
+#include "Simd.h"
+#include "MemoryResource.h"
+#include "FlatHashMap.h"
+#include "ComponentColumn.h"
+#include "LaneColumn.h"
 #include "CircularBuffer.h"
+#include "ConcurrentQueue.h"
+#include "Snapshot.h"
 #include "Archetype.h"
 #include "EntityRegistry.h"
+#include "RollbackRing.h"
+#include "StaticRegistry.h"
@@ -1,6 +1,7 @@
 #include "pch.h"
 #include "TestHelpers.h"
 //#define CIRCULAR_BUFFER_STRESS_TEST
+//#define ECS_BENCHMARKS
 
 namespace ECSTests
 {
@@ -174,6 +175,147 @@ TEST(CircularBufferTests, CircularBufferComplexStructTest)
     EXPECT_EQ(buffer3.GetCapacity(), buffer2.GetCapacity());
 }
 
+TEST(CircularBufferTests, CircularBufferObjectLifetime)
+{
+    // only pushed items are constructed and each of them is destroyed exactly once
+    CountedObject::Reset();
+    {
+        CircularBuffer<CountedObject> buffer(5);
+        EXPECT_EQ(CountedObject::Alive, 0);
+        for (int i = 0; i < 4; ++i)
+            buffer.PushBack(i);
+        buffer.PopFront();
+        buffer.PopFront();
+        for (int i = 4; i < 12; ++i)
+            buffer.PushBack(i);
+        EXPECT_EQ(buffer.GetSize(), 10);
+        EXPECT_EQ(CountedObject::Alive, 10);
+        for (uint32_t i = 0; i < buffer.GetSize(); ++i)
+            EXPECT_EQ(buffer[i].Value, int(i + 2));
+
+        buffer.Clear();
+        EXPECT_EQ(CountedObject::Alive, 0);
+        buffer.PushFront(1);
+        buffer.PushFront(0);
+        EXPECT_EQ(buffer.GetFront().Value, 0);
+        EXPECT_EQ(buffer.GetBack().Value, 1);
+    }
+    EXPECT_EQ(CountedObject::Alive, 0);
+}
+
+TEST(CircularBufferTests, CircularBufferWrappedResize)
+{
+    CircularBuffer<uint64_t> buffer(8);
+    for (uint64_t i = 0; i < 6; ++i)
+        buffer.PushBack(i);
+    for (uint64_t i = 0; i < 5; ++i)
+        buffer.PopFront();
+    // head is now near the end of the storage so the next pushes wrap around
+    for (uint64_t i = 6; i < 40; ++i)
+        buffer.PushBack(i);
+    EXPECT_EQ(buffer.GetSize(), 35);
+    uint64_t expected = 5;
+    for (auto item : buffer)
+        EXPECT_EQ(item, expected++);
+}
+
+TEST(CircularBufferTests, CircularBufferPushAliasedItem)
+{
+    // long enough to live on the heap, a read from the freed storage would show up under the address sanitizer
+    const std::string prefix(64, 'x');
+    CircularBuffer<std::string> buffer(4);
+    for (int i = 0; i < 4; ++i)
+        buffer.PushBack(prefix + std::to_string(i));
+
+    buffer.PushBack(buffer[0]);
+    buffer.PushFront(buffer[buffer.GetSize() - 2]);
+    buffer.PushBack(std::as_const(buffer)[1]);
+    EXPECT_EQ(buffer.GetSize(), 7);
+    EXPECT_EQ(buffer[0], prefix + "3");
+    EXPECT_EQ(buffer[5], prefix + "0");
+    EXPECT_EQ(buffer[6], prefix + "0");
+
+    while (buffer.GetSize() < buffer.GetCapacity())
+        buffer.PushBack(prefix);
+    buffer.PushFront(buffer[1], 60);
+    EXPECT_EQ(buffer.GetFront(), "xxxx0");
+}
+
+TEST(CircularBufferTests, CircularBufferRangeOperations)
+{
+    CircularBuffer<uint32_t> buffer(8);
+    std::vector<uint32_t> items(6);
+    std::iota(items.begin(), items.end(), 0);
+    buffer.PushBackRange(items);
+    EXPECT_EQ(buffer.GetSize(), 6);
+
+    std::array<uint32_t, 4> out{};
+    EXPECT_EQ(buffer.PopFrontInto(out, 4), 4);
+    EXPECT_EQ(out, (std::array<uint32_t, 4>{ 0, 1, 2, 3 }));
+
+    // wraps around the end of the storage
+    std::iota(items.begin(), items.end(), 6);
+    buffer.PushBackRange(items);
+    EXPECT_EQ(buffer.GetSize(), 8);
+    EXPECT_EQ(buffer.GetCapacity(), 8);
+    auto spans = buffer.AsSpans();
+    EXPECT_EQ(spans[0].size(), 4);
+    EXPECT_EQ(spans[1].size(), 4);
+    uint32_t expected = 4;
+    for (auto span : spans)
+        for (uint32_t item : span)
+            EXPECT_EQ(item, expected++);
+
+    // grows once to fit the whole range
+    std::vector<uint32_t> bigRange(100);
+    std::iota(bigRange.begin(), bigRange.end(), 12);
+    buffer.PushBackRange(bigRange);
+    EXPECT_EQ(buffer.GetSize(), 108);
+    EXPECT_EQ(buffer.AsSpans()[1].size(), 0);
+    std::vector<uint32_t> all(200);
+    EXPECT_EQ(buffer.PopFrontInto(all, 200), 108);
+    for (uint32_t i = 0; i < 108; ++i)
+        EXPECT_EQ(all[i], i + 4);
+    EXPECT_TRUE(buffer.IsEmpty());
+    EXPECT_EQ(buffer.PopFrontInto(all, 200), 0);
+}
+
+TEST(CircularBufferTests, CircularBufferPushAliasedRange)
+{
+    const std::string prefix(64, 'x');
+    CircularBuffer<std::string> buffer(4);
+    for (int i = 0; i < 4; ++i)
+        buffer.PushBack(prefix + std::to_string(i));
+
+    // the range is read from the storage the growth replaces
+    buffer.PushBackRange(buffer.AsSpans()[0]);
+    EXPECT_EQ(buffer.GetSize(), 8);
+    for (uint32_t i = 0; i < 8; ++i)
+        EXPECT_EQ(buffer[i], prefix + std::to_string(i % 4));
+
+    CircularBuffer<uint32_t> numbers(8);
+    for (uint32_t i = 0; i < 8; ++i)
+        numbers.PushBack(i);
+    auto span = numbers.AsSpans()[0];
+    numbers.PushBackRange(span.subspan(2, 4));
+    EXPECT_EQ(numbers.GetSize(), 12);
+    EXPECT_EQ(numbers.GetBack(), 5);
+}
+
+TEST(CircularBufferTests, CircularBufferRangeComplexStruct)
+{
+    CircularBuffer<B> buffer(4);
+    std::vector<B> items{ B{ "a" }, B{ "b" }, B{ "c" } };
+    buffer.PushBackRange(items);
+    buffer.PushBackRange(items);
+    EXPECT_EQ(buffer.GetSize(), 6);
+    std::vector<B> out(6);
+    EXPECT_EQ(buffer.PopFrontInto(out, 5), 5);
+    EXPECT_EQ(out[3].s, "a");
+    EXPECT_EQ(out[4].s, "b");
+    EXPECT_EQ(buffer.GetFront().s, "c");
+}
+
 #ifdef CIRCULAR_BUFFER_STRESS_TEST
 TEST(CircularBufferTests, CircularBufferStressResize)
 {
@@ -188,667 +330,4016 @@ TEST(CircularBufferTests, CircularBufferStressResize)
 }
 #endif // CIRCULAR_BUFFER_STRESS_TEST
 
-////////////////////////////////////////////////////////////////////////////////////////
-// Archetype Tests /////////////////////////////////////////////////////////////////////
-////////////////////////////////////////////////////////////////////////////////////////
-
-class ArchetypeTest : public ::testing::Test
+#ifdef ECS_BENCHMARKS
+template<typename Queue, typename PushFunc, typename PopFunc>
+uint64_t BenchmarkQueue(const std::string& name, uint32_t queueSize, uint32_t iterations, PushFunc push, PopFunc pop)
 {
-protected:
-    void SetUp() override
+    uint64_t sum = 0;
+    Queue queue;
     {
-        archetype = new ecs::Archetype();
+        ScopeTimer timer(name + " fill " + std::to_string(queueSize));
+        for (uint32_t i = 0; i < queueSize; ++i)
+            push(queue, i);
     }
-
-    void TearDown() override
     {
-        delete archetype;
+        // steady state, like the entity ID free list: one pop and one push per iteration
+        ScopeTimer timer(name + " pop/push " + std::to_string(iterations));
+        for (uint32_t i = 0; i < iterations; ++i)
+        {
+            sum += pop(queue);
+            push(queue, i);
+        }
     }
+    return sum;
+}
 
-    ecs::Archetype* archetype{nullptr};
-};
-
-TEST_F(ArchetypeTest, AddEntityTest)
+TEST(CircularBufferBenchmarks, PushPopVersusDeque)
 {
-    EntityID e1 = 1;
-    archetype->AddEntity(e1);
+    auto bufferPush = [](CircularBuffer<uint32_t>& buffer, uint32_t i) { buffer.PushBack(i); };
+    auto bufferPop = [](CircularBuffer<uint32_t>& buffer) { return buffer.PopFront(); };
+    auto dequePush = [](std::deque<uint32_t>& deque, uint32_t i) { deque.push_back(i); };
+    auto dequePop = [](std::deque<uint32_t>& deque) { uint32_t item = deque.front(); deque.pop_front(); return item; };
 
-    const auto& entities = archetype->GetEntities();
-    ASSERT_EQ(entities.size(), 1);
-    EXPECT_EQ(entities[0], e1);
+    for (uint32_t queueSize : { 4096u, 10'000'000u })
+    {
+        uint64_t bufferSum = BenchmarkQueue<CircularBuffer<uint32_t>>("CircularBuffer<uint32_t>", queueSize, 50'000'000, bufferPush, bufferPop);
+        uint64_t dequeSum = BenchmarkQueue<std::deque<uint32_t>>("std::deque<uint32_t>", queueSize, 50'000'000, dequePush, dequePop);
+        EXPECT_EQ(bufferSum, dequeSum);
+    }
 }
+#endif // ECS_BENCHMARKS
 
-TEST_F(ArchetypeTest, RemoveEntityTest)
+////////////////////////////////////////////////////////////////////////////////////////
+// ConcurrentQueue Tests ///////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////
+
+TEST(ConcurrentQueueTests, MPSCQueueOrder)
 {
-    EntityID e1 = 1;
-    EntityID e2 = 2;
-    EntityID e3 = 3;
+    MPSCQueue<int, 4> queue;
+    int item = -1;
+    EXPECT_TRUE(queue.IsEmpty());
+    EXPECT_FALSE(queue.PopFront(item));
 
-    archetype->AddEntity(e1);
-    archetype->AddEntity(e2);
-    archetype->AddEntity(e3);
-    archetype->RemoveEntity(e2);
+    for (int i = 0; i < 10; ++i)
+        queue.PushBack(i);
+    EXPECT_EQ(queue.GetSize(), 10);
+    for (int i = 0; i < 10; ++i)
+    {
+        EXPECT_FALSE(queue.IsEmpty());
+        ASSERT_TRUE(queue.PopFront(item));
+        EXPECT_EQ(item, i);
+    }
+    EXPECT_FALSE(queue.PopFront(item));
+    EXPECT_TRUE(queue.IsEmpty());
 
-    const auto& entities = archetype->GetEntities();
-    ASSERT_EQ(entities.size(), 2);
-    EXPECT_EQ(entities[0], e1);
-    EXPECT_NE(entities[1], e2);
-    EXPECT_EQ(entities[1], e3);
-    archetype->AddEntity(e2);
-    ASSERT_EQ(entities.size(), 3);
-    EXPECT_EQ(entities[2], e2);
-    archetype->RemoveEntity(e1);
-    ASSERT_EQ(entities.size(), 2);
-    EXPECT_NE(entities[0], e1);
-    EXPECT_EQ(entities[0], e2);
+    // the last item of a full segment, then the first of the next one
+    queue.PushBack(10);
+    queue.PushBack(11);
+    ASSERT_TRUE(queue.PopFront(item));
+    ASSERT_TRUE(queue.PopFront(item));
+    EXPECT_TRUE(queue.IsEmpty());
+    queue.PushBack(12);
+    EXPECT_FALSE(queue.IsEmpty());
+    ASSERT_TRUE(queue.PopFront(item));
+    EXPECT_EQ(item, 12);
+    EXPECT_TRUE(queue.IsEmpty());
 
-    EXPECT_FALSE(archetype->HasEntity(e1));
-    EXPECT_TRUE(archetype->HasEntity(e2));
-    EXPECT_TRUE(archetype->HasEntity(e3));
+    queue.PushBack(42);
+    ASSERT_TRUE(queue.PopFront(item));
+    EXPECT_EQ(item, 42);
 }
 
-TEST_F(ArchetypeTest, CreateAndAddComponentTest)
+TEST(ConcurrentQueueTests, MPSCQueueBulkPop)
 {
-    EntityID e1 = 1;
-    archetype->CreateComponentStorages<Transform, A>();
+    MPSCQueue<uint32_t, 8> queue;
+    for (uint32_t i = 0; i < 30; ++i)
+        queue.PushBack(i);
 
-    archetype->AddEntity(e1);
-    archetype->AddComponents<Transform, A>(e1, Transform({ 1, 2, 3 }, { 4, 5, 6 }, { 7, 8, 9 }), A(42));
+    std::array<uint32_t, 16> out{};
+    EXPECT_EQ(queue.PopFrontInto(out), 16);
+    for (uint32_t i = 0; i < 16; ++i)
+        EXPECT_EQ(out[i], i);
+    EXPECT_EQ(queue.PopFrontInto(out), 14);
+    for (uint32_t i = 0; i < 14; ++i)
+        EXPECT_EQ(out[i], i + 16);
+    EXPECT_EQ(queue.PopFrontInto(out), 0);
+}
 
-    auto& transformStorage = archetype->GetComponentStorage<Transform>();
-    auto& aStorage = archetype->GetComponentStorage<A>();
+TEST(ConcurrentQueueTests, MPSCQueueConcurrentProducers)
+{
+    constexpr int producerCount = 4;
+    constexpr int itemsPerProducer = 20000;
+    MPSCQueue<int, 64> queue;
 
-    ASSERT_EQ(transformStorage.Components.size(), 1);
-    ASSERT_EQ(aStorage.Components.size(), 1);
+    std::vector<std::thread> producers;
+    for (int p = 0; p < producerCount; ++p)
+    {
+        producers.emplace_back([&queue, p]()
+        {
+            for (int i = 0; i < itemsPerProducer; ++i)
+                queue.PushBack(p * itemsPerProducer + i);
+        });
+    }
 
-    EXPECT_EQ(transformStorage.Components[0], Transform({ 1, 2, 3 }, { 4, 5, 6 }, { 7, 8, 9 }));
-    EXPECT_EQ(aStorage.Components[0], A(42));
+    // consume while the producers are still pushing, items of one producer must come out in order
+    std::vector<int> lastSeen(producerCount, -1);
+    int consumed = 0;
+    int item;
+    while (consumed < producerCount * itemsPerProducer)
+    {
+        if (!queue.PopFront(item))
+            continue;
+        int producer = item / itemsPerProducer;
+        EXPECT_GT(item % itemsPerProducer, lastSeen[producer]);
+        lastSeen[producer] = item % itemsPerProducer;
+        ++consumed;
+    }
+    for (auto& producer : producers)
+        producer.join();
+    EXPECT_TRUE(queue.IsEmpty());
 }
 
-TEST_F(ArchetypeTest, RemoveComponentTest)
+TEST(ConcurrentQueueTests, MPSCQueueBoundedRetirement)
 {
-    EntityID e1 = 1;
-    archetype->CreateComponentStorages<Transform, A>();
+    static_assert(std::is_nothrow_move_constructible_v<MPSCQueue<int>> && std::is_nothrow_move_assignable_v<MPSCQueue<int>>);
 
-    archetype->AddEntity(e1);
-    archetype->AddComponents<Transform, A>(e1, Transform({ 1, 2, 3 }, { 4, 5, 6 }, { 7, 8, 9 }), A(42));
+    // the producers never stop while the consumer drains, drained segments must still be freed
+    constexpr int producerCount = 4;
+    MPSCQueue<int, 16> queue;
+    std::atomic<bool> stop{ false };
+    std::vector<std::thread> producers;
+    for (int p = 0; p < producerCount; ++p)
+    {
+        producers.emplace_back([&queue, &stop, p]()
+        {
+            while (!stop.load(std::memory_order_relaxed))
+                queue.PushBack(p);
+        });
+    }
 
-    archetype->RemoveComponent<Transform>(e1);
+    uint32_t maxRetired = 0;
+    int item;
+    for (int popped = 0; popped < 200000;)
+    {
+        if (!queue.PopFront(item))
+            continue;
+        ++popped;
+        maxRetired = std::max(maxRetired, queue.GetRetiredSegmentCount());
+    }
+    stop = true;
+    for (auto& producer : producers)
+        producer.join();
+    EXPECT_LE(maxRetired, (MPSCQueue<int, 16>::HAZARD_SLOT_COUNT + 1));
 
-    auto& aStorage = archetype->GetComponentStorage<A>();
-    ASSERT_EQ(aStorage.Components.size(), 1);
-    EXPECT_EQ(aStorage.Components[0], A(42));
+    MPSCQueue<int, 16> moved(std::move(queue));
+    EXPECT_FALSE(moved.IsEmpty());
+    queue = std::move(moved);
+    EXPECT_FALSE(queue.IsEmpty());
 }
 
-TEST_F(ArchetypeTest, RemoveAllComponentsTest)
+TEST(ConcurrentQueueTests, SPSCRingBufferBasic)
 {
-    EntityID e1 = 1;
-    EntityID e2 = 2;
-    EntityID e3 = 3;
+    SPSCRingBuffer<int> buffer(3);
+    int item = -1;
+    EXPECT_EQ(buffer.GetCapacity(), 4);
+    EXPECT_TRUE(buffer.IsEmpty());
+    EXPECT_FALSE(buffer.PopFront(item));
 
-    archetype->CreateComponentStorages<Transform, A, B>();
+    // wrap around a few times
+    for (int lap = 0; lap < 3; ++lap)
+    {
+        for (int i = 0; i < 4; ++i)
+            EXPECT_TRUE(buffer.PushBack(lap * 4 + i));
+        EXPECT_FALSE(buffer.PushBack(-1));
+        EXPECT_EQ(buffer.GetSize(), 4);
+        for (int i = 0; i < 4; ++i)
+        {
+            ASSERT_TRUE(buffer.PopFront(item));
+            EXPECT_EQ(item, lap * 4 + i);
+        }
+        EXPECT_FALSE(buffer.PopFront(item));
+    }
 
-    archetype->AddEntity(e1);
-    archetype->AddEntity(e2);
-    archetype->AddEntity(e3);
+    CountedObject::Reset();
+    {
+        SPSCRingBuffer<CountedObject> objects(8);
+        objects.PushBack(1);
+        objects.PushBack(2);
+        EXPECT_EQ(CountedObject::Alive, 2);
+    }
+    EXPECT_EQ(CountedObject::Alive, 0);
+}
 
-    archetype->AddComponents<Transform, A, B>(e1, Transform({ 1, 1, 1 }, { 0, 0, 0 }, { 1, 1, 1 }), A(10), B{ "Entity1" });
-    archetype->AddComponents<Transform, A, B>(e2, Transform({ 2, 2, 2 }, { 0, 0, 0 }, { 1, 1, 1 }), A(20), B{ "Entity2" });
-    archetype->AddComponents<Transform, A, B>(e3, Transform({ 3, 3, 3 }, { 0, 0, 0 }, { 1, 1, 1 }), A(30), B{ "Entity3" });
+TEST(ConcurrentQueueTests, SPSCRingBufferThreaded)
+{
+    constexpr uint32_t itemCount = 200000;
+    SPSCRingBuffer<uint32_t> buffer(64);
 
-    // Remove components for the second entity (e2)
-    archetype->RemoveComponents<Transform, A, B>(e2);
+    std::thread producer([&buffer]()
+    {
+        for (uint32_t i = 0; i < itemCount; ++i)
+            while (!buffer.PushBack(i)) { std::this_thread::yield(); }
+    });
 
-    auto& transformStorage = archetype->GetComponentStorage<Transform>();
-    auto& aStorage = archetype->GetComponentStorage<A>();
-    auto& bStorage = archetype->GetComponentStorage<B>();
+    uint32_t item;
+    for (uint32_t expected = 0; expected < itemCount; ++expected)
+    {
+        while (!buffer.PopFront(item)) { std::this_thread::yield(); }
+        ASSERT_EQ(item, expected);
+    }
+    producer.join();
+    EXPECT_TRUE(buffer.IsEmpty());
+}
 
-    ASSERT_EQ(transformStorage.Components.size(), 2);
-    ASSERT_EQ(aStorage.Components.size(), 2);
-    ASSERT_EQ(bStorage.Components.size(), 2);
+TEST(ConcurrentQueueTests, MPMCRingBufferBasic)
+{
+    MPMCRingBuffer<int> buffer(5);
+    int item = -1;
+    EXPECT_EQ(buffer.GetCapacity(), 8);
+    EXPECT_FALSE(buffer.PopFront(item));
 
-    EXPECT_EQ(transformStorage.Components[0], Transform({ 1, 1, 1 }, { 0, 0, 0 }, { 1, 1, 1 }));
-    EXPECT_EQ(transformStorage.Components[1], Transform({ 3, 3, 3 }, { 0, 0, 0 }, { 1, 1, 1 }));
+    for (int lap = 0; lap < 3; ++lap)
+    {
+        for (int i = 0; i < 8; ++i)
+            EXPECT_TRUE(buffer.PushBack(lap * 8 + i));
+        EXPECT_FALSE(buffer.PushBack(-1));
+        EXPECT_EQ(buffer.GetSize(), 8);
+        for (int i = 0; i < 8; ++i)
+        {
+            ASSERT_TRUE(buffer.PopFront(item));
+            EXPECT_EQ(item, lap * 8 + i);
+        }
+        EXPECT_TRUE(buffer.IsEmpty());
+    }
+}
 
-    EXPECT_EQ(aStorage.Components[0], A(10));
-    EXPECT_EQ(aStorage.Components[1], A(30));
+TEST(ConcurrentQueueTests, MPMCRingBufferThreaded)
+{
+    constexpr uint32_t threadCount = 4;
+    constexpr uint32_t itemsPerProducer = 50000;
+    MPMCRingBuffer<uint32_t> buffer(128);
+    std::atomic<uint64_t> sum = 0;
+    std::atomic<uint32_t> consumed = 0;
 
-    EXPECT_EQ(bStorage.Components[0], B{ "Entity1" });
-    EXPECT_EQ(bStorage.Components[1], B{ "Entity3" });
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < threadCount; ++t)
+    {
+        threads.emplace_back([&buffer, t]()
+        {
+            for (uint32_t i = 0; i < itemsPerProducer; ++i)
+                while (!buffer.PushBack(t * itemsPerProducer + i)) { std::this_thread::yield(); }
+        });
+        threads.emplace_back([&]()
+        {
+            uint32_t item;
+            while (consumed.load() < threadCount * itemsPerProducer)
+            {
+                if (buffer.PopFront(item))
+                {
+                    sum += item;
+                    ++consumed;
+                }
+                else
+                {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    constexpr uint64_t itemCount = uint64_t(threadCount) * itemsPerProducer;
+    EXPECT_EQ(consumed.load(), itemCount);
+    EXPECT_EQ(sum.load(), itemCount * (itemCount - 1) / 2);
+    EXPECT_TRUE(buffer.IsEmpty());
 }
 
-TEST_F(ArchetypeTest, HandleInvalidEntityRemoval)
+#ifdef ECS_BENCHMARKS
+// a CircularBuffer behind a mutex, what the lock-free rings are measured against
+template<typename T>
+class LockedCircularBuffer
 {
-    EntityID invalidEntity = 999;
+public:
+    explicit LockedCircularBuffer(uint32_t capacity) : m_Buffer(capacity), m_Capacity(capacity) {}
 
-    // Ensure no crash occurs when removing a non-existent entity
-    EXPECT_NO_THROW(archetype->RemoveEntity(invalidEntity));
+    bool PushBack(const T& item)
+    {
+        std::scoped_lock lock(m_Mutex);
+        if (m_Buffer.GetSize() == m_Capacity)
+            return false;
+        m_Buffer.PushBack(item);
+        return true;
+    }
+
+    bool PopFront(T& outItem)
+    {
+        std::scoped_lock lock(m_Mutex);
+        if (m_Buffer.IsEmpty())
+            return false;
+        outItem = m_Buffer.PopFront();
+        return true;
+    }
+
+private:
+    std::mutex m_Mutex;
+    CircularBuffer<T> m_Buffer;
+    uint32_t m_Capacity;
+};
+
+// half of the threads push, the other half pop, returns the sum of the popped items
+template<typename Queue>
+uint64_t BenchmarkConcurrentQueue(const std::string& name, uint32_t producerCount, uint32_t consumerCount, uint32_t itemCount)
+{
+    Queue queue(1024);
+    std::atomic<uint64_t> sum = 0;
+    std::atomic<uint32_t> consumed = 0;
+    std::vector<std::thread> threads;
+
+    ScopeTimer timer(name + " " + std::to_string(producerCount) + "P/" + std::to_string(consumerCount) + "C");
+    for (uint32_t p = 0; p < producerCount; ++p)
+    {
+        threads.emplace_back([&queue, p, producerCount, itemCount]()
+        {
+            for (uint32_t i = p; i < itemCount; i += producerCount)
+                while (!queue.PushBack(i)) { std::this_thread::yield(); }
+        });
+    }
+    for (uint32_t c = 0; c < consumerCount; ++c)
+    {
+        threads.emplace_back([&]()
+        {
+            uint64_t localSum = 0;
+            uint32_t item;
+            while (consumed.load(std::memory_order_relaxed) < itemCount)
+            {
+                if (queue.PopFront(item))
+                {
+                    localSum += item;
+                    consumed.fetch_add(1, std::memory_order_relaxed);
+                }
+                else
+                {
+                    std::this_thread::yield();
+                }
+            }
+            sum += localSum;
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    return sum.load();
 }
 
-TEST_F(ArchetypeTest, HandleInvalidComponentRemoval)
+TEST(ConcurrentQueueBenchmarks, SPSCThroughput)
 {
-    EntityID e1 = 1;
-    archetype->CreateComponentStorages<Transform>();
-    archetype->AddEntity(e1);
-    archetype->AddComponents<Transform>(e1, Transform({ 1, 2, 3 }, { 4, 5, 6 }, { 7, 8, 9 }));
+    constexpr uint32_t itemCount = 20'000'000;
+    constexpr uint64_t expected = uint64_t(itemCount) * (itemCount - 1) / 2;
+    EXPECT_EQ(BenchmarkConcurrentQueue<SPSCRingBuffer<uint32_t>>("SPSCRingBuffer", 1, 1, itemCount), expected);
+    EXPECT_EQ(BenchmarkConcurrentQueue<MPMCRingBuffer<uint32_t>>("MPMCRingBuffer", 1, 1, itemCount), expected);
+    EXPECT_EQ(BenchmarkConcurrentQueue<LockedCircularBuffer<uint32_t>>("Locked CircularBuffer", 1, 1, itemCount), expected);
+}
 
-    // Ensure no crash occurs when removing a component that doesn't exist
-    EXPECT_NO_THROW(archetype->RemoveComponent<A>(e1));
+TEST(ConcurrentQueueBenchmarks, MPMCThroughput)
+{
+    constexpr uint32_t itemCount = 5'000'000;
+    constexpr uint64_t expected = uint64_t(itemCount) * (itemCount - 1) / 2;
+    // every run needs a producer and a consumer, so the smallest one uses 2 threads (the same 1P/1C run as SPSCThroughput)
+    for (uint32_t threadCount : { 2u, 4u, 8u, 16u, 32u })
+    {
+        uint32_t producerCount = threadCount / 2;
+        uint32_t consumerCount = threadCount - producerCount;
+        EXPECT_EQ(BenchmarkConcurrentQueue<MPMCRingBuffer<uint32_t>>("MPMCRingBuffer", producerCount, consumerCount, itemCount), expected);
+        EXPECT_EQ(BenchmarkConcurrentQueue<LockedCircularBuffer<uint32_t>>("Locked CircularBuffer", producerCount, consumerCount, itemCount), expected);
+    }
 }
+#endif // ECS_BENCHMARKS
 
 ////////////////////////////////////////////////////////////////////////////////////////
-// EntityRegistry Tests ////////////////////////////////////////////////////////////////
+// MemoryResource Tests ////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////
-class EntityRegistryTest : public ::testing::Test
+
+TEST(MemoryResourceTests, MonotonicArenaAllocations)
 {
-protected:
-    void SetUp() override
+    CountingResource upstream;
     {
-        ecs::EntityRegistry::RegisterComponentTypes<Transform, A, B>();
-    }
-};
+        MonotonicArena arena(256, &upstream);
+        void* first = arena.allocate(10, 1);
+        void* aligned = arena.allocate(32, 64);
+        EXPECT_NE(first, aligned);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(aligned) % 64, 0);
 
-TEST_F(EntityRegistryTest, CreateEntity)
-{
-    using namespace ecs;
-    ecs::EntityRegistry registry;
+        // bigger than a chunk, gets its own
+        void* big = arena.allocate(4096, 16);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(big) % 16, 0);
+        EXPECT_GE(arena.GetBytesAllocated(), 10 + 32 + 4096);
+        EXPECT_EQ(arena.GetBytesReserved(), upstream.Outstanding);
 
-    EntityID entity0 = registry.CreateEntity();
-    EntityID entity1 = registry.CreateEntity();
-    EntityID entity2 = registry.CreateEntity();
+        // deallocation does nothing, release gives everything back at once
+        arena.deallocate(big, 4096, 16);
+        EXPECT_EQ(arena.GetBytesReserved(), upstream.Outstanding);
+        arena.Release();
+        EXPECT_EQ(upstream.Outstanding, 0);
+        EXPECT_EQ(arena.GetBytesAllocated(), 0);
 
-    EXPECT_EQ(entity0, 0);
-    EXPECT_EQ(entity1, 1);
-    EXPECT_EQ(entity2, 2);
+        void* memory = arena.allocate(8, 8);
+        EXPECT_NE(memory, nullptr);
+        EXPECT_GT(upstream.Outstanding, 0);
+    }
+    EXPECT_EQ(upstream.Outstanding, 0);
 }
 
-// Unit test to check if all the functions in the EntityRegistry class work as intended
-TEST_F(EntityRegistryTest, GetComponent)
+TEST(MemoryResourceTests, PoolResourceReusesBlocks)
 {
-    using namespace ecs;
-    ecs::EntityRegistry registry;
+    CountingResource upstream;
+    {
+        PoolResource pool(4096, &upstream);
+        void* a = pool.allocate(24, 8);
+        void* b = pool.allocate(24, 8);
+        EXPECT_NE(a, b);
+        EXPECT_EQ(pool.GetSlabCount(), 1);
 
-    Transform transform;
-    A a;
-    B b;
-    EntityID entity0 = registry.CreateEntity();
-    EntityID entity1 = registry.CreateEntity();
-    EntityID entity2 = registry.CreateEntity();
-    registry.TryAddComponent(entity0, transform);
-    registry.TryAddComponent(entity1, a);
-    registry.TryAddComponent(entity2, b);
-    EXPECT_EQ(registry.GetComponent<Transform>(entity0), transform);
-    EXPECT_EQ(registry.GetComponent<A>(entity1), a);
-    EXPECT_EQ(registry.GetComponent<B>(entity2), b);
+        // 24 bytes lands in the 32 bytes class, a freed block is handed out again
+        pool.deallocate(a, 24, 8);
+        EXPECT_EQ(pool.allocate(30, 8), a);
+
+        // blocks are aligned on their size class
+        void* aligned = pool.allocate(100, 128);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(aligned) % 128, 0);
+        EXPECT_EQ(pool.GetSlabCount(), 2);
+
+        // large blocks go straight upstream
+        size_t outstanding = upstream.Outstanding;
+        void* large = pool.allocate(PoolResource::MAX_BLOCK_SIZE * 2, 8);
+        EXPECT_EQ(upstream.Outstanding, outstanding + PoolResource::MAX_BLOCK_SIZE * 2);
+        pool.deallocate(large, PoolResource::MAX_BLOCK_SIZE * 2, 8);
+        EXPECT_EQ(upstream.Outstanding, outstanding);
+
+        // a full slab makes the pool take another one
+        std::vector<void*> blocks;
+        for (int i = 0; i < 4096 / 256 + 1; ++i)
+            blocks.push_back(pool.allocate(256, 8));
+        EXPECT_EQ(pool.GetSlabCount(), 4);
+        for (void* block : blocks)
+            pool.deallocate(block, 256, 8);
+        EXPECT_EQ(pool.allocate(256, 8), blocks.back());
+    }
+    EXPECT_EQ(upstream.Outstanding, 0);
 }
 
-TEST_F(EntityRegistryTest, HasComponent)
+TEST(MemoryResourceTests, RegistryUsesResource)
+{
+    ecs::EntityRegistry::RegisterComponentTypes<Transform, A, B>();
+    CountingResource resource;
+    {
+        EntityRegistry registry(&resource);
+        EXPECT_EQ(registry.GetMemoryResource(), &resource);
+        size_t allocationCount = resource.AllocationCount;
+        EXPECT_GT(allocationCount, 0);
+
+        for (int i = 0; i < 100; ++i)
+        {
+            EntityID entity = registry.CreateEntity();
+            registry.TryAddComponent(entity, A(i));
+            if (i % 2)
+                registry.TryAddComponent(entity, B{ std::to_string(i) });
+        }
+        EXPECT_GT(resource.AllocationCount, allocationCount);
+
+        int count = 0;
+        auto view = registry.GetView<A>();
+        for (auto& index : view)
+        {
+            auto [a] = view.Get(index);
+            count += a.Hello >= 0;
+        }
+        EXPECT_EQ(count, 100);
+    }
+    // every allocation made by the registry went back to the same resource
+    EXPECT_EQ(resource.Outstanding, 0);
+}
+
+TEST(MemoryResourceTests, BuffersAndQueuesUseResource)
+{
+    CountingResource resource;
+    {
+        CircularBuffer<EntityID> buffer(4, &resource);
+        for (EntityID i = 0; i < 100; ++i)
+            buffer.PushBack(i);
+        EXPECT_GT(resource.Outstanding, 0);
+
+        // copies use their own resource, moves take the storage with its resource
+        const size_t outstanding = resource.Outstanding;
+        CircularBuffer<EntityID> copy(buffer);
+        EXPECT_EQ(resource.Outstanding, outstanding);
+        copy = std::move(buffer);
+        EXPECT_EQ(copy.GetMemoryResource(), &resource);
+        EXPECT_EQ(copy.GetSize(), 100);
+
+        MPSCQueue<EntityID, 4> queue(&resource);
+        for (EntityID i = 0; i < 100; ++i)
+            queue.PushBack(i);
+        EXPECT_GT(resource.Outstanding, outstanding);
+        EntityID item;
+        while (queue.PopFront(item)) {}
+    }
+    EXPECT_EQ(resource.Outstanding, 0);
+}
+
+TEST(MemoryResourceTests, RegistryOnArenaAndPool)
+{
+    ecs::EntityRegistry::RegisterComponentTypes<Transform, A, B>();
+    CountingResource upstream;
+    {
+        MonotonicArena arena(1024 * 1024, &upstream);
+        PoolResource pool(64 * 1024, &arena);
+        {
+            EntityRegistry registry(1024, &pool);
+            for (int i = 0; i < 2000; ++i)
+            {
+                EntityID entity = registry.CreateEntity();
+                registry.TryAddComponent(entity, Transform());
+                registry.TryAddComponent(entity, A(i));
+                if (i % 3 == 0)
+                    registry.DeleteEntity(entity);
+            }
+            registry.Flush();
+
+            EXPECT_EQ(registry.GetEntityCount(), 1333);
+            uint32_t count = 0;
+            auto view = registry.GetView<Transform, A>();
+            for (auto& index : view)
+            {
+                auto [transform, a] = view.Get(index);
+                EXPECT_NE(a.Hello % 3, 0);
+                ++count;
+            }
+            EXPECT_EQ(count, 1333);
+        }
+        EXPECT_GT(arena.GetBytesAllocated(), 0);
+    }
+    EXPECT_EQ(upstream.Outstanding, 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// FlatHashMap Tests ///////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////
+
+// sends every key to the same slot so every operation goes through the probing and the backward shift
+struct CollidingHash
+{
+    uint64_t operator()(uint32_t key) const noexcept { return key % 3; }
+};
+
+TEST(FlatHashMapTests, InsertFindErase)
+{
+    FlatHashMap<EntitySignature, int> map;
+    EXPECT_TRUE(map.IsEmpty());
+    EXPECT_FALSE(map.Contains(EntitySignature(1)));
+    EXPECT_EQ(map.Find(EntitySignature(1)), map.end());
+    EXPECT_FALSE(map.Erase(EntitySignature(1)));
+
+    for (uint64_t i = 0; i < 100; ++i)
+        map[EntitySignature(i * 7)] = (int)i;
+    EXPECT_EQ(map.GetSize(), 100);
+    EXPECT_GE(map.GetCapacity() * 3, map.GetSize() * 4);
+
+    for (uint64_t i = 0; i < 100; ++i)
+    {
+        ASSERT_NE(map.TryGet(EntitySignature(i * 7)), nullptr);
+        EXPECT_EQ(*map.TryGet(EntitySignature(i * 7)), (int)i);
+    }
+    EXPECT_FALSE(map.Contains(EntitySignature(1)));
+
+    auto [entry, inserted] = map.TryEmplace(EntitySignature(0), 42);
+    EXPECT_FALSE(inserted);
+    EXPECT_EQ(entry.second, 0);
+
+    int sum = 0;
+    for (auto& [signature, value] : map)
+        sum += value;
+    EXPECT_EQ(sum, 99 * 100 / 2);
+
+    for (uint64_t i = 0; i < 100; i += 2)
+        EXPECT_TRUE(map.Erase(EntitySignature(i * 7)));
+    EXPECT_EQ(map.GetSize(), 50);
+    for (uint64_t i = 0; i < 100; ++i)
+        EXPECT_EQ(map.Contains(EntitySignature(i * 7)), i % 2 == 1);
+
+    map.ShrinkToFit();
+    EXPECT_LT(map.GetCapacity(), 256);
+    for (uint64_t i = 1; i < 100; i += 2)
+        EXPECT_EQ(map[EntitySignature(i * 7)], (int)i);
+
+    map.Clear();
+    EXPECT_TRUE(map.IsEmpty());
+    EXPECT_EQ(map.begin(), map.end());
+}
+
+TEST(FlatHashMapTests, MatchesUnorderedMap)
+{
+    // random inserts and erases with lots of collisions, checked against std::unordered_map
+    FlatHashMap<uint32_t, uint32_t, CollidingHash> map;
+    std::unordered_map<uint32_t, uint32_t> reference;
+    uint32_t seed = 12345;
+    auto random = [&seed]() { seed = seed * 1664525u + 1013904223u; return seed >> 8; };
+
+    for (int i = 0; i < 20000; ++i)
+    {
+        uint32_t key = random() % 300;
+        if (random() % 3 == 0)
+        {
+            EXPECT_EQ(map.Erase(key), reference.erase(key) == 1);
+        }
+        else
+        {
+            uint32_t value = random();
+            map[key] = value;
+            reference[key] = value;
+        }
+    }
+
+    ASSERT_EQ(map.GetSize(), reference.size());
+    for (uint32_t key = 0; key < 300; ++key)
+    {
+        auto it = reference.find(key);
+        const uint32_t* value = map.TryGet(key);
+        ASSERT_EQ(value != nullptr, it != reference.end());
+        if (value)
+        {
+            EXPECT_EQ(*value, it->second);
+        }
+    }
+}
+
+TEST(FlatHashMapTests, ValuesUseResource)
+{
+    CountedObject::Reset();
+    CountingResource resource;
+    {
+        FlatHashMap<uint32_t, std::pmr::vector<int>> map(&resource);
+        for (uint32_t i = 0; i < 50; ++i)
+            map[i].push_back((int)i);
+
+        // values are built with the map's resource and keep it when the table grows
+        for (uint32_t i = 0; i < 50; ++i)
+            EXPECT_EQ(map[i].get_allocator().resource(), &resource);
+
+        FlatHashMap<uint32_t, std::pmr::vector<int>> moved(std::move(map));
+        EXPECT_TRUE(map.IsEmpty());
+        EXPECT_EQ(moved.GetSize(), 50);
+        EXPECT_EQ(moved[10].front(), 10);
+
+        FlatHashMap<uint32_t, std::unique_ptr<CountedObject>> owners;
+        for (uint32_t i = 0; i < 20; ++i)
+            owners[i] = std::make_unique<CountedObject>((int)i);
+        for (uint32_t i = 0; i < 20; i += 2)
+            owners.Erase(i);
+        EXPECT_EQ(CountedObject::Alive, 10);
+        EXPECT_EQ(owners[5]->Value, 5);
+    }
+    EXPECT_EQ(CountedObject::Alive, 0);
+    EXPECT_EQ(resource.Outstanding, 0);
+}
+
+TEST(FlatHashMapTests, CopyFrom)
+{
+    CountingResource resource;
+    {
+        FlatHashMap<uint32_t, int> map(&resource);
+        for (uint32_t i = 0; i < 100; ++i)
+            map[i * 3] = (int)i;
+        map.Erase(3);
+
+        FlatHashMap<uint32_t, int> copy(&resource);
+        copy[1000] = 1;
+        copy.CopyFrom(map);
+        EXPECT_EQ(copy.GetSize(), map.GetSize());
+        EXPECT_EQ(copy.GetCapacity(), map.GetCapacity());
+        EXPECT_FALSE(copy.Contains(1000));
+        EXPECT_FALSE(copy.Contains(3));
+        for (uint32_t i = 2; i < 100; ++i)
+            EXPECT_EQ(copy[i * 3], (int)i);
+
+        copy[0] = -1;
+        EXPECT_EQ(map[0], 0);
+
+        FlatHashMap<uint32_t, std::pmr::string> strings(&resource);
+        for (uint32_t i = 0; i < 20; ++i)
+            strings[i] = "a string too long for the small buffer " + std::to_string(i);
+        FlatHashMap<uint32_t, std::pmr::string> stringsCopy(&resource);
+        stringsCopy.CopyFrom(strings);
+        strings.Clear();
+        EXPECT_EQ(stringsCopy[7], "a string too long for the small buffer 7");
+    }
+    EXPECT_EQ(resource.Outstanding, 0);
+}
+
+#ifdef ECS_BENCHMARKS
+template<typename Map, typename Key>
+uint64_t BenchmarkLookups(const std::string& name, Map& map, const std::vector<Key>& keys, uint32_t iterations)
+{
+    uint64_t sum = 0;
+    ScopeTimer timer(name);
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+        auto it = map.find(keys[i % keys.size()]);
+        sum += it->second;
+    }
+    return sum;
+}
+
+// adapts FlatHashMap to the std interface used above
+template<typename Key, typename Value>
+struct FlatHashMapAdapter
+{
+    FlatHashMap<Key, Value> Map;
+    auto find(const Key& key) { return Map.Find(key); }
+};
+
+TEST(FlatHashMapBenchmarks, ArchetypeLookup)
+{
+    // 5000 random signatures looked up in a scrambled order, like archetype lookups during migrations
+    std::vector<EntitySignature> keys;
+    uint64_t seed = 42;
+    for (int i = 0; i < 5000; ++i)
+    {
+        seed = MixHashBits(seed + i);
+        keys.push_back(EntitySignature(seed & 0x0000ffffffffffffull));
+    }
+    std::unordered_map<EntitySignature, uint32_t> unorderedMap;
+    FlatHashMapAdapter<EntitySignature, uint32_t> flatMap;
+    for (uint32_t i = 0; i < keys.size(); ++i)
+    {
+        unorderedMap[keys[i]] = i;
+        flatMap.Map[keys[i]] = i;
+    }
+    std::vector<EntitySignature> lookups(keys);
+    for (size_t i = 0; i < lookups.size(); ++i)
+        std::swap(lookups[i], lookups[MixHashBits(i) % lookups.size()]);
+
+    uint64_t unorderedSum = BenchmarkLookups("std::unordered_map signature lookup", unorderedMap, lookups, 20'000'000);
+    uint64_t flatSum = BenchmarkLookups("FlatHashMap signature lookup", flatMap, lookups, 20'000'000);
+    EXPECT_EQ(unorderedSum, flatSum);
+}
+
+TEST(FlatHashMapBenchmarks, ComponentLookup)
+{
+    // entity -> row -> column, what GetComponent goes through
+    ecs::EntityRegistry::RegisterComponentTypes<Transform, A, B>();
+    ecs::EntityRegistry registry(100000);
+    for (int i = 0; i < 100000; ++i)
+    {
+        EntityID entity = registry.CreateEntity();
+        registry.TryAddComponent(entity, Transform());
+        registry.TryAddComponent(entity, A(i));
+    }
+
+    uint64_t sum = 0;
+    {
+        ScopeTimer timer("GetComponent<A> on 100000 entities x 100");
+        for (int pass = 0; pass < 100; ++pass)
+        {
+            for (EntityID entity = 0; entity < 100000; ++entity)
+                sum += registry.GetComponent<A>((entity * 7919) % 100000).Hello;
+        }
+    }
+    EXPECT_EQ(sum, 100ull * 99999 * 100000 / 2);
+}
+#endif // ECS_BENCHMARKS
+
+////////////////////////////////////////////////////////////////////////////////////////
+// ComponentColumn Tests ///////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////
+
+TEST(ComponentColumnTests, GrowShrinkAndLifetime)
+{
+    CountingResource resource;
+    CountedObject::Reset();
+    {
+        ComponentColumn<CountedObject> column(&resource);
+        for (int i = 0; i < 100; ++i)
+            column.emplace_back(i);
+        EXPECT_EQ(CountedObject::Alive, 100);
+
+        // the argument lives in the column that reallocates
+        column.shrink_to_fit();
+        column.push_back(column[0]);
+        EXPECT_EQ(column.back().Value, 0);
+
+        while (column.size() > 10)
+            column.pop_back();
+        EXPECT_EQ(CountedObject::Alive, 10);
+        column.shrink_to_fit();
+        EXPECT_EQ(column.capacity(), 10);
+        for (int i = 0; i < 10; ++i)
+            EXPECT_EQ(column[i].Value, i);
+    }
+    EXPECT_EQ(CountedObject::Alive, 0);
+    EXPECT_EQ(resource.Outstanding, 0);
+}
+
+TEST(ComponentColumnTests, AdoptedMemory)
+{
+    CountingResource resource;
+    // aligned and padded like the columns' own memory
+    alignas(COLUMN_ALIGNMENT) std::array<int, MAX_BATCH_WIDTH> external = { 0, 1, 2, 3, 4, 5, 6, 7 };
+    {
+        ComponentColumn<int> column(&resource);
+        column.push_back(42);
+        column.Adopt(external.data(), 8);
+        EXPECT_TRUE(column.IsBorrowed());
+        EXPECT_EQ(resource.Outstanding, 0);
+
+        column[3] = 30;
+        EXPECT_EQ(external[3], 30);
+        column.pop_back();
+        EXPECT_TRUE(column.IsBorrowed());
+
+        // the freed slot is reused in place, growing copies the components out
+        column.push_back(70);
+        EXPECT_EQ(external[7], 70);
+        column.push_back(80);
+        EXPECT_FALSE(column.IsBorrowed());
+        column[0] = -1;
+        EXPECT_EQ(external[0], 0);
+        EXPECT_EQ(column[3], 30);
+        EXPECT_EQ(column[7], 70);
+        EXPECT_EQ(column[8], 80);
+    }
+    EXPECT_EQ(resource.Outstanding, 0);
+}
+
+TEST(ComponentColumnTests, Splice)
+{
+    CountingResource resource;
+    CountingResource otherResource;
+    CountedObject::Reset();
+    {
+        ComponentColumn<CountedObject> column(&resource);
+        ComponentColumn<CountedObject> source(&resource);
+        for (int i = 0; i < 10; ++i)
+            source.emplace_back(i);
+
+        // an empty column takes the memory over
+        const CountedObject* data = source.data();
+        column.Splice(source);
+        EXPECT_EQ(column.data(), data);
+        EXPECT_TRUE(source.empty());
+        EXPECT_EQ(CountedObject::Alive, 10);
+
+        // otherwise the components are moved to the end
+        ComponentColumn<CountedObject> foreign(&otherResource);
+        for (int i = 10; i < 15; ++i)
+            foreign.emplace_back(i);
+        column.Splice(foreign);
+        EXPECT_TRUE(foreign.empty());
+        EXPECT_EQ(column.size(), 15);
+        EXPECT_EQ(CountedObject::Alive, 15);
+        for (int i = 0; i < 15; ++i)
+            EXPECT_EQ(column[i].Value, i);
+
+        ComponentColumn<CountedObject> empty(&otherResource);
+        empty.Splice(column);
+        EXPECT_EQ(empty.size(), 15);
+        EXPECT_EQ(empty.GetMemoryResource(), &otherResource);
+    }
+    EXPECT_EQ(CountedObject::Alive, 0);
+    EXPECT_EQ(resource.Outstanding, 0);
+    EXPECT_EQ(otherResource.Outstanding, 0);
+}
+
+TEST(ComponentColumnTests, FailedRelocationRollsBack)
+{
+    CountingResource resource;
+    {
+        ComponentColumn<ThrowingCopy> column(&resource);
+        ComponentColumn<ThrowingCopy> source(&resource);
+        for (int i = 0; i < 4; ++i)
+        {
+            column.emplace_back(i);
+            source.emplace_back(10 + i);
+        }
+        size_t outstanding = resource.Outstanding;
+
+        // the move constructor can throw so the components are copied, the third copy fails
+        ThrowingCopy::CopiesBeforeThrow = 2;
+        EXPECT_THROW(column.reserve(100), std::runtime_error);
+        ThrowingCopy::CopiesBeforeThrow = 2;
+        EXPECT_THROW(column.emplace_back(4), std::runtime_error);
+        EXPECT_EQ(resource.Outstanding, outstanding);
+
+        // fails while appending, not while growing
+        ThrowingCopy::CopiesBeforeThrow = -1;
+        column.reserve(16);
+        outstanding = resource.Outstanding;
+        ThrowingCopy::CopiesBeforeThrow = 2;
+        EXPECT_THROW(column.Splice(source), std::runtime_error);
+        ThrowingCopy::CopiesBeforeThrow = -1;
+
+        EXPECT_EQ(ThrowingCopy::Alive, 8);
+        EXPECT_EQ(resource.Outstanding, outstanding);
+        ASSERT_EQ(column.size(), 4);
+        ASSERT_EQ(source.size(), 4);
+        for (int i = 0; i < 4; ++i)
+        {
+            EXPECT_EQ(column[i].Value, i);
+            EXPECT_EQ(source[i].Value, 10 + i);
+        }
+    }
+    EXPECT_EQ(ThrowingCopy::Alive, 0);
+    EXPECT_EQ(resource.Outstanding, 0);
+}
+
+TEST(ComponentColumnTests, SharedColumns)
+{
+    CountingResource resource;
+    CountedObject::Reset();
+    {
+        ComponentColumn<CountedObject> column(&resource);
+        for (int i = 0; i < 10; ++i)
+            column.emplace_back(i);
+        const size_t outstanding = resource.Outstanding;
+
+        ComponentColumn<CountedObject> first(&resource);
+        ComponentColumn<CountedObject> second(&resource);
+        first.ShareFrom(column);
+        second.ShareFrom(first);
+        EXPECT_TRUE(column.IsShared() && first.IsShared() && second.IsShared());
+        EXPECT_EQ(first.data(), column.data());
+        EXPECT_EQ(CountedObject::Alive, 10);
+
+        // the first one to be modified copies the components, the others keep sharing them
+        first.push_back(CountedObject(10));
+        EXPECT_FALSE(first.IsShared());
+        EXPECT_NE(first.data(), column.data());
+        EXPECT_EQ(CountedObject::Alive, 21);
+        EXPECT_EQ(first.size(), 11);
+        EXPECT_EQ(column.size(), 10);
+        EXPECT_EQ(second[3].Value, 3);
+
+        // once alone, a column takes the components back without copying them
+        second.clear();
+        EXPECT_TRUE(second.empty());
+        const CountedObject* data = column.data();
+        column.MakeUnique();
+        EXPECT_FALSE(column.IsShared());
+        EXPECT_EQ(column.data(), data);
+        EXPECT_GT(resource.Outstanding, outstanding);
+    }
+    EXPECT_EQ(CountedObject::Alive, 0);
+    EXPECT_EQ(resource.Outstanding, 0);
+}
+
+TEST(ComponentColumnTests, AlignedColumns)
+{
+    CountingResource resource;
+    {
+        ComponentColumn<vec3> column(&resource);
+        for (int i = 0; i < 100; ++i)
+        {
+            column.push_back(vec3{ (float)i, 0, 0 });
+            EXPECT_EQ(reinterpret_cast<uintptr_t>(column.data()) % COLUMN_ALIGNMENT, 0);
+            EXPECT_EQ(resource.Outstanding % COLUMN_ALIGNMENT, 0);
+        }
+        // 5 vec3 are padded to a whole batch of MAX_BATCH_WIDTH rows, 768 bytes
+        while (column.size() > 5)
+            column.pop_back();
+        column.shrink_to_fit();
+        EXPECT_EQ(column.capacity(), 5);
+        EXPECT_EQ(resource.Outstanding, sizeof(vec3) * MAX_BATCH_WIDTH);
+        EXPECT_EQ(ComponentColumn<vec3>::GetAllocationSize(5), sizeof(vec3) * MAX_BATCH_WIDTH);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(column.data()) % COLUMN_ALIGNMENT, 0);
+    }
+    EXPECT_EQ(resource.Outstanding, 0);
+}
+
+TEST(SimdTests, SimdFloat)
+{
+    alignas(64) float values[16] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 };
+    SimdFloat<8> a = SimdFloat<8>::Load(values);
+    SimdFloat<8> b = SimdFloat<8>::Load(values + 8);
+    SimdFloat<8> sum = MulAdd(a, SimdFloat<8>(2.0f), b);
+    for (uint32_t i = 0; i < 8; ++i)
+    {
+        EXPECT_EQ(sum[i], values[i] * 2 + values[i + 8]);
+        EXPECT_EQ(Min(a, b)[i], values[i]);
+        EXPECT_EQ(Max(a, b)[i], values[i + 8]);
+    }
+    (b - a).Store(values);
+    EXPECT_EQ(values[7], 8.0f);
+    (a / SimdFloat<8>(2.0f)).StoreMasked(values, 0b101);
+    EXPECT_EQ(values[0], 0.5f);
+    EXPECT_EQ(values[1], 8.0f);
+    EXPECT_EQ(values[2], 1.5f);
+
+    // the kernel runs for one of the levels, the one the CPU has
+    const SimdLevel level = DispatchSimd([](auto level) { return level.value; });
+    EXPECT_EQ(level, GetSimdLevel());
+    const uint32_t width = DispatchSimd([](auto level)
+    {
+        SimdFloat<GetSimdFloatCount(level)> ones(1.0f);
+        float total = 0;
+        for (uint32_t i = 0; i < GetSimdFloatCount(level); ++i)
+            total += ones[i];
+        return (uint32_t)total;
+    });
+    EXPECT_EQ(width, GetSimdFloatCount(GetSimdLevel()));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Archetype Tests /////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////
+
+class ArchetypeTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        archetype = new ecs::Archetype();
+    }
+
+    void TearDown() override
+    {
+        delete archetype;
+    }
+
+    ecs::Archetype* archetype{nullptr};
+};
+
+TEST_F(ArchetypeTest, AddEntityTest)
+{
+    EntityID e1 = 1;
+    archetype->AddEntity(e1);
+
+    const auto& entities = archetype->GetEntities();
+    ASSERT_EQ(entities.size(), 1);
+    EXPECT_EQ(entities[0], e1);
+}
+
+TEST_F(ArchetypeTest, RemoveEntityTest)
+{
+    EntityID e1 = 1;
+    EntityID e2 = 2;
+    EntityID e3 = 3;
+
+    archetype->AddEntity(e1);
+    archetype->AddEntity(e2);
+    archetype->AddEntity(e3);
+    archetype->RemoveEntity(e2);
+
+    const auto& entities = archetype->GetEntities();
+    ASSERT_EQ(entities.size(), 2);
+    EXPECT_EQ(entities[0], e1);
+    EXPECT_NE(entities[1], e2);
+    EXPECT_EQ(entities[1], e3);
+    archetype->AddEntity(e2);
+    ASSERT_EQ(entities.size(), 3);
+    EXPECT_EQ(entities[2], e2);
+    archetype->RemoveEntity(e1);
+    ASSERT_EQ(entities.size(), 2);
+    EXPECT_NE(entities[0], e1);
+    EXPECT_EQ(entities[0], e2);
+
+    EXPECT_FALSE(archetype->HasEntity(e1));
+    EXPECT_TRUE(archetype->HasEntity(e2));
+    EXPECT_TRUE(archetype->HasEntity(e3));
+}
+
+TEST_F(ArchetypeTest, CreateAndAddComponentTest)
+{
+    EntityID e1 = 1;
+    archetype->CreateComponentStorages<Transform, A>();
+
+    archetype->AddEntity(e1);
+    archetype->AddComponents<Transform, A>(e1, Transform({ 1, 2, 3 }, { 4, 5, 6 }, { 7, 8, 9 }), A(42));
+
+    auto& transformStorage = archetype->GetComponentStorage<Transform>();
+    auto& aStorage = archetype->GetComponentStorage<A>();
+
+    ASSERT_EQ(transformStorage.Components.size(), 1);
+    ASSERT_EQ(aStorage.Components.size(), 1);
+
+    EXPECT_EQ(transformStorage.Components[0], Transform({ 1, 2, 3 }, { 4, 5, 6 }, { 7, 8, 9 }));
+    EXPECT_EQ(aStorage.Components[0], A(42));
+}
+
+TEST_F(ArchetypeTest, RemoveComponentTest)
+{
+    EntityID e1 = 1;
+    archetype->CreateComponentStorages<Transform, A>();
+
+    archetype->AddEntity(e1);
+    archetype->AddComponents<Transform, A>(e1, Transform({ 1, 2, 3 }, { 4, 5, 6 }, { 7, 8, 9 }), A(42));
+
+    archetype->RemoveComponent<Transform>(e1);
+
+    auto& aStorage = archetype->GetComponentStorage<A>();
+    ASSERT_EQ(aStorage.Components.size(), 1);
+    EXPECT_EQ(aStorage.Components[0], A(42));
+}
+
+TEST_F(ArchetypeTest, RemoveAllComponentsTest)
+{
+    EntityID e1 = 1;
+    EntityID e2 = 2;
+    EntityID e3 = 3;
+
+    archetype->CreateComponentStorages<Transform, A, B>();
+
+    archetype->AddEntity(e1);
+    archetype->AddEntity(e2);
+    archetype->AddEntity(e3);
+
+    archetype->AddComponents<Transform, A, B>(e1, Transform({ 1, 1, 1 }, { 0, 0, 0 }, { 1, 1, 1 }), A(10), B{ "Entity1" });
+    archetype->AddComponents<Transform, A, B>(e2, Transform({ 2, 2, 2 }, { 0, 0, 0 }, { 1, 1, 1 }), A(20), B{ "Entity2" });
+    archetype->AddComponents<Transform, A, B>(e3, Transform({ 3, 3, 3 }, { 0, 0, 0 }, { 1, 1, 1 }), A(30), B{ "Entity3" });
+
+    // Remove components for the second entity (e2)
+    archetype->RemoveComponents<Transform, A, B>(e2);
+
+    auto& transformStorage = archetype->GetComponentStorage<Transform>();
+    auto& aStorage = archetype->GetComponentStorage<A>();
+    auto& bStorage = archetype->GetComponentStorage<B>();
+
+    ASSERT_EQ(transformStorage.Components.size(), 2);
+    ASSERT_EQ(aStorage.Components.size(), 2);
+    ASSERT_EQ(bStorage.Components.size(), 2);
+
+    EXPECT_EQ(transformStorage.Components[0], Transform({ 1, 1, 1 }, { 0, 0, 0 }, { 1, 1, 1 }));
+    EXPECT_EQ(transformStorage.Components[1], Transform({ 3, 3, 3 }, { 0, 0, 0 }, { 1, 1, 1 }));
+
+    EXPECT_EQ(aStorage.Components[0], A(10));
+    EXPECT_EQ(aStorage.Components[1], A(30));
+
+    EXPECT_EQ(bStorage.Components[0], B{ "Entity1" });
+    EXPECT_EQ(bStorage.Components[1], B{ "Entity3" });
+}
+
+TEST_F(ArchetypeTest, HandleInvalidEntityRemoval)
+{
+    EntityID invalidEntity = 999;
+
+    // Ensure no crash occurs when removing a non-existent entity
+    EXPECT_NO_THROW(archetype->RemoveEntity(invalidEntity));
+}
+
+TEST_F(ArchetypeTest, HandleInvalidComponentRemoval)
+{
+    EntityID e1 = 1;
+    archetype->CreateComponentStorages<Transform>();
+    archetype->AddEntity(e1);
+    archetype->AddComponents<Transform>(e1, Transform({ 1, 2, 3 }, { 4, 5, 6 }, { 7, 8, 9 }));
+
+    // Ensure no crash occurs when removing a component that doesn't exist
+    EXPECT_NO_THROW(archetype->RemoveComponent<A>(e1));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// EntityRegistry Tests ////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////
+class EntityRegistryTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        ecs::EntityRegistry::RegisterComponentTypes<Transform, A, B>();
+    }
+};
+
+TEST_F(EntityRegistryTest, CreateEntity)
+{
+    using namespace ecs;
+    ecs::EntityRegistry registry;
+
+    EntityID entity0 = registry.CreateEntity();
+    EntityID entity1 = registry.CreateEntity();
+    EntityID entity2 = registry.CreateEntity();
+
+    EXPECT_EQ(entity0, 0);
+    EXPECT_EQ(entity1, 1);
+    EXPECT_EQ(entity2, 2);
+}
+
+// Unit test to check if all the functions in the EntityRegistry class work as intended
+TEST_F(EntityRegistryTest, GetComponent)
+{
+    using namespace ecs;
+    ecs::EntityRegistry registry;
+
+    Transform transform;
+    A a;
+    B b;
+    EntityID entity0 = registry.CreateEntity();
+    EntityID entity1 = registry.CreateEntity();
+    EntityID entity2 = registry.CreateEntity();
+    registry.TryAddComponent(entity0, transform);
+    registry.TryAddComponent(entity1, a);
+    registry.TryAddComponent(entity2, b);
+    EXPECT_EQ(registry.GetComponent<Transform>(entity0), transform);
+    EXPECT_EQ(registry.GetComponent<A>(entity1), a);
+    EXPECT_EQ(registry.GetComponent<B>(entity2), b);
+}
+
+TEST_F(EntityRegistryTest, HasComponent)
+{
+    using namespace ecs;
+    ecs::EntityRegistry registry;
+
+    Transform transform;
+    A a;
+    B b;
+    EntityID entity0 = registry.CreateEntity();
+    EntityID entity1 = registry.CreateEntity();
+    EntityID entity2 = registry.CreateEntity();
+    registry.TryAddComponent(entity0, transform);
+    registry.TryAddComponent(entity1, a);
+    registry.EmplaceComponent<B>(entity2);
+    EXPECT_TRUE(registry.HasComponent<Transform>(entity0));
+    EXPECT_TRUE(registry.HasComponent<A>(entity1));
+    EXPECT_TRUE(registry.HasComponent<B>(entity2));
+}
+
+TEST_F(EntityRegistryTest, DeleteComponent)
+{        
+    using namespace ecs;
+    ecs::EntityRegistry registry;
+
+    Transform transform;
+    A a;
+    B b;
+    EntityID entity0 = registry.CreateEntity();
+    EntityID entity1 = registry.CreateEntity();
+    EntityID entity2 = registry.CreateEntity();
+    registry.TryAddComponent(entity0, transform);
+    registry.TryAddComponent(entity1, a);
+    registry.TryAddComponent(entity2, b);
+    registry.TryAddComponent(entity0, a);
+    registry.TryAddComponent(entity1, b);
+    registry.TryAddComponent(entity2, transform);
+    EXPECT_TRUE(registry.HasComponent<Transform>(entity0));
+    EXPECT_TRUE(registry.HasComponent<A>(entity1));
+    EXPECT_TRUE(registry.HasComponent<B>(entity2));
+    bool r = registry.HasComponents<Transform, B>(entity2);
+    EXPECT_TRUE(r);
+    registry.DeleteComponent<Transform>(entity0);
+    registry.DeleteComponent<A>(entity1);
+    registry.DeleteComponent<B>(entity2);
+    EXPECT_TRUE(registry.HasComponent<Transform>(entity0)); 
+    EXPECT_TRUE(registry.HasComponent<A>(entity1)); 
+    EXPECT_TRUE(registry.HasComponent<B>(entity2)); 
+    registry.Flush();
+    EXPECT_FALSE(registry.HasComponent<Transform>(entity0));
+    EXPECT_FALSE(registry.HasComponent<A>(entity1));
+    EXPECT_FALSE(registry.HasComponent<B>(entity2));
+}
+
+TEST_F(EntityRegistryTest, DeleteEntity)
+{
+    using namespace ecs;
+    ecs::EntityRegistry registry;
+
+    Transform transform;
+    A a;
+    B b;
+    EntityID entity0 = registry.CreateEntity();
+    registry.TryAddComponent(entity0, transform);
+    registry.TryAddComponent(entity0, b);
+    EXPECT_TRUE(registry.HasComponent<Transform>(entity0));
+    EXPECT_TRUE(registry.HasComponent<B>(entity0));
+    registry.DeleteEntity(entity0);
+    EXPECT_TRUE(registry.HasComponent<Transform>(entity0));
+    EXPECT_TRUE(registry.HasComponent<B>(entity0));
+    registry.Flush();
+    EXPECT_FALSE(registry.HasComponent<Transform>(entity0));
+    EXPECT_FALSE(registry.HasComponent<B>(entity0));
+    registry.DeleteEntity(entity0);
+    registry.Flush();
+}
+
+TEST_F(EntityRegistryTest, EntityStressTest)
 {
     using namespace ecs;
     ecs::EntityRegistry registry;
+    {
+        SCOPED_TRACE("Create entities");
+        for (int i = 0; i < 8192; i++)
+        {
+            try
+            {
+                EntityID entity = registry.CreateEntity();
+                Transform transform{{(float)-i, (float)i, (float)i * 10}, {0, 0, 0}, {1, 1, 1}};
+                A a{i};
+                B b{"Entity" + std::to_string(i)};
+                registry.TryAddComponent(entity, transform);
+                registry.TryAddComponent(entity, a);
+                registry.TryAddComponent(entity, b);
+                bool r = registry.HasComponents<Transform, A, B>(entity);
+                EXPECT_TRUE(r);
+            }
+            catch (const std::exception& e)
+            {
+                FAIL() << e.what();
+                break;
+            }
+        }
+    }
+    {
+        SCOPED_TRACE("Delete Components");
+        for (EntityID entity = 100; entity < 420; entity++)
+        {
+            registry.DeleteComponent<Transform>(entity);
+        }
+        for (EntityID entity = 420; entity < 1000; entity++)
+        {
+            registry.DeleteComponent<A>(entity);
+        }
+        for (EntityID entity = 1000; entity < 1400; entity++)
+        {
+            registry.DeleteComponent<B>(entity);
+        }
+        for (EntityID entity = 1400; entity < 1800; entity++)
+        {
+            registry.DeleteComponent<Transform>(entity);
+            registry.DeleteComponent<B>(entity);
+        }
+        {
+            SCOPED_TRACE("Flush");
+            registry.Flush();
+        }
+        for (EntityID entity = 100; entity < 420; entity++)
+        {
+            EXPECT_FALSE(registry.HasComponent<Transform>(entity));
+            EXPECT_TRUE(registry.HasComponent<A>(entity));
+            EXPECT_TRUE(registry.HasComponent<B>(entity));
+        }
+        for (EntityID entity = 420; entity < 1000; entity++)
+        {
+            EXPECT_FALSE(registry.HasComponent<A>(entity));
+            EXPECT_TRUE(registry.HasComponent<B>(entity));
+            EXPECT_TRUE(registry.HasComponent<Transform>(entity));
+        }
+        for (EntityID entity = 1000; entity < 1400; entity++)
+        {
+            EXPECT_FALSE(registry.HasComponent<B>(entity));
+            EXPECT_TRUE(registry.HasComponent<A>(entity));
+            EXPECT_TRUE(registry.HasComponent<Transform>(entity));
+        }
+        for (EntityID entity = 1400; entity < 1800; entity++)
+        {
+            EXPECT_FALSE(registry.HasComponent<Transform>(entity));
+            EXPECT_FALSE(registry.HasComponent<B>(entity));
+            EXPECT_TRUE(registry.HasComponent<A>(entity));
+        }
+    }
+    {
+        SCOPED_TRACE("Delete Entities");
+        for (int i = 696; i < 756; i++)
+        {
+            registry.DeleteEntity(i);    
+        }
+        for (int i = 1800; i < 2120; i++)
+        {
+            registry.DeleteEntity(i);
+        }
+        {
+            SCOPED_TRACE("Flush");
+            registry.Flush();
+        }
+        for (int i = 696; i < 756; i++)
+        {
+            EXPECT_FALSE(registry.IsEntityValid(i));  
+        }
+        for (int i = 1800; i < 2120; i++)
+        {
+            EXPECT_FALSE(registry.IsEntityValid(i));
+        }
+    }
+    {
+        SCOPED_TRACE("Verify Component Values");
+        ScopeTimer timer("Verify Component Values");
+        for (EntityID entity = 0; entity < 8192; entity++)
+        {
+            if (entity >= 100 && entity < 420)
+            {
+                EXPECT_FALSE(registry.HasComponent<Transform>(entity));
+                EXPECT_TRUE(registry.HasComponent<A>(entity));
+                EXPECT_TRUE(registry.HasComponent<B>(entity));
+                EXPECT_EQ(registry.GetComponent<A>(entity).Hello, A{(int)entity}.Hello);
+                EXPECT_EQ(registry.GetComponent<B>(entity).s, B{"Entity" + std::to_string(entity)}.s);
+            }
+            else if (entity >= 420 && entity < 1000)
+            {
+                if (entity >= 696 && entity < 756)
+                {
+                    EXPECT_FALSE(registry.IsEntityValid(entity));
+                    continue;
+                }
+                EXPECT_FALSE(registry.HasComponent<A>(entity));
+                EXPECT_TRUE(registry.HasComponent<B>(entity));
+                EXPECT_TRUE(registry.HasComponent<Transform>(entity));
+                EXPECT_EQ(registry.GetComponent<B>(entity).s, B{"Entity" + std::to_string(entity)}.s);
+                auto t = Transform{{(float)-(int)entity, (float)entity, (float)entity * 10}, {0, 0, 0}, {1, 1, 1}};
+                EXPECT_EQ(registry.GetComponent<Transform>(entity).Position, t.Position);
+            }
+            else if (entity >= 1000 && entity < 1400)
+            {
+                EXPECT_FALSE(registry.HasComponent<B>(entity));
+                EXPECT_TRUE(registry.HasComponent<A>(entity));
+                EXPECT_TRUE(registry.HasComponent<Transform>(entity));
+                EXPECT_EQ(registry.GetComponent<A>(entity).Hello, A{(int)entity}.Hello);
+                auto t = Transform{{(float)-(int)entity, (float)entity, (float)entity * 10}, {0, 0, 0}, {1, 1, 1}};
+                EXPECT_EQ(registry.GetComponent<Transform>(entity).Position, t.Position);
+            }
+            else if (entity >= 1400 && entity < 1800)
+            {
+                EXPECT_FALSE(registry.HasComponent<Transform>(entity));
+                EXPECT_FALSE(registry.HasComponent<B>(entity));
+                EXPECT_TRUE(registry.HasComponent<A>(entity));
+                EXPECT_EQ(registry.GetComponent<A>(entity).Hello, A{(int)entity}.Hello);
+            }
+            else if (entity >= 1800 && entity < 2120)
+            {
+                EXPECT_FALSE(registry.IsEntityValid(entity));
+            }
+            else
+            {
+                EXPECT_TRUE(registry.HasComponent<Transform>(entity));
+                EXPECT_TRUE(registry.HasComponent<A>(entity));
+                EXPECT_TRUE(registry.HasComponent<B>(entity));
+            }
+        }
+    }
+}
+
+TEST_F(EntityRegistryTest, AddAndVerifyComponents)
+{
+    ecs::EntityRegistry registry;
+
+    EntityID entity0 = registry.CreateEntity();
+    Transform transform{ {1.0f, 2.0f, 3.0f}, {0,0,0}, {1,1,1} };
+    A a{ 42 };
+
+    registry.TryAddComponent(entity0, transform);
+    registry.TryAddComponent(entity0, a);
+    EXPECT_EQ(registry.GetComponent<Transform>(entity0).Position, transform.Position);
+    EXPECT_EQ(registry.GetComponent<A>(entity0).Hello, a.Hello);
+}
+
+TEST_F(EntityRegistryTest, DeleteComponentsPreservesOtherComponents)
+{
+    ecs::EntityRegistry registry;
+
+    EntityID entity0 = registry.CreateEntity();
+    Transform transform{ {1.0f, 2.0f, 3.0f}, {0,0,0}, {1,1,1} };
+    A a{ 42 };
+
+    registry.TryAddComponent(entity0, transform);
+    registry.TryAddComponent(entity0, a);
+
+    registry.DeleteComponent<Transform>(entity0);
+    registry.Flush();
+
+    EXPECT_FALSE(registry.HasComponent<Transform>(entity0));
+    EXPECT_TRUE(registry.HasComponent<A>(entity0));
+    EXPECT_EQ(registry.GetComponent<A>(entity0).Hello, a.Hello);
+}
+
+TEST_F(EntityRegistryTest, DeleteEntityCleansUpComponents)
+{
+    ecs::EntityRegistry registry;
+    EntityID entity0 = registry.CreateEntity();
+    EXPECT_TRUE(registry.IsEntityValid(entity0));
+    Transform transform{ {1.0f, 2.0f, 3.0f}, {0,0,0}, {1,1,1} };
+    A a{ 42 };
+
+    registry.TryAddComponent(entity0, transform);
+    registry.TryAddComponent(entity0, a);
+
+    registry.DeleteEntity(entity0);
+    registry.Flush();
+
+    EXPECT_FALSE(registry.IsEntityValid(entity0));
+    EXPECT_FALSE(registry.HasComponent<Transform>(entity0));
+    EXPECT_FALSE(registry.HasComponent<A>(entity0));
+}
+
+TEST_F(EntityRegistryTest, MultipleEntitiesWithSameSignature) {
+    ecs::EntityRegistry registry;
+    Transform t1{ {1.0f, 2.0f, 3.0f}, {0,0,0}, {1,1,1} };
+    Transform t2{ {4.0f, 5.0f, 6.0f}, {0,0,0}, {1,1,1} };
+    Transform t3{ {7.0f, 8.0f, 9.0f}, {0,0,0}, {1,1,1} };
+    Transform t4{ {10.0f, 11.0f, 12.0f}, {0,0,0}, {1,1,1} };
+    Transform t5{ {13.0f, 14.0f, 15.0f}, {0,0,0}, {1,1,1} };
+    A a1{ 42 };
+    A a2{ 84 };
+    A a3{ 126 };
+    A a4{ 168 };
+    A a5{ 210 };
+
+    EntityID entity0 = registry.CreateEntity();
+    EntityID entity1 = registry.CreateEntity();
+    EntityID entity2 = registry.CreateEntity();
+    EntityID entity3 = registry.CreateEntity();
+    EntityID entity4 = registry.CreateEntity();
+
+    registry.TryAddComponent(entity0, t1);
+    registry.TryAddComponent(entity0, a1);
+    registry.TryAddComponent(entity1, t2);
+    registry.TryAddComponent(entity1, a2);
+    registry.TryAddComponent(entity2, t3);
+    registry.TryAddComponent(entity2, a3);
+    registry.TryAddComponent(entity3, t4);
+    registry.TryAddComponent(entity3, a4);
+    registry.TryAddComponent(entity4, t5);
+    registry.TryAddComponent(entity4, a5);
+
+    EXPECT_EQ(registry.GetComponent<Transform>(entity0).Position, t1.Position);
+    EXPECT_EQ(registry.GetComponent<A>(entity0).Hello, a1.Hello);
+
+    EXPECT_EQ(registry.GetComponent<Transform>(entity1).Position, t2.Position);
+    EXPECT_EQ(registry.GetComponent<A>(entity1).Hello, a2.Hello);
+
+    EXPECT_EQ(registry.GetComponent<Transform>(entity2).Position, t3.Position);
+    EXPECT_EQ(registry.GetComponent<A>(entity2).Hello, a3.Hello);
+
+    EXPECT_EQ(registry.GetComponent<Transform>(entity3).Position, t4.Position);
+    EXPECT_EQ(registry.GetComponent<A>(entity3).Hello, a4.Hello);
+
+    EXPECT_EQ(registry.GetComponent<Transform>(entity4).Position, t5.Position);
+    EXPECT_EQ(registry.GetComponent<A>(entity4).Hello, a5.Hello);
+
+    registry.DeleteComponent<Transform>(entity0);
+    registry.Flush();
+
+    EXPECT_FALSE(registry.HasComponent<Transform>(entity0));
+    EXPECT_EQ(registry.GetComponent<A>(entity0).Hello, a1.Hello);
+
+    EXPECT_EQ(registry.GetComponent<Transform>(entity1).Position, t2.Position);
+    EXPECT_EQ(registry.GetComponent<A>(entity1).Hello, a2.Hello);
+
+    EXPECT_EQ(registry.GetComponent<Transform>(entity2).Position, t3.Position);
+    EXPECT_EQ(registry.GetComponent<A>(entity2).Hello, a3.Hello);
+
+    EXPECT_EQ(registry.GetComponent<Transform>(entity3).Position, t4.Position);
+    EXPECT_EQ(registry.GetComponent<A>(entity3).Hello, a4.Hello);
+
+    EXPECT_EQ(registry.GetComponent<Transform>(entity4).Position, t5.Position);
+    EXPECT_EQ(registry.GetComponent<A>(entity4).Hello, a5.Hello);
+}
+
+TEST_F(EntityRegistryTest, MigrateEntityBetweenArchetypes) {
+    ecs::EntityRegistry registry;
+    Transform t{ {1.0f, 2.0f, 3.0f}, {0,0,0}, {1,1,1} };
+    A a{ 42 };
+    B b{ "SD" };
+
+    EntityID entity = registry.CreateEntity();
+
+    registry.TryAddComponent(entity, t);
+    registry.TryAddComponent(entity, a);
+
+    EXPECT_EQ(registry.GetComponent<Transform>(entity).Position, t.Position);
+    EXPECT_EQ(registry.GetComponent<A>(entity).Hello, a.Hello);
+
+    registry.TryAddComponent(entity, b);
+
+    EXPECT_EQ(registry.GetComponent<B>(entity).s, b.s);
+
+    registry.DeleteComponent<A>(entity);
+    registry.Flush();
+
+    EXPECT_FALSE(registry.HasComponent<A>(entity));
+    EXPECT_EQ(registry.GetComponent<Transform>(entity).Position, t.Position);
+    EXPECT_EQ(registry.GetComponent<B>(entity).s, b.s);
+}
+
+TEST_F(EntityRegistryTest, VerifyStateAfterComplexOperations) {
+    ecs::EntityRegistry registry;
+    Transform t1{ {1.0f, 2.0f, 3.0f}, {0,0,0}, {1,1,1}  };
+    Transform t2{ {4.0f, 5.0f, 6.0f}, {0,0,0}, {1,1,1}  };
+    Transform t3{ {7.0f, 8.0f, 9.0f}, {0,0,0}, {1,1,1}  };
+    Transform t4{ {10.0f, 11.0f, 12.0f}, {0,0,0}, {1,1,1}  };
+    Transform t5{ {13.0f, 14.0f, 15.0f}, {0,0,0}, {1,1,1}  };
+    A a1{ 42 };
+    A a2{ 84 };
+    A a3{ 126 };
+    A a4{ 168 };
+    A a5{ 210 };
+    B b1{ "S1" };
+    B b2{ "S2" };
+
+    EntityID entity0 = registry.CreateEntity();
+    EntityID entity1 = registry.CreateEntity();
+    EntityID entity2 = registry.CreateEntity();
+    EntityID entity3 = registry.CreateEntity();
+    EntityID entity4 = registry.CreateEntity();
+
+    registry.TryAddComponent(entity0, t1);
+    registry.TryAddComponent(entity0, a1);
+    registry.TryAddComponent(entity1, t2);
+    registry.TryAddComponent(entity1, b1);
+    registry.TryAddComponent(entity2, t3);
+    registry.TryAddComponent(entity2, a2);
+    registry.TryAddComponent(entity3, t4);
+    registry.TryAddComponent(entity3, b2);
+    registry.TryAddComponent(entity4, t5);
+    registry.TryAddComponent(entity4, a3);
+
+    registry.DeleteComponent<Transform>(entity0);
+    registry.DeleteEntity(entity1);
+
+    registry.Flush();
+
+    EXPECT_FALSE(registry.IsEntityValid(entity1));
+    EXPECT_FALSE(registry.HasComponent<Transform>(entity0));
+    EXPECT_TRUE(registry.HasComponent<A>(entity0));
+    EXPECT_EQ(registry.GetComponent<A>(entity0).Hello, a1.Hello);
+
+    EXPECT_FALSE(registry.HasComponent<Transform>(entity1));
+    EXPECT_FALSE(registry.HasComponent<B>(entity1));
+
+    EXPECT_EQ(registry.GetComponent<Transform>(entity2).Position, t3.Position);
+    EXPECT_EQ(registry.GetComponent<A>(entity2).Hello, a2.Hello);
+
+    EXPECT_EQ(registry.GetComponent<Transform>(entity3).Position, t4.Position);
+    EXPECT_EQ(registry.GetComponent<B>(entity3).s, b2.s);
+
+    EXPECT_EQ(registry.GetComponent<Transform>(entity4).Position, t5.Position);
+    EXPECT_EQ(registry.GetComponent<A>(entity4).Hello, a3.Hello);
+}
+
+TEST_F(EntityRegistryTest, ComponentViewTest)
+{
+    ecs::EntityRegistry registry;
+    Transform t[5];
+    t[0] = { {1.0f, 2.0f, 3.0f}, {0,0,0}, {1,1,1}  };
+    t[1] = { {4.0f, 5.0f, 6.0f}, {0,0,0}, {1,1,1}  };
+    t[2] = { {7.0f, 8.0f, 9.0f}, {0,0,0}, {1,1,1}  };
+    t[3] = { {10.0f, 11.0f, 12.0f}, {0,0,0}, {1,1,1}  };
+    t[4] = { {13.0f, 14.0f, 15.0f}, {0,0,0}, {1,1,1}  };
+    A a1{ 42 };
+    A a2{ 84 };
+    A a3{ 126 };
+    B b1{ "S1" };
+    B b2{ "S2" };
+
+    EntityID entity0 = registry.CreateEntity();
+    EntityID entity1 = registry.CreateEntity();
+    EntityID entity2 = registry.CreateEntity();
+    EntityID entity3 = registry.CreateEntity();
+    EntityID entity4 = registry.CreateEntity();
+
+    registry.TryAddComponent(entity0, t[0]);
+    registry.TryAddComponent(entity0, a1);
+    registry.TryAddComponent(entity1, t[1]);
+    registry.TryAddComponent(entity1, b1);
+    registry.TryAddComponent(entity2, t[2]);
+    registry.TryAddComponent(entity2, a2);
+    registry.TryAddComponent(entity3, t[3]);
+    registry.TryAddComponent(entity3, b2);
+    registry.TryAddComponent(entity4, t[4]);
+    registry.TryAddComponent(entity4, a3);
+
+    auto view = registry.GetView<Transform>();
+    for (auto index : view)
+    {
+        auto[transform] = view.Get(index);
+        EXPECT_EQ(transform.Position, t[index.Entity].Position);
+    }
+}
+
+// the bits of mask, one per row of rowScalars scalars, spread over the width scalars starting at scalar first of the batch
+static uint64_t GetScalarMask(uint64_t mask, uint32_t first, uint32_t width, uint32_t rowScalars)
+{
+    uint64_t scalarMask = 0;
+    for (uint32_t i = 0; i < width; ++i)
+        scalarMask |= ((mask >> ((first + i) / rowScalars)) & 1) << i;
+    return scalarMask;
+}
+
+TEST_F(EntityRegistryTest, ComponentViewBatches)
+{
+    ecs::EntityRegistry::RegisterComponentTypes<Position, Velocity>();
+    ecs::EntityRegistry registry;
+    constexpr uint32_t entityCount = 21;
+    for (uint32_t i = 0; i < entityCount; ++i)
+    {
+        EntityID entity = registry.CreateEntity();
+        registry.TryAddComponent(entity, Position{ { (float)i, 0, 0 } });
+        registry.TryAddComponent(entity, Velocity{ { 1, 2, 3 } });
+        // a second archetype, with a batch of its own
+        if (i % 4 == 0)
+            registry.TryAddComponent(entity, A((int)i));
+    }
+    registry.SetEnabled(5, false);
+    registry.DeleteEntity(6);
 
-    Transform transform;
-    A a;
-    B b;
+    auto view = registry.GetView<Position, Velocity>();
+    uint32_t visited = 0;
+    uint32_t fullBatches = 0;
+    view.EachBatch<4>([&](Batch<Position, 4> positions, Batch<Velocity, 4> velocities, uint64_t mask)
+    {
+        // the whole batch is loaded even past the last row, only the rows of the mask are written
+        float* p = positions.GetScalars<float>();
+        const float* v = velocities.GetScalars<float>();
+        for (uint32_t i = 0; i < Batch<Position, 4>::GetScalarCount<float>(); i += 4)
+        {
+            const SimdFloat<4> sum = SimdFloat<4>::Load(p + i) + SimdFloat<4>::Load(v + i);
+            if (mask == 0b1111)
+                sum.Store(p + i);
+            else
+                sum.StoreMasked(p + i, GetScalarMask(mask, i, 4, 3));
+        }
+        fullBatches += mask == 0b1111;
+        visited += (uint32_t)std::popcount(mask);
+    });
+    EXPECT_EQ(visited, entityCount - 2);
+    EXPECT_GT(fullBatches, 0);
+    for (EntityID entity = 0; entity < entityCount; ++entity)
+    {
+        const bool hidden = entity == 5 || entity == 6;
+        EXPECT_EQ(registry.GetComponent<Position>(entity).Value, (vec3{ (float)entity + (hidden ? 0 : 1), hidden ? 0.0f : 2.0f, hidden ? 0.0f : 3.0f }));
+    }
+}
+
+TEST_F(EntityRegistryTest, ComponentViewRows)
+{
+    using View = ComponentView<A>;
+    static_assert(std::forward_iterator<View::Iterator>);
+    static_assert(std::is_copy_assignable_v<View::Iterator>);
+    // the rows are stored, so their iterators are random access for the legacy algorithms too
+    static_assert(std::is_same_v<std::iterator_traits<View::RowRange::iterator>::iterator_category, std::random_access_iterator_tag>);
+    static_assert(std::ranges::contiguous_range<View::RowRange>);
+    static_assert(std::ranges::view<View::RowRange>);
+
+    ecs::EntityRegistry registry;
+    constexpr uint32_t entityCount = 200;
+    for (uint32_t i = 0; i < entityCount; ++i)
+    {
+        EntityID entity = registry.CreateEntity();
+        registry.TryAddComponent(entity, A((int)i));
+        if (i % 3 == 0)
+            registry.TryAddComponent(entity, Transform{});
+        if (i % 5 == 0)
+            registry.TryAddComponent(entity, B{ "B" });
+    }
+
+    auto view = registry.GetView<A>();
+    // iterators are regular values, post increment returns the previous position
+    View::Iterator it = view.begin();
+    View::Iterator previous = it++;
+    EXPECT_EQ(previous, view.begin());
+    previous = it;
+    EXPECT_EQ(previous, it);
+
+    auto rows = view.Rows();
+    ASSERT_EQ(rows.size(), entityCount);
+    std::vector<EntityID> ordered;
+    for (const auto& index : view)
+        ordered.push_back(index.Entity);
+    for (uint32_t i = 0; i < entityCount; ++i)
+        EXPECT_EQ(rows[i].Entity, ordered[i]);
+    EXPECT_EQ(rows.back().Entity, ordered.back());
+
+    std::for_each(std::execution::par, rows.begin(), rows.end(), [&view](const auto& index)
+    {
+        auto [a] = view.Get(index);
+        a.Hello *= 2;
+    });
+    for (EntityID entity = 0; entity < entityCount; ++entity)
+        EXPECT_EQ(registry.GetComponent<A>(entity).Hello, 2 * (int)entity);
+
+    // hidden rows are left out, the range adaptors work on the rows
+    registry.SetEnabled(10, false);
+    registry.DeleteEntity(20);
+    auto hidingView = registry.GetView<A>();
+    auto visibleRows = hidingView.Rows();
+    EXPECT_EQ(visibleRows.size(), entityCount - 2);
+    EXPECT_EQ(std::ranges::distance(visibleRows), std::distance(hidingView.begin(), hidingView.end()));
+    auto evens = visibleRows | std::views::filter([](const auto& index) { return index.Entity % 2 == 0; }) | std::views::reverse;
+    int count = 0;
+    for (const auto& index : evens)
+    {
+        EXPECT_NE(index.Entity, 10);
+        EXPECT_NE(index.Entity, 20);
+        ++count;
+    }
+    EXPECT_EQ(count, (int)entityCount / 2 - 2);
+}
+
+TEST_F(EntityRegistryTest, GatherComponents)
+{
+    ecs::EntityRegistry registry;
+    constexpr uint32_t entityCount = 100;
+    for (uint32_t i = 0; i < entityCount; ++i)
+    {
+        EntityID entity = registry.CreateEntity();
+        registry.TryAddComponent(entity, A((int)i));
+        if (i % 2 == 0)
+            registry.TryAddComponent(entity, Transform{ { (float)i, 0, 0 }, { 0, 0, 0 }, { 1, 1, 1 } });
+        if (i % 3 == 0)
+            registry.TryAddComponent(entity, B{ "B" });
+    }
+
+    // random order, a duplicate, an entity without a Transform, a dead one, one queued for deletion and one out of range
+    std::vector<EntityID> requests = { 98, 4, 60, 4, 33, 12, 0, 50 };
+    registry.DeleteEntity(60);
+    registry.Flush();
+    registry.DeleteEntity(50);
+    requests.push_back(entityCount + 10);
+
+    std::vector<EntityID> visited;
+    const size_t calls = registry.Gather<A, Transform>(requests, [&](EntityID entity, A& a, Transform& transform)
+    {
+        EXPECT_EQ(a.Hello, (int)entity);
+        EXPECT_EQ(transform.Position.x, (float)entity);
+        transform.Position.y = 1.0f;
+        visited.push_back(entity);
+    });
+    EXPECT_EQ(calls, 5);
+    EXPECT_EQ(visited.size(), 5);
+    std::sort(visited.begin(), visited.end());
+    EXPECT_EQ(visited, (std::vector<EntityID>{ 0, 4, 4, 12, 98 }));
+    EXPECT_EQ(registry.GetComponent<Transform>(98).Position.y, 1.0f);
+    EXPECT_EQ(registry.GetComponent<Transform>(2).Position.y, 0.0f);
+
+    // visited archetype by archetype, in row order
+    std::vector<std::pair<bool, EntityID>> order;
+    registry.Gather<A>(std::vector<EntityID>{ 9, 3, 1, 7, 6, 2 }, [&](EntityID entity, A&)
+    {
+        order.emplace_back(registry.HasComponent<B>(entity), entity);
+    });
+    ASSERT_EQ(order.size(), 6);
+    for (size_t i = 1; i < order.size(); ++i)
+    {
+        if (order[i].first == order[i - 1].first && registry.HasComponent<Transform>(order[i].second) == registry.HasComponent<Transform>(order[i - 1].second))
+        {
+            EXPECT_LT(order[i - 1].second, order[i].second);
+        }
+    }
+}
+
+TEST_F(EntityRegistryTest, BulkOperations)
+{
+    ecs::EntityRegistry registry;
+    constexpr uint32_t entityCount = 100;
+    for (uint32_t i = 0; i < entityCount; ++i)
+    {
+        EntityID entity = registry.CreateEntity();
+        registry.TryAddComponent(entity, A((int)i));
+        if (i % 4 == 0)
+            registry.TryAddComponent(entity, B{ "B" });
+    }
+    EntityID other = registry.CreateEntity();
+    registry.TryAddComponent(other, B{ "other" });
+
+    // the entities with only an A move to an archetype that doesn't exist yet, their column changes hands
+    A* column = &registry.GetComponent<A>(1);
+    uint32_t addedEvents = 0;
+    registry.OnAdd<Transform>([&](ComponentBatch<Transform>& batch) { addedEvents += batch.GetSize(); });
+    const Transform transform{ { 1, 2, 3 }, { 0, 0, 0 }, { 1, 1, 1 } };
+    EXPECT_EQ((registry.AddToAll<Transform, A>(transform)), entityCount);
+    EXPECT_EQ(&registry.GetComponent<A>(1), column);
+    for (EntityID entity = 0; entity < entityCount; ++entity)
+    {
+        EXPECT_EQ(registry.GetComponent<A>(entity).Hello, (int)entity);
+        EXPECT_EQ(registry.GetComponent<Transform>(entity).Position.y, 2.0f);
+        EXPECT_EQ(registry.HasComponent<B>(entity), entity % 4 == 0);
+    }
+    EXPECT_FALSE(registry.HasComponent<Transform>(other));
+    // entities that already have the component keep theirs
+    registry.GetComponent<Transform>(8).Position.y = 5.0f;
+    EXPECT_EQ((registry.AddToAll<Transform, A>(transform)), 0);
+    EXPECT_EQ(registry.GetComponent<Transform>(8).Position.y, 5.0f);
+    registry.Flush();
+    EXPECT_EQ(addedEvents, entityCount);
+
+    // disabled entities and entities queued for deletion are left out, the rest of their archetype is handled one by one
+    registry.SetEnabled(4, false);
+    registry.DeleteEntity(5);
+    std::vector<EntityID> removedEvents;
+    registry.OnRemove<Transform>([&](ComponentBatch<Transform>& batch)
+    {
+        removedEvents.insert(removedEvents.end(), batch.GetEntities().begin(), batch.GetEntities().end());
+    });
+    EXPECT_EQ((registry.RemoveFromAll<Transform, A>()), entityCount - 2);
+    EXPECT_TRUE(registry.HasComponent<Transform>(4));
+    EXPECT_TRUE(registry.HasComponent<Transform>(5));
+    EXPECT_FALSE(registry.HasComponent<Transform>(0));
+    EXPECT_FALSE(registry.HasComponent<Transform>(1));
+    EXPECT_EQ(registry.GetComponent<A>(1).Hello, 1);
+    EXPECT_EQ(registry.GetComponent<B>(0).s, "B");
+    registry.Flush();
+    // entity 5 died in the flush, which reports it too
+    EXPECT_EQ(removedEvents.size(), entityCount - 1);
+    EXPECT_EQ((registry.RemoveFromAll<Transform, A>()), 0);
+
+    registry.SetEnabled(4, true);
+    registry.DeleteComponent<A>(1);
+    EXPECT_EQ(registry.DestroyAll<A>(), entityCount - 1);
+    EXPECT_EQ(registry.GetEntityCount(), 1);
+    EXPECT_TRUE(registry.IsEntityValid(other));
+    EXPECT_FALSE(registry.IsEntityValid(0));
+    EXPECT_FALSE(registry.IsEntityValid(4));
+    auto view = registry.GetView<A>();
+    EXPECT_TRUE(view.begin() == view.end());
+    // the deletion queued for a destroyed entity is dropped
+    EXPECT_EQ(registry.GetPendingFlushCount(), 0);
+
+    // the IDs can be used again, and the queued deletion doesn't reach the entity that gets ID 1 next
+    std::vector<EntityID> created;
+    do
+    {
+        created.push_back(registry.CreateEntity());
+        registry.TryAddComponent(created.back(), A(7));
+    } while (created.back() != 1);
+    registry.Flush();
+    EXPECT_EQ(registry.GetComponent<A>(1).Hello, 7);
+    EXPECT_EQ(registry.DestroyAll<A>(), created.size());
+}
+
+TEST_F(EntityRegistryTest, QueuedDeletionHidesEntity)
+{
+    ecs::EntityRegistry registry;
     EntityID entity0 = registry.CreateEntity();
     EntityID entity1 = registry.CreateEntity();
     EntityID entity2 = registry.CreateEntity();
-    registry.TryAddComponent(entity0, transform);
-    registry.TryAddComponent(entity1, a);
-    registry.EmplaceComponent<B>(entity2);
-    EXPECT_TRUE(registry.HasComponent<Transform>(entity0));
-    EXPECT_TRUE(registry.HasComponent<A>(entity1));
-    EXPECT_TRUE(registry.HasComponent<B>(entity2));
+    registry.TryAddComponent(entity0, A{ 0 });
+    registry.TryAddComponent(entity1, A{ 1 });
+    registry.TryAddComponent(entity2, A{ 2 });
+
+    // a view created before the deletions hides the entities as well
+    auto earlyView = registry.GetView<A>();
+    EXPECT_EQ(earlyView.GetSize(), 3);
+    registry.DeleteEntity(entity0);
+    registry.DeleteEntity(entity2);
+    registry.DeleteEntity(entity2);
+    EXPECT_FALSE(registry.IsEntityValid(entity0));
+    EXPECT_TRUE(registry.IsEntityValid(entity1));
+    EXPECT_FALSE(registry.IsEntityValid(entity2));
+    EXPECT_EQ(registry.GetPendingFlushCount(), 2);
+
+    auto expectOnlyEntity1 = [entity1](ComponentView<A>& view)
+    {
+        EXPECT_EQ(view.GetSize(), 1);
+        std::vector<EntityID> visited;
+        for (auto index : view)
+            visited.push_back(index.Entity);
+        ASSERT_EQ(visited.size(), 1);
+        EXPECT_EQ(visited[0], entity1);
+    };
+    expectOnlyEntity1(earlyView);
+    auto view = registry.GetView<A>();
+    expectOnlyEntity1(view);
+
+    // no components can be added to a queued entity, the ones it has stay readable until the flush
+    EXPECT_FALSE(registry.TryAddComponent(entity0, B{ "B" }));
+    EXPECT_THROW(registry.EmplaceComponent<B>(entity0), EntityIDOutOfRange);
+    EXPECT_EQ(registry.GetComponent<A>(entity0).Hello, 0);
+
+    registry.Flush();
+    EXPECT_EQ(registry.GetEntityCount(), 1);
+    EXPECT_FALSE(registry.IsEntityValid(entity0));
+    EXPECT_TRUE(registry.IsEntityValid(entity1));
+}
+
+TEST_F(EntityRegistryTest, QueuedDeletionHiddenAfterGrowth)
+{
+    ecs::EntityRegistry registry(4);
+    EntityID kept = registry.CreateEntity();
+    EntityID deleted = registry.CreateEntity();
+    registry.TryAddComponent(kept, A{ 1 });
+    registry.TryAddComponent(deleted, A{ 2 });
+    auto view = registry.GetView<A>();
+    registry.DeleteEntity(deleted);
+
+    // growing the registry reallocates the deletion flags the view reads
+    for (int i = 0; i < 100; ++i)
+        registry.CreateEntity();
+    int sum = 0;
+    for (auto index : view)
+        sum += std::get<0>(view.Get(index)).Hello;
+    EXPECT_EQ(sum, 1);
+}
+
+TEST_F(EntityRegistryTest, BudgetedFlush)
+{
+    ecs::EntityRegistry registry;
+    for (int i = 0; i < 1024; i++)
+    {
+        EntityID entity = registry.CreateEntity();
+        registry.TryAddComponent(entity, A{ i });
+        registry.TryAddComponent(entity, B{ "Entity" + std::to_string(i) });
+    }
+    for (EntityID entity = 0; entity < 512; entity++)
+        registry.DeleteComponent<B>(entity);
+    for (EntityID entity = 512; entity < 1024; entity++)
+        registry.DeleteEntity(entity);
+
+    // an empty budget still processes a batch and carries the rest over to the next flush
+    EXPECT_FALSE(registry.Flush(std::chrono::microseconds(0)));
+    const uint32_t pending = registry.GetPendingFlushCount();
+    EXPECT_LT(pending, 1024);
+    EXPECT_GT(pending, 0);
+    EXPECT_FALSE(registry.HasComponent<B>(0));
+    EXPECT_TRUE(registry.HasComponent<B>(511));
+    EXPECT_EQ(registry.GetEntityCount(), 1024);
+
+    // so even an empty budget gets through everything eventually
+    uint32_t calls = 1;
+    while (!registry.Flush(std::chrono::microseconds(0)))
+        ++calls;
+    EXPECT_GT(calls, 1);
+    EXPECT_EQ(registry.GetPendingFlushCount(), 0);
+    EXPECT_EQ(registry.GetEntityCount(), 512);
+    for (EntityID entity = 0; entity < 512; entity++)
+    {
+        EXPECT_FALSE(registry.HasComponent<B>(entity));
+        EXPECT_EQ(registry.GetComponent<A>(entity).Hello, (int)entity);
+    }
+    for (EntityID entity = 512; entity < 1024; entity++)
+        EXPECT_FALSE(registry.IsEntityValid(entity));
+}
+
+TEST_F(EntityRegistryTest, ConcurrentDeletions)
+{
+    ecs::EntityRegistry registry;
+    for (int i = 0; i < 4096; i++)
+    {
+        EntityID entity = registry.CreateEntity();
+        registry.TryAddComponent(entity, A{ i });
+        registry.TryAddComponent(entity, Transform{});
+    }
+
+    std::vector<std::thread> workers;
+    for (uint32_t t = 0; t < 4; ++t)
+    {
+        workers.emplace_back([&registry, t]()
+        {
+            for (EntityID entity = t; entity < 4096; entity += 4)
+            {
+                if (entity % 2 == 0)
+                    registry.DeleteEntity(entity);
+                else
+                    registry.DeleteComponent<Transform>(entity);
+            }
+        });
+    }
+    for (auto& worker : workers)
+        worker.join();
+
+    registry.Flush();
+    EXPECT_EQ(registry.GetEntityCount(), 2048);
+    for (EntityID entity = 0; entity < 4096; entity++)
+    {
+        if (entity % 2 == 0)
+        {
+            EXPECT_FALSE(registry.IsEntityValid(entity));
+            continue;
+        }
+        EXPECT_FALSE(registry.HasComponent<Transform>(entity));
+        EXPECT_EQ(registry.GetComponent<A>(entity).Hello, (int)entity);
+    }
+}
+
+TEST_F(EntityRegistryTest, ReserveArchetype)
+{
+    using namespace ecs;
+    ecs::EntityRegistry registry(64);
+
+    uint32_t archetypeCount = registry.GetArchetypeCount();
+    registry.Reserve<Transform, A>(1000);
+    EXPECT_EQ(registry.GetArchetypeCount(), archetypeCount + 1);
+    EXPECT_GE(registry.GetMaxEntityCount(), 1000);
+
+    // reserving again doesn't create anything new
+    registry.Reserve<A, Transform>(500);
+    EXPECT_EQ(registry.GetArchetypeCount(), archetypeCount + 1);
+
+    // entities reach the reserved archetype through the Transform one
+    EntityID first = registry.CreateEntity();
+    registry.TryAddComponent(first, Transform());
+    registry.TryAddComponent(first, A(0));
+    A* firstA = &registry.GetComponent<A>(first);
+    Transform* firstTransform = &registry.GetComponent<Transform>(first);
+    for (int i = 1; i < 1000; ++i)
+    {
+        EntityID entity = registry.CreateEntity();
+        registry.TryAddComponent(entity, Transform());
+        registry.TryAddComponent(entity, A(i));
+    }
+    // the columns never had to grow
+    EXPECT_EQ(&registry.GetComponent<A>(first), firstA);
+    EXPECT_EQ(&registry.GetComponent<Transform>(first), firstTransform);
+
+    auto view = registry.GetView<Transform, A>();
+    int count = 0;
+    for (auto& index : view)
+    {
+        auto [transform, a] = view.Get(index);
+        EXPECT_EQ(a.Hello, (int)index.Entity);
+        ++count;
+    }
+    EXPECT_EQ(count, 1000);
+}
+
+TEST_F(EntityRegistryTest, CollectEmptyArchetypes)
+{
+    using namespace ecs;
+    ecs::EntityRegistry registry;
+    registry.SetEmptyArchetypeLifetime(2);
+
+    EntityID entity = registry.CreateEntity();
+    registry.TryAddComponent(entity, A(1));
+    registry.TryAddComponent(entity, B{ "transient" });
+    EntityID other = registry.CreateEntity();
+    registry.TryAddComponent(other, A(2));
+
+    // {A} and {A, B} exist, the view cache for A holds both
+    uint32_t archetypeCount = registry.GetArchetypeCount();
+    auto view = registry.GetView<A>();
+    EXPECT_EQ(std::distance(view.begin(), view.end()), 2);
+
+    registry.DeleteComponent<B>(entity);
+    registry.Flush();
+    EXPECT_EQ(registry.GetArchetypeCount(), archetypeCount);
+
+    // {A, B} has now been empty for two flushes in a row
+    registry.Flush();
+    EXPECT_EQ(registry.GetArchetypeCount(), archetypeCount - 1);
+
+    auto collectedView = registry.GetView<A>();
+    EXPECT_EQ(std::distance(collectedView.begin(), collectedView.end()), 2);
+    auto emptyView = registry.GetView<A, B>();
+    EXPECT_EQ(emptyView.begin(), emptyView.end());
+
+    // the archetype comes back when needed and its counter starts over once used again
+    registry.TryAddComponent(entity, B{ "back" });
+    EXPECT_EQ(registry.GetArchetypeCount(), archetypeCount);
+    auto recreatedView = registry.GetView<A, B>();
+    EXPECT_EQ(std::distance(recreatedView.begin(), recreatedView.end()), 1);
+    registry.Flush();
+    registry.Flush();
+    EXPECT_EQ(registry.GetArchetypeCount(), archetypeCount);
+
+    // {A} only loses its entities, views over A still see {A, B}
+    registry.DeleteEntity(other);
+    registry.DeleteComponent<B>(entity);
+    registry.Flush();
+    registry.TryAddComponent(entity, B{ "again" });
+    registry.Flush();
+    registry.Flush();
+    EXPECT_EQ(registry.GetArchetypeCount(), archetypeCount - 1);
+    auto supersetView = registry.GetView<A>();
+    EXPECT_EQ(std::distance(supersetView.begin(), supersetView.end()), 1);
+    EXPECT_EQ(registry.GetComponent<B>(entity).s, "again");
+}
+
+TEST_F(EntityRegistryTest, ArchetypeMatchingIndex)
+{
+    using namespace ecs;
+    constexpr auto tags = std::make_integer_sequence<uint32_t, 8>();
+    RegisterTags(tags);
+    ecs::EntityRegistry registry;
+    registry.SetEmptyArchetypeLifetime(1);
+
+    // counts the entities of a view and checks them against every entity whose tags are a superset of the query
+    auto check = [&registry](auto view, uint32_t query, const std::vector<uint32_t>& masks)
+    {
+        int64_t expected = std::count_if(masks.begin(), masks.end(), [query](uint32_t mask) { return (mask & query) == query; });
+        EXPECT_EQ(std::distance(view.begin(), view.end()), expected) << "query " << query;
+    };
+
+    // some caches exist before the archetypes, the others are made after
+    check(registry.GetView<Tag<0>>(), 0b1, {});
+    check(registry.GetView<Tag<1>, Tag<3>>(), 0b1010, {});
+
+    std::vector<uint32_t> masks;
+    for (uint32_t mask = 1; mask < 256; ++mask)
+    {
+        EntityID entity = registry.CreateEntity();
+        AddTags(registry, entity, mask, tags);
+        masks.push_back(mask);
+    }
+
+    auto checkAll = [&]()
+    {
+        check(registry.GetView<Tag<0>>(), 0b1, masks);
+        check(registry.GetView<Tag<1>, Tag<3>>(), 0b1010, masks);
+        check(registry.GetView<Tag<7>>(), 0b10000000, masks);
+        check(registry.GetView<Tag<2>, Tag<5>, Tag<7>>(), 0b10100100, masks);
+        check(registry.GetView<Tag<0>, Tag<1>, Tag<2>, Tag<3>, Tag<4>, Tag<5>, Tag<6>, Tag<7>>(), 0b11111111, masks);
+    };
+    checkAll();
+
+    // empty out and collect every archetype with Tag<4>, the caches lose them
+    for (EntityID entity = 0; entity < masks.size(); ++entity)
+    {
+        if (masks[entity] & 0b10000)
+        {
+            registry.DeleteEntity(entity);
+            masks[entity] = 0;
+        }
+    }
+    registry.Flush();
+    checkAll();
+
+    // and they come back
+    for (uint32_t mask = 0b10000; mask < 256; mask = (mask + 1) | 0b10000)
+    {
+        EntityID entity = registry.CreateEntity();
+        AddTags(registry, entity, mask, tags);
+        masks.resize(entity + 1);
+        masks[entity] = mask;
+    }
+    checkAll();
+}
+
+#ifdef ECS_BENCHMARKS
+// the 1287 masks with five of the 13 tag bits set
+static constexpr auto s_FiveTagMasks = []()
+{
+    std::array<uint32_t, 1287> masks{};
+    uint32_t count = 0;
+    for (uint32_t mask = 0; mask < (1u << 13); ++mask)
+    {
+        if (std::popcount(mask) == 5)
+            masks[count++] = mask;
+    }
+    return masks;
+}();
+
+static constexpr uint32_t NthSetBit(uint32_t mask, uint32_t n)
+{
+    for (; n > 0; --n)
+        mask &= mask - 1;
+    return (uint32_t)std::countr_zero(mask);
+}
+
+// creates the archetype of every five tag mask with Reserve, which goes through archetype creation without moving any entity
+template<size_t... Is>
+static void ReserveFiveTagArchetypes(ecs::EntityRegistry& registry, std::index_sequence<Is...>)
+{
+    (registry.Reserve<Tag<NthSetBit(s_FiveTagMasks[Is], 0)>, Tag<NthSetBit(s_FiveTagMasks[Is], 1)>, Tag<NthSetBit(s_FiveTagMasks[Is], 2)>,
+        Tag<NthSetBit(s_FiveTagMasks[Is], 3)>, Tag<NthSetBit(s_FiveTagMasks[Is], 4)>>(1), ...);
+}
+
+TEST_F(EntityRegistryTest, ArchetypeMatchingIndexBenchmark)
+{
+    using namespace ecs;
+    constexpr auto tags = std::make_integer_sequence<uint32_t, 13>();
+    RegisterTags(tags);
+
+    // about 500 distinct queries of one to three components
+    auto makeViews = []<uint32_t... Ns>(ecs::EntityRegistry& registry, std::integer_sequence<uint32_t, Ns...>)
+    {
+        ((void)registry.GetView<Tag<Ns % 13>>(), ...);
+        ((void)registry.GetView<Tag<Ns % 13>, Tag<(Ns / 13) % 13>>(), ...);
+        ((void)registry.GetView<Tag<Ns % 13>, Tag<(Ns * 7 + 3) % 13>, Tag<(Ns * 5 + 1) % 13>>(), ...);
+    };
+    // every signature of 13 components, one entity each
+    auto makeArchetypes = [&tags](ecs::EntityRegistry& registry)
+    {
+        for (uint32_t mask = 1; mask < (1u << 13); ++mask)
+        {
+            EntityID entity = registry.CreateEntity();
+            AddTags(registry, entity, mask, tags);
+        }
+    };
+
+    {
+        ecs::EntityRegistry registry;
+        makeViews(registry, std::make_integer_sequence<uint32_t, 169>());
+        ScopeTimer timer("Create 1287 archetypes with 500 cached queries");
+        ReserveFiveTagArchetypes(registry, std::make_index_sequence<s_FiveTagMasks.size()>());
+    }
+    {
+        ecs::EntityRegistry registry;
+        makeArchetypes(registry);
+        ScopeTimer timer("Create 500 queries over 8191 archetypes");
+        makeViews(registry, std::make_integer_sequence<uint32_t, 169>());
+    }
+}
+#endif // ECS_BENCHMARKS
+
+TEST_F(EntityRegistryTest, ShrinkToFit)
+{
+    using namespace ecs;
+    CountingResource resource;
+    {
+        ecs::EntityRegistry registry(4096, &resource);
+        registry.Reserve<A, B>(4096);
+        for (int i = 0; i < 4000; ++i)
+        {
+            EntityID entity = registry.CreateEntity();
+            registry.TryAddComponent(entity, A(i));
+            registry.TryAddComponent(entity, B{ "b" });
+        }
+        for (EntityID entity = 100; entity < 4000; ++entity)
+            registry.DeleteEntity(entity);
+        registry.Flush();
+
+        size_t peak = resource.Outstanding;
+        registry.ShrinkToFit();
+        EXPECT_LT(resource.Outstanding, peak);
+
+        for (EntityID entity = 0; entity < 100; ++entity)
+        {
+            EXPECT_EQ(registry.GetComponent<A>(entity).Hello, (int)entity);
+            EXPECT_EQ(registry.GetComponent<B>(entity).s, "b");
+        }
+    }
+    EXPECT_EQ(resource.Outstanding, 0);
+}
+
+TEST_F(EntityRegistryTest, SnapshotRoundTrip)
+{
+    using namespace ecs;
+    ecs::EntityRegistry registry;
+    for (int i = 0; i < 3000; ++i)
+    {
+        EntityID entity = registry.CreateEntity();
+        if (i % 2 == 0)
+            registry.TryAddComponent(entity, A(i));
+        if (i % 3 == 0)
+            registry.TryAddComponent(entity, B{ "Entity" + std::to_string(i) });
+        if (i % 5 == 0)
+            registry.TryAddComponent(entity, Transform{ { (float)i, 0, 0 }, { 0, 0, 0 }, { 1, 1, 1 } });
+    }
+    for (EntityID entity = 100; entity < 3000; entity += 7)
+        registry.DeleteEntity(entity);
+    registry.Flush();
+
+    std::stringstream stream;
+    registry.SaveSnapshot(stream);
+
+    ecs::EntityRegistry loaded(16);
+    loaded.CreateEntity();
+    loaded.LoadSnapshot(stream);
+    EXPECT_EQ(loaded.GetEntityCount(), registry.GetEntityCount());
+    EXPECT_EQ(loaded.GetMaxEntityCount(), registry.GetMaxEntityCount());
+
+    for (EntityID entity = 0; entity < registry.GetMaxEntityCount(); ++entity)
+    {
+        ASSERT_EQ(loaded.IsEntityValid(entity), registry.IsEntityValid(entity));
+        if (!registry.IsEntityValid(entity))
+            continue;
+        ASSERT_EQ(loaded.HasComponent<A>(entity), registry.HasComponent<A>(entity));
+        ASSERT_EQ(loaded.HasComponent<B>(entity), registry.HasComponent<B>(entity));
+        ASSERT_EQ(loaded.HasComponent<Transform>(entity), registry.HasComponent<Transform>(entity));
+        if (registry.HasComponent<A>(entity))
+        {
+            EXPECT_EQ(loaded.GetComponent<A>(entity), registry.GetComponent<A>(entity));
+        }
+        if (registry.HasComponent<B>(entity))
+        {
+            EXPECT_EQ(loaded.GetComponent<B>(entity), registry.GetComponent<B>(entity));
+        }
+        if (registry.HasComponent<Transform>(entity))
+        {
+            EXPECT_EQ(loaded.GetComponent<Transform>(entity), registry.GetComponent<Transform>(entity));
+        }
+    }
+
+    uint32_t viewCount = 0;
+    auto view = loaded.GetView<A, B>();
+    for (auto& index : view)
+    {
+        auto [a, b] = view.Get(index);
+        EXPECT_EQ(b.s, "Entity" + std::to_string(a.Hello));
+        ++viewCount;
+    }
+    uint32_t expectedCount = 0;
+    for (EntityID entity = 0; entity < 3000; ++entity)
+        expectedCount += registry.IsEntityValid(entity) && entity % 6 == 0;
+    EXPECT_EQ(viewCount, expectedCount);
+
+    // free IDs are handed out in the same order
+    for (int i = 0; i < 500; ++i)
+        EXPECT_EQ(loaded.CreateEntity(), registry.CreateEntity());
 }
 
-TEST_F(EntityRegistryTest, DeleteComponent)
-{        
-    using namespace ecs;
+TEST_F(EntityRegistryTest, SnapshotComponentlessEntities)
+{
     ecs::EntityRegistry registry;
-
-    Transform transform;
-    A a;
-    B b;
-    EntityID entity0 = registry.CreateEntity();
-    EntityID entity1 = registry.CreateEntity();
-    EntityID entity2 = registry.CreateEntity();
-    registry.TryAddComponent(entity0, transform);
-    registry.TryAddComponent(entity1, a);
-    registry.TryAddComponent(entity2, b);
-    registry.TryAddComponent(entity0, a);
-    registry.TryAddComponent(entity1, b);
-    registry.TryAddComponent(entity2, transform);
-    EXPECT_TRUE(registry.HasComponent<Transform>(entity0));
-    EXPECT_TRUE(registry.HasComponent<A>(entity1));
-    EXPECT_TRUE(registry.HasComponent<B>(entity2));
-    bool r = registry.HasComponents<Transform, B>(entity2);
-    EXPECT_TRUE(r);
-    registry.DeleteComponent<Transform>(entity0);
-    registry.DeleteComponent<A>(entity1);
-    registry.DeleteComponent<B>(entity2);
-    EXPECT_TRUE(registry.HasComponent<Transform>(entity0)); 
-    EXPECT_TRUE(registry.HasComponent<A>(entity1)); 
-    EXPECT_TRUE(registry.HasComponent<B>(entity2)); 
+    EntityID stripped = registry.CreateEntity();
+    registry.TryAddComponent(stripped, A(1));
+    EntityID kept = registry.CreateEntity();
+    registry.TryAddComponent(kept, A(2));
+    EntityID fresh = registry.CreateEntity();
+    // losing its last component lists the entity in the archetype without components
+    registry.DeleteComponent<A>(stripped);
     registry.Flush();
-    EXPECT_FALSE(registry.HasComponent<Transform>(entity0));
-    EXPECT_FALSE(registry.HasComponent<A>(entity1));
-    EXPECT_FALSE(registry.HasComponent<B>(entity2));
+
+    std::stringstream stream;
+    registry.SaveSnapshot(stream);
+    ecs::EntityRegistry loaded;
+    loaded.LoadSnapshot(stream);
+    EXPECT_EQ(loaded.GetEntityCount(), 3);
+    EXPECT_TRUE(loaded.IsEntityValid(stripped));
+    EXPECT_TRUE(loaded.IsEntityValid(fresh));
+    EXPECT_FALSE(loaded.HasComponent<A>(stripped));
+    EXPECT_EQ(loaded.GetComponent<A>(kept).Hello, 2);
+    loaded.TryAddComponent(stripped, A(3));
+    EXPECT_EQ(loaded.GetComponent<A>(stripped).Hello, 3);
 }
 
-TEST_F(EntityRegistryTest, DeleteEntity)
+TEST_F(EntityRegistryTest, SnapshotErrors)
 {
     using namespace ecs;
+    ecs::EntityRegistry::RegisterComponentType<ComplexStruct>();
     ecs::EntityRegistry registry;
+    EntityID entity = registry.CreateEntity();
+    registry.TryAddComponent(entity, A(1));
 
-    Transform transform;
-    A a;
-    B b;
-    EntityID entity0 = registry.CreateEntity();
-    registry.TryAddComponent(entity0, transform);
-    registry.TryAddComponent(entity0, b);
-    EXPECT_TRUE(registry.HasComponent<Transform>(entity0));
-    EXPECT_TRUE(registry.HasComponent<B>(entity0));
-    registry.DeleteEntity(entity0);
-    EXPECT_TRUE(registry.HasComponent<Transform>(entity0));
-    EXPECT_TRUE(registry.HasComponent<B>(entity0));
+    // deferred operations have to be flushed first
+    std::stringstream stream;
+    registry.DeleteEntity(entity);
+    EXPECT_THROW(registry.SaveSnapshot(stream), SnapshotException);
     registry.Flush();
-    EXPECT_FALSE(registry.HasComponent<Transform>(entity0));
-    EXPECT_FALSE(registry.HasComponent<B>(entity0));
-    registry.DeleteEntity(entity0);
+
+    // components that aren't trivially copyable need a serializer
+    entity = registry.CreateEntity();
+    registry.TryAddComponent(entity, ComplexStruct());
+    EXPECT_THROW(registry.SaveSnapshot(stream), SnapshotException);
+    registry.DeleteComponent<ComplexStruct>(entity);
+    registry.TryAddComponent(entity, A(2));
     registry.Flush();
+
+    stream.str("");
+    registry.SaveSnapshot(stream);
+    std::string bytes = stream.str();
+
+    ecs::EntityRegistry loaded;
+    std::stringstream garbage(std::string(64, 'x'));
+    EXPECT_THROW(loaded.LoadSnapshot(garbage), SnapshotException);
+    std::stringstream truncated(bytes.substr(0, bytes.size() - 2));
+    EXPECT_THROW(loaded.LoadSnapshot(truncated), SnapshotException);
+    EXPECT_EQ(loaded.GetEntityCount(), 0);
+    EXPECT_EQ(loaded.CreateEntity(), 0);
+
+    std::stringstream valid(bytes);
+    loaded.LoadSnapshot(valid);
+    EXPECT_EQ(loaded.GetComponent<A>(entity).Hello, 2);
 }
 
-TEST_F(EntityRegistryTest, EntityStressTest)
+TEST_F(EntityRegistryTest, SnapshotMappedFile)
 {
     using namespace ecs;
     ecs::EntityRegistry registry;
+    for (int i = 0; i < 1000; ++i)
     {
-        SCOPED_TRACE("Create entities");
-        for (int i = 0; i < 8192; i++)
+        EntityID entity = registry.CreateEntity();
+        registry.TryAddComponent(entity, A(i));
+        if (i % 2)
+            registry.TryAddComponent(entity, B{ "Entity" + std::to_string(i) });
+    }
+
+    const std::string path = (std::filesystem::temp_directory_path() / "ecs_mapped_snapshot.bin").string();
+    {
+        std::ofstream file(path, std::ios::binary);
+        registry.SaveSnapshot(file);
+    }
+    {
+        MappedFile mapping(path);
+        ecs::EntityRegistry loaded;
+        loaded.LoadSnapshot(mapping.GetData());
+        EXPECT_EQ(loaded.GetEntityCount(), 1000);
+        for (EntityID entity = 0; entity < 1000; ++entity)
         {
-            try
-            {
-                EntityID entity = registry.CreateEntity();
-                Transform transform{{(float)-i, (float)i, (float)i * 10}, {0, 0, 0}, {1, 1, 1}};
-                A a{i};
-                B b{"Entity" + std::to_string(i)};
-                registry.TryAddComponent(entity, transform);
-                registry.TryAddComponent(entity, a);
-                registry.TryAddComponent(entity, b);
-                bool r = registry.HasComponents<Transform, A, B>(entity);
-                EXPECT_TRUE(r);
-            }
-            catch (const std::exception& e)
+            EXPECT_EQ(loaded.GetComponent<A>(entity), registry.GetComponent<A>(entity));
+            if (entity % 2)
             {
-                FAIL() << e.what();
-                break;
+                EXPECT_EQ(loaded.GetComponent<B>(entity), registry.GetComponent<B>(entity));
             }
         }
-    }
-    {
-        SCOPED_TRACE("Delete Components");
-        for (EntityID entity = 100; entity < 420; entity++)
+
+        // the column of A points in the mapping, writes go to private pages
+        auto view = loaded.GetView<A>();
+        for (auto& index : view)
         {
-            registry.DeleteComponent<Transform>(entity);
+            auto [a] = view.Get(index);
+            const std::byte* address = reinterpret_cast<const std::byte*>(&a);
+            EXPECT_TRUE(address >= mapping.GetData().data() && address < mapping.GetData().data() + mapping.GetSize());
+            a.Hello = -a.Hello;
         }
-        for (EntityID entity = 420; entity < 1000; entity++)
+        EXPECT_EQ(loaded.GetComponent<A>(10).Hello, -10);
+
+        // entities come and go, the columns are copied out of the mapping
+        loaded.DeleteEntity(0);
+        loaded.Flush();
+        EntityID entity = loaded.CreateEntity();
+        loaded.TryAddComponent(entity, A(5000));
+        EXPECT_EQ(loaded.GetComponent<A>(entity).Hello, 5000);
+        EXPECT_EQ(loaded.GetComponent<A>(999).Hello, -999);
+    }
+
+    // the file is untouched
+    std::ifstream file(path, std::ios::binary);
+    ecs::EntityRegistry reloaded;
+    reloaded.LoadSnapshot(file);
+    EXPECT_EQ(reloaded.GetComponent<A>(10).Hello, 10);
+    file.close();
+    std::filesystem::remove(path);
+}
+
+TEST_F(EntityRegistryTest, SnapshotWithoutComponents)
+{
+    using namespace ecs;
+    ecs::EntityRegistry registry;
+    EntityID fresh = registry.CreateEntity();
+    EntityID stripped = registry.CreateEntity();
+    registry.TryAddComponent(stripped, A(1));
+    registry.DeleteComponent<A>(stripped);
+    registry.Flush();
+
+    std::stringstream stream;
+    registry.SaveSnapshot(stream);
+    ecs::EntityRegistry loaded;
+    loaded.LoadSnapshot(stream);
+    EXPECT_EQ(loaded.GetEntityCount(), 2);
+    EXPECT_TRUE(loaded.IsEntityValid(fresh));
+    EXPECT_TRUE(loaded.IsEntityValid(stripped));
+    EXPECT_FALSE(loaded.HasComponent<A>(stripped));
+}
+
+// checks the replica has the same entities, components and free IDs as the source
+static void ExpectSameRegistry(ecs::EntityRegistry& source, ecs::EntityRegistry& replica)
+{
+    using namespace ecs;
+    ASSERT_EQ(replica.GetEntityCount(), source.GetEntityCount());
+    ASSERT_EQ(replica.GetMaxEntityCount(), source.GetMaxEntityCount());
+    for (EntityID entity = 0; entity < source.GetMaxEntityCount(); ++entity)
+    {
+        ASSERT_EQ(replica.IsEntityValid(entity), source.IsEntityValid(entity)) << entity;
+        if (!source.IsEntityValid(entity))
+            continue;
+        ASSERT_EQ(replica.IsEnabled(entity), source.IsEnabled(entity)) << entity;
+        ASSERT_EQ(replica.HasComponent<A>(entity), source.HasComponent<A>(entity)) << entity;
+        ASSERT_EQ(replica.HasComponent<B>(entity), source.HasComponent<B>(entity)) << entity;
+        ASSERT_EQ(replica.HasComponent<Transform>(entity), source.HasComponent<Transform>(entity)) << entity;
+        if (source.HasComponent<A>(entity))
         {
-            registry.DeleteComponent<A>(entity);
+            EXPECT_EQ(replica.GetComponent<A>(entity), source.GetComponent<A>(entity)) << entity;
         }
-        for (EntityID entity = 1000; entity < 1400; entity++)
+        if (source.HasComponent<B>(entity))
         {
-            registry.DeleteComponent<B>(entity);
+            EXPECT_EQ(replica.GetComponent<B>(entity), source.GetComponent<B>(entity)) << entity;
         }
-        for (EntityID entity = 1400; entity < 1800; entity++)
+        if (source.HasComponent<Transform>(entity))
         {
-            registry.DeleteComponent<Transform>(entity);
-            registry.DeleteComponent<B>(entity);
+            EXPECT_EQ(replica.GetComponent<Transform>(entity), source.GetComponent<Transform>(entity)) << entity;
         }
+    }
+}
+
+TEST_F(EntityRegistryTest, DeltaReplication)
+{
+    using namespace ecs;
+    ecs::EntityRegistry source(64);
+    for (int i = 0; i < 40; ++i)
+    {
+        EntityID entity = source.CreateEntity();
+        source.TryAddComponent(entity, A(i));
+    }
+
+    std::stringstream snapshot;
+    source.SaveSnapshot(snapshot);
+    source.SetChangeTracking(true);
+    ecs::EntityRegistry replica;
+    replica.LoadSnapshot(snapshot);
+
+    std::vector<std::string> deltas;
+    for (int tick = 0; tick < 20; ++tick)
+    {
+        // spawn a few, grows the registry past 64 entities on the way
+        for (int i = 0; i < 5; ++i)
         {
-            SCOPED_TRACE("Flush");
-            registry.Flush();
+            EntityID entity = source.CreateEntity();
+            source.TryAddComponent(entity, B{ "Tick" + std::to_string(tick) });
+            if (i % 2)
+                source.TryAddComponent(entity, A(tick * 100 + i));
         }
-        for (EntityID entity = 100; entity < 420; entity++)
+        // destroy some, strip components from others
+        for (EntityID entity = tick; entity < source.GetMaxEntityCount(); entity += 9)
         {
-            EXPECT_FALSE(registry.HasComponent<Transform>(entity));
-            EXPECT_TRUE(registry.HasComponent<A>(entity));
-            EXPECT_TRUE(registry.HasComponent<B>(entity));
+            if (source.IsEntityValid(entity))
+                source.DeleteEntity(entity);
         }
-        for (EntityID entity = 420; entity < 1000; entity++)
+        for (EntityID entity = tick * 2; entity < source.GetMaxEntityCount(); entity += 11)
         {
-            EXPECT_FALSE(registry.HasComponent<A>(entity));
-            EXPECT_TRUE(registry.HasComponent<B>(entity));
-            EXPECT_TRUE(registry.HasComponent<Transform>(entity));
+            if (source.IsEntityValid(entity) && source.HasComponent<A>(entity))
+                source.DeleteComponent<A>(entity);
         }
-        for (EntityID entity = 1000; entity < 1400; entity++)
+        source.Flush();
+        // modify in place and through the registry
+        auto view = source.GetView<A>();
+        for (auto& index : view)
         {
-            EXPECT_FALSE(registry.HasComponent<B>(entity));
-            EXPECT_TRUE(registry.HasComponent<A>(entity));
-            EXPECT_TRUE(registry.HasComponent<Transform>(entity));
+            auto [a] = view.Get(index);
+            if (a.Hello % 3 == 0)
+            {
+                a.Hello += 1;
+                source.MarkComponentChanged<A>(index.Entity);
+            }
         }
-        for (EntityID entity = 1400; entity < 1800; entity++)
+        for (EntityID entity = tick % 4; entity < source.GetMaxEntityCount(); entity += 4)
         {
-            EXPECT_FALSE(registry.HasComponent<Transform>(entity));
-            EXPECT_FALSE(registry.HasComponent<B>(entity));
-            EXPECT_TRUE(registry.HasComponent<A>(entity));
+            if (source.IsEntityValid(entity))
+                source.TryAddComponent(entity, Transform{ { (float)tick, 0, 0 }, { 0, 0, 0 }, { 1, 1, 1 } });
         }
+
+        std::stringstream delta;
+        source.SaveDelta(delta);
+        deltas.push_back(delta.str());
+        replica.ApplyDelta(delta);
+        ExpectSameRegistry(source, replica);
     }
+
+    // nothing changed, nothing to send but the header
+    std::stringstream empty;
+    source.SaveDelta(empty);
+    EXPECT_EQ(empty.str().size(), sizeof(DeltaHeader));
+
+    // record and replay from the snapshot
+    snapshot.clear();
+    snapshot.seekg(0);
+    ecs::EntityRegistry replay;
+    replay.LoadSnapshot(snapshot);
+    for (const std::string& bytes : deltas)
     {
-        SCOPED_TRACE("Delete Entities");
-        for (int i = 696; i < 756; i++)
+        std::stringstream delta(bytes);
+        replay.ApplyDelta(delta);
+    }
+    ExpectSameRegistry(source, replay);
+
+    // a delta only applies to its baseline
+    std::stringstream stale(deltas.front());
+    EXPECT_THROW(replay.ApplyDelta(stale), SnapshotException);
+
+    // free IDs are handed out in the same order
+    for (int i = 0; i < 100; ++i)
+        EXPECT_EQ(replica.CreateEntity(), source.CreateEntity());
+}
+
+TEST_F(EntityRegistryTest, DeltaOnlyCarriesChanges)
+{
+    using namespace ecs;
+    ecs::EntityRegistry registry;
+    for (int i = 0; i < 1000; ++i)
+    {
+        EntityID entity = registry.CreateEntity();
+        registry.TryAddComponent(entity, Transform());
+        registry.TryAddComponent(entity, A(i));
+    }
+    std::stringstream delta;
+    EXPECT_THROW(registry.SaveDelta(delta), SnapshotException);
+
+    registry.SetChangeTracking(true);
+    registry.TryReplaceComponent(10, A(-10));
+    registry.GetComponent<A>(20).Hello = -20;
+    registry.MarkComponentChanged<A>(20);
+    registry.GetComponent<A>(30).Hello = -30; // not reported
+    registry.SaveDelta(delta);
+
+    // header, the types of their signature, two entities with one A each
+    const size_t entitySize = sizeof(EntityID) + 2 * sizeof(uint64_t) + sizeof(A);
+    EXPECT_EQ(delta.str().size(), sizeof(DeltaHeader) + 2 * sizeof(SnapshotComponentInfo) + 2 * entitySize);
+
+    registry.SetChangeTracking(false);
+    EXPECT_FALSE(registry.IsChangeTracking());
+    EXPECT_THROW(registry.SaveDelta(delta), SnapshotException);
+}
+
+TEST_F(EntityRegistryTest, SnapshotAsync)
+{
+    using namespace ecs;
+    ecs::EntityRegistry registry;
+    for (int i = 0; i < 3000; ++i)
+    {
+        EntityID entity = registry.CreateEntity();
+        if (i % 2 == 0)
+            registry.TryAddComponent(entity, A(i));
+        if (i % 3 == 0)
+            registry.TryAddComponent(entity, B{ "Entity" + std::to_string(i) });
+    }
+    ecs::EntityRegistry expected = registry.Fork();
+
+    registry.DeleteEntity(0);
+    std::stringstream stream;
+    EXPECT_THROW((void)registry.SnapshotAsync(stream), SnapshotException);
+    registry.Flush();
+    expected.DeleteEntity(0);
+    expected.Flush();
+
+    // the registry keeps changing while the snapshot is written
+    EntityRegistry::AsyncSnapshot snapshot = registry.SnapshotAsync(stream);
+    auto view = registry.GetView<A>();
+    for (auto& index : view)
+        std::get<0>(view.Get(index)).Hello = -1;
+    for (EntityID entity = 3; entity < 3000; entity += 3)
+        registry.GetComponent<B>(entity).s = "Changed";
+    for (EntityID entity = 1; entity < 3000; entity += 5)
+        registry.DeleteEntity(entity);
+    registry.Flush();
+    registry.CreateEntity();
+    snapshot.Wait();
+    EXPECT_TRUE(snapshot.IsDone());
+
+    ecs::EntityRegistry loaded;
+    loaded.LoadSnapshot(stream);
+    ExpectSameRegistry(expected, loaded);
+
+    // write errors are reported when waiting
+    std::stringstream broken;
+    broken.setstate(std::ios::badbit);
+    EntityRegistry::AsyncSnapshot failed = registry.SnapshotAsync(broken);
+    EXPECT_THROW(failed.Wait(), SnapshotException);
+
+    // and when a failed snapshot is overwritten, the new one is kept
+    failed = registry.SnapshotAsync(broken);
+    std::stringstream next;
+    EntityRegistry::AsyncSnapshot pending = registry.SnapshotAsync(next);
+    EXPECT_THROW(failed = std::move(pending), SnapshotException);
+    EXPECT_TRUE(failed.IsDone());
+    pending.Wait();
+    EXPECT_GT(next.str().size(), 0);
+}
+
+TEST_F(EntityRegistryTest, ForkIsIndependent)
+{
+    using namespace ecs;
+    ecs::EntityRegistry registry;
+    for (int i = 0; i < 1000; ++i)
+    {
+        EntityID entity = registry.CreateEntity();
+        if (i % 2 == 0)
+            registry.TryAddComponent(entity, A(i));
+        if (i % 3 == 0)
+            registry.TryAddComponent(entity, B{ "Entity" + std::to_string(i) });
+    }
+    for (EntityID entity = 50; entity < 1000; entity += 9)
+        registry.DeleteEntity(entity);
+    EXPECT_THROW((void)registry.Fork(), ForkException);
+    registry.Flush();
+
+    ecs::EntityRegistry fork = registry.Fork();
+    ExpectSameRegistry(registry, fork);
+
+    // changes on either side don't show on the other
+    fork.GetComponent<A>(0).Hello = -1;
+    fork.GetComponent<B>(3).s = "Forked";
+    fork.DeleteEntity(6);
+    fork.Flush();
+    registry.TryAddComponent(1, A(-2));
+    registry.GetComponent<B>(9).s = "Original";
+    EXPECT_EQ(registry.GetComponent<A>(0).Hello, 0);
+    EXPECT_EQ(registry.GetComponent<B>(3).s, "Entity3");
+    EXPECT_TRUE(registry.IsEntityValid(6));
+    EXPECT_FALSE(fork.HasComponent<A>(1));
+    EXPECT_EQ(fork.GetComponent<B>(9).s, "Entity9");
+
+    uint32_t viewCount = 0;
+    auto view = fork.GetView<A, B>();
+    for (auto& index : view)
+    {
+        auto [a, b] = view.Get(index);
+        if (a.Hello >= 0 && b.s != "Forked")
         {
-            registry.DeleteEntity(i);    
+            EXPECT_EQ(b.s, "Entity" + std::to_string(a.Hello));
         }
-        for (int i = 1800; i < 2120; i++)
+        ++viewCount;
+    }
+    uint32_t expectedCount = 0;
+    for (EntityID entity = 0; entity < 1000; ++entity)
+        expectedCount += fork.IsEntityValid(entity) && entity % 6 == 0;
+    EXPECT_EQ(viewCount, expectedCount);
+
+    // free IDs are handed out in the same order, entities without components are kept
+    EntityID created = registry.CreateEntity();
+    EXPECT_EQ(fork.CreateEntity(), created);
+    ecs::EntityRegistry second = registry.Fork();
+    EXPECT_TRUE(second.IsEntityValid(created));
+    EXPECT_TRUE(second.TryAddComponent(created, A(5)));
+    EXPECT_FALSE(registry.HasComponent<A>(created));
+}
+
+TEST_F(EntityRegistryTest, ForkSharesColumns)
+{
+    using namespace ecs;
+    struct Payload
+    {
+        std::array<float, 64> Values{};
+    };
+    EntityRegistry::RegisterComponentType<Payload>();
+
+    CountingResource resource;
+    {
+        ecs::EntityRegistry registry(10000, &resource);
+        for (int i = 0; i < 10000; ++i)
         {
-            registry.DeleteEntity(i);
+            EntityID entity = registry.CreateEntity();
+            registry.TryAddComponent(entity, Payload());
+            registry.TryAddComponent(entity, A(i));
         }
+        const size_t columnBytes = 10000 * (sizeof(Payload) + sizeof(A));
+
+        // the columns stay with the registry until one side writes to them
+        size_t before = resource.Outstanding;
+        ecs::EntityRegistry fork = registry.Fork();
+        EXPECT_LT(resource.Outstanding - before, columnBytes / 2);
+
+        before = resource.Outstanding;
+        fork.GetComponent<A>(10).Hello = -10;
+        EXPECT_GE(resource.Outstanding - before, 10000 * sizeof(A));
+        EXPECT_LT(resource.Outstanding - before, 10000 * sizeof(Payload));
+        EXPECT_EQ(registry.GetComponent<A>(10).Hello, 10);
+
+        registry.SetChangeTracking(true);
+        ecs::EntityRegistry tracked = registry.Fork();
+        EXPECT_TRUE(tracked.IsChangeTracking());
+    }
+    EXPECT_EQ(resource.Outstanding, 0);
+}
+
+TEST_F(EntityRegistryTest, RollbackRing)
+{
+    using namespace ecs;
+    ecs::EntityRegistry registry;
+    ecs::RollbackRing ring(4);
+    EXPECT_TRUE(ring.IsEmpty());
+
+    // one entity per tick, the A of every entity holds the current tick
+    auto simulate = [&registry](uint64_t tick)
+    {
+        EntityID entity = registry.CreateEntity();
+        registry.TryAddComponent(entity, A());
+        auto view = registry.GetView<A>();
+        for (auto& index : view)
+            std::get<0>(view.Get(index)).Hello = (int)tick;
+    };
+
+    for (uint64_t tick = 1; tick <= 6; ++tick)
+    {
+        simulate(tick);
+        ring.Save(tick, registry);
+    }
+    EXPECT_EQ(ring.GetSize(), 4);
+    EXPECT_EQ(ring.GetOldestTick(), 3);
+    EXPECT_EQ(ring.GetNewestTick(), 6);
+    EXPECT_FALSE(ring.Contains(2));
+    EXPECT_FALSE(ring.Restore(2, registry));
+    EXPECT_EQ(registry.GetEntityCount(), 6);
+
+    ASSERT_TRUE(ring.Restore(4, registry));
+    EXPECT_EQ(registry.GetEntityCount(), 4);
+    EXPECT_EQ(registry.GetComponent<A>(0).Hello, 4);
+    EXPECT_FALSE(registry.IsEntityValid(4));
+
+    // replaying from tick 4 replaces the states saved after it
+    simulate(5);
+    registry.GetComponent<A>(1).Hello = 50;
+    ring.Save(5, registry);
+    EXPECT_EQ(ring.GetNewestTick(), 5);
+    EXPECT_FALSE(ring.Contains(6));
+    ASSERT_TRUE(ring.Restore(5, registry));
+    EXPECT_EQ(registry.GetComponent<A>(1).Hello, 50);
+
+    // a restored state can be restored again after being modified
+    registry.GetComponent<A>(0).Hello = -1;
+    ASSERT_TRUE(ring.Restore(3, registry));
+    ASSERT_TRUE(ring.Restore(5, registry));
+    EXPECT_EQ(registry.GetComponent<A>(0).Hello, 5);
+    EXPECT_EQ(registry.GetEntityCount(), 5);
+
+    ring.Clear();
+    EXPECT_EQ(ring.GetSize(), 0);
+}
+
+TEST_F(EntityRegistryTest, RollbackRingRestoresInPlace)
+{
+    using namespace ecs;
+    ecs::EntityRegistry registry;
+    ecs::RollbackRing ring(4);
+    uint32_t added = 0;
+    registry.OnAdd<A>([&](ComponentBatch<A>& batch) { added += batch.GetSize(); });
+    registry.SetChangeTracking(true);
+    for (int i = 0; i < 3; ++i)
+        registry.TryAddComponent(registry.CreateEntity(), A(i));
+    registry.Flush();
+    EXPECT_EQ(added, 3);
+
+    // the view outlives the save, writing through it must not reach the saved state
+    auto view = registry.GetView<A>();
+    ring.Save(1, registry);
+    for (auto& index : view)
+        std::get<0>(view.Get(index)).Hello += 100;
+    EXPECT_EQ(registry.GetComponent<A>(2).Hello, 102);
+
+    registry.TryAddComponent(0, B("Gone"));
+    registry.TryAddComponent(registry.CreateEntity(), A(3));
+    registry.DeleteEntity(1);
+    EXPECT_THROW(ring.Restore(1, registry), ForkException);
+    registry.Flush();
+    EXPECT_EQ(added, 4);
+
+    // the events queued before the restore are dropped, the observer and the change tracking are kept
+    registry.TryAddComponent(registry.CreateEntity(), A(4));
+    ASSERT_TRUE(ring.Restore(1, registry));
+    registry.Flush();
+    EXPECT_EQ(added, 4);
+    EXPECT_TRUE(registry.IsChangeTracking());
+    EXPECT_EQ(registry.GetEntityCount(), 3);
+    EXPECT_FALSE(registry.HasComponent<B>(0));
+    EXPECT_FALSE(registry.IsEntityValid(3));
+    for (EntityID entity = 0; entity < 3; ++entity)
+        EXPECT_EQ(registry.GetComponent<A>(entity).Hello, (int)entity);
+    EXPECT_EQ(registry.GetView<A>().GetSize(), 3);
+    EXPECT_EQ((registry.GetView<A, B>().GetSize()), 0);
+
+    registry.TryAddComponent(registry.CreateEntity(), A(5));
+    registry.Flush();
+    EXPECT_EQ(added, 5);
+}
+
+TEST_F(EntityRegistryTest, MergeRegistries)
+{
+    using namespace ecs;
+    CountingResource stagingResource;
+    ecs::EntityRegistry live(64);
+    for (int i = 0; i < 50; ++i)
+    {
+        EntityID entity = live.CreateEntity();
+        live.TryAddComponent(entity, A(i));
+    }
+    live.SetChangeTracking(true);
+    std::stringstream snapshot;
+    live.SaveSnapshot(snapshot);
+    ecs::EntityRegistry replica;
+    replica.LoadSnapshot(snapshot);
+
+    {
+        // half of the staging registry shares a memory resource with the live one
+        ecs::EntityRegistry staging(16, &stagingResource);
+        ecs::EntityRegistry sameResource(16);
+        for (int i = 0; i < 100; ++i)
         {
-            SCOPED_TRACE("Flush");
-            registry.Flush();
+            EntityID entity = staging.CreateEntity();
+            if (i % 2 == 0)
+                staging.TryAddComponent(entity, A(1000 + i));
+            if (i % 3 == 0)
+                staging.TryAddComponent(entity, B{ "Staged" + std::to_string(i) });
+            entity = sameResource.CreateEntity();
+            sameResource.TryAddComponent(entity, Transform{ { (float)i, 0, 0 }, { 0, 0, 0 }, { 1, 1, 1 } });
         }
-        for (int i = 696; i < 756; i++)
+        staging.DeleteEntity(4);
+        staging.DeleteComponent<B>(9);
+        staging.Flush();
+        EXPECT_THROW(live.Merge(std::move(live)), MergeException);
+
+        std::vector<std::pair<EntityID, EntityID>> remapped;
+        std::vector<EntityID> remap = live.Merge(std::move(staging), [&](EntityID oldEntity, EntityID newEntity)
         {
-            EXPECT_FALSE(registry.IsEntityValid(i));  
-        }
-        for (int i = 1800; i < 2120; i++)
+            remapped.emplace_back(oldEntity, newEntity);
+        });
+        EXPECT_EQ(live.GetEntityCount(), 50 + 99);
+        EXPECT_EQ(remapped.size(), 99);
+        EXPECT_EQ(remap[4], INVALID_ENTITY_ID);
+        EXPECT_EQ(staging.GetEntityCount(), 0);
+        for (int i = 0; i < 100; ++i)
         {
-            EXPECT_FALSE(registry.IsEntityValid(i));
+            if (i == 4)
+                continue;
+            const EntityID entity = remap[i];
+            ASSERT_TRUE(live.IsEntityValid(entity));
+            EXPECT_EQ(live.HasComponent<A>(entity), i % 2 == 0);
+            EXPECT_EQ(live.HasComponent<B>(entity), i % 3 == 0 && i != 9);
+            if (i % 2 == 0)
+            {
+                EXPECT_EQ(live.GetComponent<A>(entity).Hello, 1000 + i);
+            }
+            if (i % 3 == 0 && i != 9)
+            {
+                EXPECT_EQ(live.GetComponent<B>(entity).s, "Staged" + std::to_string(i));
+            }
         }
+
+        remap = live.Merge(std::move(sameResource));
+        EXPECT_EQ(live.GetComponent<Transform>(remap[99]).Position.x, 99.0f);
+
+        // the staging registry can be filled again
+        EntityID entity = staging.CreateEntity();
+        EXPECT_TRUE(staging.TryAddComponent(entity, A(7)));
+    }
+    EXPECT_EQ(live.GetEntityCount(), 50 + 99 + 100);
+    uint32_t viewCount = 0;
+    auto view = live.GetView<A>();
+    for (auto& index : view)
+    {
+        ++viewCount;
+        (void)index;
     }
+    EXPECT_EQ(viewCount, 50 + 50 - 1);
+
+    // merged entities reach replicas through deltas
+    std::stringstream delta;
+    live.SaveDelta(delta);
+    replica.ApplyDelta(delta);
+    ExpectSameRegistry(live, replica);
+}
+
+TEST_F(EntityRegistryTest, MergeOutOfMemory)
+{
+    using namespace ecs;
+    CountingResource resource;
+    bool merged = false;
+    size_t limit = 0;
+    for (; !merged; ++limit)
     {
-        SCOPED_TRACE("Verify Component Values");
-        ScopeTimer timer("Verify Component Values");
-        for (EntityID entity = 0; entity < 8192; entity++)
         {
-            if (entity >= 100 && entity < 420)
-            {
-                EXPECT_FALSE(registry.HasComponent<Transform>(entity));
-                EXPECT_TRUE(registry.HasComponent<A>(entity));
-                EXPECT_TRUE(registry.HasComponent<B>(entity));
-                EXPECT_EQ(registry.GetComponent<A>(entity).Hello, A{(int)entity}.Hello);
-                EXPECT_EQ(registry.GetComponent<B>(entity).s, B{"Entity" + std::to_string(entity)}.s);
-            }
-            else if (entity >= 420 && entity < 1000)
+            ecs::EntityRegistry live(256, &resource);
+            ecs::EntityRegistry staging(64);
+            uint32_t added = 0;
+            live.OnAdd<A>([&](ComponentBatch<A>& batch) { added += batch.GetSize(); });
+            live.SetChangeTracking(true);
+            for (int i = 0; i < 40; ++i)
             {
-                if (entity >= 696 && entity < 756)
+                if (i < 20)
                 {
-                    EXPECT_FALSE(registry.IsEntityValid(entity));
-                    continue;
+                    EntityID entity = live.CreateEntity();
+                    live.TryAddComponent(entity, A(i));
+                    if (i % 2)
+                        live.TryAddComponent(entity, B{ "Live" + std::to_string(i) });
                 }
-                EXPECT_FALSE(registry.HasComponent<A>(entity));
-                EXPECT_TRUE(registry.HasComponent<B>(entity));
-                EXPECT_TRUE(registry.HasComponent<Transform>(entity));
-                EXPECT_EQ(registry.GetComponent<B>(entity).s, B{"Entity" + std::to_string(entity)}.s);
-                auto t = Transform{{(float)-(int)entity, (float)entity, (float)entity * 10}, {0, 0, 0}, {1, 1, 1}};
-                EXPECT_EQ(registry.GetComponent<Transform>(entity).Position, t.Position);
+                EntityID entity = staging.CreateEntity();
+                if (i % 2 == 0)
+                    staging.TryAddComponent(entity, A(1000 + i));
+                if (i % 3 == 0)
+                    staging.TryAddComponent(entity, B{ "Staged" + std::to_string(i) });
+                if (i % 5 == 0)
+                    staging.TryAddComponent(entity, Transform{ { (float)i, 0, 0 }, { 0, 0, 0 }, { 1, 1, 1 } });
             }
-            else if (entity >= 1000 && entity < 1400)
+            live.Flush();
+            ecs::EntityRegistry expectedLive = live.Fork();
+            ecs::EntityRegistry expectedStaging = staging.Fork();
+            const uint32_t addedBefore = added;
+
+            resource.AllocationLimit = resource.AllocationCount + limit;
+            try
             {
-                EXPECT_FALSE(registry.HasComponent<B>(entity));
-                EXPECT_TRUE(registry.HasComponent<A>(entity));
-                EXPECT_TRUE(registry.HasComponent<Transform>(entity));
-                EXPECT_EQ(registry.GetComponent<A>(entity).Hello, A{(int)entity}.Hello);
-                auto t = Transform{{(float)-(int)entity, (float)entity, (float)entity * 10}, {0, 0, 0}, {1, 1, 1}};
-                EXPECT_EQ(registry.GetComponent<Transform>(entity).Position, t.Position);
+                live.Merge(std::move(staging));
+                merged = true;
             }
-            else if (entity >= 1400 && entity < 1800)
+            catch (const std::bad_alloc&) {}
+            resource.AllocationLimit = SIZE_MAX;
+
+            if (merged)
             {
-                EXPECT_FALSE(registry.HasComponent<Transform>(entity));
-                EXPECT_FALSE(registry.HasComponent<B>(entity));
-                EXPECT_TRUE(registry.HasComponent<A>(entity));
-                EXPECT_EQ(registry.GetComponent<A>(entity).Hello, A{(int)entity}.Hello);
+                EXPECT_EQ(live.GetEntityCount(), 60);
+                EXPECT_EQ(staging.GetEntityCount(), 0);
             }
-            else if (entity >= 1800 && entity < 2120)
+            else
             {
-                EXPECT_FALSE(registry.IsEntityValid(entity));
+                // nothing moved, no event was queued
+                ExpectSameRegistry(expectedLive, live);
+                ExpectSameRegistry(expectedStaging, staging);
+                live.Flush();
+                EXPECT_EQ(added, addedBefore);
+            }
+        }
+        // the allocations made before running out of memory all went back to the resource
+        EXPECT_EQ(resource.Outstanding, 0);
+        if (merged)
+            break;
+    }
+    EXPECT_GT(limit, 1);
+}
+
+TEST_F(EntityRegistryTest, MoveEntityBetweenRegistries)
+{
+    using namespace ecs;
+    ecs::EntityRegistry source;
+    ecs::EntityRegistry target;
+    target.CreateEntity();
+    EntityID first = source.CreateEntity();
+    source.TryAddComponent(first, A(1));
+    source.TryAddComponent(first, B{ "First" });
+    EntityID second = source.CreateEntity();
+    source.TryAddComponent(second, A(2));
+    EntityID empty = source.CreateEntity();
+
+    EntityID moved = target.MoveEntity(source, first);
+    EXPECT_NE(moved, first);
+    EXPECT_FALSE(source.IsEntityValid(first));
+    EXPECT_EQ(source.GetEntityCount(), 2);
+    EXPECT_EQ(target.GetComponent<A>(moved).Hello, 1);
+    EXPECT_EQ(target.GetComponent<B>(moved).s, "First");
+    EXPECT_EQ(source.GetComponent<A>(second).Hello, 2);
+
+    EntityID movedEmpty = target.MoveEntity(source, empty);
+    EXPECT_TRUE(target.IsEntityValid(movedEmpty));
+    EXPECT_FALSE(target.HasComponent<A>(movedEmpty));
+    EXPECT_THROW(target.MoveEntity(source, first), EntityIDOutOfRange);
+
+    // and back
+    EntityID back = source.MoveEntity(target, moved);
+    EXPECT_EQ(source.GetComponent<B>(back).s, "First");
+    EXPECT_EQ(target.GetEntityCount(), 2);
+
+    // a queued deletion would apply to whichever entity gets the ID next
+    source.DeleteComponent<A>(back);
+    EXPECT_THROW(target.MoveEntity(source, back), MergeException);
+    EXPECT_TRUE(source.HasComponent<A>(back));
+    source.Flush();
+    EXPECT_FALSE(source.HasComponent<A>(back));
+    EntityID movedBack = target.MoveEntity(source, back);
+    EXPECT_FALSE(target.HasComponent<A>(movedBack));
+    EXPECT_EQ(target.GetComponent<B>(movedBack).s, "First");
+}
+
+TEST_F(EntityRegistryTest, MoveEntityOutOfMemory)
+{
+    using namespace ecs;
+    CountingResource resource;
+    bool moved = false;
+    size_t limit = 0;
+    for (; !moved; ++limit)
+    {
+        {
+            ecs::EntityRegistry source;
+            ecs::EntityRegistry target(64, &resource);
+            EntityID entity = source.CreateEntity();
+            source.TryAddComponent(entity, A(7));
+            source.TryAddComponent(entity, B{ "Moved" });
+            // the target archetype exists and is full, moving in has to grow it
+            for (int i = 0; i < 16; ++i)
+            {
+                EntityID existing = target.CreateEntity();
+                target.TryAddComponent(existing, A(i));
+                target.TryAddComponent(existing, B{ "Target" });
+            }
+
+            resource.AllocationLimit = resource.AllocationCount + limit;
+            EntityID newEntity = INVALID_ENTITY_ID;
+            try
+            {
+                newEntity = target.MoveEntity(source, entity);
+                moved = true;
+            }
+            catch (const std::bad_alloc&) {}
+            resource.AllocationLimit = SIZE_MAX;
+
+            if (moved)
+            {
+                EXPECT_FALSE(source.IsEntityValid(entity));
+                EXPECT_EQ(target.GetComponent<B>(newEntity).s, "Moved");
             }
             else
             {
-                EXPECT_TRUE(registry.HasComponent<Transform>(entity));
-                EXPECT_TRUE(registry.HasComponent<A>(entity));
-                EXPECT_TRUE(registry.HasComponent<B>(entity));
+                // the entity is still in the source and no ID of the target was taken
+                EXPECT_EQ(source.GetComponent<B>(entity).s, "Moved");
+                EXPECT_EQ(target.GetEntityCount(), 16);
+                EntityID retried = target.MoveEntity(source, entity);
+                EXPECT_EQ(target.GetComponent<A>(retried).Hello, 7);
+                EXPECT_EQ(target.GetEntityCount(), 17);
             }
         }
+        EXPECT_EQ(resource.Outstanding, 0);
+        if (moved)
+            break;
     }
+    EXPECT_GT(limit, 1);
 }
 
-TEST_F(EntityRegistryTest, AddAndVerifyComponents)
+TEST_F(EntityRegistryTest, ObserversAreBatched)
 {
+    using namespace ecs;
     ecs::EntityRegistry registry;
+    uint32_t addCalls = 0;
+    uint32_t added = 0;
+    int addedSum = 0;
+    ObserverID onAdd = registry.OnAdd<A>([&](ComponentBatch<A>& batch)
+    {
+        ++addCalls;
+        added += batch.GetSize();
+        for (uint32_t i = 0; i < batch.GetSize(); ++i)
+        {
+            EXPECT_EQ(&batch.GetComponent(i), &registry.GetComponent<A>(batch.GetEntities()[i]));
+            addedSum += batch.GetComponent(i).Hello;
+        }
+    });
 
-    EntityID entity0 = registry.CreateEntity();
-    Transform transform{ {1.0f, 2.0f, 3.0f}, {0,0,0}, {1,1,1} };
-    A a{ 42 };
+    // two archetypes, many entities: one call each
+    std::vector<EntityID> entities;
+    for (int i = 0; i < 1000; ++i)
+    {
+        EntityID entity = registry.CreateEntity();
+        if (i % 2)
+            registry.TryAddComponent(entity, B{ "Odd" });
+        registry.EmplaceComponent<A>(entity, A(i));
+        entities.push_back(entity);
+    }
+    EXPECT_EQ(addCalls, 0);
+    registry.Flush();
+    EXPECT_EQ(addCalls, 2);
+    EXPECT_EQ(added, 1000);
+    EXPECT_EQ(addedSum, 999 * 1000 / 2);
 
-    registry.TryAddComponent(entity0, transform);
-    registry.TryAddComponent(entity0, a);
-    EXPECT_EQ(registry.GetComponent<Transform>(entity0).Position, transform.Position);
-    EXPECT_EQ(registry.GetComponent<A>(entity0).Hello, a.Hello);
+    // the removed component isn't reported as added, the destroyed entity only as removed
+    std::vector<EntityID> removed;
+    registry.OnRemove<A>([&](ComponentBatch<A>& batch)
+    {
+        EXPECT_FALSE(batch.HasComponents());
+        removed.insert(removed.end(), batch.GetEntities().begin(), batch.GetEntities().end());
+    });
+    EntityID transient = registry.CreateEntity();
+    registry.TryAddComponent(transient, A(5));
+    registry.DeleteComponent<A>(transient);
+    registry.DeleteEntity(entities[0]);
+    registry.DeleteEntity(entities[1]);
+    addCalls = added = 0;
+    registry.Flush();
+    EXPECT_EQ(addCalls, 0);
+    EXPECT_EQ(removed, (std::vector<EntityID>{ transient, entities[0], entities[1] }));
+
+    // replaced and reported values, each entity once
+    std::vector<EntityID> set;
+    registry.OnSet<A>([&](ComponentBatch<A>& batch)
+    {
+        set.insert(set.end(), batch.GetEntities().begin(), batch.GetEntities().end());
+    });
+    registry.TryReplaceComponent(entities[2], A(-1));
+    registry.MarkComponentChanged<A>(entities[2]);
+    registry.MarkComponentChanged<A>(entities[3]);
+    registry.MarkComponentChanged<B>(entities[4]);
+    registry.DispatchEvents();
+    std::sort(set.begin(), set.end());
+    EXPECT_EQ(set, (std::vector<EntityID>{ entities[2], entities[3] }));
+
+    EXPECT_TRUE(registry.RemoveObserver(onAdd));
+    EXPECT_FALSE(registry.RemoveObserver(onAdd));
+    registry.TryAddComponent(registry.CreateEntity(), A(0));
+    registry.Flush();
+    EXPECT_EQ(addCalls, 0);
+
+    // entities arriving from another registry are added
+    uint32_t moved = 0;
+    registry.OnAdd<B>([&](ComponentBatch<B>& batch) { moved += batch.GetSize(); });
+    ecs::EntityRegistry staging;
+    for (int i = 0; i < 10; ++i)
+        staging.TryAddComponent(staging.CreateEntity(), B{ "Staged" });
+    // and removed from the registry they leave, whether merged or moved one by one
+    uint32_t left = 0;
+    staging.OnRemove<B>([&](ComponentBatch<B>& batch) { left += batch.GetSize(); });
+    EntityID single = registry.MoveEntity(staging, 0);
+    staging.Flush();
+    EXPECT_EQ(left, 1);
+    registry.Merge(std::move(staging));
+    registry.Flush();
+    EXPECT_EQ(moved, 10);
+    staging.Flush();
+    EXPECT_EQ(left, 10);
+    EXPECT_TRUE(registry.HasComponent<B>(single));
+
+    // moving a registry into another one keeps the observers of the target and drops its queued events
+    ecs::EntityRegistry replacement;
+    replacement.TryAddComponent(replacement.CreateEntity(), B{ "Replacement" });
+    registry.TryAddComponent(registry.CreateEntity(), B{ "Dropped" });
+    moved = 0;
+    registry = std::move(replacement);
+    registry.TryAddComponent(registry.CreateEntity(), B{ "Kept" });
+    registry.Flush();
+    EXPECT_EQ(moved, 1);
+    registry = registry.Fork();
+    registry.TryAddComponent(registry.CreateEntity(), B{ "Forked" });
+    registry.Flush();
+    EXPECT_EQ(moved, 2);
 }
 
-TEST_F(EntityRegistryTest, DeleteComponentsPreservesOtherComponents)
+TEST_F(EntityRegistryTest, DisabledEntities)
 {
+    using namespace ecs;
     ecs::EntityRegistry registry;
+    registry.SetChangeTracking(true);
+    ecs::EntityRegistry replica;
+    replica.SetChangeTracking(true);
 
-    EntityID entity0 = registry.CreateEntity();
-    Transform transform{ {1.0f, 2.0f, 3.0f}, {0,0,0}, {1,1,1} };
-    A a{ 42 };
+    // more than a word of rows, every third one disabled
+    std::vector<EntityID> entities;
+    for (int i = 0; i < 200; ++i)
+    {
+        EntityID entity = registry.CreateEntity();
+        registry.TryAddComponent(entity, A(i));
+        entities.push_back(entity);
+    }
+    for (int i = 0; i < 200; i += 3)
+        registry.SetEnabled(entities[i], false);
+    EXPECT_FALSE(registry.IsEnabled(entities[0]));
+    EXPECT_TRUE(registry.IsEnabled(entities[1]));
+    EXPECT_EQ(registry.GetComponent<A>(entities[0]).Hello, 0);
 
-    registry.TryAddComponent(entity0, transform);
-    registry.TryAddComponent(entity0, a);
+    auto expectVisible = [&registry](std::vector<int> expected)
+    {
+        std::vector<int> visible;
+        auto view = registry.GetView<A>();
+        for (auto& index : view)
+        {
+            visible.push_back(std::get<0>(view.Get(index)).Hello);
+            EXPECT_TRUE(registry.IsEnabled(index.Entity));
+        }
+        std::sort(visible.begin(), visible.end());
+        EXPECT_EQ(visible, expected);
+    };
+    std::vector<int> expected;
+    for (int i = 0; i < 200; ++i)
+    {
+        if (i % 3)
+            expected.push_back(i);
+    }
+    expectVisible(expected);
 
-    registry.DeleteComponent<Transform>(entity0);
+    // swap and pop carries the flag of the last row, migrations keep it
+    registry.DeleteEntity(entities[1]);
+    registry.DeleteEntity(entities[197]);
+    registry.TryAddComponent(entities[3], B{ "Disabled" });
+    registry.TryAddComponent(entities[4], B{ "Enabled" });
     registry.Flush();
+    std::erase(expected, 1);
+    std::erase(expected, 197);
+    expectVisible(expected);
+    EXPECT_FALSE(registry.IsEnabled(entities[3]));
+    auto both = registry.GetView<A, B>();
+    EXPECT_EQ(std::distance(both.begin(), both.end()), 1);
 
-    EXPECT_FALSE(registry.HasComponent<Transform>(entity0));
-    EXPECT_TRUE(registry.HasComponent<A>(entity0));
-    EXPECT_EQ(registry.GetComponent<A>(entity0).Hello, a.Hello);
+    // a whole archetype disabled, and an entity without components
+    registry.SetEnabled(entities[4], false);
+    EXPECT_TRUE((registry.GetView<A, B>().begin() == registry.GetView<A, B>().end()));
+    EntityID bare = registry.CreateEntity();
+    registry.SetEnabled(bare, false);
+    registry.TryAddComponent(bare, A(1000));
+    EXPECT_FALSE(registry.IsEnabled(bare));
+    registry.SetEnabled(entities[0], true);
+    std::erase(expected, 4);
+    expected.insert(expected.begin(), 0);
+    expectVisible(expected);
+
+    // deltas, snapshots, forks and moves keep the state
+    std::stringstream delta;
+    registry.SaveDelta(delta);
+    replica.ApplyDelta(delta);
+    ExpectSameRegistry(registry, replica);
+    std::stringstream snapshot;
+    registry.SaveSnapshot(snapshot);
+    ecs::EntityRegistry loaded;
+    loaded.LoadSnapshot(snapshot);
+    ExpectSameRegistry(registry, loaded);
+    ecs::EntityRegistry fork = registry.Fork();
+    ExpectSameRegistry(registry, fork);
+    ecs::EntityRegistry other;
+    EntityID moved = other.MoveEntity(registry, entities[3]);
+    EXPECT_FALSE(other.IsEnabled(moved));
+    EXPECT_EQ(other.GetComponent<B>(moved).s, "Disabled");
+    EntityID recycled = registry.CreateEntity();
+    EXPECT_TRUE(registry.IsEnabled(recycled));
+    EXPECT_THROW(registry.SetEnabled(entities[1], false), EntityIDOutOfRange);
 }
 
-TEST_F(EntityRegistryTest, DeleteEntityCleansUpComponents)
+TEST_F(EntityRegistryTest, SplitComponents)
 {
+    using namespace ecs;
+    EntityRegistry::RegisterComponentType<Particle>();
     ecs::EntityRegistry registry;
-    EntityID entity0 = registry.CreateEntity();
-    EXPECT_TRUE(registry.IsEntityValid(entity0));
-    Transform transform{ {1.0f, 2.0f, 3.0f}, {0,0,0}, {1,1,1} };
-    A a{ 42 };
+    registry.Reserve<Particle, A>(16);
 
-    registry.TryAddComponent(entity0, transform);
-    registry.TryAddComponent(entity0, a);
+    EntityID first = registry.CreateEntity();
+    registry.TryAddComponent(first, A(1));
+    EXPECT_TRUE(registry.TryAddComponent(first, Particle{ { { 1, 2, 3 }, { 1, 0, 0 } }, { { 0, 1, 0 }, 2.0f, 7 } }));
+    EXPECT_FALSE(registry.TryAddComponent(first, Particle{}));
+    EXPECT_TRUE(registry.HasComponent<Particle>(first));
+    EXPECT_TRUE(registry.HasComponent<ParticleMotion>(first));
+    EXPECT_TRUE(registry.HasComponent<ParticleLook>(first));
+    EXPECT_EQ(registry.GetComponent<ParticleLook>(first).Emitter, 7);
+    EXPECT_EQ(registry.GetComponent<A>(first).Hello, 1);
 
-    registry.DeleteEntity(entity0);
+    EntityID second = registry.CreateEntity();
+    SplitComponentRef<Particle> parts = registry.EmplaceComponent<Particle>(second, Particle{ { { 5, 5, 5 }, { 0, 0, 1 } }, {} });
+    parts.ColdPart.Lifetime = 3.0f;
+    EXPECT_EQ(registry.GetComponent<Particle>(second).Get().Look.Lifetime, 3.0f);
+    EXPECT_THROW(registry.EmplaceComponent<Particle>(second), ComponentAlreadyExistsException);
+
+    // the hot part alone
+    auto view = registry.GetView<ParticleMotion>();
+    for (auto& index : view)
+    {
+        auto [motion] = view.Get(index);
+        motion.Position.x += motion.Velocity.x;
+    }
+    Particle joined = registry.GetComponent<Particle>(first);
+    EXPECT_EQ(joined.Motion.Position, (vec3{ 2, 2, 3 }));
+    EXPECT_EQ(joined.Look.Lifetime, 2.0f);
+
+    EXPECT_TRUE(registry.TryReplaceComponent(second, Particle{ { { 0, 0, 0 }, { 0, 0, 0 } }, { { 0, 0, 0 }, 9.0f, 1 } }));
+    EXPECT_EQ(registry.GetComponent<ParticleLook>(second).Lifetime, 9.0f);
+    registry.GetComponent<Particle>(second) = Particle{};
+    EXPECT_EQ(registry.GetComponent<ParticleLook>(second).Lifetime, 0.0f);
+
+    // one part alone isn't the whole component
+    registry.DeleteComponent<ParticleLook>(second);
     registry.Flush();
+    EXPECT_TRUE(registry.HasComponent<ParticleMotion>(second));
+    EXPECT_FALSE(registry.HasComponent<Particle>(second));
+    EXPECT_FALSE((registry.HasComponents<Particle, A>(second)));
+    EXPECT_TRUE((registry.HasComponents<Particle, A>(first)));
+    EXPECT_FALSE(registry.TryReplaceComponent(second, Particle{ { { 9, 9, 9 }, { 0, 0, 0 } }, {} }));
+    EXPECT_EQ(registry.GetComponent<ParticleMotion>(second).Position.x, 0.0f);
 
-    EXPECT_FALSE(registry.IsEntityValid(entity0));
-    EXPECT_FALSE(registry.HasComponent<Transform>(entity0));
-    EXPECT_FALSE(registry.HasComponent<A>(entity0));
+    registry.DeleteComponent<Particle>(first);
+    registry.Flush();
+    EXPECT_FALSE(registry.HasComponent<Particle>(first));
+    EXPECT_FALSE(registry.HasComponent<ParticleMotion>(first));
+    EXPECT_FALSE(registry.HasComponent<ParticleLook>(first));
+    EXPECT_EQ(registry.GetComponent<A>(first).Hello, 1);
 }
 
-TEST_F(EntityRegistryTest, MultipleEntitiesWithSameSignature) {
+TEST_F(EntityRegistryTest, LaneComponents)
+{
+    using namespace ecs;
+    EntityRegistry::RegisterComponentTypes<Boid, A>();
     ecs::EntityRegistry registry;
-    Transform t1{ {1.0f, 2.0f, 3.0f}, {0,0,0}, {1,1,1} };
-    Transform t2{ {4.0f, 5.0f, 6.0f}, {0,0,0}, {1,1,1} };
-    Transform t3{ {7.0f, 8.0f, 9.0f}, {0,0,0}, {1,1,1} };
-    Transform t4{ {10.0f, 11.0f, 12.0f}, {0,0,0}, {1,1,1} };
-    Transform t5{ {13.0f, 14.0f, 15.0f}, {0,0,0}, {1,1,1} };
-    A a1{ 42 };
-    A a2{ 84 };
-    A a3{ 126 };
-    A a4{ 168 };
-    A a5{ 210 };
+    registry.Reserve<Boid>(4);
 
-    EntityID entity0 = registry.CreateEntity();
-    EntityID entity1 = registry.CreateEntity();
-    EntityID entity2 = registry.CreateEntity();
-    EntityID entity3 = registry.CreateEntity();
-    EntityID entity4 = registry.CreateEntity();
+    constexpr uint32_t entityCount = 20;
+    std::vector<EntityID> entities;
+    for (uint32_t i = 0; i < entityCount; ++i)
+    {
+        EntityID entity = registry.CreateEntity();
+        EXPECT_TRUE(registry.TryAddComponent(entity, Boid{ { (float)i, 0, 0 }, { 1, 2, 3 } }));
+        entities.push_back(entity);
+    }
+    EXPECT_FALSE(registry.TryAddComponent(entities[0], Boid{}));
+    EXPECT_EQ(registry.GetComponent<Boid>(entities[5]).Get().Position, (vec3{ 5, 0, 0 }));
 
-    registry.TryAddComponent(entity0, t1);
-    registry.TryAddComponent(entity0, a1);
-    registry.TryAddComponent(entity1, t2);
-    registry.TryAddComponent(entity1, a2);
-    registry.TryAddComponent(entity2, t3);
-    registry.TryAddComponent(entity2, a3);
-    registry.TryAddComponent(entity3, t4);
-    registry.TryAddComponent(entity3, a4);
-    registry.TryAddComponent(entity4, t5);
-    registry.TryAddComponent(entity4, a5);
+    // written through the reference, scattered in the lanes
+    registry.GetComponent<Boid>(entities[6]) = Boid{ { 60, 0, 0 }, { 1, 2, 3 } };
+    EXPECT_TRUE(registry.TryReplaceComponent(entities[7], Boid{ { 70, 0, 0 }, { 1, 2, 3 } }));
+    Boid boid = registry.GetComponent<Boid>(entities[6]);
+    EXPECT_EQ(boid.Position.x, 60.0f);
+    EXPECT_EQ(boid.Velocity, (vec3{ 1, 2, 3 }));
 
-    EXPECT_EQ(registry.GetComponent<Transform>(entity0).Position, t1.Position);
-    EXPECT_EQ(registry.GetComponent<A>(entity0).Hello, a1.Hello);
+    // the last boid takes the row of the removed one
+    registry.DeleteComponent<Boid>(entities[2]);
+    registry.Flush();
+    EXPECT_FALSE(registry.HasComponent<Boid>(entities[2]));
+    EXPECT_EQ(registry.GetComponent<Boid>(entities[19]).Get().Position.x, 19.0f);
 
-    EXPECT_EQ(registry.GetComponent<Transform>(entity1).Position, t2.Position);
-    EXPECT_EQ(registry.GetComponent<A>(entity1).Hello, a2.Hello);
+    // moving to another archetype carries the boid
+    registry.TryAddComponent(entities[4], A(4));
+    EXPECT_EQ(registry.GetComponent<Boid>(entities[4]).Get().Position.x, 4.0f);
 
-    EXPECT_EQ(registry.GetComponent<Transform>(entity2).Position, t3.Position);
-    EXPECT_EQ(registry.GetComponent<A>(entity2).Hello, a3.Hello);
+    registry.SetEnabled(entities[8], false);
+    registry.DeleteEntity(entities[9]);
+    std::vector<float> expected(entityCount, -1.0f);
+    float expectedSum = 0;
+    for (uint32_t i = 0; i < entityCount; ++i)
+    {
+        if (i == 2 || i == 8 || i == 9)
+            continue;
+        expectedSum += registry.GetComponent<Boid>(entities[i]).Get().Position.x;
+    }
 
-    EXPECT_EQ(registry.GetComponent<Transform>(entity3).Position, t4.Position);
-    EXPECT_EQ(registry.GetComponent<A>(entity3).Hello, a4.Hello);
+    auto sumPositions = [](ecs::EntityRegistry& from)
+    {
+        float sum = 0;
+        uint32_t count = 0;
+        from.EachBlock<Boid>([&](uint64_t mask, LaneBlock<Boid>& block)
+        {
+            const float* x = block.Field(offsetof(Boid, Position.x));
+            for (uint32_t lane = 0; lane < LaneBlock<Boid>::Lanes; ++lane)
+            {
+                if (mask & (uint64_t(1) << lane))
+                {
+                    sum += x[lane];
+                    ++count;
+                }
+            }
+        });
+        return std::pair(sum, count);
+    };
+    EXPECT_EQ(sumPositions(registry), std::pair(expectedSum, entityCount - 3));
 
-    EXPECT_EQ(registry.GetComponent<Transform>(entity4).Position, t5.Position);
-    EXPECT_EQ(registry.GetComponent<A>(entity4).Hello, a5.Hello);
+    // components without a LaneLayout come along as the rows of the block
+    for (uint32_t i = 10; i < entityCount; i += 2)
+        registry.TryAddComponent(entities[i], A((int)i));
+    uint32_t withA = 0;
+    registry.EachBlock<Boid, A>([&withA](uint64_t mask, LaneBlock<Boid>& block, A* a)
+    {
+        const float* x = block.Field(offsetof(Boid, Position.x));
+        for (uint64_t bits = mask; bits; bits &= bits - 1)
+        {
+            const uint32_t lane = (uint32_t)std::countr_zero(bits);
+            EXPECT_EQ(x[lane], (float)a[lane].Hello);
+            ++withA;
+        }
+    });
+    EXPECT_EQ(withA, 6);
 
-    registry.DeleteComponent<Transform>(entity0);
+    // every lane is integrated, the hidden ones are left as they were
+    registry.EachBlock<Boid>([](uint64_t mask, LaneBlock<Boid>& block)
+    {
+        float* x = block.Field(offsetof(Boid, Position.x));
+        const float* vx = block.Field(offsetof(Boid, Velocity.x));
+        for (uint32_t lane = 0; lane < LaneBlock<Boid>::Lanes; ++lane)
+            x[lane] = mask & (uint64_t(1) << lane) ? x[lane] + vx[lane] : x[lane];
+    });
+    EXPECT_EQ(registry.GetComponent<Boid>(entities[0]).Get().Position.x, 1.0f);
+    EXPECT_EQ(registry.GetComponent<Boid>(entities[8]).Get().Position.x, 8.0f);
     registry.Flush();
 
-    EXPECT_FALSE(registry.HasComponent<Transform>(entity0));
-    EXPECT_EQ(registry.GetComponent<A>(entity0).Hello, a1.Hello);
+    std::stringstream stream;
+    registry.SaveSnapshot(stream);
+    ecs::EntityRegistry loaded;
+    loaded.LoadSnapshot(stream);
+    ecs::EntityRegistry fork = registry.Fork();
+    for (uint32_t i = 0; i < entityCount; ++i)
+    {
+        if (i == 2 || i == 9)
+            continue;
+        const Boid original = registry.GetComponent<Boid>(entities[i]);
+        EXPECT_EQ(loaded.GetComponent<Boid>(entities[i]).Get(), original);
+        EXPECT_EQ(fork.GetComponent<Boid>(entities[i]).Get(), original);
+    }
+    EXPECT_EQ(sumPositions(loaded), sumPositions(registry));
+    fork.GetComponent<Boid>(entities[0]) = Boid{};
+    EXPECT_EQ(registry.GetComponent<Boid>(entities[0]).Get().Position.x, 1.0f);
+}
 
-    EXPECT_EQ(registry.GetComponent<Transform>(entity1).Position, t2.Position);
-    EXPECT_EQ(registry.GetComponent<A>(entity1).Hello, a2.Hello);
+#ifdef ECS_BENCHMARKS
+// count entities moving along x, entity i at x = i
+static void PopulateMovers(ecs::EntityRegistry& registry, uint32_t count)
+{
+    registry.Reserve<Position, Velocity>(count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        ecs::EntityID entity = registry.CreateEntity();
+        registry.TryAddComponent(entity, Position{ { (float)i, 0, 0 } });
+        registry.TryAddComponent(entity, Velocity{ { 1, 2, 3 } });
+    }
+}
 
-    EXPECT_EQ(registry.GetComponent<Transform>(entity2).Position, t3.Position);
-    EXPECT_EQ(registry.GetComponent<A>(entity2).Hello, a3.Hello);
+TEST_F(EntityRegistryTest, SnapshotBenchmark)
+{
+    using namespace ecs;
+    constexpr uint32_t entityCount = 1000000;
+    ecs::EntityRegistry registry(entityCount);
+    registry.Reserve<Transform, A>(entityCount);
+    for (uint32_t i = 0; i < entityCount; ++i)
+    {
+        EntityID entity = registry.CreateEntity();
+        registry.TryAddComponent(entity, Transform{ { (float)i, 0, 0 }, { 0, 0, 0 }, { 1, 1, 1 } });
+        registry.TryAddComponent(entity, A((int)i));
+    }
 
-    EXPECT_EQ(registry.GetComponent<Transform>(entity3).Position, t4.Position);
-    EXPECT_EQ(registry.GetComponent<A>(entity3).Hello, a4.Hello);
+    std::stringstream stream;
+    {
+        ScopeTimer timer("Save a snapshot of 1M entities with Transform and A");
+        registry.SaveSnapshot(stream);
+    }
+    ecs::EntityRegistry loaded;
+    {
+        ScopeTimer timer("Load a snapshot of 1M entities with Transform and A");
+        loaded.LoadSnapshot(stream);
+    }
+    EXPECT_EQ(loaded.GetEntityCount(), entityCount);
+    EXPECT_EQ(loaded.GetComponent<A>(entityCount - 1).Hello, (int)entityCount - 1);
 
-    EXPECT_EQ(registry.GetComponent<Transform>(entity4).Position, t5.Position);
-    EXPECT_EQ(registry.GetComponent<A>(entity4).Hello, a5.Hello);
+    const std::string path = (std::filesystem::temp_directory_path() / "ecs_snapshot_benchmark.bin").string();
+    {
+        std::ofstream file(path, std::ios::binary);
+        registry.SaveSnapshot(file);
+    }
+    {
+        ecs::EntityRegistry fromFile;
+        ScopeTimer timer("Load a snapshot file of 1M entities with Transform and A");
+        std::ifstream file(path, std::ios::binary);
+        fromFile.LoadSnapshot(file);
+    }
+    {
+        ecs::EntityRegistry fromMapping;
+        ScopeTimer timer("Load a mapped snapshot file of 1M entities with Transform and A");
+        MappedFile mapping(path);
+        fromMapping.LoadSnapshot(mapping.GetData());
+    }
+    std::filesystem::remove(path);
 }
 
-TEST_F(EntityRegistryTest, MigrateEntityBetweenArchetypes) {
-    ecs::EntityRegistry registry;
-    Transform t{ {1.0f, 2.0f, 3.0f}, {0,0,0}, {1,1,1} };
-    A a{ 42 };
-    B b{ "SD" };
+TEST_F(EntityRegistryTest, ForkBenchmark)
+{
+    using namespace ecs;
+    constexpr uint32_t entityCount = 1000000;
+    ecs::EntityRegistry registry(entityCount);
+    registry.Reserve<Transform, A>(entityCount);
+    for (uint32_t i = 0; i < entityCount; ++i)
+    {
+        EntityID entity = registry.CreateEntity();
+        registry.TryAddComponent(entity, Transform{ { (float)i, 0, 0 }, { 0, 0, 0 }, { 1, 1, 1 } });
+        registry.TryAddComponent(entity, A((int)i));
+    }
 
-    EntityID entity = registry.CreateEntity();
+    {
+        ScopeTimer timer("Save and load a snapshot of 1M entities with Transform and A");
+        std::stringstream stream;
+        registry.SaveSnapshot(stream);
+        ecs::EntityRegistry loaded;
+        loaded.LoadSnapshot(stream);
+    }
+    RollbackRing ring(8);
+    {
+        ScopeTimer timer("Save 1M entities with Transform and A in a rollback ring");
+        ring.Save(0, registry);
+    }
+    {
+        ScopeTimer timer("Write A after a save (copies the A column)");
+        auto view = registry.GetView<A>();
+        for (auto& index : view)
+            ++std::get<0>(view.Get(index)).Hello;
+    }
+    {
+        ScopeTimer timer("Restore 1M entities with Transform and A from a rollback ring");
+        ring.Restore(0, registry);
+    }
+    EXPECT_EQ(registry.GetComponent<A>(entityCount - 1).Hello, (int)entityCount - 1);
+}
 
-    registry.TryAddComponent(entity, t);
-    registry.TryAddComponent(entity, a);
+TEST_F(EntityRegistryTest, SnapshotAsyncBenchmark)
+{
+    using namespace ecs;
+    constexpr uint32_t entityCount = 1000000;
+    ecs::EntityRegistry registry(entityCount);
+    registry.Reserve<Transform, A>(entityCount);
+    for (uint32_t i = 0; i < entityCount; ++i)
+    {
+        EntityID entity = registry.CreateEntity();
+        registry.TryAddComponent(entity, Transform{ { (float)i, 0, 0 }, { 0, 0, 0 }, { 1, 1, 1 } });
+        registry.TryAddComponent(entity, A((int)i));
+    }
+
+    std::stringstream stream;
+    EntityRegistry::AsyncSnapshot snapshot;
+    {
+        ScopeTimer timer("Start an async snapshot of 1M entities with Transform and A (main thread stall)");
+        snapshot = registry.SnapshotAsync(stream);
+    }
+    {
+        ScopeTimer timer("Update A of 1M entities while the snapshot is written");
+        auto view = registry.GetView<A>();
+        for (auto& index : view)
+            ++std::get<0>(view.Get(index)).Hello;
+    }
+    {
+        ScopeTimer timer("Wait for the async snapshot");
+        snapshot.Wait();
+    }
+    ecs::EntityRegistry loaded;
+    loaded.LoadSnapshot(stream);
+    EXPECT_EQ(loaded.GetComponent<A>(entityCount - 1).Hello, (int)entityCount - 1);
+}
 
-    EXPECT_EQ(registry.GetComponent<Transform>(entity).Position, t.Position);
-    EXPECT_EQ(registry.GetComponent<A>(entity).Hello, a.Hello);
+TEST_F(EntityRegistryTest, MergeBenchmark)
+{
+    using namespace ecs;
+    constexpr uint32_t entityCount = 100000;
+    auto fill = [](ecs::EntityRegistry& registry)
+    {
+        for (uint32_t i = 0; i < entityCount; ++i)
+        {
+            EntityID entity = registry.CreateEntity();
+            registry.TryAddComponent(entity, Transform{ { (float)i, 0, 0 }, { 0, 0, 0 }, { 1, 1, 1 } });
+            registry.TryAddComponent(entity, A((int)i));
+        }
+    };
+    ecs::EntityRegistry staging(entityCount);
+    fill(staging);
+    ecs::EntityRegistry live(entityCount);
+    fill(live);
+    {
+        ScopeTimer timer("Copy 100k staged entities with CreateEntity and TryAddComponent");
+        for (EntityID entity = 0; entity < entityCount; ++entity)
+        {
+            EntityID copy = live.CreateEntity();
+            live.TryAddComponent(copy, staging.GetComponent<Transform>(entity));
+            live.TryAddComponent(copy, staging.GetComponent<A>(entity));
+        }
+    }
+    {
+        ScopeTimer timer("Merge 100k staged entities");
+        live.Merge(std::move(staging));
+    }
+    EXPECT_EQ(live.GetEntityCount(), 3 * entityCount);
+}
 
-    registry.TryAddComponent(entity, b);
+TEST_F(EntityRegistryTest, SplitComponentBenchmark)
+{
+    using namespace ecs;
+    EntityRegistry::RegisterComponentTypes<Particle, UnsplitParticle>();
+    constexpr uint32_t entityCount = 1000000;
+    ecs::EntityRegistry registry(2 * entityCount);
+    registry.Reserve<Particle>(entityCount);
+    registry.Reserve<UnsplitParticle>(entityCount);
+    for (uint32_t i = 0; i < entityCount; ++i)
+    {
+        const ParticleMotion motion{ { (float)i, 0, 0 }, { 1, 2, 3 } };
+        registry.TryAddComponent(registry.CreateEntity(), Particle{ motion, {} });
+        registry.TryAddComponent(registry.CreateEntity(), UnsplitParticle{ motion, {} });
+    }
 
-    EXPECT_EQ(registry.GetComponent<B>(entity).s, b.s);
+    constexpr int frames = 10;
+    constexpr float dt = 0.016f;
+    {
+        auto view = registry.GetView<UnsplitParticle>();
+        ScopeTimer timer("Integrate 1M particles stored whole, 10 frames");
+        for (int frame = 0; frame < frames; ++frame)
+        {
+            for (auto& index : view)
+            {
+                auto [particle] = view.Get(index);
+                particle.Motion.Position.x += particle.Motion.Velocity.x * dt;
+                particle.Motion.Position.y += particle.Motion.Velocity.y * dt;
+                particle.Motion.Position.z += particle.Motion.Velocity.z * dt;
+            }
+        }
+    }
+    {
+        auto view = registry.GetView<ParticleMotion>();
+        ScopeTimer timer("Integrate 1M particles split in hot and cold parts, 10 frames");
+        for (int frame = 0; frame < frames; ++frame)
+        {
+            for (auto& index : view)
+            {
+                auto [motion] = view.Get(index);
+                motion.Position.x += motion.Velocity.x * dt;
+                motion.Position.y += motion.Velocity.y * dt;
+                motion.Position.z += motion.Velocity.z * dt;
+            }
+        }
+    }
+    EXPECT_EQ(registry.GetComponent<ParticleMotion>(0).Position, registry.GetComponent<UnsplitParticle>(1).Motion.Position);
+}
 
-    registry.DeleteComponent<A>(entity);
-    registry.Flush();
+TEST_F(EntityRegistryTest, LaneComponentBenchmark)
+{
+    using namespace ecs;
+    EntityRegistry::RegisterComponentTypes<Boid, UnlanedBoid>();
+    constexpr uint32_t entityCount = 1000000;
+    ecs::EntityRegistry registry(2 * entityCount);
+    registry.Reserve<Boid>(entityCount);
+    registry.Reserve<UnlanedBoid>(entityCount);
+    for (uint32_t i = 0; i < entityCount; ++i)
+    {
+        registry.TryAddComponent(registry.CreateEntity(), Boid{ { (float)i, 0, 0 }, { 1, 2, 3 } });
+        registry.TryAddComponent(registry.CreateEntity(), UnlanedBoid{ { (float)i, 0, 0 }, { 1, 2, 3 } });
+    }
 
-    EXPECT_FALSE(registry.HasComponent<A>(entity));
-    EXPECT_EQ(registry.GetComponent<Transform>(entity).Position, t.Position);
-    EXPECT_EQ(registry.GetComponent<B>(entity).s, b.s);
+    constexpr int frames = 10;
+    constexpr float dt = 0.016f;
+    {
+        auto view = registry.GetView<UnlanedBoid>();
+        ScopeTimer timer("Integrate 1M boids stored whole, 10 frames");
+        for (int frame = 0; frame < frames; ++frame)
+        {
+            for (auto& index : view)
+            {
+                auto [boid] = view.Get(index);
+                boid.Position.x += boid.Velocity.x * dt;
+                boid.Position.y += boid.Velocity.y * dt;
+                boid.Position.z += boid.Velocity.z * dt;
+            }
+        }
+    }
+    {
+        ScopeTimer timer("Integrate 1M boids in blocks of 8 lanes, 10 frames");
+        for (int frame = 0; frame < frames; ++frame)
+        {
+            // the tail lanes are integrated too, they hold nothing anyone reads
+            registry.EachBlock<Boid>([](uint64_t, LaneBlock<Boid>& block)
+            {
+                for (uint32_t field = 0; field < 3; ++field)
+                {
+                    float* position = block.Fields[field];
+                    const float* velocity = block.Fields[field + 3];
+                    for (uint32_t lane = 0; lane < LaneBlock<Boid>::Lanes; ++lane)
+                        position[lane] += velocity[lane] * dt;
+                }
+            });
+        }
+    }
+    EXPECT_EQ(registry.GetComponent<Boid>(0).Get().Position, registry.GetComponent<UnlanedBoid>(1).Position);
 }
 
-TEST_F(EntityRegistryTest, VerifyStateAfterComplexOperations) {
-    ecs::EntityRegistry registry;
-    Transform t1{ {1.0f, 2.0f, 3.0f}, {0,0,0}, {1,1,1}  };
-    Transform t2{ {4.0f, 5.0f, 6.0f}, {0,0,0}, {1,1,1}  };
-    Transform t3{ {7.0f, 8.0f, 9.0f}, {0,0,0}, {1,1,1}  };
-    Transform t4{ {10.0f, 11.0f, 12.0f}, {0,0,0}, {1,1,1}  };
-    Transform t5{ {13.0f, 14.0f, 15.0f}, {0,0,0}, {1,1,1}  };
-    A a1{ 42 };
-    A a2{ 84 };
-    A a3{ 126 };
-    A a4{ 168 };
-    A a5{ 210 };
-    B b1{ "S1" };
-    B b2{ "S2" };
-
-    EntityID entity0 = registry.CreateEntity();
-    EntityID entity1 = registry.CreateEntity();
-    EntityID entity2 = registry.CreateEntity();
-    EntityID entity3 = registry.CreateEntity();
-    EntityID entity4 = registry.CreateEntity();
+TEST_F(EntityRegistryTest, EachBatchBenchmark)
+{
+    using namespace ecs;
+    EntityRegistry::RegisterComponentTypes<Position, Velocity>();
+    constexpr uint32_t entityCount = 1000000;
+    ecs::EntityRegistry registry(entityCount);
+    PopulateMovers(registry, entityCount);
 
-    registry.TryAddComponent(entity0, t1);
-    registry.TryAddComponent(entity0, a1);
-    registry.TryAddComponent(entity1, t2);
-    registry.TryAddComponent(entity1, b1);
-    registry.TryAddComponent(entity2, t3);
-    registry.TryAddComponent(entity2, a2);
-    registry.TryAddComponent(entity3, t4);
-    registry.TryAddComponent(entity3, b2);
-    registry.TryAddComponent(entity4, t5);
-    registry.TryAddComponent(entity4, a3);
+    constexpr int frames = 10;
+    constexpr float dt = 0.016f;
+    auto view = registry.GetView<Position, Velocity>();
+    {
+        ScopeTimer timer("Integrate 1M entities with the view iterator, 10 frames");
+        for (int frame = 0; frame < frames; ++frame)
+        {
+            for (auto& index : view)
+            {
+                auto [position, velocity] = view.Get(index);
+                position.Value.x += velocity.Value.x * dt;
+                position.Value.y += velocity.Value.y * dt;
+                position.Value.z += velocity.Value.z * dt;
+            }
+        }
+    }
+    {
+        ScopeTimer timer("Integrate 1M entities with EachBatch, 10 frames");
+        for (int frame = 0; frame < frames; ++frame)
+        {
+            DispatchSimd([&](auto level)
+            {
+                constexpr uint32_t width = GetSimdFloatCount(level);
+                using Floats = SimdFloat<width>;
+                view.EachBatch<width>([](Batch<Position, width> positions, Batch<Velocity, width> velocities, uint64_t mask)
+                {
+                    float* p = positions.template GetScalars<float>();
+                    const float* v = velocities.template GetScalars<float>();
+                    const bool full = mask == (uint64_t(1) << width) - 1;
+                    for (uint32_t i = 0; i < Batch<Position, width>::template GetScalarCount<float>(); i += width)
+                    {
+                        const Floats result = MulAdd(Floats::Load(v + i), Floats(dt), Floats::Load(p + i));
+                        if (full)
+                            result.Store(p + i);
+                        else
+                            result.StoreMasked(p + i, GetScalarMask(mask, i, width, 3));
+                    }
+                });
+            });
+        }
+    }
+    EXPECT_EQ(registry.GetComponent<Position>(0).Value.y, registry.GetComponent<Position>(entityCount - 1).Value.y);
+}
 
-    registry.DeleteComponent<Transform>(entity0);
-    registry.DeleteEntity(entity1);
+TEST_F(EntityRegistryTest, ParallelRowsBenchmark)
+{
+    using namespace ecs;
+    EntityRegistry::RegisterComponentTypes<Position, Velocity>();
+    constexpr uint32_t entityCount = 1000000;
+    ecs::EntityRegistry registry(entityCount);
+    PopulateMovers(registry, entityCount);
 
-    registry.Flush();
+    constexpr int frames = 10;
+    auto view = registry.GetView<Position, Velocity>();
+    auto integrate = [&view](const auto& index)
+    {
+        constexpr float dt = 0.016f;
+        auto [position, velocity] = view.Get(index);
+        position.Value.x += velocity.Value.x * dt;
+        position.Value.y += velocity.Value.y * dt;
+        position.Value.z += velocity.Value.z * dt;
+    };
+    {
+        ScopeTimer timer("Integrate 1M entities with the view iterator, 10 frames");
+        for (int frame = 0; frame < frames; ++frame)
+            std::for_each(view.begin(), view.end(), integrate);
+    }
+    {
+        ScopeTimer timer("Integrate 1M entities with std::execution::par over the rows, 10 frames");
+        for (int frame = 0; frame < frames; ++frame)
+        {
+            auto rows = view.Rows();
+            std::for_each(std::execution::par, rows.begin(), rows.end(), integrate);
+        }
+    }
+    EXPECT_EQ(registry.GetComponent<Position>(0).Value.y, registry.GetComponent<Position>(entityCount - 1).Value.y);
+}
 
-    EXPECT_FALSE(registry.IsEntityValid(entity1));
-    EXPECT_FALSE(registry.HasComponent<Transform>(entity0));
-    EXPECT_TRUE(registry.HasComponent<A>(entity0));
-    EXPECT_EQ(registry.GetComponent<A>(entity0).Hello, a1.Hello);
+TEST_F(EntityRegistryTest, GatherBenchmark)
+{
+    using namespace ecs;
+    EntityRegistry::RegisterComponentTypes<Position, Velocity>();
+    constexpr uint32_t entityCount = 1000000;
+    constexpr uint32_t lookupCount = 2000000;
+    ecs::EntityRegistry registry(entityCount);
+    PopulateMovers(registry, entityCount);
+    // collision pairs between random entities
+    uint32_t seed = 42;
+    auto random = [&seed]() { seed = seed * 1664525u + 1013904223u; return seed >> 8; };
+    std::vector<EntityID> targets(lookupCount);
+    for (EntityID& target : targets)
+        target = random() % entityCount;
 
-    EXPECT_FALSE(registry.HasComponent<Transform>(entity1));
-    EXPECT_FALSE(registry.HasComponent<B>(entity1));
+    float first = 0;
+    {
+        ScopeTimer timer("2M random lookups with GetComponents");
+        for (EntityID target : targets)
+        {
+            auto [position, velocity] = registry.GetComponents<Position, Velocity>(target);
+            first += position.Value.x * velocity.Value.x;
+        }
+    }
+    float second = 0;
+    {
+        ScopeTimer timer("2M random lookups with Gather");
+        registry.Gather<Position, Velocity>(targets, [&second](EntityID, Position& position, Velocity& velocity)
+        {
+            second += position.Value.x * velocity.Value.x;
+        });
+    }
+    EXPECT_NEAR(first, second, std::abs(first) * 1e-3f);
+}
 
-    EXPECT_EQ(registry.GetComponent<Transform>(entity2).Position, t3.Position);
-    EXPECT_EQ(registry.GetComponent<A>(entity2).Hello, a2.Hello);
+TEST_F(EntityRegistryTest, BulkOperationsBenchmark)
+{
+    using namespace ecs;
+    EntityRegistry::RegisterComponentTypes<Position, Velocity>();
+    constexpr uint32_t entityCount = 1000000;
+    auto populate = [](EntityRegistry& registry)
+    {
+        registry.Reserve<Position>(entityCount);
+        for (uint32_t i = 0; i < entityCount; ++i)
+        {
+            EntityID entity = registry.CreateEntity();
+            registry.TryAddComponent(entity, Position{ { (float)i, 0, 0 } });
+        }
+    };
+    const Velocity velocity{ { 1, 2, 3 } };
 
-    EXPECT_EQ(registry.GetComponent<Transform>(entity3).Position, t4.Position);
-    EXPECT_EQ(registry.GetComponent<B>(entity3).s, b2.s);
+    EntityRegistry perEntity(entityCount);
+    populate(perEntity);
+    {
+        ScopeTimer timer("Add, remove and destroy 1M entities one by one");
+        for (EntityID entity = 0; entity < entityCount; ++entity)
+            perEntity.TryAddComponent(entity, velocity);
+        for (EntityID entity = 0; entity < entityCount; ++entity)
+            perEntity.DeleteComponent<Velocity>(entity);
+        perEntity.Flush();
+        for (EntityID entity = 0; entity < entityCount; ++entity)
+            perEntity.DeleteEntity(entity);
+        perEntity.Flush();
+    }
 
-    EXPECT_EQ(registry.GetComponent<Transform>(entity4).Position, t5.Position);
-    EXPECT_EQ(registry.GetComponent<A>(entity4).Hello, a3.Hello);
+    EntityRegistry bulk(entityCount);
+    populate(bulk);
+    {
+        ScopeTimer timer("Add, remove and destroy 1M entities with AddToAll, RemoveFromAll and DestroyAll");
+        EXPECT_EQ((bulk.AddToAll<Velocity, Position>(velocity)), entityCount);
+        EXPECT_EQ((bulk.RemoveFromAll<Velocity, Position>()), entityCount);
+        EXPECT_EQ(bulk.DestroyAll<Position>(), entityCount);
+    }
+    EXPECT_EQ(perEntity.GetEntityCount(), 0);
+    EXPECT_EQ(bulk.GetEntityCount(), 0);
 }
 
-TEST_F(EntityRegistryTest, ComponentViewTest)
+TEST_F(EntityRegistryTest, SetEnabledBenchmark)
 {
-    ecs::EntityRegistry registry;
-    Transform t[5];
-    t[0] = { {1.0f, 2.0f, 3.0f}, {0,0,0}, {1,1,1}  };
-    t[1] = { {4.0f, 5.0f, 6.0f}, {0,0,0}, {1,1,1}  };
-    t[2] = { {7.0f, 8.0f, 9.0f}, {0,0,0}, {1,1,1}  };
-    t[3] = { {10.0f, 11.0f, 12.0f}, {0,0,0}, {1,1,1}  };
-    t[4] = { {13.0f, 14.0f, 15.0f}, {0,0,0}, {1,1,1}  };
-    A a1{ 42 };
-    A a2{ 84 };
-    A a3{ 126 };
-    B b1{ "S1" };
-    B b2{ "S2" };
-
-    EntityID entity0 = registry.CreateEntity();
-    EntityID entity1 = registry.CreateEntity();
-    EntityID entity2 = registry.CreateEntity();
-    EntityID entity3 = registry.CreateEntity();
-    EntityID entity4 = registry.CreateEntity();
+    using namespace ecs;
+    EntityRegistry::RegisterComponentType<Tag<0>>();
+    constexpr uint32_t entityCount = 100000;
+    ecs::EntityRegistry registry(entityCount);
+    for (uint32_t i = 0; i < entityCount; ++i)
+    {
+        EntityID entity = registry.CreateEntity();
+        registry.TryAddComponent(entity, Transform{ { (float)i, 0, 0 }, { 0, 0, 0 }, { 1, 1, 1 } });
+        registry.TryAddComponent(entity, A((int)i));
+    }
 
-    registry.TryAddComponent(entity0, t[0]);
-    registry.TryAddComponent(entity0, a1);
-    registry.TryAddComponent(entity1, t[1]);
-    registry.TryAddComponent(entity1, b1);
-    registry.TryAddComponent(entity2, t[2]);
-    registry.TryAddComponent(entity2, a2);
-    registry.TryAddComponent(entity3, t[3]);
-    registry.TryAddComponent(entity3, b2);
-    registry.TryAddComponent(entity4, t[4]);
-    registry.TryAddComponent(entity4, a3);
+    {
+        ScopeTimer timer("Disable and enable 100k entities with a tag component");
+        for (EntityID entity = 0; entity < entityCount; ++entity)
+            registry.TryAddComponent(entity, Tag<0>{});
+        for (EntityID entity = 0; entity < entityCount; ++entity)
+            registry.DeleteComponent<Tag<0>>(entity);
+        registry.Flush();
+    }
+    {
+        ScopeTimer timer("Disable and enable 100k entities with SetEnabled");
+        for (EntityID entity = 0; entity < entityCount; ++entity)
+            registry.SetEnabled(entity, false);
+        for (EntityID entity = 0; entity < entityCount; ++entity)
+            registry.SetEnabled(entity, true);
+    }
 
-    auto view = registry.GetView<Transform>();
-    for (auto index : view)
+    for (EntityID entity = 0; entity < entityCount; entity += 2)
+        registry.SetEnabled(entity, false);
+    int sum = 0;
     {
-        auto[transform] = view.Get(index);
-        EXPECT_EQ(transform.Position, t[index.Entity].Position);
+        ScopeTimer timer("View over 100k entities, every other one disabled");
+        auto view = registry.GetView<A>();
+        for (auto& index : view)
+            sum += std::get<0>(view.Get(index)).Hello;
     }
+    EXPECT_NE(sum, 0);
 }
+#endif // ECS_BENCHMARKS
 
 class ComponentViewStressTest : public ::testing::Test
 {
@@ -913,4 +4404,191 @@ TEST_F(ComponentViewStressTest, ComponentViewStressTest)
         EXPECT_EQ(a.Hello, aInView.Hello);
     }
 }
+
+////////////////////////////////////////////////////////////////////////////////////////
+// StaticRegistry Tests ////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////
+
+using TestStaticRegistry = StaticRegistry<Transform, A, B>;
+
+static_assert(TestStaticRegistry::ComponentIndex<Transform> == 0);
+static_assert(TestStaticRegistry::ComponentIndex<B> == 2);
+static_assert(TestStaticRegistry::SignatureMask<A, B> == 0b110);
+
+TEST(StaticRegistryTests, ComponentOperations)
+{
+    EXPECT_EQ((TestStaticRegistry::Signature<B, A>), EntitySignature(0b110));
+    TestStaticRegistry registry(16);
+    for (int i = 0; i < 100; ++i)
+    {
+        EntityID entity = registry.CreateEntity();
+        if (i % 2 == 0)
+            registry.TryAddComponent(entity, A(i));
+        if (i % 3 == 0)
+            registry.EmplaceComponent<B>(entity, "Entity" + std::to_string(i));
+    }
+    EXPECT_EQ(registry.GetEntityCount(), 100);
+    EXPECT_EQ(registry.GetArchetypeCount(), 4);
+    EXPECT_FALSE(registry.TryAddComponent(0, A(1)));
+    EXPECT_THROW(registry.EmplaceComponent<A>(0, 1), ComponentAlreadyExistsException);
+    EXPECT_THROW((void)registry.GetComponent<A>(1), NoComponentException);
+    EXPECT_THROW((void)registry.GetComponent<A>(1000), EntityIDOutOfRange);
+
+    EXPECT_TRUE(registry.RemoveComponent<A>(6));
+    EXPECT_FALSE(registry.RemoveComponent<A>(6));
+    registry.DeleteEntity(12);
+    registry.DeleteEntity(12);
+    EXPECT_FALSE(registry.IsEntityValid(12));
+    EXPECT_EQ(registry.GetEntityCount(), 99);
+
+    for (EntityID entity = 0; entity < 100; ++entity)
+    {
+        if (entity == 12)
+            continue;
+        ASSERT_TRUE(registry.IsEntityValid(entity));
+        EXPECT_EQ(registry.HasComponent<A>(entity), entity % 2 == 0 && entity != 6) << entity;
+        EXPECT_EQ(registry.HasComponent<B>(entity), entity % 3 == 0) << entity;
+        if (registry.HasComponent<A>(entity))
+        {
+            EXPECT_EQ(registry.GetComponent<A>(entity).Hello, (int)entity);
+        }
+        if (registry.HasComponent<B>(entity))
+        {
+            EXPECT_EQ(registry.GetComponent<B>(entity).s, "Entity" + std::to_string(entity));
+        }
+    }
+    EXPECT_TRUE((registry.HasComponents<A, B>(18)));
+    EXPECT_FALSE((registry.HasComponents<A, B>(6)));
+
+    uint32_t count = 0;
+    registry.Each<A, B>([&count](EntityID entity, A& a, B& b)
+    {
+        EXPECT_EQ(a.Hello, (int)entity);
+        EXPECT_EQ(b.s, "Entity" + std::to_string(entity));
+        ++count;
+    });
+    EXPECT_EQ(count, 100 / 6 + 1 - 2);
+    registry.Each<A>([](A& a) { a.Hello = -a.Hello; });
+    EXPECT_EQ(registry.GetComponent<A>(98).Hello, -98);
+
+    // freed IDs are reused
+    EntityID entity = registry.CreateEntity();
+    EXPECT_EQ(entity, 100);
+}
+
+// built from another component of the same entity
+struct NameLength
+{
+    size_t Length = 0;
+
+    NameLength() = default;
+    explicit NameLength(const B& name) : Length(name.s.size()) {}
+};
+
+TEST(StaticRegistryTests, EmplaceFromOwnComponent)
+{
+    StaticRegistry<A, B, NameLength> registry(4);
+    EntityID entity = registry.CreateEntity();
+    registry.EmplaceComponent<B>(entity, std::string(64, 'x'));
+    registry.TryAddComponent(entity, A(3));
+
+    // the B of the entity moves to another archetype, it must still be intact when NameLength reads it
+    NameLength& length = registry.EmplaceComponent<NameLength>(entity, registry.GetComponent<B>(entity));
+    EXPECT_EQ(length.Length, 64);
+    EXPECT_EQ(registry.GetComponent<B>(entity).s, std::string(64, 'x'));
+    EXPECT_EQ(registry.GetComponent<A>(entity).Hello, 3);
+}
+
+TEST(StaticRegistryTests, UsesResource)
+{
+    CountingResource resource;
+    {
+        TestStaticRegistry registry(64, &resource);
+        registry.Reserve<A, B>(100);
+        const size_t outstanding = resource.Outstanding;
+        for (int i = 0; i < 100; ++i)
+        {
+            EntityID entity = registry.CreateEntity();
+            registry.EmplaceComponent<A>(entity, i);
+            registry.EmplaceComponent<B>(entity);
+        }
+        EXPECT_GT(resource.Outstanding, outstanding);
+        EXPECT_EQ(registry.GetMaxEntityCount(), 128);
+    }
+    EXPECT_EQ(resource.Outstanding, 0);
+}
+
+#ifdef ECS_BENCHMARKS
+TEST(StaticRegistryBenchmarks, VersusEntityRegistry)
+{
+    EntityRegistry::RegisterComponentTypes<Transform, A, B>();
+    constexpr uint32_t entityCount = 1000000;
+    EntityRegistry dynamicRegistry(entityCount);
+    TestStaticRegistry staticRegistry(entityCount);
+
+    {
+        ScopeTimer timer("EntityRegistry: create 1M entities with Transform and A");
+        for (uint32_t i = 0; i < entityCount; ++i)
+        {
+            EntityID entity = dynamicRegistry.CreateEntity();
+            dynamicRegistry.TryAddComponent(entity, Transform{ { (float)i, 0, 0 }, { 0, 0, 0 }, { 1, 1, 1 } });
+            dynamicRegistry.TryAddComponent(entity, A((int)i));
+        }
+    }
+    {
+        ScopeTimer timer("StaticRegistry: create 1M entities with Transform and A");
+        for (uint32_t i = 0; i < entityCount; ++i)
+        {
+            EntityID entity = staticRegistry.CreateEntity();
+            staticRegistry.TryAddComponent(entity, Transform{ { (float)i, 0, 0 }, { 0, 0, 0 }, { 1, 1, 1 } });
+            staticRegistry.TryAddComponent(entity, A((int)i));
+        }
+    }
+
+    int64_t dynamicSum = 0;
+    int64_t staticSum = 0;
+    {
+        ScopeTimer timer("EntityRegistry: GetComponent<A> on 1M entities");
+        for (EntityID entity = 0; entity < entityCount; ++entity)
+            dynamicSum += dynamicRegistry.GetComponent<A>(entity).Hello;
+    }
+    {
+        ScopeTimer timer("StaticRegistry: GetComponent<A> on 1M entities");
+        for (EntityID entity = 0; entity < entityCount; ++entity)
+            staticSum += staticRegistry.GetComponent<A>(entity).Hello;
+    }
+    EXPECT_EQ(dynamicSum, staticSum);
+
+    {
+        ScopeTimer timer("EntityRegistry: view over 1M Transform and A");
+        auto view = dynamicRegistry.GetView<Transform, A>();
+        for (auto& index : view)
+        {
+            auto [transform, a] = view.Get(index);
+            transform.Position.x += (float)a.Hello;
+        }
+    }
+    {
+        ScopeTimer timer("StaticRegistry: Each over 1M Transform and A");
+        staticRegistry.Each<Transform, A>([](Transform& transform, A& a) { transform.Position.x += (float)a.Hello; });
+    }
+
+    {
+        ScopeTimer timer("EntityRegistry: add and remove B on 1M entities");
+        for (EntityID entity = 0; entity < entityCount; ++entity)
+            dynamicRegistry.TryAddComponent(entity, B());
+        for (EntityID entity = 0; entity < entityCount; ++entity)
+            dynamicRegistry.DeleteComponent<B>(entity);
+        dynamicRegistry.Flush();
+    }
+    {
+        ScopeTimer timer("StaticRegistry: add and remove B on 1M entities");
+        for (EntityID entity = 0; entity < entityCount; ++entity)
+            staticRegistry.TryAddComponent(entity, B());
+        for (EntityID entity = 0; entity < entityCount; ++entity)
+            staticRegistry.RemoveComponent<B>(entity);
+    }
+    EXPECT_EQ(staticRegistry.GetComponent<Transform>(10).Position, dynamicRegistry.GetComponent<Transform>(10).Position);
+}
+#endif // ECS_BENCHMARKS
 }